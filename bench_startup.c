@@ -0,0 +1,167 @@
+/* Startup latency of btc-cli (make bench-startup)
+ *
+ * Listens on a loopback port and runs "btc-cli getblockcount" against it
+ * over and over. For each run it takes the time from fork() to the first
+ * byte of the request arriving (time to first byte: everything the
+ * binary does before its call goes out) and to the process exiting
+ * after the canned reply. The runs read a bitcoin.conf with rpcuser and
+ * rpcpassword from a scratch datadir, as a typical setup would.
+ *
+ * usage: bench_startup [binary] [runs]   (default: ./btc-cli 200)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static const char reply_body[] = "{\"result\":1,\"error\":null,\"id\":1}\n";
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Read a whole request (head and Content-Length body); first_byte gets
+ * the time the first of it arrived. Returns 0 or -1. */
+static int read_request(int fd, long long *first_byte)
+{
+	char buf[8192];
+	size_t len = 0;
+	long long body = -1;
+
+	for (;;) {
+		ssize_t n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+		char *end;
+
+		if (n <= 0)
+			return -1;
+		if (len == 0)
+			*first_byte = now_ns();
+		len += n;
+		buf[len] = '\0';
+		if (body < 0 && (end = strstr(buf, "\r\n\r\n")) != NULL) {
+			const char *cl = strcasestr(buf, "Content-Length:");
+			body = (end + 4 - buf) + (cl ? atoll(cl + 15) : 0);
+		}
+		if (body >= 0 && (long long)len >= body)
+			return 0;
+		if (len == sizeof(buf) - 1)
+			return -1;
+	}
+}
+
+static void report(const char *what, long long *v, int n)
+{
+	long long sum = 0;
+	int i;
+
+	qsort(v, n, sizeof(*v), cmp_ll);
+	for (i = 0; i < n; i++)
+		sum += v[i];
+	printf("%-22s min %7.0f  median %7.0f  p90 %7.0f  mean %7.0f us\n", what,
+	       v[0] / 1e3, v[n / 2] / 1e3, v[n * 9 / 10] / 1e3, sum / 1e3 / n);
+}
+
+int main(int argc, char **argv)
+{
+	const char *binary = argc > 1 ? argv[1] : "./btc-cli";
+	int runs = argc > 2 ? atoi(argv[2]) : 200;
+	char dir[] = "/tmp/btc-cli-bench-XXXXXX", path[256], datadir[300], port[32];
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	long long *ttfb, *total;
+	FILE *conf;
+	int lfd, i, done = 0, one = 1;
+
+	if (runs < 1)
+		runs = 1;
+	ttfb = malloc(sizeof(*ttfb) * runs);
+	total = malloc(sizeof(*total) * runs);
+	if (!ttfb || !total || !mkdtemp(dir)) {
+		perror("bench_startup");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/bitcoin.conf", dir);
+	if (!(conf = fopen(path, "w"))) {
+		perror(path);
+		return 1;
+	}
+	fputs("# bench_startup\nserver=1\nrpcuser=bench\nrpcpassword=bench\n", conf);
+	fclose(conf);
+	snprintf(datadir, sizeof(datadir), "-datadir=%s", dir);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(lfd, 16) < 0 ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &alen) < 0) {
+		perror("bench_startup: listen");
+		return 1;
+	}
+	snprintf(port, sizeof(port), "-rpcport=%d", ntohs(addr.sin_port));
+
+	for (i = 0; i < runs; i++) {
+		char head[160];
+		long long start = now_ns(), first = 0;
+		int status, fd;
+		pid_t pid = fork();
+
+		if (pid == 0) {
+			int null = open("/dev/null", O_WRONLY);
+			dup2(null, STDOUT_FILENO);
+			execl(binary, binary, datadir, "-rpcconnect=127.0.0.1", port,
+			      "getblockcount", (char *)NULL);
+			_exit(127);
+		}
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0 || read_request(fd, &first) < 0) {
+			fprintf(stderr, "bench_startup: no request from %s\n", binary);
+			if (fd >= 0)
+				close(fd);
+			waitpid(pid, &status, 0);
+			break;
+		}
+		snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+		         "Content-Length: %zu\r\n\r\n", sizeof(reply_body) - 1);
+		if (send(fd, head, strlen(head), 0) < 0 ||
+		    send(fd, reply_body, sizeof(reply_body) - 1, 0) < 0)
+			perror("send");
+		waitpid(pid, &status, 0);
+		close(fd);
+		ttfb[done] = first - start;
+		total[done] = now_ns() - start;
+		done++;
+	}
+
+	unlink(path);
+	rmdir(dir);
+	if (!done)
+		return 1;
+	printf("%s getblockcount, %d runs\n", binary, done);
+	report("time to first byte", ttfb, done);
+	report("total (exec to exit)", total, done);
+	return 0;
+}
@@ -0,0 +1,1225 @@
+/* Native decoding of serialized blocks and transactions (-rest)
+ *
+ * Produces what bitcoind's getblock and getrawtransaction would from the
+ * same bytes, down to script disassembly, output types, addresses and
+ * inferred descriptors, so the node only has to hand over the raw block.
+ */
+
+#include "block.h"
+#include "p2p.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Consensus limit on a compact size, as in ReadCompactSize() */
+#define BLOCK_MAX_SIZE 0x02000000
+
+/* Scripts longer than this are unspendable */
+#define BLOCK_MAX_SCRIPT 10000
+
+#define MAX_MULTISIG_KEYS 20
+
+/* Growing output buffer; oom is set if an allocation failed */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+	int oom;
+} Out;
+
+static void out_put(Out *o, const char *s, size_t n)
+{
+	if (o->oom)
+		return;
+	if (o->len + n + 1 > o->size) {
+		size_t size = o->size ? o->size : 4096;
+		char *grown;
+
+		while (size < o->len + n + 1)
+			size *= 2;
+		grown = realloc(o->data, size);
+		if (!grown) {
+			o->oom = 1;
+			return;
+		}
+		o->data = grown;
+		o->size = size;
+	}
+	memcpy(o->data + o->len, s, n);
+	o->len += n;
+	o->data[o->len] = '\0';
+}
+
+static void out_str(Out *o, const char *s)
+{
+	out_put(o, s, strlen(s));
+}
+
+static void out_uint(Out *o, unsigned long long v)
+{
+	char buf[24];
+	out_put(o, buf, snprintf(buf, sizeof(buf), "%llu", v));
+}
+
+static void out_int(Out *o, long long v)
+{
+	char buf[24];
+	out_put(o, buf, snprintf(buf, sizeof(buf), "%lld", v));
+}
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void out_hex(Out *o, const uint8_t *data, size_t len)
+{
+	char buf[256];
+	size_t i, n = 0;
+
+	for (i = 0; i < len; i++) {
+		buf[n++] = hex_digits[data[i] >> 4];
+		buf[n++] = hex_digits[data[i] & 15];
+		if (n == sizeof(buf)) {
+			out_put(o, buf, n);
+			n = 0;
+		}
+	}
+	out_put(o, buf, n);
+}
+
+/* Hashes are shown byte-reversed */
+static void out_hash(Out *o, const uint8_t *hash)
+{
+	uint8_t rev[32];
+	int i;
+
+	for (i = 0; i < 32; i++)
+		rev[i] = hash[31 - i];
+	out_hex(o, rev, 32);
+}
+
+/* Amount in BTC with 8 decimals, as ValueFromAmount() writes it */
+static void out_amount(Out *o, int64_t sats)
+{
+	char buf[32];
+	unsigned long long abs = sats < 0 ? 0 - (unsigned long long)sats
+	                                  : (unsigned long long)sats;
+
+	out_put(o, buf, snprintf(buf, sizeof(buf), "%s%llu.%08llu",
+	                         sats < 0 ? "-" : "", abs / 100000000ULL,
+	                         abs % 100000000ULL));
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+	       (uint32_t)p[3] << 24;
+}
+
+/* ---- Reading the serialization ---- */
+
+typedef struct {
+	const uint8_t *data;
+	size_t len;
+	size_t pos;
+} Reader;
+
+static const uint8_t *rd_take(Reader *r, size_t n)
+{
+	const uint8_t *p;
+
+	if (n > r->len - r->pos)
+		return NULL;
+	p = r->data + r->pos;
+	r->pos += n;
+	return p;
+}
+
+/* Compact size; non-canonical encodings are rejected like bitcoind does */
+static int rd_compact(Reader *r, uint64_t *v)
+{
+	const uint8_t *p = rd_take(r, 1);
+	int width, i;
+
+	if (!p)
+		return -1;
+	if (*p < 0xfd) {
+		*v = *p;
+		return 0;
+	}
+	width = *p == 0xfd ? 2 : *p == 0xfe ? 4 : 8;
+	if (!(p = rd_take(r, width)))
+		return -1;
+	*v = 0;
+	for (i = width; i-- > 0;)
+		*v = *v << 8 | p[i];
+	if (*v < (width == 2 ? 0xfdULL : width == 4 ? 0x10000ULL : 0x100000000ULL) ||
+	    *v > BLOCK_MAX_SIZE)
+		return -1;
+	return 0;
+}
+
+/* Length-prefixed bytes */
+static const uint8_t *rd_var(Reader *r, size_t *len)
+{
+	uint64_t n;
+
+	if (rd_compact(r, &n) < 0)
+		return NULL;
+	*len = (size_t)n;
+	return rd_take(r, *len);
+}
+
+/* Where the parts of a transaction are */
+typedef struct {
+	size_t start, end;        /* The whole serialization */
+	size_t io_start, io_end;  /* Inputs and outputs */
+	int segwit;               /* Has the marker, flag and witnesses */
+} TxSpan;
+
+static int tx_scan(Reader *r, TxSpan *t)
+{
+	uint64_t n_in, n_out, items, i;
+	size_t n;
+
+	t->start = r->pos;
+	if (!rd_take(r, 4))
+		return -1;
+	t->segwit = 0;
+	if (r->pos < r->len && r->data[r->pos] == 0) {
+		/* An empty input list followed by the flag; only flag 1
+		 * (witnesses) is defined */
+		if (r->len - r->pos < 2 || r->data[r->pos + 1] != 1)
+			return -1;
+		t->segwit = 1;
+		r->pos += 2;
+	}
+
+	t->io_start = r->pos;
+	if (rd_compact(r, &n_in) < 0)
+		return -1;
+	for (i = 0; i < n_in; i++)
+		if (!rd_take(r, 36) || !rd_var(r, &n) || !rd_take(r, 4))
+			return -1;
+	if (rd_compact(r, &n_out) < 0)
+		return -1;
+	for (i = 0; i < n_out; i++)
+		if (!rd_take(r, 8) || !rd_var(r, &n))
+			return -1;
+	t->io_end = r->pos;
+
+	if (t->segwit) {
+		int any = 0;
+
+		for (i = 0; i < n_in; i++) {
+			if (rd_compact(r, &items) < 0)
+				return -1;
+			any |= items != 0;
+			while (items-- > 0)
+				if (!rd_var(r, &n))
+					return -1;
+		}
+		if (!any)
+			return -1;  /* Superfluous witness record */
+	}
+	if (!rd_take(r, 4))
+		return -1;
+	t->end = r->pos;
+	return 0;
+}
+
+/* Size without the witness data */
+static size_t tx_stripped_size(const TxSpan *t)
+{
+	return t->io_end - t->io_start + 8;
+}
+
+/* txid hashes the serialization without witness data, wtxid all of it */
+static int tx_hashes(const uint8_t *d, const TxSpan *t, uint8_t txid[32],
+                     uint8_t wtxid[32])
+{
+	size_t io = t->io_end - t->io_start;
+	uint8_t *s;
+
+	sha256d(d + t->start, t->end - t->start, wtxid);
+	if (!t->segwit) {
+		memcpy(txid, wtxid, 32);
+		return 0;
+	}
+	s = malloc(io + 8);
+	if (!s)
+		return -1;
+	memcpy(s, d + t->start, 4);
+	memcpy(s + 4, d + t->io_start, io);
+	memcpy(s + 4 + io, d + t->end - 4, 4);
+	sha256d(s, io + 8, txid);
+	free(s);
+	return 0;
+}
+
+/* ---- Scripts ---- */
+
+#define OP_PUSHDATA1 0x4c
+#define OP_PUSHDATA4 0x4e
+#define OP_1         0x51
+#define OP_16        0x60
+#define OP_RETURN    0x6a
+
+/* Names of opcodes OP_1NEGATE (0x4f) to OP_CHECKSIGADD (0xba) */
+static const char *const op_names[] = {
+	"-1", "OP_RESERVED", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10",
+	"11", "12", "13", "14", "15", "16",
+	"OP_NOP", "OP_VER", "OP_IF", "OP_NOTIF", "OP_VERIF", "OP_VERNOTIF",
+	"OP_ELSE", "OP_ENDIF", "OP_VERIFY", "OP_RETURN",
+	"OP_TOALTSTACK", "OP_FROMALTSTACK", "OP_2DROP", "OP_2DUP", "OP_3DUP",
+	"OP_2OVER", "OP_2ROT", "OP_2SWAP", "OP_IFDUP", "OP_DEPTH", "OP_DROP",
+	"OP_DUP", "OP_NIP", "OP_OVER", "OP_PICK", "OP_ROLL", "OP_ROT", "OP_SWAP",
+	"OP_TUCK",
+	"OP_CAT", "OP_SUBSTR", "OP_LEFT", "OP_RIGHT", "OP_SIZE",
+	"OP_INVERT", "OP_AND", "OP_OR", "OP_XOR", "OP_EQUAL", "OP_EQUALVERIFY",
+	"OP_RESERVED1", "OP_RESERVED2",
+	"OP_1ADD", "OP_1SUB", "OP_2MUL", "OP_2DIV", "OP_NEGATE", "OP_ABS",
+	"OP_NOT", "OP_0NOTEQUAL", "OP_ADD", "OP_SUB", "OP_MUL", "OP_DIV",
+	"OP_MOD", "OP_LSHIFT", "OP_RSHIFT", "OP_BOOLAND", "OP_BOOLOR",
+	"OP_NUMEQUAL", "OP_NUMEQUALVERIFY", "OP_NUMNOTEQUAL", "OP_LESSTHAN",
+	"OP_GREATERTHAN", "OP_LESSTHANOREQUAL", "OP_GREATERTHANOREQUAL",
+	"OP_MIN", "OP_MAX", "OP_WITHIN",
+	"OP_RIPEMD160", "OP_SHA1", "OP_SHA256", "OP_HASH160", "OP_HASH256",
+	"OP_CODESEPARATOR", "OP_CHECKSIG", "OP_CHECKSIGVERIFY",
+	"OP_CHECKMULTISIG", "OP_CHECKMULTISIGVERIFY",
+	"OP_NOP1", "OP_CHECKLOCKTIMEVERIFY", "OP_CHECKSEQUENCEVERIFY",
+	"OP_NOP4", "OP_NOP5", "OP_NOP6", "OP_NOP7", "OP_NOP8", "OP_NOP9",
+	"OP_NOP10", "OP_CHECKSIGADD"
+};
+
+static const char *op_name(int op)
+{
+	if (op >= 0x4f && op < 0x4f + (int)(sizeof(op_names) / sizeof(op_names[0])))
+		return op_names[op - 0x4f];
+	return op == 0xff ? "OP_INVALIDOPCODE" : "OP_UNKNOWN";
+}
+
+/* Read the operation at *pc, with the data it pushes if any. Returns 0 at
+ * the end of the script or if the push runs past it. */
+static int script_op(const uint8_t *s, size_t len, size_t *pc, int *op,
+                     const uint8_t **data, size_t *data_len)
+{
+	size_t n = 0;
+
+	*op = 0xff;
+	*data = NULL;
+	*data_len = 0;
+	if (*pc >= len)
+		return 0;
+	*op = s[(*pc)++];
+	if (*op > OP_PUSHDATA4)
+		return 1;
+	if (*op < OP_PUSHDATA1) {
+		n = *op;
+	} else {
+		size_t width = *op == OP_PUSHDATA1 ? 1 : *op == OP_PUSHDATA4 ? 4 : 2;
+		size_t i;
+
+		if (len - *pc < width)
+			return 0;
+		for (i = width; i-- > 0;)
+			n = n << 8 | s[*pc + i];
+		*pc += width;
+	}
+	if (len - *pc < n)
+		return 0;
+	*data = s + *pc;
+	*data_len = n;
+	*pc += n;
+	return 1;
+}
+
+/* Little-endian sign-magnitude number of up to 4 bytes */
+static long long script_num(const uint8_t *d, size_t n)
+{
+	long long v = 0;
+	size_t i;
+
+	if (n == 0)
+		return 0;
+	for (i = 0; i < n; i++)
+		v |= (long long)d[i] << (8 * i);
+	if (d[n - 1] & 0x80)
+		return -(v & ~(0x80LL << (8 * (n - 1))));
+	return v;
+}
+
+/* Strict DER signature with a defined sighash type, as
+ * CheckSignatureEncoding() checks it under STRICTENC; returns the name
+ * of the sighash type, or NULL */
+static const char *sighash_name(const uint8_t *sig, size_t n)
+{
+	size_t len_r, len_s;
+
+	if (n < 9 || n > 73 || sig[0] != 0x30 || sig[1] != n - 3)
+		return NULL;
+	len_r = sig[3];
+	if (5 + len_r >= n)
+		return NULL;
+	len_s = sig[5 + len_r];
+	if (len_r + len_s + 7 != n || sig[2] != 0x02 || len_r == 0 ||
+	    (sig[4] & 0x80) || (len_r > 1 && sig[4] == 0 && !(sig[5] & 0x80)))
+		return NULL;
+	if (sig[len_r + 4] != 0x02 || len_s == 0 || (sig[len_r + 6] & 0x80) ||
+	    (len_s > 1 && sig[len_r + 6] == 0 && !(sig[len_r + 7] & 0x80)))
+		return NULL;
+
+	switch (sig[n - 1]) {
+	case 0x01: return "ALL";
+	case 0x81: return "ALL|ANYONECANPAY";
+	case 0x02: return "NONE";
+	case 0x82: return "NONE|ANYONECANPAY";
+	case 0x03: return "SINGLE";
+	case 0x83: return "SINGLE|ANYONECANPAY";
+	}
+	return NULL;
+}
+
+/* Disassemble like ScriptToAsmStr(); with sighash, pushes that are
+ * signatures show their sighash type as a [NAME] suffix */
+static void out_asm(Out *o, const uint8_t *s, size_t len, int sighash)
+{
+	const uint8_t *data;
+	size_t pc = 0, n;
+	int op;
+
+	if ((len > 0 && s[0] == OP_RETURN) || len > BLOCK_MAX_SCRIPT)
+		sighash = 0;
+	while (pc < len) {
+		if (pc > 0)
+			out_put(o, " ", 1);
+		if (!script_op(s, len, &pc, &op, &data, &n)) {
+			out_str(o, "[error]");
+			return;
+		}
+		if (op > OP_PUSHDATA4) {
+			out_str(o, op_name(op));
+		} else if (n <= 4) {
+			out_int(o, script_num(data, n));
+		} else {
+			const char *type = sighash ? sighash_name(data, n) : NULL;
+
+			out_hex(o, data, type ? n - 1 : n);
+			if (type) {
+				out_put(o, "[", 1);
+				out_str(o, type);
+				out_put(o, "]", 1);
+			}
+		}
+	}
+}
+
+/* Output types, named as bitcoind names them */
+enum {
+	TX_NONSTANDARD,
+	TX_PUBKEY,
+	TX_PUBKEYHASH,
+	TX_SCRIPTHASH,
+	TX_MULTISIG,
+	TX_NULL_DATA,
+	TX_WITNESS_V0_KEYHASH,
+	TX_WITNESS_V0_SCRIPTHASH,
+	TX_WITNESS_V1_TAPROOT,
+	TX_ANCHOR,
+	TX_WITNESS_UNKNOWN
+};
+
+static const char *const type_names[] = {
+	"nonstandard", "pubkey", "pubkeyhash", "scripthash", "multisig",
+	"nulldata", "witness_v0_keyhash", "witness_v0_scripthash",
+	"witness_v1_taproot", "anchor", "witness_unknown"
+};
+
+/* An output script matched to its template */
+typedef struct {
+	int type;
+	int version;              /* Witness version */
+	const uint8_t *program;   /* Hash, witness program or P2PK key */
+	size_t program_len;
+	int required;             /* Multisig: signatures required */
+	int nkeys;
+	const uint8_t *keys[MAX_MULTISIG_KEYS];
+	size_t key_len[MAX_MULTISIG_KEYS];
+} Solution;
+
+/* Length a public key has, going by its first byte (0 = not a key) */
+static size_t pubkey_len(uint8_t header)
+{
+	if (header == 2 || header == 3)
+		return 33;
+	if (header == 4 || header == 6 || header == 7)
+		return 65;
+	return 0;
+}
+
+/* The push is the shortest way to push its data */
+static int minimal_push(int op, const uint8_t *d, size_t n)
+{
+	if (n == 0)
+		return op == 0;
+	if (n == 1 && ((d[0] >= 1 && d[0] <= 16) || d[0] == 0x81))
+		return 0;
+	if (n <= 75)
+		return (size_t)op == n;
+	if (n <= 255)
+		return op == OP_PUSHDATA1;
+	if (n <= 65535)
+		return op == OP_PUSHDATA1 + 1;
+	return 1;
+}
+
+/* A multisig key count: OP_1..OP_16 or a minimally pushed number within
+ * [min, max]; -1 if it is not one */
+static int script_number(int op, const uint8_t *d, size_t n, int min, int max)
+{
+	long long v;
+
+	if (op >= OP_1 && op <= OP_16) {
+		v = op - OP_1 + 1;
+	} else if (op > 0 && op <= OP_PUSHDATA4) {
+		if (!minimal_push(op, d, n) || n > 4)
+			return -1;
+		if (n > 0 && (d[n - 1] & 0x7f) == 0 && (n == 1 || !(d[n - 2] & 0x80)))
+			return -1;
+		v = script_num(d, n);
+	} else {
+		return -1;
+	}
+	return v < min || v > max ? -1 : (int)v;
+}
+
+static int match_multisig(const uint8_t *s, size_t len, Solution *sol)
+{
+	const uint8_t *d;
+	size_t pc = 0, n;
+	int op, keys;
+
+	if (len < 1 || s[len - 1] != 0xae)
+		return 0;
+	if (!script_op(s, len, &pc, &op, &d, &n))
+		return 0;
+	sol->required = script_number(op, d, n, 1, MAX_MULTISIG_KEYS);
+	if (sol->required < 0)
+		return 0;
+	sol->nkeys = 0;
+	while (script_op(s, len, &pc, &op, &d, &n) && n > 0 && pubkey_len(d[0]) == n) {
+		if (sol->nkeys == MAX_MULTISIG_KEYS)
+			return 0;
+		sol->keys[sol->nkeys] = d;
+		sol->key_len[sol->nkeys++] = n;
+	}
+	keys = script_number(op, d, n, sol->required, MAX_MULTISIG_KEYS);
+	return keys == sol->nkeys && pc + 1 == len;
+}
+
+/* Only pushes (OP_RESERVED counts as one) */
+static int push_only(const uint8_t *s, size_t len)
+{
+	const uint8_t *d;
+	size_t pc = 0, n;
+	int op;
+
+	while (pc < len)
+		if (!script_op(s, len, &pc, &op, &d, &n) || op > OP_16)
+			return 0;
+	return 1;
+}
+
+/* Match a script to a template in the order Solver() tries them */
+static int script_solve(const uint8_t *s, size_t len, Solution *sol)
+{
+	memset(sol, 0, sizeof(*sol));
+	sol->type = TX_NONSTANDARD;
+
+	if (len == 23 && s[0] == 0xa9 && s[1] == 0x14 && s[22] == 0x87) {
+		sol->type = TX_SCRIPTHASH;
+		sol->program = s + 2;
+		sol->program_len = 20;
+	} else if (len >= 4 && len <= 42 && (s[0] == 0 || (s[0] >= OP_1 && s[0] <= OP_16)) &&
+	           (size_t)s[1] + 2 == len) {
+		sol->version = s[0] ? s[0] - OP_1 + 1 : 0;
+		sol->program = s + 2;
+		sol->program_len = len - 2;
+		if (sol->version == 0 && len == 22)
+			sol->type = TX_WITNESS_V0_KEYHASH;
+		else if (sol->version == 0 && len == 34)
+			sol->type = TX_WITNESS_V0_SCRIPTHASH;
+		else if (sol->version == 1 && len == 34)
+			sol->type = TX_WITNESS_V1_TAPROOT;
+		else if (sol->version == 1 && len == 4 && s[2] == 0x4e && s[3] == 0x73)
+			sol->type = TX_ANCHOR;
+		else if (sol->version != 0)
+			sol->type = TX_WITNESS_UNKNOWN;
+	} else if (len >= 1 && s[0] == OP_RETURN && push_only(s + 1, len - 1)) {
+		sol->type = TX_NULL_DATA;
+	} else if ((len == 67 || len == 35) && s[0] == len - 2 && s[len - 1] == 0xac &&
+	           pubkey_len(s[1]) == len - 2) {
+		sol->type = TX_PUBKEY;
+		sol->program = s + 1;
+		sol->program_len = len - 2;
+	} else if (len == 25 && s[0] == 0x76 && s[1] == 0xa9 && s[2] == 0x14 &&
+	           s[23] == 0x88 && s[24] == 0xac) {
+		sol->type = TX_PUBKEYHASH;
+		sol->program = s + 3;
+		sol->program_len = 20;
+	} else if (match_multisig(s, len, sol)) {
+		sol->type = TX_MULTISIG;
+	}
+	return sol->type;
+}
+
+/* ---- Addresses ---- */
+
+static void base58check(uint8_t version, const uint8_t hash[20], char *out)
+{
+	static const char alphabet[] =
+		"123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+	uint8_t raw[25], check[32], digits[40];
+	size_t ndigits = 0, zeros = 0, i, j, k = 0;
+
+	raw[0] = version;
+	memcpy(raw + 1, hash, 20);
+	sha256d(raw, 21, check);
+	memcpy(raw + 21, check, 4);
+
+	while (zeros < sizeof(raw) && raw[zeros] == 0)
+		zeros++;
+	for (i = zeros; i < sizeof(raw); i++) {
+		unsigned carry = raw[i];
+
+		for (j = 0; j < ndigits; j++) {
+			carry += (unsigned)digits[j] << 8;
+			digits[j] = carry % 58;
+			carry /= 58;
+		}
+		while (carry) {
+			digits[ndigits++] = carry % 58;
+			carry /= 58;
+		}
+	}
+	for (i = 0; i < zeros; i++)
+		out[k++] = '1';
+	while (ndigits > 0)
+		out[k++] = alphabet[digits[--ndigits]];
+	out[k] = '\0';
+}
+
+static const char bech32_charset[] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+static uint32_t bech32_step(uint32_t c, uint8_t v)
+{
+	uint32_t top = c >> 25;
+
+	c = (c & 0x1ffffff) << 5 ^ v;
+	if (top & 1) c ^= 0x3b6a57b2;
+	if (top & 2) c ^= 0x26508e6d;
+	if (top & 4) c ^= 0x1ea119fa;
+	if (top & 8) c ^= 0x3d4233dd;
+	if (top & 16) c ^= 0x2a1462b3;
+	return c;
+}
+
+/* Segwit address: bech32 for version 0, bech32m after (BIP 173, 350) */
+static void segwit_address(const char *hrp, int version, const uint8_t *prog,
+                           size_t len, char *out)
+{
+	uint8_t data[1 + 64];
+	uint32_t c = 1, acc = 0;
+	size_t n = 0, i, k = 0;
+	int bits = 0;
+
+	data[n++] = version;
+	for (i = 0; i < len; i++) {
+		acc = acc << 8 | prog[i];
+		bits += 8;
+		while (bits >= 5) {
+			bits -= 5;
+			data[n++] = acc >> bits & 31;
+		}
+	}
+	if (bits > 0)
+		data[n++] = acc << (5 - bits) & 31;
+
+	for (i = 0; hrp[i]; i++)
+		c = bech32_step(c, hrp[i] >> 5);
+	c = bech32_step(c, 0);
+	for (i = 0; hrp[i]; i++) {
+		c = bech32_step(c, hrp[i] & 31);
+		out[k++] = hrp[i];
+	}
+	out[k++] = '1';
+	for (i = 0; i < n; i++) {
+		c = bech32_step(c, data[i]);
+		out[k++] = bech32_charset[data[i]];
+	}
+	for (i = 0; i < 6; i++)
+		c = bech32_step(c, 0);
+	c ^= version == 0 ? 1 : 0x2bc830a3;
+	for (i = 0; i < 6; i++)
+		out[k++] = bech32_charset[c >> (5 * (5 - i)) & 31];
+	out[k] = '\0';
+}
+
+/* Address of an output, as ExtractDestination() finds one (not for
+ * pay-to-pubkey); returns 0 if it has none */
+static int script_address(const Solution *sol, Network net, char *out)
+{
+	int main = net == NET_MAINNET;
+	const char *hrp = main ? "bc" : net == NET_REGTEST ? "bcrt" : "tb";
+
+	switch (sol->type) {
+	case TX_PUBKEYHASH:
+		base58check(main ? 0 : 111, sol->program, out);
+		return 1;
+	case TX_SCRIPTHASH:
+		base58check(main ? 5 : 196, sol->program, out);
+		return 1;
+	case TX_WITNESS_V0_KEYHASH:
+	case TX_WITNESS_V0_SCRIPTHASH:
+	case TX_WITNESS_V1_TAPROOT:
+	case TX_ANCHOR:
+	case TX_WITNESS_UNKNOWN:
+		segwit_address(hrp, sol->version, sol->program, sol->program_len, out);
+		return 1;
+	}
+	out[0] = '\0';
+	return 0;
+}
+
+/* ---- x-only keys ---- */
+
+/* secp256k1 field elements, 32-bit limbs least significant first */
+typedef uint32_t Fe[8];
+
+static const Fe fe_p = {
+	0xfffffc2f, 0xfffffffe, 0xffffffff, 0xffffffff,
+	0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff
+};
+
+static int fe_ge_p(const Fe a)
+{
+	int i;
+
+	for (i = 7; i >= 0; i--)
+		if (a[i] != fe_p[i])
+			return a[i] > fe_p[i];
+	return 1;
+}
+
+static void fe_sub_p(Fe a)
+{
+	int64_t borrow = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		int64_t v = (int64_t)a[i] - fe_p[i] - borrow;
+		borrow = v < 0;
+		a[i] = (uint32_t)v;
+	}
+}
+
+/* r = a * b mod p, using 2^256 = 2^32 + 977 (mod p) */
+static void fe_mul(Fe r, const Fe a, const Fe b)
+{
+	uint32_t t[16] = {0};
+	uint64_t c, top;
+	uint32_t u[8];
+	int i, j;
+
+	for (i = 0; i < 8; i++) {
+		c = 0;
+		for (j = 0; j < 8; j++) {
+			c += (uint64_t)a[i] * b[j] + t[i + j];
+			t[i + j] = (uint32_t)c;
+			c >>= 32;
+		}
+		t[i + 8] = (uint32_t)c;
+	}
+
+	c = 0;
+	for (i = 0; i < 8; i++) {
+		c += (uint64_t)t[i] + (uint64_t)t[8 + i] * 977 + (i > 0 ? t[7 + i] : 0);
+		u[i] = (uint32_t)c;
+		c >>= 32;
+	}
+	top = c + t[15];
+
+	c = (uint64_t)u[0] + top * 977;
+	r[0] = (uint32_t)c;
+	c >>= 32;
+	c += (uint64_t)u[1] + top;
+	r[1] = (uint32_t)c;
+	c >>= 32;
+	for (i = 2; i < 8; i++) {
+		c += u[i];
+		r[i] = (uint32_t)c;
+		c >>= 32;
+	}
+	if (c) {
+		/* Wrapped past 2^256 once more; what is left is small */
+		c = (uint64_t)r[0] + 977;
+		r[0] = (uint32_t)c;
+		c = (c >> 32) + (uint64_t)r[1] + 1;
+		r[1] = (uint32_t)c;
+		for (i = 2; i < 8 && (c >>= 32); i++) {
+			c += r[i];
+			r[i] = (uint32_t)c;
+		}
+	}
+	if (fe_ge_p(r))
+		fe_sub_p(r);
+}
+
+/* The x coordinate of a point on the curve: x < p and x^3 + 7 a square,
+ * by Euler's criterion */
+static int xonly_valid(const uint8_t key[32])
+{
+	/* (p - 1) / 2 */
+	static const Fe half = {
+		0x7ffffe17, 0xffffffff, 0xffffffff, 0xffffffff,
+		0xffffffff, 0xffffffff, 0xffffffff, 0x7fffffff
+	};
+	Fe x, y, acc = {1};
+	int i, bit;
+
+	for (i = 0; i < 8; i++)
+		x[i] = (uint32_t)key[31 - 4 * i] | (uint32_t)key[30 - 4 * i] << 8 |
+		       (uint32_t)key[29 - 4 * i] << 16 | (uint32_t)key[28 - 4 * i] << 24;
+	if (fe_ge_p(x))
+		return 0;
+
+	fe_mul(y, x, x);
+	fe_mul(y, y, x);
+	y[0] += 7;
+	if (y[0] < 7)
+		for (i = 1; i < 8 && ++y[i] == 0; i++)
+			;
+	if (fe_ge_p(y))
+		fe_sub_p(y);
+
+	for (bit = 255; bit >= 0; bit--) {
+		fe_mul(acc, acc, acc);
+		if (half[bit / 32] >> (bit % 32) & 1)
+			fe_mul(acc, acc, y);
+	}
+	/* 1 for a square, 0 for y = 0, p - 1 otherwise */
+	for (i = 1; i < 8; i++)
+		if (acc[i])
+			return 0;
+	return acc[0] <= 1;
+}
+
+/* ---- Descriptors ---- */
+
+static uint64_t desc_step(uint64_t c, int v)
+{
+	uint8_t top = c >> 35;
+
+	c = (c & 0x7ffffffffULL) << 5 ^ v;
+	if (top & 1) c ^= 0xf5dee51989ULL;
+	if (top & 2) c ^= 0xa9fdca3312ULL;
+	if (top & 4) c ^= 0x1bab10e32dULL;
+	if (top & 8) c ^= 0x3706b1677aULL;
+	if (top & 16) c ^= 0x644d626ffdULL;
+	return c;
+}
+
+/* Descriptor checksum (BIP 380) of desc, written to out[0..8] */
+static void desc_checksum(const char *desc, size_t len, char out[9])
+{
+	static const char input_charset[] =
+		"0123456789()[],'/*abcdefgh@:$%{}"
+		"IJKLMNOPQRSTUVWXYZ&+-.;<=>?!^_|~"
+		"ijklmnopqrstuvwxyzABCDEFGH`#\"\\ ";
+	uint64_t c = 1;
+	int cls = 0, count = 0, j;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		const char *at = strchr(input_charset, desc[i]);
+		int pos = at ? (int)(at - input_charset) : 0;
+
+		c = desc_step(c, pos & 31);
+		cls = cls * 3 + (pos >> 5);
+		if (++count == 3) {
+			c = desc_step(c, cls);
+			cls = 0;
+			count = 0;
+		}
+	}
+	if (count > 0)
+		c = desc_step(c, cls);
+	for (j = 0; j < 8; j++)
+		c = desc_step(c, 0);
+	c ^= 1;
+	for (j = 0; j < 8; j++)
+		out[j] = bech32_charset[c >> (5 * (7 - j)) & 31];
+	out[8] = '\0';
+}
+
+/* The descriptor InferDescriptor() gives an output script when nothing
+ * but the script is known */
+static void out_descriptor(Out *o, const uint8_t *s, size_t len,
+                           const Solution *sol, const char *address)
+{
+	Out d = {0};
+	char checksum[9];
+	int i;
+
+	switch (sol->type) {
+	case TX_PUBKEY:
+		/* Hybrid keys (0x06, 0x07) have no descriptor */
+		if (sol->program[0] <= 4) {
+			out_str(&d, "pk(");
+			out_hex(&d, sol->program, sol->program_len);
+			out_put(&d, ")", 1);
+		}
+		break;
+	case TX_MULTISIG:
+		for (i = 0; i < sol->nkeys; i++)
+			if (sol->keys[i][0] > 4)
+				break;
+		if (i == sol->nkeys) {
+			out_str(&d, "multi(");
+			out_int(&d, sol->required);
+			for (i = 0; i < sol->nkeys; i++) {
+				out_put(&d, ",", 1);
+				out_hex(&d, sol->keys[i], sol->key_len[i]);
+			}
+			out_put(&d, ")", 1);
+		}
+		break;
+	case TX_WITNESS_V1_TAPROOT:
+		if (xonly_valid(sol->program)) {
+			out_str(&d, "rawtr(");
+			out_hex(&d, sol->program, 32);
+			out_put(&d, ")", 1);
+		}
+		break;
+	}
+	if (d.len == 0 && address[0]) {
+		out_str(&d, "addr(");
+		out_str(&d, address);
+		out_put(&d, ")", 1);
+	}
+	if (d.len == 0) {
+		out_str(&d, "raw(");
+		out_hex(&d, s, len);
+		out_put(&d, ")", 1);
+	}
+	if (d.oom) {
+		o->oom = 1;
+		free(d.data);
+		return;
+	}
+	desc_checksum(d.data, d.len, checksum);
+	out_put(o, d.data, d.len);
+	out_put(o, "#", 1);
+	out_put(o, checksum, 8);
+	free(d.data);
+}
+
+/* scriptPubKey object, as ScriptToUniv() builds it */
+static void out_script_pubkey(Out *o, const uint8_t *s, size_t len, Network net)
+{
+	Solution sol;
+	char address[96];
+
+	script_solve(s, len, &sol);
+	script_address(&sol, net, address);
+
+	out_str(o, "{\"asm\":\"");
+	out_asm(o, s, len, 0);
+	out_str(o, "\",\"desc\":\"");
+	out_descriptor(o, s, len, &sol, address);
+	out_str(o, "\",\"hex\":\"");
+	out_hex(o, s, len);
+	out_str(o, "\",");
+	if (address[0]) {
+		out_str(o, "\"address\":\"");
+		out_str(o, address);
+		out_str(o, "\",");
+	}
+	out_str(o, "\"type\":\"");
+	out_str(o, type_names[sol.type]);
+	out_str(o, "\"}");
+}
+
+/* ---- Transactions ---- */
+
+/* Transaction object, as TxToUniv() builds it (no block hash, no undo
+ * data); t has been through tx_scan */
+static void out_tx(Out *o, const uint8_t *d, const TxSpan *t,
+                   const uint8_t txid[32], const uint8_t wtxid[32], Network net)
+{
+	Reader r = { d, t->end, t->io_start };
+	Reader w = { d, t->end, t->io_end };  /* Witnesses */
+	size_t total = t->end - t->start, stripped = tx_stripped_size(t), len = 0;
+	unsigned long long weight = (unsigned long long)stripped * 3 + total;
+	uint64_t n_in, n_out, items, i;
+	const uint8_t *prev, *script, *item;
+	int coinbase;
+
+	out_str(o, "{\"txid\":\"");
+	out_hash(o, txid);
+	out_str(o, "\",\"hash\":\"");
+	out_hash(o, wtxid);
+	out_str(o, "\",\"version\":");
+	out_uint(o, le32(d + t->start));
+	out_str(o, ",\"size\":");
+	out_uint(o, total);
+	out_str(o, ",\"vsize\":");
+	out_uint(o, (weight + 3) / 4);
+	out_str(o, ",\"weight\":");
+	out_uint(o, weight);
+	out_str(o, ",\"locktime\":");
+	out_uint(o, le32(d + t->end - 4));
+
+	out_str(o, ",\"vin\":[");
+	rd_compact(&r, &n_in);
+	coinbase = 0;
+	if (n_in == 1) {
+		static const uint8_t null_hash[32];
+		prev = r.data + r.pos;
+		coinbase = memcmp(prev, null_hash, 32) == 0 && le32(prev + 32) == 0xffffffff;
+	}
+	for (i = 0; i < n_in; i++) {
+		prev = rd_take(&r, 36);
+		script = rd_var(&r, &len);
+		if (i > 0)
+			out_put(o, ",", 1);
+		if (coinbase) {
+			out_str(o, "{\"coinbase\":\"");
+			out_hex(o, script, len);
+			out_put(o, "\"", 1);
+		} else {
+			out_str(o, "{\"txid\":\"");
+			out_hash(o, prev);
+			out_str(o, "\",\"vout\":");
+			out_uint(o, le32(prev + 32));
+			out_str(o, ",\"scriptSig\":{\"asm\":\"");
+			out_asm(o, script, len, 1);
+			out_str(o, "\",\"hex\":\"");
+			out_hex(o, script, len);
+			out_str(o, "\"}");
+		}
+		if (t->segwit && rd_compact(&w, &items) == 0 && items > 0) {
+			uint64_t k;
+
+			out_str(o, ",\"txinwitness\":[");
+			for (k = 0; k < items; k++) {
+				item = rd_var(&w, &len);
+				out_str(o, k > 0 ? ",\"" : "\"");
+				out_hex(o, item, len);
+				out_put(o, "\"", 1);
+			}
+			out_put(o, "]", 1);
+		}
+		out_str(o, ",\"sequence\":");
+		out_uint(o, le32(rd_take(&r, 4)));
+		out_put(o, "}", 1);
+	}
+
+	out_str(o, "],\"vout\":[");
+	rd_compact(&r, &n_out);
+	for (i = 0; i < n_out; i++) {
+		const uint8_t *value = rd_take(&r, 8);
+
+		script = rd_var(&r, &len);
+		if (i > 0)
+			out_put(o, ",", 1);
+		out_str(o, "{\"value\":");
+		out_amount(o, (int64_t)((uint64_t)le32(value) | (uint64_t)le32(value + 4) << 32));
+		out_str(o, ",\"n\":");
+		out_uint(o, i);
+		out_str(o, ",\"scriptPubKey\":");
+		out_script_pubkey(o, script, len, net);
+		out_put(o, "}", 1);
+	}
+
+	out_str(o, "],\"hex\":\"");
+	out_hex(o, d + t->start, total);
+	out_str(o, "\"}");
+}
+
+static char *out_finish(Out *o)
+{
+	if (o->oom) {
+		free(o->data);
+		return NULL;
+	}
+	return o->data;
+}
+
+char *block_to_json(const uint8_t *block, size_t len,
+                    const char *header_json, size_t header_len,
+                    int verbosity, Network net)
+{
+	Reader r = { block, len, 80 };
+	uint8_t txid[32], wtxid[32];
+	unsigned long long stripped;
+	uint64_t ntx, i;
+	TxSpan *txs;
+	Out o = {0};
+
+	/* Every transaction takes at least 10 bytes */
+	if (len < 80 || rd_compact(&r, &ntx) < 0 || ntx > len / 10)
+		return NULL;
+	/* The header's closing brace, where the block's own members go */
+	while (header_len > 0 && header_json[header_len - 1] != '}')
+		header_len--;
+	if (header_len < 2 || header_json[0] != '{')
+		return NULL;
+
+	txs = malloc((ntx ? ntx : 1) * sizeof(*txs));
+	if (!txs)
+		return NULL;
+	stripped = r.pos;
+	for (i = 0; i < ntx; i++) {
+		if (tx_scan(&r, &txs[i]) < 0) {
+			free(txs);
+			return NULL;
+		}
+		stripped += tx_stripped_size(&txs[i]);
+	}
+	if (r.pos != len) {
+		free(txs);
+		return NULL;
+	}
+
+	out_put(&o, header_json, header_len - 1);
+	out_str(&o, ",\"strippedsize\":");
+	out_uint(&o, stripped);
+	out_str(&o, ",\"size\":");
+	out_uint(&o, len);
+	out_str(&o, ",\"weight\":");
+	out_uint(&o, stripped * 3 + len);
+	out_str(&o, ",\"tx\":[");
+	for (i = 0; i < ntx && !o.oom; i++) {
+		if (tx_hashes(block, &txs[i], txid, wtxid) < 0) {
+			o.oom = 1;
+			break;
+		}
+		if (i > 0)
+			out_put(&o, ",", 1);
+		if (verbosity >= 2) {
+			out_tx(&o, block, &txs[i], txid, wtxid, net);
+		} else {
+			out_put(&o, "\"", 1);
+			out_hash(&o, txid);
+			out_put(&o, "\"", 1);
+		}
+	}
+	out_str(&o, "]}");
+	free(txs);
+	return out_finish(&o);
+}
+
+/* Height bitcoind gives coins that are only in the mempool */
+#define BLOCK_MEMPOOL_HEIGHT 0x7fffffff
+
+char *block_utxos_to_ndjson(const uint8_t *resp, size_t len,
+                            const BlockOutpoint *outpoints, int count,
+                            Network net)
+{
+	Reader r = { resp, len, 0 };
+	const uint8_t *tip, *hash, *bitmap, *coin, *script;
+	uint32_t tip_height;
+	size_t bitmap_len, script_len;
+	uint64_t ncoins;
+	Out o = {0};
+	int i;
+
+	/* Tip height and hash, the bitmap of outpoints found, then a CCoin
+	 * (version dummy, height, CTxOut) for each one found */
+	if (!(tip = rd_take(&r, 36)) || !(bitmap = rd_var(&r, &bitmap_len)) ||
+	    bitmap_len != (size_t)(count + 7) / 8 || rd_compact(&r, &ncoins) < 0)
+		return NULL;
+	tip_height = le32(tip);
+	hash = tip + 4;
+
+	for (i = 0; i < count; i++) {
+		int unspent = bitmap[i / 8] >> (i % 8) & 1;
+
+		out_str(&o, "{\"txid\":\"");
+		out_str(&o, outpoints[i].txid);
+		out_str(&o, "\",\"vout\":");
+		out_uint(&o, outpoints[i].n);
+		out_str(&o, unspent ? ",\"unspent\":true" : ",\"unspent\":false");
+		out_str(&o, ",\"bestblock\":\"");
+		out_hash(&o, hash);
+		out_put(&o, "\"", 1);
+		if (unspent) {
+			uint32_t height;
+			int64_t value;
+
+			if (ncoins-- == 0 || !(coin = rd_take(&r, 16)) ||
+			    !(script = rd_var(&r, &script_len))) {
+				free(o.data);
+				return NULL;
+			}
+			height = le32(coin + 4);
+			value = (int64_t)((uint64_t)le32(coin + 8) | (uint64_t)le32(coin + 12) << 32);
+			out_str(&o, ",\"confirmations\":");
+			out_uint(&o, height == BLOCK_MEMPOOL_HEIGHT || height > tip_height
+			             ? 0 : tip_height - height + 1);
+			out_str(&o, ",\"value\":");
+			out_amount(&o, value);
+			out_str(&o, ",\"scriptPubKey\":");
+			out_script_pubkey(&o, script, script_len, net);
+		}
+		out_str(&o, "}\n");
+	}
+	if (ncoins != 0 || r.pos != len) {
+		free(o.data);
+		return NULL;
+	}
+	return out_finish(&o);
+}
+
+char *block_hex(const uint8_t *data, size_t len)
+{
+	Out o = {0};
+
+	out_hex(&o, data, len);
+	return out_finish(&o);
+}
+
+/* Byte-reversed hex of a hash into 65 bytes */
+static void hash_hex(const uint8_t *hash, char *hex)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		hex[i * 2] = digits[hash[31 - i] >> 4];
+		hex[i * 2 + 1] = digits[hash[31 - i] & 15];
+	}
+	hex[64] = '\0';
+}
+
+int block_txid(const uint8_t *tx, size_t len, char *hex)
+{
+	Reader r = { tx, len, 0 };
+	uint8_t txid[32], wtxid[32];
+	TxSpan t;
+
+	if (tx_scan(&r, &t) < 0 || r.pos != len || tx_hashes(tx, &t, txid, wtxid) < 0)
+		return -1;
+	hash_hex(txid, hex);
+	return 0;
+}
+
+int block_hash(const uint8_t *block, size_t len, char *hex)
+{
+	uint8_t hash[32];
+
+	if (len < 80)
+		return -1;
+	sha256d(block, 80, hash);
+	hash_hex(hash, hex);
+	return 0;
+}
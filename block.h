@@ -0,0 +1,47 @@
+/* Native decoding of serialized blocks and transactions (-rest) */
+
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+/* The functions below return JSON as bitcoind would write it (compact, in
+ * the same member order), or NULL if the data does not parse. Addresses
+ * are encoded for net. */
+
+/* getblock <hash> 1 or 2 for a block as served by /rest/block/<hash>.bin.
+ * header_json is the block's header as getblockheader returns it; it
+ * supplies the fields that depend on the chain (height, confirmations,
+ * chainwork, ...). Verbosity 2 has no "fee" members, which need the
+ * block's undo data. */
+char *block_to_json(const uint8_t *block, size_t len,
+                    const char *header_json, size_t header_len,
+                    int verbosity, Network net);
+
+/* An outpoint as given to -getutxos */
+typedef struct {
+	char txid[65];  /* Lowercase hex, as shown */
+	uint32_t n;
+} BlockOutpoint;
+
+/* One NDJSON line per outpoint (in order) from a
+ * /rest/getutxos/checkmempool/...bin response to a request for them:
+ * txid, vout, unspent, bestblock and, for unspent ones, the confirmations,
+ * value and scriptPubKey gettxout would show. Coins only in the mempool
+ * have 0 confirmations. */
+char *block_utxos_to_ndjson(const uint8_t *resp, size_t len,
+                            const BlockOutpoint *outpoints, int count,
+                            Network net);
+
+/* Lowercase hex of data, for verbosity 0 */
+char *block_hex(const uint8_t *data, size_t len);
+
+/* The txid of a serialized transaction, or the hash of a serialized
+ * block (from its header), as shown: 64 hex digits into 65 bytes.
+ * Returns 0, or -1 if the data does not parse. */
+int block_txid(const uint8_t *tx, size_t len, char *hex);
+int block_hash(const uint8_t *block, size_t len, char *hex);
+
+#endif
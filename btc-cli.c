@@ -15,6 +15,9 @@
 #endif
 
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/stat.h>
 
 #include "config.h"
 #include "methods.h"
@@ -23,20 +26,40 @@
 #include "fallback.h"
 #include "format.h"
 #include "completions.h"
+#include "daemon.h"
+#include "block.h"
+#include "stats.h"
+#include "hashidx.h"
+#include "zmtp.h"
+#include "exporter.h"
 
 #define BTC_CLI_VERSION "0.12.0"
 
-/* ANSI color codes */
-#define C_RESET   "\033[0m"
-#define C_KEY     "\033[36m"   /* Cyan for keys */
-#define C_STRING  "\033[32m"   /* Green for strings */
-#define C_NUMBER  "\033[33m"   /* Yellow for numbers */
-#define C_BOOL    "\033[35m"   /* Magenta for true/false/null */
-#define C_BRACE   "\033[1m"    /* Bold for {} [] */
-
 /* Global color setting */
 static int use_color = 0;
 
+/* Whether an argument of an unknown method is sent as a JSON string:
+ * true/false/null, JSON arrays/objects and numbers go unquoted */
+static int raw_needs_quotes(const char *arg)
+{
+	const char *s = arg;
+
+	if (strcmp(arg, "true") == 0 || strcmp(arg, "false") == 0 ||
+	    strcmp(arg, "null") == 0)
+		return 0;
+	if (arg[0] == '[' || arg[0] == '{')
+		return 0;
+
+	/* Check if numeric */
+	if (*s == '-') s++;
+	if (!*s) return 1;
+	while (*s) {
+		if (!isdigit(*s) && *s != '.') return 1;
+		s++;
+	}
+	return 0;
+}
+
 /* Build raw JSON params array from argv with type inference (for unknown methods) */
 static char *build_raw_params(int argc, char **argv)
 {
@@ -52,7 +75,6 @@ static char *build_raw_params(int argc, char **argv)
 
 	for (i = 0; i < argc; i++) {
 		const char *arg = argv[i];
-		char *file_content = NULL;
 		size_t arglen;
 
 		if (i > 0) buf[pos++] = ',';
@@ -63,27 +85,17 @@ static char *build_raw_params(int argc, char **argv)
 			continue;
 		}
 
-		/* @file.json syntax — read arg from file */
+		/* @file.json syntax — read arg from file, in place (as in
+		 * method_build_params) */
 		if (arg[0] == '@' && arg[1] != '\0') {
-			FILE *f = fopen(arg + 1, "r");
-			if (f) {
-				long len;
-				fseek(f, 0, SEEK_END);
-				len = ftell(f);
-				fseek(f, 0, SEEK_SET);
-				if (len > 0 && len <= 10 * 1024 * 1024) {
-					file_content = malloc(len + 1);
-					if (file_content) {
-						size_t nread = fread(file_content, 1, len, f);
-						file_content[nread] = '\0';
-						while (nread > 0 && (file_content[nread-1] == '\n' ||
-						       file_content[nread-1] == '\r' ||
-						       file_content[nread-1] == ' '))
-							file_content[--nread] = '\0';
-						arg = file_content;
-					}
-				}
-				fclose(f);
+			long n = method_read_file_arg(arg + 1, &buf, &bufsize, pos + 1);
+			if (n >= 0) {
+				int quote = raw_needs_quotes(buf + pos + 1);
+				buf[pos] = quote ? '"' : ' ';
+				pos += 1 + n;
+				if (quote)
+					buf[pos++] = '"';
+				continue;
 			}
 		}
 
@@ -91,33 +103,15 @@ static char *build_raw_params(int argc, char **argv)
 
 		while (pos + arglen + 64 > bufsize) {
 			bufsize *= 2;
-			buf = realloc(buf, bufsize);
-			if (!buf) { free(file_content); return NULL; }
+			char *newbuf = realloc(buf, bufsize);
+			if (!newbuf) { free(buf); return NULL; }
+			buf = newbuf;
 		}
 
-		if (strcmp(arg, "true") == 0 || strcmp(arg, "false") == 0 ||
-		    strcmp(arg, "null") == 0) {
-			pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-		} else if (arg[0] == '[' || arg[0] == '{') {
-			/* Already JSON */
+		if (raw_needs_quotes(arg))
+			pos += snprintf(buf + pos, bufsize - pos, "\"%s\"", arg);
+		else
 			pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-		} else {
-			/* Check if numeric */
-			const char *s = arg;
-			int is_num = 1;
-			if (*s == '-') s++;
-			if (!*s) is_num = 0;
-			while (*s) {
-				if (!isdigit(*s) && *s != '.') { is_num = 0; break; }
-				s++;
-			}
-			if (is_num)
-				pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-			else
-				pos += snprintf(buf + pos, bufsize - pos, "\"%s\"", arg);
-		}
-
-		free(file_content);
 	}
 
 	buf[pos++] = ']';
@@ -128,98 +122,7 @@ static char *build_raw_params(int argc, char **argv)
 /* Pretty print JSON output with optional color to specified stream */
 static void fprint_json_pretty(FILE *out, const char *json, int indent)
 {
-	const char *p = json;
-	int in_string = 0;
-	int is_key = 0;
-	int level = indent;
-	int i;
-
-	while (*p) {
-		if (*p == '"' && (p == json || *(p-1) != '\\')) {
-			if (!in_string) {
-				/* Starting a string - check if it's a key */
-				const char *ahead = p + 1;
-				while (*ahead && *ahead != '"')
-					ahead++;
-				if (*ahead == '"') {
-					ahead++;
-					while (*ahead == ' ' || *ahead == '\t')
-						ahead++;
-					is_key = (*ahead == ':');
-				}
-				if (use_color)
-					fprintf(out, "%s", is_key ? C_KEY : C_STRING);
-			}
-			fputc(*p, out);
-			if (in_string) {
-				if (use_color)
-					fprintf(out, "%s", C_RESET);
-				is_key = 0;
-			}
-			in_string = !in_string;
-		} else if (in_string) {
-			fputc(*p, out);
-		} else if (*p == '{' || *p == '[') {
-			/* Peek ahead for empty container {} or [] */
-			const char *peek = p + 1;
-			while (*peek == ' ' || *peek == '\t' || *peek == '\n' || *peek == '\r')
-				peek++;
-			char closing = (*p == '{') ? '}' : ']';
-			if (*peek == closing) {
-				/* Empty container — print compacted on same line */
-				if (use_color)
-					fprintf(out, "%s", C_BRACE);
-				fputc(*p, out);
-				fputc(closing, out);
-				if (use_color)
-					fprintf(out, "%s", C_RESET);
-				p = peek;  /* Skip to closing bracket (loop will advance past it) */
-			} else {
-				if (use_color)
-					fprintf(out, "%s", C_BRACE);
-				fputc(*p, out);
-				if (use_color)
-					fprintf(out, "%s", C_RESET);
-				fputc('\n', out);
-				level++;
-				for (i = 0; i < level * 2; i++) fputc(' ', out);
-			}
-		} else if (*p == '}' || *p == ']') {
-			fputc('\n', out);
-			level--;
-			for (i = 0; i < level * 2; i++) fputc(' ', out);
-			if (use_color)
-				fprintf(out, "%s", C_BRACE);
-			fputc(*p, out);
-			if (use_color)
-				fprintf(out, "%s", C_RESET);
-		} else if (*p == ',') {
-			fputc(*p, out);
-			fputc('\n', out);
-			for (i = 0; i < level * 2; i++) fputc(' ', out);
-		} else if (*p == ':') {
-			fputc(*p, out);
-			fputc(' ', out);
-		} else if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
-			/* Skip whitespace - we add our own */
-		} else {
-			/* Numbers, booleans, null */
-			if (use_color) {
-				if (*p == 't' || *p == 'f' || *p == 'n')
-					fprintf(out, "%s", C_BOOL);  /* true/false/null */
-				else if ((*p >= '0' && *p <= '9') || *p == '-' || *p == '.')
-					fprintf(out, "%s", C_NUMBER);
-			}
-			fputc(*p, out);
-			/* Check if next char ends the token */
-			char next = *(p + 1);
-			if (use_color && (next == ',' || next == '}' || next == ']' ||
-			    next == ' ' || next == '\n' || next == '\0'))
-				fprintf(out, "%s", C_RESET);
-		}
-		p++;
-	}
-	fputc('\n', out);
+	format_print_json(out, json, strlen(json), indent, use_color ? FORMAT_COLOR : 0);
 }
 
 /* Get cookie path for network */
@@ -281,56 +184,48 @@ static void read_password_stdin(char *buf, size_t size)
 #endif
 }
 
+/* Parse an RPC response onto a tape; returns the index of its "result"
+ * member, or -1. The tape is always safe to json_tape_free(). */
+static int tape_result(JsonTape *t, const char *response)
+{
+	memset(t, 0, sizeof(*t));
+	if (!response || json_tape_parse(t, response, strlen(response)) < 0)
+		return -1;
+	return json_tape_get(t, 0, "result");
+}
+
 /* Handle -addrinfo: address count by network type */
 static int handle_addrinfo(RpcClient *rpc)
 {
-	char *response;
-	const char *p;
+	const char *response;
+	JsonTape tape;
+	int res, e;
 	int ipv4 = 0, ipv6 = 0, onion = 0, i2p = 0, cjdns = 0, total = 0;
 
 	/* getnodeaddresses 0 = return all known addresses */
-	response = rpc_call(rpc, "getnodeaddresses", "[0]");
+	response = rpc_call_view(rpc, "getnodeaddresses", "[0]", NULL);
 	if (!response) {
 		fprintf(stderr, "error: Could not get node addresses\n");
 		return 1;
 	}
 
-	/* Find result array within JSON-RPC response */
-	const char *result_arr = json_find_value(response, "result");
-	if (!result_arr) result_arr = response;
-	while (*result_arr && *result_arr != '[') result_arr++;
-	const char *arr_end = NULL;
-	if (*result_arr == '[')
-		arr_end = json_find_closing(result_arr);
-
 	/* Iterate address objects within the result array */
-	p = result_arr;
-	while (*p && (!arr_end || p < arr_end)) {
-		const char *obj = strchr(p, '{');
-		if (!obj || (arr_end && obj >= arr_end)) break;
-		const char *end = json_find_closing(obj);
-		if (!end) break;
-
-		size_t len = end - obj + 1;
-		char *entry = malloc(len + 1);
-		if (entry) {
-			char net[32] = {0};
-			memcpy(entry, obj, len);
-			entry[len] = '\0';
-
-			if (json_get_string(entry, "network", net, sizeof(net)) > 0) {
-				total++;
-				if (strcmp(net, "ipv4") == 0) ipv4++;
-				else if (strcmp(net, "ipv6") == 0) ipv6++;
-				else if (strcmp(net, "onion") == 0) onion++;
-				else if (strcmp(net, "i2p") == 0) i2p++;
-				else if (strcmp(net, "cjdns") == 0) cjdns++;
-			}
-			free(entry);
+	res = tape_result(&tape, response);
+	for (e = json_tape_child(&tape, res); e >= 0; e = json_tape_next(&tape, e)) {
+		char net[32] = {0};
+		if (tape.tok[e].type != JSON_OBJECT)
+			continue;
+		if (json_tape_string(&tape, json_tape_get(&tape, e, "network"),
+		                     net, sizeof(net)) > 0) {
+			total++;
+			if (strcmp(net, "ipv4") == 0) ipv4++;
+			else if (strcmp(net, "ipv6") == 0) ipv6++;
+			else if (strcmp(net, "onion") == 0) onion++;
+			else if (strcmp(net, "i2p") == 0) i2p++;
+			else if (strcmp(net, "cjdns") == 0) cjdns++;
 		}
-		p = end + 1;
 	}
-	free(response);
+	json_tape_free(&tape);
 
 	{
 		char buf[512];
@@ -346,7 +241,7 @@ static int handle_addrinfo(RpcClient *rpc)
 /* Handle -generate: convenience block generator */
 static int handle_generate(RpcClient *rpc, int argc, char **argv, int cmd_index)
 {
-	char *response;
+	const char *response;
 	char params[512];
 	char address[256] = {0};
 	int nblocks = 1;
@@ -362,14 +257,13 @@ static int handle_generate(RpcClient *rpc, int argc, char **argv, int cmd_index)
 	if (nblocks < 1) nblocks = 1;
 
 	/* Step 1: get a fresh address */
-	response = rpc_call(rpc, "getnewaddress", "[]");
+	response = rpc_call_view(rpc, "getnewaddress", "[]", NULL);
 	if (!response) {
 		fprintf(stderr, "error: getnewaddress failed (is a wallet loaded?)\n");
 		return 1;
 	}
 
 	char *addr_result = method_extract_result(response, &error_code);
-	free(response);
 
 	if (error_code != 0 || !addr_result) {
 		fprintf(stderr, "error: getnewaddress: %s\n", addr_result ? addr_result : "failed");
@@ -382,14 +276,13 @@ static int handle_generate(RpcClient *rpc, int argc, char **argv, int cmd_index)
 	/* Step 2: generatetoaddress */
 	snprintf(params, sizeof(params), "[%d,\"%s\",%d]", nblocks, address, maxtries);
 
-	response = rpc_call(rpc, "generatetoaddress", params);
+	response = rpc_call_view(rpc, "generatetoaddress", params, NULL);
 	if (!response) {
 		fprintf(stderr, "error: generatetoaddress failed\n");
 		return 1;
 	}
 
 	char *result = method_extract_result(response, &error_code);
-	free(response);
 
 	if (result) {
 		/* Wrap result in {"address": "<addr>", "blocks": [...]} */
@@ -413,20 +306,33 @@ static int handle_getinfo(RpcClient *rpc, const char *wallet_name, int human)
 	char *blockchain = NULL;
 	char *network = NULL;
 	char *walletlist = NULL;
+	const char *bc, *net;  /* Their results */
 	char buf[256];
-
-	/* Collect data */
-	blockchain = rpc_call(rpc, "getblockchaininfo", "[]");
-	network = rpc_call(rpc, "getnetworkinfo", "[]");
+	RpcRequest reqs[] = {
+		{"getblockchaininfo", "[]", NULL, NULL, 0},
+		{"getnetworkinfo", "[]", NULL, NULL, 0},
+		{"listwallets", "[]", NULL, NULL, 0},
+		{"getwalletinfo", "[]", NULL, NULL, 0},
+		{"getbalances", "[]", NULL, NULL, 0},
+	};
+
+	/* Collect data — independent calls, pipelined into one round-trip,
+	 * the wallet's too when -rpcwallet names it */
+	rpc_call_pipelined(rpc, reqs, wallet_name[0] ? 5 : 3);
+	blockchain = reqs[0].response;
+	network = reqs[1].response;
+	walletlist = reqs[2].response;
+	bc = json_object_get(blockchain, "result");
+	net = json_object_get(network, "result");
 
 	/* Chain info */
-	if (blockchain) {
-		json_get_string(blockchain, "chain", buf, sizeof(buf));
+	if (bc) {
+		json_get_string(bc, "chain", buf, sizeof(buf));
 		printf("Chain: %s\n", buf);
-		printf("Blocks: %d\n", (int)json_get_int(blockchain, "blocks"));
-		printf("Headers: %d\n", (int)json_get_int(blockchain, "headers"));
+		printf("Blocks: %d\n", (int)json_get_int(bc, "blocks"));
+		printf("Headers: %d\n", (int)json_get_int(bc, "headers"));
 		{
-			double vp = json_get_double(blockchain, "verificationprogress");
+			double vp = json_get_double(bc, "verificationprogress");
 			double pct = vp * 100.0;
 			if (human && vp >= 0.9999) {
 				printf("Verification progress: Synced\n");
@@ -452,48 +358,34 @@ static int handle_getinfo(RpcClient *rpc, const char *wallet_name, int human)
 				}
 			}
 		}
-		printf("Difficulty: %.16g\n", json_get_double(blockchain, "difficulty"));
+		printf("Difficulty: %.16g\n", json_get_double(bc, "difficulty"));
 	}
 
 	/* Network info */
-	if (network) {
-		int conn_in = (int)json_get_int(network, "connections_in");
-		int conn_out = (int)json_get_int(network, "connections_out");
-		int conn_total = (int)json_get_int(network, "connections");
+	if (net) {
+		int conn_in = (int)json_get_int(net, "connections_in");
+		int conn_out = (int)json_get_int(net, "connections_out");
+		int conn_total = (int)json_get_int(net, "connections");
 		printf("\nNetwork: in %d, out %d, total %d\n", conn_in, conn_out, conn_total);
-		printf("Version: %d\n", (int)json_get_int(network, "version"));
-		printf("Time offset (s): %d\n", (int)json_get_int(network, "timeoffset"));
+		printf("Version: %d\n", (int)json_get_int(net, "version"));
+		printf("Time offset (s): %d\n", (int)json_get_int(net, "timeoffset"));
 
-		/* Proxy */
+		/* Proxy: the first network's */
 		char proxy[256] = {0};
-		const char *networks_arr = json_find_array(network, "networks");
-		if (networks_arr) {
-			const char *first_net = strchr(networks_arr, '{');
-			if (first_net) {
-				const char *first_end = json_find_closing(first_net);
-				if (first_end) {
-					size_t nlen = first_end - first_net + 1;
-					char *net_obj = malloc(nlen + 1);
-					if (net_obj) {
-						memcpy(net_obj, first_net, nlen);
-						net_obj[nlen] = '\0';
-						json_get_string(net_obj, "proxy", proxy, sizeof(proxy));
-						free(net_obj);
-					}
-				}
-			}
-		}
+		const char *networks_arr = json_find_array(net, "networks");
+		const char *first_net, *first_end;
+		if (networks_arr && (first_net = json_array_next(networks_arr, &first_end)) != NULL)
+			json_get_string(first_net, "proxy", proxy, sizeof(proxy));
 		printf("Proxies: %s\n", proxy[0] ? proxy : "n/a");
 		printf("Min tx relay fee rate (BTC/kvB): %.8f\n",
-		       json_get_double(network, "relayfee"));
+		       json_get_double(net, "relayfee"));
 	}
 
 	/* Detect wallet situation */
 	int no_wallet = 0;
 	int wallet_count = 0;
-	walletlist = rpc_call(rpc, "listwallets", "[]");
 	if (walletlist) {
-		const char *arr_start = json_find_value(walletlist, "result");
+		const char *arr_start = json_object_get(walletlist, "result");
 		if (!arr_start) arr_start = walletlist;
 		while (*arr_start && *arr_start != '[') arr_start++;
 
@@ -519,18 +411,23 @@ static int handle_getinfo(RpcClient *rpc, const char *wallet_name, int human)
 		}
 	}
 
-	/* Multi-wallet: show balances list */
+	/* Multi-wallet: show balances list, all wallets' getbalances
+	 * pipelined into one round-trip */
 	if (wallet_count > 1 && !wallet_name[0]) {
+		char (*names)[256] = calloc(wallet_count, sizeof(*names));
+		RpcRequest *breqs = calloc(wallet_count, sizeof(*breqs));
+		int nw = 0, k;
+
 		printf("\nBalances\n");
 
-		const char *arr_start = json_find_value(walletlist, "result");
+		const char *arr_start = json_object_get(walletlist, "result");
 		if (!arr_start) arr_start = walletlist;
 		while (*arr_start && *arr_start != '[') arr_start++;
 		const char *arr_end = json_find_closing(arr_start);
 		if (!arr_end) arr_end = arr_start;
 
 		const char *p = arr_start + 1;
-		while (p < arr_end) {
+		while (names && breqs && nw < wallet_count && p < arr_end) {
 			const char *start = strchr(p, '"');
 			if (!start || start >= arr_end) break;
 			start++;
@@ -538,25 +435,36 @@ static int handle_getinfo(RpcClient *rpc, const char *wallet_name, int human)
 			if (!end || end >= arr_end) break;
 
 			size_t namelen = end - start;
-			char wname[256] = {0};
-			if (namelen < sizeof(wname)) {
-				memcpy(wname, start, namelen);
-				wname[namelen] = '\0';
-
-				rpc_set_wallet(rpc, wname);
-				char *wb = rpc_call(rpc, "getbalances", "[]");
-				if (wb) {
-					const char *mine = json_find_object(wb, "mine");
-					double bal = mine ? json_get_double(mine, "trusted") : 0;
-					printf("%12.8f %s\n", bal, wname);
-					free(wb);
-				}
+			if (namelen < sizeof(names[0])) {
+				memcpy(names[nw], start, namelen);
+				names[nw][namelen] = '\0';
+				breqs[nw].method = "getbalances";
+				breqs[nw].params = "[]";
+				breqs[nw].wallet = names[nw];
+				nw++;
 			}
 			p = end + 1;
 		}
+		if (nw > 0)
+			rpc_call_pipelined(rpc, breqs, nw);
+		for (k = 0; k < nw; k++) {
+			const char *wb = breqs[k].response;
+			if (wb) {
+				const char *mine = json_find_object(json_object_get(wb, "result"), "mine");
+				double bal = mine ? json_get_double(mine, "trusted") : 0;
+				printf("%12.8f %s\n", bal, names[k]);
+			}
+			free(breqs[k].response);
+		}
+		free(breqs);
+		free(names);
 	} else if (!no_wallet) {
-		/* Single wallet or specific -rpcwallet */
-		char *winfo = rpc_call(rpc, "getwalletinfo", "[]");
+		/* Single wallet or specific -rpcwallet; with -rpcwallet these
+		 * came with the first round-trip */
+		if (!wallet_name[0])
+			rpc_call_pipelined(rpc, reqs + 3, 2);
+
+		const char *winfo = json_object_get(reqs[3].response, "result");
 		if (winfo) {
 			char wname[256] = {0};
 			json_get_string(winfo, "walletname", wname, sizeof(wname));
@@ -564,23 +472,23 @@ static int handle_getinfo(RpcClient *rpc, const char *wallet_name, int human)
 			printf("Keypool size: %d\n", (int)json_get_int(winfo, "keypoolsize"));
 			printf("Transaction fee rate (-paytxfee) (BTC/kvB): %.8f\n",
 			       json_get_double(winfo, "paytxfee"));
-			free(winfo);
 		}
 
-		char *balances = rpc_call(rpc, "getbalances", "[]");
+		const char *balances = json_object_get(reqs[4].response, "result");
 		if (balances) {
 			const char *mine = json_find_object(balances, "mine");
 			if (mine)
 				printf("\nBalance: %.8f\n", json_get_double(mine, "trusted"));
-			free(balances);
 		}
 	}
+	free(reqs[3].response);
+	free(reqs[4].response);
 	free(walletlist);
 
 	/* Warnings */
-	if (network) {
+	if (net) {
 		char warnings[1024] = {0};
-		json_get_string(network, "warnings", warnings, sizeof(warnings));
+		json_get_string(net, "warnings", warnings, sizeof(warnings));
 		printf("\nWarnings: %s\n", warnings[0] ? warnings : "(none)");
 	}
 
@@ -600,10 +508,17 @@ static int handle_health(RpcClient *rpc)
 	double vp = 0;
 	int64_t mediantime = 0;
 	char subversion[256] = {0};
-
-	bc_resp = rpc_call(rpc, "getblockchaininfo", "[]");
-	net_resp = rpc_call(rpc, "getnetworkinfo", "[]");
-	mp_resp = rpc_call(rpc, "getmempoolinfo", "[]");
+	RpcRequest reqs[] = {
+		{"getblockchaininfo", "[]", NULL, NULL, 0},
+		{"getnetworkinfo", "[]", NULL, NULL, 0},
+		{"getmempoolinfo", "[]", NULL, NULL, 0},
+	};
+
+	/* Independent calls, pipelined into one round-trip */
+	rpc_call_pipelined(rpc, reqs, 3);
+	bc_resp = reqs[0].response;
+	net_resp = reqs[1].response;
+	mp_resp = reqs[2].response;
 
 	if (!bc_resp) {
 		fprintf(stderr, "error: Could not query node\n");
@@ -614,19 +529,19 @@ static int handle_health(RpcClient *rpc)
 
 	/* Parse blockchain info from result */
 	{
-		const char *r = json_find_value(bc_resp, "result");
+		const char *r = json_object_get(bc_resp, "result");
 		if (r && *r == '{') {
 			json_get_string(r, "chain", chain, sizeof(chain));
 			blocks = (int)json_get_int(r, "blocks");
 			vp = json_get_double(r, "verificationprogress");
 			mediantime = json_get_int(r, "mediantime");
-			const char *ibd_val = json_find_value(r, "initialblockdownload");
+			const char *ibd_val = json_object_get(r, "initialblockdownload");
 			if (ibd_val && strncmp(ibd_val, "true", 4) == 0) ibd = 1;
 		}
 	}
 
 	if (net_resp) {
-		const char *r = json_find_value(net_resp, "result");
+		const char *r = json_object_get(net_resp, "result");
 		if (r && *r == '{') {
 			connections = (int)json_get_int(r, "connections");
 			json_get_string(r, "subversion", subversion, sizeof(subversion));
@@ -634,7 +549,7 @@ static int handle_health(RpcClient *rpc)
 	}
 
 	if (mp_resp) {
-		const char *r = json_find_value(mp_resp, "result");
+		const char *r = json_object_get(mp_resp, "result");
 		if (r && *r == '{') {
 			mp_size = (int)json_get_int(r, "size");
 			mp_bytes = json_get_int(r, "bytes");
@@ -681,51 +596,51 @@ static int handle_health(RpcClient *rpc)
 /* Handle -progress: sync progress display */
 static int handle_progress(RpcClient *rpc)
 {
-	char *bc_resp;
+	const char *bc_resp;
 	int blocks = 0, headers = 0;
 	double vp = 0;
 	int ibd = 0;
 	char bestblockhash[128] = {0};
+	int64_t btime = 0;
 
-	bc_resp = rpc_call(rpc, "getblockchaininfo", "[]");
+	bc_resp = rpc_call_view(rpc, "getblockchaininfo", "[]", NULL);
 	if (!bc_resp) {
 		fprintf(stderr, "error: Could not query node\n");
 		return 1;
 	}
 
 	{
-		const char *r = json_find_value(bc_resp, "result");
+		const char *r = json_object_get(bc_resp, "result");
 		if (r && *r == '{') {
 			blocks = (int)json_get_int(r, "blocks");
 			headers = (int)json_get_int(r, "headers");
 			vp = json_get_double(r, "verificationprogress");
 			json_get_string(r, "bestblockhash", bestblockhash, sizeof(bestblockhash));
-			const char *ibd_val = json_find_value(r, "initialblockdownload");
+			btime = json_get_int(r, "time");
+			const char *ibd_val = json_object_get(r, "initialblockdownload");
 			if (ibd_val && strncmp(ibd_val, "true", 4) == 0) ibd = 1;
 		}
 	}
-	free(bc_resp);
 
-	/* Get tip block date via getblockheader */
+	/* Tip block date: getblockchaininfo has it since v23; older nodes
+	 * need a getblockheader for the tip */
 	char block_date[64] = {0};
-	if (bestblockhash[0]) {
+	if (btime <= 0 && bestblockhash[0]) {
 		char params[256];
 		snprintf(params, sizeof(params), "[\"%s\"]", bestblockhash);
-		char *hdr_resp = rpc_call(rpc, "getblockheader", params);
+		const char *hdr_resp = rpc_call_view(rpc, "getblockheader", params, NULL);
 		if (hdr_resp) {
-			const char *r = json_find_value(hdr_resp, "result");
-			if (r && *r == '{') {
-				int64_t btime = json_get_int(r, "time");
-				if (btime > 0) {
-					time_t t = (time_t)btime;
-					struct tm *tm = gmtime(&t);
-					if (tm)
-						strftime(block_date, sizeof(block_date), "%Y-%m-%d %H:%M:%S UTC", tm);
-				}
-			}
-			free(hdr_resp);
+			const char *r = json_object_get(hdr_resp, "result");
+			if (r && *r == '{')
+				btime = json_get_int(r, "time");
 		}
 	}
+	if (btime > 0) {
+		time_t t = (time_t)btime;
+		struct tm *tm = gmtime(&t);
+		if (tm)
+			strftime(block_date, sizeof(block_date), "%Y-%m-%d %H:%M:%S UTC", tm);
+	}
 
 	int synced = !ibd && vp >= 0.9999;
 
@@ -767,60 +682,76 @@ static int handle_netinfo(RpcClient *rpc, int level, int outonly)
 {
 	char *peers_json = NULL;
 	char *net_json = NULL;
-	PeerRow peers[256];
+	char *bc_json = NULL;
+	RpcRequest reqs[] = {
+		{"getnetworkinfo", "[]", NULL, NULL, 0},
+		{"getpeerinfo", "[]", NULL, NULL, 0},
+		{"getblockchaininfo", "[]", NULL, NULL, 0},
+	};
+	JsonTape peers_tape, net_tape;
+	int peers_res, net_res;
+	PeerRow *peers;
 	int peer_count = 0;
 	int total = 0, inbound = 0, outbound = 0, block_relay = 0, manual = 0;
 	int ipv4_in = 0, ipv6_in = 0, onion_in = 0, i2p_in = 0, cjdns_in = 0;
 	int ipv4_out = 0, ipv6_out = 0, onion_out = 0, i2p_out = 0, cjdns_out = 0;
 	int block_relay_out = 0;
-	const char *p;
-	int i;
+	int e, i;
 	time_t now = time(NULL);
 
-	/* Fetch getnetworkinfo first (needed for header banner and local info) */
-	net_json = rpc_call(rpc, "getnetworkinfo", "[]");
+	/* getnetworkinfo (header banner and local info), getpeerinfo and
+	 * getblockchaininfo (chain name), pipelined into one round-trip */
+	rpc_call_pipelined(rpc, reqs, 3);
+	net_json = reqs[0].response;
+	peers_json = reqs[1].response;
+	bc_json = reqs[2].response;
+	net_res = tape_result(&net_tape, net_json);
 
-	peers_json = rpc_call(rpc, "getpeerinfo", "[]");
 	if (!peers_json) {
 		fprintf(stderr, "error: Could not get peer info\n");
+		json_tape_free(&net_tape);
 		free(net_json);
+		free(bc_json);
 		return 1;
 	}
 
-	/* Find the result array within the JSON-RPC response */
-	const char *result_arr = json_find_value(peers_json, "result");
-	if (!result_arr) result_arr = peers_json;
-	/* Skip to opening [ */
-	while (*result_arr && *result_arr != '[') result_arr++;
-	const char *arr_end = NULL;
-	if (*result_arr == '[')
-		arr_end = json_find_closing(result_arr);
+	/* Tokenize the response once; each peer field is then a lookup
+	 * scoped to that peer's object */
+	peers_res = tape_result(&peers_tape, peers_json);
+	if (peers_res < 0 && peers_tape.count > 0 &&
+	    peers_tape.tok[0].type == JSON_ARRAY)
+		peers_res = 0;
+	if (peers_res >= 0 && peers_tape.tok[peers_res].type != JSON_ARRAY)
+		peers_res = -1;
+
+	peers = calloc(peers_res >= 0 ? peers_tape.tok[peers_res].count + 1 : 1,
+	               sizeof(PeerRow));
+	if (!peers) {
+		json_tape_free(&peers_tape);
+		json_tape_free(&net_tape);
+		free(peers_json);
+		free(net_json);
+		free(bc_json);
+		return 1;
+	}
 
 	/* Parse peer objects into structs */
-	p = result_arr;
-	while (*p && peer_count < 256 && (!arr_end || p < arr_end)) {
-		const char *obj = strchr(p, '{');
-		if (!obj || (arr_end && obj >= arr_end)) break;
-		const char *end = json_find_closing(obj);
-		if (!end) break;
-
-		size_t len = end - obj + 1;
-		char *pj = malloc(len + 1);
-		if (!pj) { p = end + 1; continue; }
-		memcpy(pj, obj, len);
-		pj[len] = '\0';
+	for (e = json_tape_child(&peers_tape, peers_res); e >= 0;
+	     e = json_tape_next(&peers_tape, e)) {
+		const JsonTape *t = &peers_tape;
+		if (t->tok[e].type != JSON_OBJECT)
+			continue;
 
 		PeerRow *pr = &peers[peer_count];
-		memset(pr, 0, sizeof(PeerRow));
 
 		/* Direction */
-		json_get_string(pj, "connection_type", pr->conn_type, sizeof(pr->conn_type));
+		json_tape_string(t, json_tape_get(t, e, "connection_type"),
+		                 pr->conn_type, sizeof(pr->conn_type));
 		if (strcmp(pr->conn_type, "inbound") == 0) {
 			pr->is_inbound = 1;
 			inbound++;
 		} else {
-			const char *inb = json_find_value(pj, "inbound");
-			if (inb && strncmp(inb, "true", 4) == 0) {
+			if (json_tape_bool(t, json_tape_get(t, e, "inbound"))) {
 				pr->is_inbound = 1;
 				inbound++;
 			} else {
@@ -836,7 +767,8 @@ static int handle_netinfo(RpcClient *rpc, int level, int outonly)
 			manual++;
 
 		/* Network - track per-direction counts */
-		json_get_string(pj, "network", pr->network, sizeof(pr->network));
+		json_tape_string(t, json_tape_get(t, e, "network"),
+		                 pr->network, sizeof(pr->network));
 		if (pr->is_inbound) {
 			if (strcmp(pr->network, "ipv4") == 0) ipv4_in++;
 			else if (strcmp(pr->network, "ipv6") == 0) ipv6_in++;
@@ -852,30 +784,24 @@ static int handle_netinfo(RpcClient *rpc, int level, int outonly)
 		}
 
 		/* Timing */
-		pr->minping = json_get_double(pj, "minping");
-		pr->pingtime = json_get_double(pj, "pingtime");
-		pr->lastsend = json_get_int(pj, "lastsend");
-		pr->lastrecv = json_get_int(pj, "lastrecv");
-		pr->last_transaction = json_get_int(pj, "last_transaction");
-		pr->last_block = json_get_int(pj, "last_block");
-		pr->conntime = json_get_int(pj, "conntime");
+		pr->minping = json_tape_double(t, json_tape_get(t, e, "minping"));
+		pr->pingtime = json_tape_double(t, json_tape_get(t, e, "pingtime"));
+		pr->lastsend = json_tape_int(t, json_tape_get(t, e, "lastsend"));
+		pr->lastrecv = json_tape_int(t, json_tape_get(t, e, "lastrecv"));
+		pr->last_transaction = json_tape_int(t, json_tape_get(t, e, "last_transaction"));
+		pr->last_block = json_tape_int(t, json_tape_get(t, e, "last_block"));
+		pr->conntime = json_tape_int(t, json_tape_get(t, e, "conntime"));
 
 		/* BIP152 high-bandwidth */
-		{
-			const char *hb_from = json_find_value(pj, "bip152_hb_from");
-			const char *hb_to = json_find_value(pj, "bip152_hb_to");
-			pr->bip152_hb_from = (hb_from && strncmp(hb_from, "true", 4) == 0) ? 1 : 0;
-			pr->bip152_hb_to = (hb_to && strncmp(hb_to, "true", 4) == 0) ? 1 : 0;
-		}
+		pr->bip152_hb_from = json_tape_bool(t, json_tape_get(t, e, "bip152_hb_from"));
+		pr->bip152_hb_to = json_tape_bool(t, json_tape_get(t, e, "bip152_hb_to"));
 
 		/* Address and version */
-		json_get_string(pj, "addr", pr->addr, sizeof(pr->addr));
-		json_get_string(pj, "subver", pr->subver, sizeof(pr->subver));
+		json_tape_string(t, json_tape_get(t, e, "addr"), pr->addr, sizeof(pr->addr));
+		json_tape_string(t, json_tape_get(t, e, "subver"), pr->subver, sizeof(pr->subver));
 
 		total++;
 		peer_count++;
-		free(pj);
-		p = end + 1;
 	}
 
 	/* Header banner from getnetworkinfo */
@@ -884,45 +810,19 @@ static int handle_netinfo(RpcClient *rpc, int level, int outonly)
 		char chain[64] = {0};
 		int protover = 0;
 		/* Extract from net_json result */
-		if (net_json) {
-			const char *nr = json_find_value(net_json, "result");
-			if (nr && *nr == '{') {
-				size_t nlen;
-				const char *nend = json_find_closing(nr);
-				char *nobj;
-				if (nend) {
-					nlen = nend - nr + 1;
-					nobj = malloc(nlen + 1);
-					if (nobj) {
-						memcpy(nobj, nr, nlen);
-						nobj[nlen] = '\0';
-						json_get_string(nobj, "subversion", subver, sizeof(subver));
-						protover = (int)json_get_int(nobj, "protocolversion");
-						free(nobj);
-					}
-				}
-			}
+		if (net_res >= 0) {
+			json_tape_string(&net_tape, json_tape_get(&net_tape, net_res, "subversion"),
+			                 subver, sizeof(subver));
+			protover = (int)json_tape_int(&net_tape,
+			                              json_tape_get(&net_tape, net_res, "protocolversion"));
 		}
 		/* Get chain from getblockchaininfo */
 		{
-			char *bc = rpc_call(rpc, "getblockchaininfo", "[]");
-			if (bc) {
-				const char *br = json_find_value(bc, "result");
-				if (br && *br == '{') {
-					const char *bend = json_find_closing(br);
-					if (bend) {
-						size_t blen = bend - br + 1;
-						char *bobj = malloc(blen + 1);
-						if (bobj) {
-							memcpy(bobj, br, blen);
-							bobj[blen] = '\0';
-							json_get_string(bobj, "chain", chain, sizeof(chain));
-							free(bobj);
-						}
-					}
-				}
-				free(bc);
-			}
+			JsonTape bc_tape;
+			int bc_res = tape_result(&bc_tape, bc_json);
+			json_tape_string(&bc_tape, json_tape_get(&bc_tape, bc_res, "chain"),
+			                 chain, sizeof(chain));
+			json_tape_free(&bc_tape);
 		}
 		/* Strip leading/trailing slashes from subver for display */
 		{
@@ -1055,246 +955,1808 @@ static int handle_netinfo(RpcClient *rpc, int level, int outonly)
 	}
 
 	/* Local services from getnetworkinfo */
-	if (net_json) {
-		const char *nr = json_find_value(net_json, "result");
-		if (nr && *nr == '{') {
-			const char *services = json_find_array(nr, "localservicesnames");
-			if (services) {
-				const char *arr_end = json_find_closing(services);
-				if (arr_end) {
-					printf("\nLocal services:");
-					/* Parse array of strings, bounded by ] */
-					const char *sp = services;
-					int first = 1;
-					while (sp < arr_end) {
-						const char *q = strchr(sp, '"');
-						if (!q || q >= arr_end) break;
-						q++;
-						const char *qe = strchr(q, '"');
-						if (!qe || qe >= arr_end) break;
-						size_t slen = qe - q;
-						if (slen > 0) {
-							/* Print lowercase, underscores as spaces */
-							size_t si;
-							printf("%s ", first ? "" : ",");
-							for (si = 0; si < slen; si++) {
-								char ch = q[si];
-								if (ch == '_') ch = ' ';
-								else if (ch >= 'A' && ch <= 'Z') ch = ch + 32;
-								putchar(ch);
-							}
-							first = 0;
-						}
-						sp = qe + 1;
+	{
+		int services = json_tape_get(&net_tape, net_res, "localservicesnames");
+		if (services >= 0 && net_tape.tok[services].type == JSON_ARRAY) {
+			int first = 1;
+			printf("\nLocal services:");
+			for (e = json_tape_child(&net_tape, services); e >= 0;
+			     e = json_tape_next(&net_tape, e)) {
+				if (net_tape.tok[e].type != JSON_STRING)
+					continue;
+				const char *q = json_tape_text(&net_tape, e) + 1;
+				size_t slen = net_tape.tok[e].len - 2;
+				if (slen > 0) {
+					/* Print lowercase, underscores as spaces */
+					size_t si;
+					printf("%s ", first ? "" : ",");
+					for (si = 0; si < slen; si++) {
+						char ch = q[si];
+						if (ch == '_') ch = ' ';
+						else if (ch >= 'A' && ch <= 'Z') ch = ch + 32;
+						putchar(ch);
 					}
-					printf("\n");
+					first = 0;
 				}
 			}
+			printf("\n");
 		}
 	}
 
 	/* Local addresses */
-	if (net_json) {
-		const char *local = json_find_array(net_json, "localaddresses");
+	{
+		int local = json_tape_get(&net_tape, net_res, "localaddresses");
 		int has_addr = 0;
-		if (local) {
-			const char *la = strchr(local, '{');
-			if (la) {
+		for (e = json_tape_child(&net_tape, local); e >= 0;
+		     e = json_tape_next(&net_tape, e)) {
+			char addr[256] = {0};
+			if (net_tape.tok[e].type != JSON_OBJECT)
+				continue;
+			if (!has_addr) {
 				has_addr = 1;
 				printf("\nLocal addresses:");
-				while (la) {
-					const char *la_end = json_find_closing(la);
-					if (!la_end) break;
-					size_t llen = la_end - la + 1;
-					char *la_obj = malloc(llen + 1);
-					if (la_obj) {
-						char addr[256] = {0};
-						memcpy(la_obj, la, llen);
-						la_obj[llen] = '\0';
-						json_get_string(la_obj, "address", addr, sizeof(addr));
-						int port = (int)json_get_int(la_obj, "port");
-						int score = (int)json_get_int(la_obj, "score");
-						printf("  %s:%d (score %d)", addr, port, score);
-						free(la_obj);
-					}
-					la = strchr(la_end + 1, '{');
-				}
-				printf("\n");
 			}
+			json_tape_string(&net_tape, json_tape_get(&net_tape, e, "address"),
+			                 addr, sizeof(addr));
+			int port = (int)json_tape_int(&net_tape, json_tape_get(&net_tape, e, "port"));
+			int score = (int)json_tape_int(&net_tape, json_tape_get(&net_tape, e, "score"));
+			printf("  %s:%d (score %d)", addr, port, score);
 		}
-		if (!has_addr) {
+		if (has_addr)
+			printf("\n");
+		else
 			printf("\nLocal addresses: n/a\n");
-		}
-		free(net_json);
-	} else {
-		printf("\nLocal addresses: n/a\n");
 	}
 
+	json_tape_free(&net_tape);
+	json_tape_free(&peers_tape);
+	free(net_json);
 	free(peers_json);
+	free(bc_json);
+	free(peers);
 	return 0;
 }
 
-/* Connect with retry for -rpcwait, including warmup wait (error -28) */
-static int rpc_connect_wait(RpcClient *rpc, int timeout_secs)
+/* Streaming reader for -batch input: turns "method arg1 arg2 ..." lines
+ * into JSON-RPC batch arrays a chunk at a time, so memory use does not
+ * grow with the length of the input */
+typedef struct {
+	FILE *in;
+	char *line;       /* getline() buffer, reused for every line */
+	size_t line_cap;
+	char **args;      /* Argument pointers into line */
+	int args_cap;
+	int next_id;      /* JSON-RPC id of the next request (input order) */
+	int eof;
+} BatchReader;
+
+/* Print each result in a batch response array; returns 1 if any failed */
+static int print_batch_response(const char *response)
 {
-	time_t start = time(NULL);
-	int attempt = 0;
+	int ret = 0;
+	const char *p = response;
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
 
-	while (1) {
-		attempt++;
-		if (rpc_connect(rpc) == 0) {
-			/* TCP connected — now check if node is warmed up
-			 * by making a test RPC call */
-			char *response = rpc_call(rpc, "getnetworkinfo", "[]");
-			if (response) {
-				/* Check for warmup error (code -28) */
-				int error_code = 0;
-				char *result = method_extract_result(response, &error_code);
-				free(result);
-				free(response);
+	if (*p != '[') {
+		/* Unexpected — just print it */
+		printf("%s\n", response);
+		return 0;
+	}
 
-				if (error_code == -28) {
-					/* Node is warming up, disconnect and retry */
-					if (attempt == 1)
-						fprintf(stderr, "Waiting for server warmup...\n");
-					rpc_disconnect(rpc);
-					goto wait_and_retry;
-				}
-				/* Node is ready */
-				return 0;
+	/* Parse individual results from the batch response array */
+	const char *arr_end = json_find_closing(p);
+	if (!arr_end)
+		return 0;
+	const char *obj = strchr(p + 1, '{');
+	while (obj && obj < arr_end) {
+		const char *obj_end = json_find_closing(obj);
+		if (!obj_end) break;
+
+		size_t olen = obj_end - obj + 1;
+		char *entry = malloc(olen + 1);
+		if (entry) {
+			int error_code;
+			memcpy(entry, obj, olen);
+			entry[olen] = '\0';
+			char *res = method_extract_result(entry, &error_code);
+			if (res) {
+				const char *rp = res;
+				while (*rp == ' ' || *rp == '\t' || *rp == '\n') rp++;
+				if (*rp == '{' || *rp == '[')
+					fprint_json_pretty(stdout, res, 0);
+				else
+					printf("%s\n", res);
+				free(res);
 			}
-			/* No response — node might be mid-startup, retry */
-			rpc_disconnect(rpc);
-			goto wait_and_retry;
+			if (error_code != 0) ret = 1;
+			free(entry);
 		}
+		obj = strchr(obj_end + 1, '{');
+	}
+	return ret;
+}
 
-wait_and_retry:
-		/* Check timeout */
-		if (timeout_secs > 0) {
-			time_t elapsed = time(NULL) - start;
-			if (elapsed >= timeout_secs) {
-				fprintf(stderr, "error: Timeout waiting for RPC server after %d seconds\n", timeout_secs);
-				return -1;
+/* Read up to max requests from the input and return them as a JSON batch
+ * array. Returns NULL once the input is exhausted (or on allocation
+ * failure, which also ends the input). */
+static char *batch_read_chunk(BatchReader *br, int max)
+{
+	size_t size = 4096, pos = 0;
+	int count = 0;
+	ssize_t len;
+	char *batch;
+
+	if (br->eof)
+		return NULL;
+	batch = malloc(size);
+	if (!batch) {
+		br->eof = 1;
+		return NULL;
+	}
+	batch[pos++] = '[';
+
+	while (count < max) {
+		len = getline(&br->line, &br->line_cap, br->in);
+		if (len < 0) {
+			br->eof = 1;
+			break;
+		}
+
+		/* Trim newline */
+		char *nl = strchr(br->line, '\n');
+		if (nl) *nl = '\0';
+		nl = strchr(br->line, '\r');
+		if (nl) *nl = '\0';
+		if (br->line[0] == '\0') continue;
+
+		/* Parse: method arg1 arg2 ... */
+		char *save_ptr = NULL;
+		char *method_name = strtok_r(br->line, " \t", &save_ptr);
+		if (!method_name) continue;
+
+		/* Collect args */
+		char *tok;
+		int nargs = 0;
+		while ((tok = strtok_r(NULL, " \t", &save_ptr)) != NULL) {
+			if (nargs == br->args_cap) {
+				int cap = br->args_cap ? br->args_cap * 2 : 64;
+				char **tmp = realloc(br->args, cap * sizeof(char *));
+				if (!tmp) break;
+				br->args = tmp;
+				br->args_cap = cap;
 			}
+			br->args[nargs++] = tok;
 		}
 
-		/* Wait before retry */
-		if (attempt == 1) {
-			fprintf(stderr, "Waiting for RPC server...\n");
+		/* Build params */
+		char *params = build_raw_params(nargs, br->args);
+		if (!params) continue;
+
+		/* Append JSON-RPC request object */
+		size_t needed = strlen(method_name) + strlen(params) + 128;
+		if (pos + needed > size) {
+			while (pos + needed > size)
+				size *= 2;
+			char *tmp = realloc(batch, size);
+			if (!tmp) {
+				free(params);
+				free(batch);
+				br->eof = 1;
+				return NULL;
+			}
+			batch = tmp;
 		}
-		sleep(1);
+		if (count > 0) batch[pos++] = ',';
+		pos += snprintf(batch + pos, size - pos,
+			"{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":%s}",
+			br->next_id++, method_name, params);
+		free(params);
+		count++;
+	}
+
+	if (count == 0) {
+		free(batch);
+		return NULL;
 	}
+	batch[pos++] = ']';
+	batch[pos] = '\0';
+	return batch;
 }
 
-int main(int argc, char **argv)
+/* Print a finished chunk's results */
+static int finish_batch_chunk(const char *response)
 {
-	Config cfg;
-	RpcClient rpc;
-	const MethodDef *method = NULL;
-	char *result = NULL;
-
-#ifndef _WIN32
-	signal(SIGPIPE, SIG_IGN);
-#endif
 	int ret;
-	char cookie_path[1024];
-
-	/* Parse command-line arguments */
-	if (config_parse_args(&cfg, argc, argv) < 0)
+	if (!response) {
+		fprintf(stderr, "error: Batch RPC call failed\n");
 		return 1;
-
-	/* Load config file (CLI args take priority) */
-	if (cfg.conf_file[0]) {
-		/* Explicit -conf= path */
-		if (config_parse_file(&cfg, cfg.conf_file) < 0) {
-			fprintf(stderr, "error: Could not read config file: %s\n", cfg.conf_file);
-			return 1;
-		}
-	} else {
-		/* Try default config file in datadir */
-		char conf_path[1024];
-		snprintf(conf_path, sizeof(conf_path), "%s/bitcoin.conf", cfg.datadir);
-		config_parse_file(&cfg, conf_path);  /* Ignore failure - file optional */
 	}
+	ret = print_batch_response(response);
+	/* Results appear as each chunk completes, even through a pipe */
+	fflush(stdout);
+	return ret;
+}
 
-	/* Apply network defaults */
-	config_apply_network_defaults(&cfg);
+/* A chunk of the batch, from being sent until it is printed */
+typedef struct {
+	char *response;   /* Copy of the response, NULL if the chunk failed */
+	int done;
+} BatchSlot;
 
-	/* Set up color output */
-	if (cfg.color == COLOR_ALWAYS) {
-		use_color = 1;
-	} else if (cfg.color == COLOR_AUTO) {
-		/* Auto: use color if stdout is a terminal */
-		use_color = isatty(STDOUT_FILENO);
-	}
-	/* COLOR_NEVER: use_color stays 0 */
+static void batch_chunk_done(void *arg, const char *response, size_t len,
+                             int http_status)
+{
+	BatchSlot *slot = arg;
 
-	/* Show version if requested */
-	if (cfg.version == 1) {
-		print_version();
-		return 0;
+	(void)http_status;
+	slot->response = NULL;
+	if (response) {
+		slot->response = malloc(len + 1);
+		if (slot->response)
+			memcpy(slot->response, response, len + 1);
 	}
-	if (cfg.version == 2) {
-		printf("btc-cli v%s (compatible with Bitcoin Core RPC client v30.2.0)\n", BTC_CLI_VERSION);
-		return 0;
+	slot->done = 1;
+}
+
+/* Run chunks of the batch over nconns connections of the RPC engine, one
+ * chunk in flight on each. A connection takes the next chunk from the
+ * input as soon as its previous one completes, so one slow call only
+ * holds up its own chunk. Responses are printed in input order; at most
+ * `window` chunks are sent or held ahead of the oldest unprinted one,
+ * which bounds memory. */
+static int run_batch_parallel(RpcClient *rpc, BatchReader *br, int chunk,
+                              int nconns)
+{
+	int ret = 0;
+	int window = nconns * 2;
+	BatchSlot *slots = calloc(window, sizeof(BatchSlot));
+	RpcEngine *engine = rpc_engine_new(1);
+	int node = -1;
+
+	/* The engine's connections share the main client's settings; the
+	 * main socket is closed meanwhile (calls after this reconnect) */
+	rpc_disconnect(rpc);
+	if (slots && engine)
+		node = rpc_engine_add_node(engine, rpc, nconns);
+	if (node < 0) {
+		free(slots);
+		rpc_engine_free(engine);
+		return 1;
 	}
 
-	/* Show help if requested */
-	if (cfg.help) {
-		if (cfg.help_cmd[0]) {
-			/* Help for specific command */
-			method = method_find(cfg.help_cmd);
-			if (method) {
-				method_print_help(method);
-			} else {
-				fprintf(stderr, "Unknown command: %s\n", cfg.help_cmd);
-				return 1;
+	int next_chunk = 0, next_print = 0;
+
+	for (;;) {
+		/* Keep the window full */
+		while (next_chunk < next_print + window &&
+		       rpc_engine_live(engine, node) > 0) {
+			char *batch = batch_read_chunk(br, chunk);
+			if (!batch) break;
+			BatchSlot *slot = &slots[next_chunk % window];
+			slot->response = NULL;
+			slot->done = 0;
+			if (rpc_engine_batch(engine, node, batch, batch_chunk_done, slot) < 0)
+				slot->done = 1;
+			next_chunk++;
+			free(batch);
+		}
+
+		/* Print finished chunks that are next in input order */
+		while (next_print < next_chunk && slots[next_print % window].done) {
+			if (finish_batch_chunk(slots[next_print % window].response) != 0)
+				ret = 1;
+			free(slots[next_print % window].response);
+			next_print++;
+		}
+		if (next_print == next_chunk) {
+			if (br->eof)
+				break;
+			if (rpc_engine_live(engine, node) == 0) {
+				/* Every socket failed; nothing can make progress */
+				fprintf(stderr, "error: Batch RPC call failed\n");
+				ret = 1;
+				break;
 			}
-		} else {
-			config_print_usage(argv[0]);
+			continue;
 		}
-		return 0;
-	}
 
-	/* Handle -completions (no RPC connection needed) */
-	if (cfg.completions[0]) {
-		completions_generate(cfg.completions);
-		return 0;
+		rpc_engine_poll(engine, -1);
 	}
 
-	/* Check for special info commands that don't need a command argument */
-	int need_command = 1;
-	if (cfg.getinfo || cfg.netinfo >= 0 || cfg.addrinfo || cfg.generate ||
-	    cfg.batch_mode || cfg.health || cfg.progress) {
-		need_command = 0;
-	}
+	rpc_engine_free(engine);
+	free(slots);
+	return ret;
+}
 
-	/* Need a command (unless using -getinfo or -netinfo) */
-	if (need_command && (cfg.cmd_index < 0 || cfg.cmd_index >= argc)) {
-		config_print_usage(argv[0]);
-		return 1;
-	}
+/* -batch: read commands from stdin and send them as JSON-RPC batches of
+ * chunk requests, printing each batch's results as it completes */
+static int handle_batch(RpcClient *rpc, int chunk, int nconns)
+{
+	BatchReader br;
+	int ret = 0;
+	char *batch;
 
-	const char *command = NULL;
+	memset(&br, 0, sizeof(br));
+	br.in = stdin;
+	br.next_id = 1;
 
-	/* Find command in registry (if not using special flags) */
-	if (need_command) {
-		command = argv[cfg.cmd_index];
-		method = method_find(command);
-		/* Unknown methods are forwarded to the server (like bitcoin-cli) */
+	if (nconns > 1) {
+		ret = run_batch_parallel(rpc, &br, chunk, nconns);
+	} else {
+		while ((batch = batch_read_chunk(&br, chunk)) != NULL) {
+			/* Each response is printed straight from the receive
+			 * buffer, which the next chunk reuses */
+			const char *response = NULL;
+			if (rpc_batch_send(rpc, batch) == 0)
+				response = rpc_batch_recv_view(rpc, NULL);
+			free(batch);
+			if (finish_batch_chunk(response) != 0)
+				ret = 1;
+		}
 	}
 
-	/* Initialize RPC client */
-	rpc_init(&rpc, cfg.host, cfg.port);
-	rpc.timeout = cfg.rpc_timeout;
+	free(br.line);
+	free(br.args);
+	return ret;
+}
 
-	/* Set wallet if specified */
-	if (cfg.wallet[0])
-		rpc_set_wallet(&rpc, cfg.wallet);
+/* Outpoints per /rest/getutxos request (bitcoind's MAX_GETUTXOS_OUTPOINTS) */
+#define GETUTXOS_PER_REQUEST 15
+/* Requests -getutxos reads ahead and pipelines at once */
+#define GETUTXOS_REQUESTS RPC_PIPELINE_WINDOW
 
-	/* Read password from stdin if requested */
-	if (cfg.stdinrpcpass) {
-		fprintf(stderr, "RPC password: ");
+/* Parse an outpoint line: "<txid>:<n>", "<txid>-<n>" or "<txid> <n>" */
+static int getutxos_parse(const char *line, BlockOutpoint *op)
+{
+	const char *p = line;
+	char *end;
+	unsigned long n;
+	int i;
+
+	while (isspace((unsigned char)*p))
+		p++;
+	for (i = 0; i < 64; i++) {
+		if (!isxdigit((unsigned char)p[i]))
+			return -1;
+		op->txid[i] = tolower((unsigned char)p[i]);
+	}
+	op->txid[64] = '\0';
+	p += 64;
+	if (*p != ':' && *p != '-' && *p != ' ' && *p != '\t')
+		return -1;
+	p++;
+	if (!isdigit((unsigned char)*p))
+		return -1;
+	errno = 0;
+	n = strtoul(p, &end, 10);
+	if (errno || n > 0xffffffffUL)
+		return -1;
+	while (isspace((unsigned char)*end))
+		end++;
+	if (*end)
+		return -1;
+	op->n = (uint32_t)n;
+	return 0;
+}
+
+typedef struct {
+	const BlockOutpoint *ops;  /* This round's outpoints */
+	int nops;
+	Network net;
+	int failed;                /* Nonzero once a request has failed */
+} GetutxosRound;
+
+static void getutxos_response(void *arg, int index, const char *body,
+                              size_t len, int http_status)
+{
+	GetutxosRound *round = arg;
+	int first = index * GETUTXOS_PER_REQUEST;
+	int count = round->nops - first;
+	char *lines;
+
+	if (round->failed)
+		return;
+	if (count > GETUTXOS_PER_REQUEST)
+		count = GETUTXOS_PER_REQUEST;
+	if (!body) {
+		if (http_status == 404 || http_status == 403)
+			fprintf(stderr, "error: REST interface not available (HTTP %d); "
+			        "start bitcoind with -rest\n", http_status);
+		else
+			fprintf(stderr, "error: getutxos request failed (HTTP %d)\n",
+			        http_status);
+		round->failed = 1;
+		return;
+	}
+	lines = block_utxos_to_ndjson((const uint8_t *)body, len,
+	                              round->ops + first, count, round->net);
+	if (!lines) {
+		fprintf(stderr, "error: Invalid getutxos response\n");
+		round->failed = 1;
+		return;
+	}
+	fputs(lines, stdout);
+	free(lines);
+}
+
+/* -getutxos: look up the outpoints listed in path (or stdin), one per
+ * line, over /rest/getutxos and print one JSON object per outpoint.
+ * Outpoints are sent 15 to a request, up to GETUTXOS_REQUESTS requests
+ * pipelined at a time, and printed in input order. */
+static int handle_getutxos(RpcClient *rpc, const char *path, Network net)
+{
+	BlockOutpoint *ops;
+	GetutxosRound round;
+	char *paths[GETUTXOS_REQUESTS];
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned long lineno = 0;
+	FILE *in = stdin;
+	int ret = 0, eof = 0;
+	int i;
+
+	if (path[0] && strcmp(path, "-") != 0) {
+		in = fopen(path, "r");
+		if (!in) {
+			fprintf(stderr, "error: Cannot open %s: %s\n", path, strerror(errno));
+			return 1;
+		}
+	}
+	ops = malloc(sizeof(*ops) * GETUTXOS_PER_REQUEST * GETUTXOS_REQUESTS);
+	if (!ops) {
+		if (in != stdin)
+			fclose(in);
+		return 1;
+	}
+
+	memset(&round, 0, sizeof(round));
+	round.ops = ops;
+	round.net = net;
+	while (!eof && !round.failed) {
+		int nreq, done;
+
+		round.nops = 0;
+		while (round.nops < GETUTXOS_PER_REQUEST * GETUTXOS_REQUESTS) {
+			const char *p;
+
+			if (getline(&line, &line_size, in) < 0) {
+				eof = 1;
+				break;
+			}
+			lineno++;
+			for (p = line; isspace((unsigned char)*p); p++)
+				;
+			if (!*p)
+				continue;
+			if (getutxos_parse(line, &ops[round.nops]) < 0) {
+				line[strcspn(line, "\r\n")] = '\0';
+				fprintf(stderr, "error: line %lu: not an outpoint (txid:n): %s\n",
+				        lineno, line);
+				ret = 1;
+				continue;
+			}
+			round.nops++;
+		}
+		if (round.nops == 0)
+			break;
+
+		/* /rest/getutxos/checkmempool/<txid>-<n>/...bin */
+		nreq = (round.nops + GETUTXOS_PER_REQUEST - 1) / GETUTXOS_PER_REQUEST;
+		for (i = 0; i < nreq; i++) {
+			int first = i * GETUTXOS_PER_REQUEST, j, n = 0;
+			int last = first + GETUTXOS_PER_REQUEST;
+
+			if (last > round.nops)
+				last = round.nops;
+			paths[i] = malloc(32 + (last - first) * 77);
+			if (!paths[i]) {
+				round.failed = 1;
+				break;
+			}
+			n = sprintf(paths[i], "/rest/getutxos/checkmempool");
+			for (j = first; j < last; j++)
+				n += sprintf(paths[i] + n, "/%s-%u", ops[j].txid, ops[j].n);
+			strcpy(paths[i] + n, ".bin");
+		}
+		if (!round.failed) {
+			done = rpc_rest_pipelined(rpc, (const char *const *)paths, nreq,
+			                          getutxos_response, &round);
+			if (done < nreq && !round.failed) {
+				fprintf(stderr, "error: Could not connect to the server\n");
+				round.failed = 1;
+			}
+		}
+		while (i-- > 0)
+			free(paths[i]);
+		fflush(stdout);
+	}
+
+	free(line);
+	free(ops);
+	if (in != stdin)
+		fclose(in);
+	return round.failed ? 1 : ret;
+}
+
+/* Heights resolved per getblockhash batch, and how far -range resolves
+ * hashes ahead of the blocks it has fetched */
+#define RANGE_HASH_CHUNK 1000
+#define RANGE_HASH_AHEAD (2 * RANGE_HASH_CHUNK)
+/* getblock calls -range keeps in flight per connection */
+#define RANGE_DEPTH 8
+
+/* Write the result of a getblock response as one NDJSON line, or report
+ * its error. Returns 0, or the exit code for the error. */
+static int range_print_block(const char *response)
+{
+	const char *error, *result, *end;
+	int code = 0;
+	char *msg;
+
+	if (!response) {
+		fprintf(stderr, "error: getblock call failed\n");
+		return 1;
+	}
+	error = json_object_get(response, "error");
+	result = json_object_get(response, "result");
+	if (error && *error == '{') {
+		msg = method_extract_result(response, &code);
+		if (code != 0) {
+			fprintf(stderr, "%s\n", msg);
+			free(msg);
+			return abs(code);
+		}
+		free(msg);
+	}
+	if (!result)
+		end = NULL;
+	else if (*result == '"')
+		end = json_skip_string(result);
+	else if ((end = json_find_closing(result)) != NULL)
+		end++;
+	if (!end) {
+		fprintf(stderr, "error: Invalid JSON-RPC response\n");
+		return 1;
+	}
+	fwrite(result, 1, end - result, stdout);
+	putchar('\n');
+	return 0;
+}
+
+/* Take the hashes out of a getblockhash batch response for heights from
+ * first. Returns how many heights resolved; the call for the next one
+ * failed if that is fewer than asked for, and *ret and *error (the
+ * message, for once the blocks before it are written) are set. */
+static int range_take_hashes(const char *response, int64_t first, int count,
+                             char (*hashes)[65], int *ret, char **error)
+{
+	JsonTape tape;
+	int n = 0, idx;
+
+	memset(&tape, 0, sizeof(tape));
+	if (!response || json_tape_parse(&tape, response, strlen(response)) < 0 ||
+	    tape.count == 0 || tape.tok[0].type != JSON_ARRAY) {
+		/* No response, or the whole batch was refused */
+		int code = 0;
+
+		*error = response ? method_extract_result(response, &code) : NULL;
+		if (!code) {
+			free(*error);
+			*error = strdup("error: getblockhash batch failed");
+		}
+		*ret = code ? abs(code) : 1;
+		json_tape_free(&tape);
+		return 0;
+	}
+	/* Elements come back in the order they were sent */
+	for (idx = json_tape_child(&tape, 0); idx > 0 && n < count;
+	     idx = json_tape_next(&tape, idx)) {
+		int result = json_tape_get(&tape, idx, "result");
+		char *hash = hashes[(first + n) % RANGE_HASH_AHEAD];
+
+		if (result < 0 || json_tape_string(&tape, result, hash, 65) != 64) {
+			char *elem = strndup(json_tape_text(&tape, idx), tape.tok[idx].len);
+			int code = 0;
+
+			*error = elem ? method_extract_result(elem, &code) : NULL;
+			*ret = code ? abs(code) : 1;
+			free(elem);
+			break;
+		}
+		n++;
+	}
+	if (n < count && !*error) {
+		*error = strdup("error: getblockhash batch failed");
+		*ret = 1;
+	}
+	json_tape_free(&tape);
+	return n;
+}
+
+/* Whether a getblock response is for the block at height: by its
+ * "height", or for a raw block, which has none, by the previous block's
+ * hash in its header against prev, the hash the height below resolved
+ * to (NULL if there is none). Errors pass, to be reported as they are. */
+static int range_block_at(const char *response, int64_t height, const char *prev)
+{
+	const char *result = response ? json_object_get(response, "result") : NULL;
+	const char *h;
+	int i;
+
+	if (!result)
+		return 1;
+	if (*result == '{')
+		return (h = json_object_get(result, "height")) != NULL &&
+		       strtoll(h, NULL, 10) == height;
+	if (*result != '"' || !prev || strspn(result + 1, "0123456789abcdef") < 160)
+		return 1;
+	/* Stored byte-reversed from how hashes are shown, after the version */
+	for (i = 0; i < 32; i++)
+		if (memcmp(result + 9 + 2 * i, prev + 62 - 2 * i, 2) != 0)
+			return 0;
+	return 1;
+}
+
+/* The block at height over the main connection, for a hash that was not
+ * it (a stale index entry): resolved again with getblockhash into hash.
+ * Returns the getblock response, or NULL. */
+static char *range_refetch(RpcClient *rpc, int64_t height, const char *verbosity,
+                           char *hash)
+{
+	char params[96], *response, *result;
+	int code = 0;
+
+	snprintf(params, sizeof(params), "[%lld]", (long long)height);
+	response = rpc_call(rpc, "getblockhash", params);
+	result = response ? method_take_result(response, &code) : NULL;
+	if (!result || code != 0 || strlen(result) != 64) {
+		free(result);
+		return NULL;
+	}
+	memcpy(hash, result, 65);
+	free(result);
+	if (verbosity)
+		snprintf(params, sizeof(params), "[\"%s\",%s]", hash, verbosity);
+	else
+		snprintf(params, sizeof(params), "[\"%s\"]", hash);
+	return rpc_call(rpc, "getblock", params);
+}
+
+/* -range=START:END getblock [verbosity]: export blocks START..END as
+ * NDJSON in height order. Heights are resolved to hashes RANGE_HASH_CHUNK
+ * at a time in getblockhash batches, kept ahead of the block fetches; up
+ * to RANGE_DEPTH getblock calls per connection are in flight while
+ * earlier blocks are written out, so fetching overlaps output. Runs of
+ * heights hashidx (NULL for none) has need no getblockhash at all; each
+ * block is checked to be at its height (START - 1 is resolved too, for
+ * the first), and one that is not is fetched again by getblockhash. */
+static int handle_range(RpcClient *rpc, const char *spec, const char *command,
+                        int argc, char **argv, HashIdx *hashidx, int nconns)
+{
+	char (*hashes)[65] = NULL;
+	BatchSlot *slots = NULL, hslot;
+	RpcEngine *engine = NULL;
+	char *hash_error = NULL;
+	int64_t start, end, next_resolve, resolved, next_fetch, next_print;
+	const char *verbosity = NULL;
+	int window = nconns * RANGE_DEPTH;
+	int ret = 0, hash_inflight = 0, stop = 0, node = -1;
+	char *p;
+
+	if (strcmp(command, "getblock") != 0) {
+		fprintf(stderr, "error: -range works with getblock only\n");
+		return 1;
+	}
+	if (argc > 1) {
+		fprintf(stderr, "error: -range takes getblock [verbosity]\n");
+		return 1;
+	}
+	if (argc == 1) {
+		verbosity = argv[0];
+		if (strcmp(verbosity, "true") != 0 && strcmp(verbosity, "false") != 0 &&
+		    (!*verbosity || verbosity[strspn(verbosity, "0123456789")])) {
+			fprintf(stderr, "error: verbosity must be a number or true/false\n");
+			return 1;
+		}
+	}
+
+	/* START:END, or START: for everything up to the current tip */
+	errno = 0;
+	start = strtoll(spec, &p, 10);
+	if (p == spec || *p != ':' || start < 0 || errno) {
+		fprintf(stderr, "error: -range must be START:END\n");
+		return 1;
+	}
+	spec = p + 1;
+	if (*spec) {
+		end = strtoll(spec, &p, 10);
+		if (*p || end < start || errno) {
+			fprintf(stderr, "error: -range must be START:END with START <= END\n");
+			return 1;
+		}
+	} else {
+		char *count = rpc_call(rpc, "getblockcount", "[]");
+		int code = 0;
+		char *result = count ? method_take_result(count, &code) : NULL;
+
+		if (!result || code != 0) {
+			fprintf(stderr, "%s\n", result ? result : "error: getblockcount failed");
+			free(result);
+			return code ? abs(code) : 1;
+		}
+		end = strtoll(result, NULL, 10);
+		free(result);
+		if (end < start)
+			return 0;
+	}
+
+	if (hashidx && hashidx_sync(hashidx, rpc, 0, 0) < 0)
+		hashidx = NULL;
+
+	hashes = malloc(sizeof(*hashes) * RANGE_HASH_AHEAD);
+	slots = calloc(window, sizeof(BatchSlot));
+	engine = rpc_engine_new(RANGE_DEPTH);
+	/* The engine's connections share the main client's settings */
+	rpc_disconnect(rpc);
+	if (hashes && slots && engine)
+		node = rpc_engine_add_node(engine, rpc, nconns);
+	if (node < 0) {
+		ret = 1;
+		goto done;
+	}
+
+	next_fetch = next_print = start;
+	next_resolve = resolved = start > 0 ? start - 1 : 0;
+	for (;;) {
+		if (hash_inflight && hslot.done) {
+			int n = range_take_hashes(hslot.response, next_resolve,
+			                          hash_inflight, hashes, &ret, &hash_error);
+			int i;
+
+			for (i = 0; hashidx && i < n; i++)
+				hashidx_put(hashidx, next_resolve + i,
+				            hashes[(next_resolve + i) % RANGE_HASH_AHEAD]);
+			free(hslot.response);
+			resolved += n;
+			next_resolve += hash_inflight;
+			if (n < hash_inflight)
+				stop = 1;
+			hash_inflight = 0;
+		}
+
+		/* Resolve the next heights while there is room ahead */
+		/* Room is left for the hash below next_print, to check it by */
+		if (!hash_inflight && !stop && next_resolve <= end &&
+		    next_resolve - next_print < RANGE_HASH_AHEAD - RANGE_HASH_CHUNK) {
+			int n = end - next_resolve + 1 > RANGE_HASH_CHUNK
+			        ? RANGE_HASH_CHUNK : (int)(end - next_resolve + 1);
+			char *batch, *b;
+			int i;
+
+			for (i = 0; hashidx && i < n; i++)
+				if (hashidx_get(hashidx, next_resolve + i,
+				                hashes[(next_resolve + i) % RANGE_HASH_AHEAD]) < 0)
+					break;
+			if (hashidx && i == n) {
+				resolved += n;
+				next_resolve += n;
+				continue;
+			}
+			b = batch = malloc((size_t)n * 96 + 2);
+			if (!batch) {
+				ret = 1;
+				break;
+			}
+			*b++ = '[';
+			for (i = 0; i < n; i++)
+				b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,"
+				             "\"method\":\"getblockhash\",\"params\":[%lld]}",
+				             i ? "," : "", i, (long long)(next_resolve + i));
+			strcpy(b, "]");
+			memset(&hslot, 0, sizeof(hslot));
+			if (rpc_engine_batch(engine, node, batch, batch_chunk_done, &hslot) < 0)
+				hslot.done = 1;
+			free(batch);
+			hash_inflight = n;
+		}
+
+		/* Keep the window of getblock calls full */
+		while (next_fetch < resolved && next_fetch < next_print + window) {
+			BatchSlot *slot = &slots[next_fetch % window];
+			char params[96];
+
+			if (verbosity)
+				snprintf(params, sizeof(params), "[\"%s\",%s]",
+				         hashes[next_fetch % RANGE_HASH_AHEAD], verbosity);
+			else
+				snprintf(params, sizeof(params), "[\"%s\"]",
+				         hashes[next_fetch % RANGE_HASH_AHEAD]);
+			slot->response = NULL;
+			slot->done = 0;
+			if (rpc_engine_call(engine, node, "getblock", params, NULL,
+			                    batch_chunk_done, slot) < 0)
+				slot->done = 1;
+			next_fetch++;
+		}
+
+		/* Write finished blocks that are next in height order */
+		while (next_print < next_fetch && slots[next_print % window].done) {
+			BatchSlot *slot = &slots[next_print % window];
+			char *hash = hashes[next_print % RANGE_HASH_AHEAD];
+			int r;
+
+			if (!range_block_at(slot->response, next_print, next_print > 0 ?
+			                    hashes[(next_print - 1) % RANGE_HASH_AHEAD] : NULL)) {
+				free(slot->response);
+				slot->response = range_refetch(rpc, next_print, verbosity, hash);
+				if (slot->response && hashidx)
+					hashidx_put(hashidx, next_print, hash);
+			}
+			r = range_print_block(slot->response);
+
+			free(slot->response);
+			slot->response = NULL;
+			next_print++;
+			if (r != 0) {
+				ret = r;
+				goto done;
+			}
+		}
+		fflush(stdout);
+
+		if (next_print >= resolved && !hash_inflight &&
+		    (stop || next_resolve > end)) {
+			if (hash_error)
+				fprintf(stderr, "%s\n", hash_error);
+			break;
+		}
+		/* Printing may have made room for the next hashes */
+		if (rpc_engine_pending(engine) == 0)
+			continue;
+		if (rpc_engine_poll(engine, -1) < 0) {
+			fprintf(stderr, "error: Could not connect to the server\n");
+			ret = 1;
+			break;
+		}
+	}
+
+done:
+	/* Calls still in flight complete into slots nobody reads */
+	rpc_engine_free(engine);
+	if (slots) {
+		int i;
+		for (i = 0; i < window; i++)
+			free(slots[i].response);
+	}
+	if (hash_inflight)
+		free(hslot.response);
+	free(slots);
+	free(hashes);
+	free(hash_error);
+	return ret;
+}
+
+/* -format=csv for a plain call: rows are written as the response streams
+ * in, so large array results are never held in memory. Returns like a
+ * method handler; *out stays NULL if the table was written, otherwise it
+ * holds the result (or error) for the normal output path. */
+static int call_csv_stream(RpcClient *rpc, const char *command,
+                           const char *params, char **out)
+{
+	JsonStream js;
+	CsvStream *cs;
+	char *response = NULL;
+	int status, r;
+
+	*out = NULL;
+	cs = format_csv_stream_new(stdout);
+	if (!cs) {
+		*out = strdup("error: Out of memory");
+		return 1;
+	}
+	json_stream_init(&js, format_csv_event, cs);
+	status = rpc_call_stream(rpc, command, params, &js);
+	r = format_csv_stream_end(cs, json_stream_finish(&js), &response);
+	json_stream_free(&js);
+
+	if (status < 0 || (status >= 400 && status != 500)) {
+		free(response);
+		if (status == 401) {
+			*out = strdup("error: Authorization failed: Incorrect rpcuser or rpcpassword");
+			return 29;
+		}
+		*out = strdup("error: Could not connect to the server");
+		return 28;
+	}
+	if (r == 0)
+		return 0;
+	if (r < 0 || !response) {
+		*out = strdup("error: Invalid JSON-RPC response");
+		return 1;
+	}
+
+	int error_code;
+	*out = method_take_result(response, &error_code);
+	return error_code != 0 ? abs(error_code) : 0;
+}
+
+/* Long polls for -wait and -watch=onblock are renewed this often, below
+ * bitcoind's default -rpcservertimeout (30s) */
+#define TIP_POLL_MS 25000
+
+typedef struct {
+	char hash[65];
+	int64_t height;
+} ChainTip;
+
+/* waitforblockheight: the node's tip once it reaches height, or when
+ * timeout_ms (0 = none) passes. Returns 0, or the exit code after
+ * printing the error. */
+static int wait_tip(RpcClient *rpc, int64_t height, int timeout_ms, ChainTip *tip)
+{
+	char params[64], *response, *result;
+	int error_code = 0;
+
+	snprintf(params, sizeof(params), "[%lld,%d]", (long long)height, timeout_ms);
+	response = rpc_call(rpc, "waitforblockheight", params);
+	if (!response) {
+		fprintf(stderr, "error: Could not connect to the server\n");
+		return 28;
+	}
+	result = method_take_result(response, &error_code);
+	if (error_code != 0 || !result ||
+	    json_get_string(result, "hash", tip->hash, sizeof(tip->hash)) < 0) {
+		fprintf(stderr, "%s\n", result && error_code ? result : "error: Invalid waitforblockheight response");
+		free(result);
+		return error_code ? abs(error_code) : 1;
+	}
+	tip->height = json_get_int(result, "height");
+	free(result);
+	return 0;
+}
+
+/* Block until the node's tip is no longer tip: a higher block arrives at
+ * once, a replacement at the same height is seen when a poll ends */
+static int wait_new_tip(RpcClient *rpc, ChainTip *tip)
+{
+	char was[65];
+	int ret;
+
+	memcpy(was, tip->hash, sizeof(was));
+	do
+		ret = wait_tip(rpc, tip->height + 1, TIP_POLL_MS, tip);
+	while (ret == 0 && strcmp(tip->hash, was) == 0);
+	return ret;
+}
+
+/* -track-txs: confirmations to wait for unless -wait says otherwise */
+#define TRACK_CONFIRMATIONS 6
+/* Blocks searched for transactions that left the mempool in one round */
+#define TRACK_SCAN_BLOCKS 16
+
+enum { TRACK_UNSEEN, TRACK_MEMPOOL, TRACK_CONFIRMED, TRACK_DONE };
+
+/* An output a tracked transaction spends */
+typedef struct {
+	char txid[65];
+	uint32_t vout;
+} TrackPrevout;
+
+typedef struct {
+	char txid[65];
+	char block[65];     /* Block it is in, once confirmed */
+	int64_t height;     /* ...and its height */
+	int state;
+	TrackPrevout *vin;  /* Outputs it spends, from its lookup */
+	int nvin;
+} TrackTx;
+
+/* A tracked transaction by txid, to match a block's against */
+typedef struct {
+	const char *txid;
+	int index;
+} TrackKey;
+
+typedef struct {
+	TrackTx *txs;
+	int count;
+	int active;         /* Not yet done */
+	int target;
+	int wallet;         /* Look up with gettransaction, not getrawtransaction */
+	int64_t scanned;    /* Height up to which blocks have been searched */
+} Tracker;
+
+/* One NDJSON event; confs < 0 and extra == NULL leave those out */
+static void track_event(const TrackTx *t, const char *event, int64_t confs,
+                        const char *extra_key, const char *extra)
+{
+	printf("{\"txid\":\"%s\",\"event\":\"%s\"", t->txid, event);
+	if (confs >= 0)
+		printf(",\"confirmations\":%lld", (long long)confs);
+	if (t->state == TRACK_CONFIRMED || (t->state == TRACK_DONE && t->block[0]))
+		printf(",\"blockhash\":\"%s\"", t->block);
+	if (extra)
+		printf(",\"%s\":\"%s\"", extra_key, extra);
+	fputs("}\n", stdout);
+}
+
+static void track_done(Tracker *tr, TrackTx *t, const char *event, int64_t confs,
+                       const char *extra_key, const char *extra)
+{
+	if (strcmp(event, "final") != 0)
+		t->block[0] = '\0';
+	t->state = TRACK_DONE;
+	track_event(t, event, confs, extra_key, extra);
+	tr->active--;
+}
+
+/* t is in block, at height, with confs confirmations */
+static void track_confirmed(Tracker *tr, TrackTx *t, const char *block,
+                            int64_t height, int64_t confs)
+{
+	snprintf(t->block, sizeof(t->block), "%s", block);
+	t->height = height;
+	if (confs >= tr->target) {
+		t->state = TRACK_CONFIRMED;
+		track_done(tr, t, "final", confs, NULL, NULL);
+	} else if (t->state != TRACK_CONFIRMED) {
+		t->state = TRACK_CONFIRMED;
+		track_event(t, "confirmed", confs, NULL, NULL);
+	}
+}
+
+/* Error code of a batch element, 0 if it has a result */
+static int track_error(const JsonTape *tape, int elem)
+{
+	int err = json_tape_get(tape, elem, "error");
+	int code;
+
+	if (err < 0 || tape->tok[err].type != JSON_OBJECT)
+		return 0;
+	code = json_tape_get(tape, err, "code");
+	return code > 0 ? (int)json_tape_int(tape, code) : -1;
+}
+
+/* Send a batch and put its elements (in order) into elems. Returns the
+ * element count, or -1 after reporting the error. */
+static int track_batch(RpcClient *rpc, const char *batch, char **response,
+                       JsonTape *tape, int *elems, int max)
+{
+	int n = 0, e;
+
+	memset(tape, 0, sizeof(*tape));
+	*response = rpc_call_batch(rpc, batch);
+	if (!*response) {
+		fprintf(stderr, "error: Could not connect to the server\n");
+		return -1;
+	}
+	if (json_tape_parse(tape, *response, strlen(*response)) < 0 ||
+	    tape->count == 0 || tape->tok[0].type != JSON_ARRAY) {
+		fprintf(stderr, "error: Invalid batch response\n");
+		return -1;
+	}
+	for (e = json_tape_child(tape, 0); e > 0 && n < max; e = json_tape_next(tape, e))
+		elems[n++] = e;
+	if (n != max) {
+		fprintf(stderr, "error: Invalid batch response\n");
+		return -1;
+	}
+	return n;
+}
+
+/* Keep the outputs t spends from its verbose lookup (result r) */
+static void track_keep_vin(TrackTx *t, const JsonTape *tape, int r)
+{
+	int vin = json_tape_get(tape, r, "vin");
+	int v, n = 0;
+
+	if (t->vin || vin < 0 || tape->tok[vin].type != JSON_ARRAY ||
+	    tape->tok[vin].count == 0)
+		return;
+	t->vin = malloc(sizeof(*t->vin) * tape->tok[vin].count);
+	if (!t->vin)
+		return;
+	for (v = json_tape_child(tape, vin); v > 0; v = json_tape_next(tape, v)) {
+		int id = json_tape_get(tape, v, "txid");
+		int out = json_tape_get(tape, v, "vout");
+
+		if (id > 0 && out > 0 &&
+		    json_tape_string(tape, id, t->vin[n].txid, sizeof(t->vin[n].txid)) == 64) {
+			t->vin[n].vout = (uint32_t)json_tape_int(tape, out);
+			n++;
+		}
+	}
+	t->nvin = n;
+}
+
+static int track_key_cmp(const void *a, const void *b)
+{
+	return strcmp(((const TrackKey *)a)->txid, ((const TrackKey *)b)->txid);
+}
+
+/* Confirm the transactions of keys (sorted by txid) that are in the block
+ * of a getblock (verbosity 1) batch element, matching its txids locally */
+static void track_match_block(Tracker *tr, const JsonTape *tape, int elem,
+                              const TrackKey *keys, int nkeys)
+{
+	int r = json_tape_get(tape, elem, "result");
+	int hash = r > 0 ? json_tape_get(tape, r, "hash") : -1;
+	int height = r > 0 ? json_tape_get(tape, r, "height") : -1;
+	int conf = r > 0 ? json_tape_get(tape, r, "confirmations") : -1;
+	int txs = r > 0 ? json_tape_get(tape, r, "tx") : -1;
+	char block[65], txid[65];
+	TrackKey key;
+	const TrackKey *k;
+	int x;
+
+	if (track_error(tape, elem) != 0 || hash < 0 || height < 0 || conf < 0 ||
+	    txs < 0 || json_tape_string(tape, hash, block, sizeof(block)) != 64 ||
+	    json_tape_int(tape, conf) < 1)
+		return;
+	key.txid = txid;
+	for (x = json_tape_child(tape, txs); x > 0; x = json_tape_next(tape, x)) {
+		if (json_tape_string(tape, x, txid, sizeof(txid)) != 64 ||
+		    !(k = bsearch(&key, keys, nkeys, sizeof(*keys), track_key_cmp)))
+			continue;
+		if (tr->txs[k->index].state == TRACK_MEMPOOL)
+			track_confirmed(tr, &tr->txs[k->index], block,
+			                json_tape_int(tape, height), json_tape_int(tape, conf));
+	}
+}
+
+/* Search the blocks before the tip that have not been searched (hashes)
+ * for keys, with a getblock each in one batch. Only a tip more than one
+ * block on, or a reorg, leaves any: the tip's own block comes with the
+ * round. */
+static int track_scan(Tracker *tr, RpcClient *rpc, char (*hashes)[65], int nh,
+                      const TrackKey *keys, int nkeys)
+{
+	char *batch, *b, *response = NULL;
+	int *elems, j, ret = 1;
+	JsonTape tape;
+
+	batch = malloc((size_t)nh * 160 + 2);
+	elems = malloc(sizeof(int) * (nh + 1));
+	memset(&tape, 0, sizeof(tape));
+	if (!batch || !elems)
+		goto out;
+	b = batch;
+	*b++ = '[';
+	for (j = 0; j < nh; j++)
+		b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"getblock\","
+		             "\"params\":[\"%s\",1]}", j ? "," : "", j, hashes[j]);
+	strcpy(b, "]");
+	if (track_batch(rpc, batch, &response, &tape, elems, nh) < 0)
+		goto out;
+	for (j = 0; j < nh; j++)
+		track_match_block(tr, &tape, elems[j], keys, nkeys);
+	ret = 0;
+out:
+	json_tape_free(&tape);
+	free(response);
+	free(batch);
+	free(elems);
+	return ret;
+}
+
+/* The transaction of gone (not yet replaced: by) that spends prevout
+ * txid:vout, or -1 */
+static int track_spender(const Tracker *tr, const int *gone, int ngone,
+                         char (*by)[65], const char *txid, uint32_t vout)
+{
+	int i, v;
+
+	for (i = 0; i < ngone; i++) {
+		const TrackTx *t = &tr->txs[gone[i]];
+
+		if (t->state != TRACK_MEMPOOL || by[i][0])
+			continue;
+		for (v = 0; v < t->nvin; v++)
+			if (t->vin[v].vout == vout && strcmp(t->vin[v].txid, txid) == 0)
+				return i;
+	}
+	return -1;
+}
+
+/* The transactions of gone that left the mempool without being mined:
+ * replaced when another transaction spends one of their outputs now,
+ * else dropped. The mempool is asked first, with one
+ * gettxspendingprevout call for all of them; a replacement mined already
+ * is looked for in the round's new blocks (hashes), fetched with their
+ * transactions only then. */
+static void track_vanished(Tracker *tr, RpcClient *rpc, const int *gone, int ngone,
+                           char (*hashes)[65], int nh)
+{
+	char (*by)[65], *params = NULL, *p, *response = NULL;
+	char txid[65], spender[65];
+	size_t nvin = 0;
+	int i, j, v, r, x = -1, left = 0;
+	JsonTape tape;
+
+	memset(&tape, 0, sizeof(tape));
+	by = calloc(ngone, sizeof(*by));
+	for (i = 0; i < ngone; i++)
+		if (tr->txs[gone[i]].state == TRACK_MEMPOOL) {
+			nvin += tr->txs[gone[i]].nvin;
+			left += tr->txs[gone[i]].nvin > 0;
+		}
+	if (by && nvin > 0 && (params = malloc(nvin * 112 + 8)) != NULL) {
+		p = params;
+		p += sprintf(p, "[[");
+		for (i = 0; i < ngone; i++) {
+			const TrackTx *t = &tr->txs[gone[i]];
+
+			if (t->state != TRACK_MEMPOOL)
+				continue;
+			for (v = 0; v < t->nvin; v++)
+				p += sprintf(p, "%s{\"txid\":\"%s\",\"vout\":%u}",
+				             p == params + 2 ? "" : ",", t->vin[v].txid,
+				             (unsigned)t->vin[v].vout);
+		}
+		strcpy(p, "]]");
+		/* Answered in the order asked; without it (before v24) only
+		 * the blocks are searched */
+		response = rpc_call(rpc, "gettxspendingprevout", params);
+		if (response && json_tape_parse(&tape, response, strlen(response)) == 0 &&
+		    tape.count > 0 && (r = json_tape_get(&tape, 0, "result")) > 0 &&
+		    tape.tok[r].type == JSON_ARRAY)
+			x = json_tape_child(&tape, r);
+		for (i = 0; i < ngone; i++) {
+			TrackTx *t = &tr->txs[gone[i]];
+
+			if (t->state != TRACK_MEMPOOL)
+				continue;
+			for (v = 0; v < t->nvin; v++) {
+				int s = x > 0 ? json_tape_get(&tape, x, "spendingtxid") : -1;
+
+				if (!by[i][0] && s > 0 &&
+				    json_tape_string(&tape, s, spender, sizeof(spender)) == 64 &&
+				    strcmp(spender, t->txid) != 0) {
+					memcpy(by[i], spender, sizeof(spender));
+					left--;
+				}
+				if (x > 0)
+					x = json_tape_next(&tape, x);
+			}
+		}
+	}
+	for (j = 0; j < nh && left > 0; j++) {
+		int txs, tx;
+
+		json_tape_free(&tape);
+		free(response);
+		response = NULL;
+		if (!params)
+			break;
+		sprintf(params, "[\"%s\",2]", hashes[j]);
+		response = rpc_call(rpc, "getblock", params);
+		if (!response || json_tape_parse(&tape, response, strlen(response)) != 0 ||
+		    tape.count == 0 || (r = json_tape_get(&tape, 0, "result")) < 0 ||
+		    (txs = json_tape_get(&tape, r, "tx")) < 0)
+			continue;
+		for (tx = json_tape_child(&tape, txs); tx > 0 && left > 0;
+		     tx = json_tape_next(&tape, tx)) {
+			int id = json_tape_get(&tape, tx, "txid");
+			int vin = json_tape_get(&tape, tx, "vin");
+
+			if (id < 0 || vin < 0 ||
+			    json_tape_string(&tape, id, spender, sizeof(spender)) != 64)
+				continue;
+			for (v = json_tape_child(&tape, vin); v > 0; v = json_tape_next(&tape, v)) {
+				int pid = json_tape_get(&tape, v, "txid");
+				int out = json_tape_get(&tape, v, "vout");
+
+				if (pid > 0 && out > 0 &&
+				    json_tape_string(&tape, pid, txid, sizeof(txid)) == 64 &&
+				    (i = track_spender(tr, gone, ngone, by, txid,
+				                       (uint32_t)json_tape_int(&tape, out))) >= 0 &&
+				    strcmp(spender, tr->txs[gone[i]].txid) != 0) {
+					memcpy(by[i], spender, sizeof(spender));
+					left--;
+				}
+			}
+		}
+	}
+	for (i = 0; i < ngone; i++) {
+		TrackTx *t = &tr->txs[gone[i]];
+
+		if (t->state != TRACK_MEMPOOL)
+			continue;
+		if (by && by[i][0])
+			track_done(tr, t, "replaced", -1, "replaced_by", by[i]);
+		else
+			track_done(tr, t, "dropped", -1, NULL, NULL);
+	}
+	json_tape_free(&tape);
+	free(response);
+	free(params);
+	free(by);
+}
+
+/* One round: the confirmations of the blocks holding confirmed
+ * transactions, a lookup of each unconfirmed one and, without a wallet,
+ * the new block to find those no longer found by txid in, in one batch */
+static int track_round(Tracker *tr, RpcClient *rpc, const ChainTip *tip)
+{
+	char (*blocks)[65] = NULL, (*hashes)[65] = NULL;
+	char *batch = NULL, *b, *response = NULL;
+	int *elems = NULL, *who = NULL, *gone = NULL;
+	int nblocks = 0, nlook = 0, nscan = 0, ngone = 0, nunconf = 0, n, i, j, ret = 1;
+	int64_t h, first, rescan = -1;
+	JsonTape tape;
+
+	memset(&tape, 0, sizeof(tape));
+	/* Blocks not yet searched for transactions that leave the mempool,
+	 * while there are any to leave it: the tip's comes with the round,
+	 * the hashes of the others (if it moved on by more than a block) are
+	 * asked for */
+	for (i = 0; i < tr->count; i++)
+		if (tr->txs[i].state == TRACK_UNSEEN || tr->txs[i].state == TRACK_MEMPOOL)
+			nunconf++;
+	first = tr->scanned + 1;
+	if (first < tip->height - TRACK_SCAN_BLOCKS + 1)
+		first = tip->height - TRACK_SCAN_BLOCKS + 1;
+	if (!tr->wallet && nunconf > 0 && first <= tip->height)
+		nscan = (int)(tip->height - first + 1);
+
+	blocks = malloc(sizeof(*blocks) * (tr->count + 1));
+	hashes = malloc(sizeof(*hashes) * (nscan + 1));
+	who = malloc(sizeof(int) * (tr->count + 1));
+	gone = malloc(sizeof(int) * (tr->count + 1));
+	elems = malloc(sizeof(int) * (tr->count + nscan + 1));
+	batch = malloc((size_t)(tr->count + nscan) * 200 + 2);
+	if (!blocks || !hashes || !who || !gone || !elems || !batch)
+		goto out;
+
+	b = batch;
+	*b++ = '[';
+	n = 0;
+	for (i = 0; i < tr->count; i++) {
+		TrackTx *t = &tr->txs[i];
+
+		if (t->state != TRACK_CONFIRMED)
+			continue;
+		for (j = 0; j < nblocks; j++)
+			if (strcmp(blocks[j], t->block) == 0)
+				break;
+		if (j < nblocks)
+			continue;
+		memcpy(blocks[nblocks++], t->block, 65);
+		b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"getblockheader\","
+		             "\"params\":[\"%s\"]}", n ? "," : "", n, t->block);
+		n++;
+	}
+	for (i = 0; i < tr->count; i++) {
+		TrackTx *t = &tr->txs[i];
+
+		if (t->state != TRACK_UNSEEN && t->state != TRACK_MEMPOOL)
+			continue;
+		who[nlook++] = i;
+		if (tr->wallet)
+			b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"gettransaction\","
+			             "\"params\":[\"%s\"]}", n ? "," : "", n, t->txid);
+		else
+			b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"getrawtransaction\","
+			             "\"params\":[\"%s\",1]}", n ? "," : "", n, t->txid);
+		n++;
+	}
+	for (h = first; h < tip->height && nscan > 0; h++, n++)
+		b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"getblockhash\","
+		             "\"params\":[%lld]}", n ? "," : "", n, (long long)h);
+	if (nscan > 0) {
+		b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"getblock\","
+		             "\"params\":[\"%s\",1]}", n ? "," : "", n, tip->hash);
+		n++;
+	}
+	strcpy(b, "]");
+	if (n == 0) {
+		ret = 0;
+		goto out;
+	}
+	if (track_batch(rpc, batch, &response, &tape, elems, n) < 0)
+		goto out;
+
+	/* Confirmed: deeper, done, or reorganized away */
+	for (j = 0; j < nblocks; j++) {
+		int r = json_tape_get(&tape, elems[j], "result");
+		int c = r > 0 ? json_tape_get(&tape, r, "confirmations") : -1;
+		int64_t confs;
+
+		if (track_error(&tape, elems[j]) != 0 || c < 0)
+			continue;
+		confs = json_tape_int(&tape, c);
+		for (i = 0; i < tr->count; i++) {
+			TrackTx *t = &tr->txs[i];
+
+			if (t->state != TRACK_CONFIRMED || strcmp(t->block, blocks[j]) != 0)
+				continue;
+			if (confs < 0) {
+				/* Looked up again from the next round, which searches
+				 * the blocks that replaced this one */
+				if (rescan < 0 || t->height - 1 < rescan)
+					rescan = t->height - 1;
+				t->state = TRACK_MEMPOOL;
+				t->block[0] = '\0';
+				track_event(t, "unconfirmed", 0, NULL, NULL);
+			} else {
+				track_confirmed(tr, t, blocks[j], tip->height - confs + 1, confs);
+			}
+		}
+	}
+
+	/* Unconfirmed: seen, confirmed, replaced or gone */
+	for (j = 0; j < nlook; j++) {
+		TrackTx *t = &tr->txs[who[j]];
+		int e = elems[nblocks + j];
+		int r = json_tape_get(&tape, e, "result");
+		int c, bh, rb;
+		int64_t confs = 0;
+		char block[65] = "", by[65] = "";
+
+		if (track_error(&tape, e) != 0 || r < 0 || tape.tok[r].type != JSON_OBJECT) {
+			/* Unknown to the node when tracking started: without
+			 * -txindex a confirmed one cannot be found by txid, and
+			 * a scan could only find it if it is mined from now on */
+			if (t->state == TRACK_UNSEEN) {
+				track_done(tr, t, "notfound", -1, NULL, NULL);
+				continue;
+			}
+			gone[ngone++] = who[j];
+			continue;
+		}
+		if (!tr->wallet)
+			track_keep_vin(t, &tape, r);
+		c = json_tape_get(&tape, r, "confirmations");
+		bh = json_tape_get(&tape, r, "blockhash");
+		rb = json_tape_get(&tape, r, "replaced_by_txid");
+		if (c > 0)
+			confs = json_tape_int(&tape, c);
+		if (bh > 0)
+			json_tape_string(&tape, bh, block, sizeof(block));
+		if (rb > 0)
+			json_tape_string(&tape, rb, by, sizeof(by));
+
+		if (confs > 0 && block[0]) {
+			track_confirmed(tr, t, block, tip->height - confs + 1, confs);
+		} else if (confs < 0 || by[0]) {
+			/* A conflicting transaction confirmed, or the wallet
+			 * replaced this one (bumpfee) */
+			if (!by[0]) {
+				int wc = json_tape_get(&tape, r, "walletconflicts");
+				int c0 = wc > 0 ? json_tape_child(&tape, wc) : -1;
+
+				if (c0 > 0)
+					json_tape_string(&tape, c0, by, sizeof(by));
+			}
+			track_done(tr, t, "replaced", -1, "replaced_by", by[0] ? by : NULL);
+		} else if (t->state == TRACK_UNSEEN) {
+			t->state = TRACK_MEMPOOL;
+			track_event(t, "mempool", 0, NULL, NULL);
+		}
+	}
+
+	/* Not found: mined into a block not yet searched, replaced or
+	 * dropped */
+	if (ngone > 0) {
+		TrackKey *keys = malloc(sizeof(*keys) * ngone);
+		int nh = 0;
+
+		if (!keys)
+			goto out;
+		for (j = 0; j < ngone; j++) {
+			keys[j].txid = tr->txs[gone[j]].txid;
+			keys[j].index = gone[j];
+		}
+		qsort(keys, ngone, sizeof(*keys), track_key_cmp);
+		if (nscan > 0)
+			track_match_block(tr, &tape, elems[n - 1], keys, ngone);
+		for (j = nblocks + nlook; j < n - (nscan > 0); j++) {
+			int r = json_tape_get(&tape, elems[j], "result");
+
+			if (r > 0 && json_tape_string(&tape, r, hashes[nh], 65) == 64)
+				nh++;
+		}
+		if (nh > 0 && track_scan(tr, rpc, hashes, nh, keys, ngone) != 0) {
+			free(keys);
+			goto out;
+		}
+		free(keys);
+		if (nscan > 0)
+			memcpy(hashes[nh++], tip->hash, 65);
+		track_vanished(tr, rpc, gone, ngone, hashes, nh);
+	}
+	tr->scanned = rescan >= 0 && rescan < tip->height ? rescan : tip->height;
+	ret = 0;
+out:
+	fflush(stdout);
+	json_tape_free(&tape);
+	free(response);
+	free(batch);
+	free(blocks);
+	free(hashes);
+	free(who);
+	free(gone);
+	free(elems);
+	return ret;
+}
+
+/* -track-txs: follow the transactions listed in path (or stdin), one
+ * txid per line, until each has target confirmations, leaves the mempool
+ * or is replaced, writing an NDJSON event at each milestone. Every round
+ * is one batch call, made when the tip changes; a tip more than a block
+ * on, or transactions leaving the mempool unmined, add one more. */
+static int handle_track_txs(RpcClient *rpc, const char *path, int target, int wallet)
+{
+	Tracker tr;
+	ChainTip tip;
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned long lineno = 0;
+	FILE *in = stdin;
+	int ret = 0, bad = 0, cap = 0, i;
+
+	if (path[0] && strcmp(path, "-") != 0) {
+		in = fopen(path, "r");
+		if (!in) {
+			fprintf(stderr, "error: Cannot open %s: %s\n", path, strerror(errno));
+			return 1;
+		}
+	}
+	memset(&tr, 0, sizeof(tr));
+	tr.target = target;
+	tr.wallet = wallet;
+	while (getline(&line, &line_size, in) >= 0) {
+		const char *p = line;
+		size_t len;
+
+		lineno++;
+		while (isspace((unsigned char)*p))
+			p++;
+		len = strcspn(p, " \t\r\n");
+		if (len == 0)
+			continue;
+		for (i = 0; i < 64 && i < (int)len && isxdigit((unsigned char)p[i]); i++)
+			;
+		if (len != 64 || i != 64) {
+			line[strcspn(line, "\r\n")] = '\0';
+			fprintf(stderr, "error: line %lu: not a txid: %s\n", lineno, line);
+			bad = 1;
+			continue;
+		}
+		if (tr.count == cap) {
+			TrackTx *grown;
+
+			cap = cap ? cap * 2 : 1024;
+			grown = realloc(tr.txs, sizeof(*tr.txs) * cap);
+			if (!grown) {
+				bad = 1;
+				break;
+			}
+			tr.txs = grown;
+		}
+		memset(&tr.txs[tr.count], 0, sizeof(*tr.txs));
+		for (i = 0; i < 64; i++)
+			tr.txs[tr.count].txid[i] = tolower((unsigned char)p[i]);
+		tr.count++;
+	}
+	free(line);
+	if (in != stdin)
+		fclose(in);
+	tr.active = tr.count;
+
+	if (tr.count > 0 && (ret = wait_tip(rpc, 0, 0, &tip)) == 0) {
+		tr.scanned = tip.height;
+		while ((ret = track_round(&tr, rpc, &tip)) == 0 && tr.active > 0)
+			if ((ret = wait_new_tip(rpc, &tip)) != 0)
+				break;
+	}
+	for (i = 0; i < tr.count; i++)
+		free(tr.txs[i].vin);
+	free(tr.txs);
+	return ret ? ret : bad;
+}
+
+/* Connect with retry for -rpcwait, including warmup wait (error -28) */
+static int rpc_connect_wait(RpcClient *rpc, int timeout_secs)
+{
+	time_t start = time(NULL);
+	int attempt = 0;
+
+	while (1) {
+		attempt++;
+		if (rpc_connect(rpc) == 0) {
+			/* TCP connected — now check if node is warmed up
+			 * by making a test RPC call */
+			const char *response = rpc_call_view(rpc, "getnetworkinfo", "[]", NULL);
+			if (response) {
+				/* Check for warmup error (code -28) */
+				int error_code = 0;
+				char *result = method_extract_result(response, &error_code);
+				free(result);
+
+				if (error_code == -28) {
+					/* Node is warming up, disconnect and retry */
+					if (attempt == 1)
+						fprintf(stderr, "Waiting for server warmup...\n");
+					rpc_disconnect(rpc);
+					goto wait_and_retry;
+				}
+				/* Node is ready */
+				return 0;
+			}
+			/* No response — node might be mid-startup, retry */
+			rpc_disconnect(rpc);
+			goto wait_and_retry;
+		}
+
+wait_and_retry:
+		/* Check timeout */
+		if (timeout_secs > 0) {
+			time_t elapsed = time(NULL) - start;
+			if (elapsed >= timeout_secs) {
+				fprintf(stderr, "error: Timeout waiting for RPC server after %d seconds\n", timeout_secs);
+				return -1;
+			}
+		}
+
+		/* Wait before retry */
+		if (attempt == 1) {
+			fprintf(stderr, "Waiting for RPC server...\n");
+		}
+		sleep(1);
+	}
+}
+
+/* The -hashindex file: the one given, none, or hashes-<chain>.bin in the
+ * cache directory. Regtest chains differ from node to node, so each gets
+ * its own. Returns 0, or -1 for none. */
+static int hashidx_file(const Config *cfg, char *path, size_t size)
+{
+	char name[300];
+
+	if (strcmp(cfg->hashindex, "none") == 0)
+		return -1;
+	if (cfg->hashindex[0]) {
+		snprintf(path, size, "%s", cfg->hashindex);
+		return 0;
+	}
+	if (cfg->network == NET_REGTEST)
+		snprintf(name, sizeof(name), "hashes-%s-%d", cfg->host, cfg->port);
+	else
+		snprintf(name, sizeof(name), "hashes");
+	return config_cache_path(cfg->network, name, path, size);
+}
+
+int main(int argc, char **argv)
+{
+	Config cfg;
+	RpcClient rpc;
+	const MethodDef *method = NULL;
+	char *result = NULL;
+
+#ifndef _WIN32
+	signal(SIGPIPE, SIG_IGN);
+#endif
+	int ret;
+	char cookie_path[1024];
+	char hashidx_path[1024];
+
+	/* Parse command-line arguments */
+	if (config_parse_args(&cfg, argc, argv) < 0)
+		return 1;
+
+	/* Load config file (CLI args take priority) */
+	if (cfg.conf_file[0]) {
+		/* Explicit -conf= path */
+		if (config_parse_file(&cfg, cfg.conf_file) < 0) {
+			fprintf(stderr, "error: Could not read config file: %s\n", cfg.conf_file);
+			return 1;
+		}
+	} else {
+		/* Try default config file in datadir */
+		char conf_path[1024];
+		snprintf(conf_path, sizeof(conf_path), "%s/bitcoin.conf", cfg.datadir);
+		config_parse_file(&cfg, conf_path);  /* Ignore failure - file optional */
+	}
+
+	/* Apply network defaults */
+	config_apply_network_defaults(&cfg);
+
+	/* Set up color output */
+	if (cfg.color == COLOR_ALWAYS) {
+		use_color = 1;
+	} else if (cfg.color == COLOR_AUTO) {
+		/* Auto: use color if stdout is a terminal */
+		use_color = isatty(STDOUT_FILENO);
+	}
+	/* COLOR_NEVER: use_color stays 0 */
+
+	/* Show version if requested */
+	if (cfg.version == 1) {
+		print_version();
+		return 0;
+	}
+	if (cfg.version == 2) {
+		printf("btc-cli v%s (compatible with Bitcoin Core RPC client v30.2.0)\n", BTC_CLI_VERSION);
+		return 0;
+	}
+
+	/* Show help if requested */
+	if (cfg.help) {
+		if (cfg.help_cmd[0]) {
+			/* Help for specific command */
+			method = method_find(cfg.help_cmd);
+			if (method) {
+				method_print_help(method);
+			} else {
+				fprintf(stderr, "Unknown command: %s\n", cfg.help_cmd);
+				return 1;
+			}
+		} else {
+			config_print_usage(argv[0]);
+		}
+		return 0;
+	}
+
+	/* Handle -completions (no RPC connection needed) */
+	if (cfg.completions[0]) {
+		completions_generate(cfg.completions);
+		return 0;
+	}
+
+	/* Check for special info commands that don't need a command argument */
+	int need_command = 1;
+	if (cfg.getinfo || cfg.netinfo >= 0 || cfg.addrinfo || cfg.generate ||
+	    cfg.batch_mode || cfg.health || cfg.progress || cfg.daemon ||
+	    cfg.getutxos || cfg.stats_range[0] || cfg.subscribe[0] || cfg.track_txs ||
+	    cfg.exporter[0]) {
+		need_command = 0;
+	}
+
+	/* Need a command (unless using -getinfo or -netinfo) */
+	if (need_command && (cfg.cmd_index < 0 || cfg.cmd_index >= argc)) {
+		config_print_usage(argv[0]);
+		return 1;
+	}
+
+	const char *command = NULL;
+
+	/* Find command in registry (if not using special flags) */
+	if (need_command) {
+		command = argv[cfg.cmd_index];
+		method = method_find(command);
+		/* Unknown methods are forwarded to the server (like bitcoin-cli) */
+	}
+
+	/* Initialize RPC client */
+	rpc_init(&rpc, cfg.host, cfg.port);
+	rpc.timeout = cfg.rpc_timeout;
+	rpc.connect_timeout = cfg.connect_timeout;
+	rpc.fastopen = cfg.fastopen;
+
+	/* Set wallet if specified */
+	if (cfg.wallet[0])
+		rpc_set_wallet(&rpc, cfg.wallet);
+
+	/* -daemon needs no credentials of its own: the requests it relays
+	 * carry their invocation's */
+	if (cfg.daemon) {
+		char sock_path[108];
+		if (daemon_socket_path(cfg.daemon_socket, cfg.host, cfg.port, 1,
+		                       sock_path, sizeof(sock_path)) < 0) {
+			fprintf(stderr, "error: No private directory for the daemon socket; use -daemonsocket=<path>\n");
+			return 1;
+		}
+		return daemon_run(&rpc, sock_path);
+	}
+
+	/* -subscribe at a given endpoint does not involve RPC at all */
+	if (cfg.subscribe[0] && cfg.subscribe_endpoint[0])
+		return zmtp_run(NULL, cfg.subscribe, cfg.subscribe_endpoint, cfg.host);
+
+	/* Read password from stdin if requested */
+	if (cfg.stdinrpcpass) {
+		fprintf(stderr, "RPC password: ");
 		read_password_stdin(cfg.password, sizeof(cfg.password));
 		fprintf(stderr, "\n");
 	}
@@ -1316,20 +2778,33 @@ int main(int argc, char **argv)
 		/* Explicit user/password */
 		rpc_auth_userpass(&rpc, cfg.user, cfg.password);
 	} else {
-		/* Try auto-detection: cookie first (for selected network), then config */
+		/* The selected network's cookie. rpcuser and rpcpassword from
+		 * bitcoin.conf came in with the rest of the configuration, so
+		 * there is nothing else to look for. -getutxos only talks
+		 * REST, which takes no authentication. */
 		get_cookie_path(cookie_path, sizeof(cookie_path), cfg.datadir, cfg.network);
 
-		if (rpc_auth_cookie(&rpc, cookie_path) < 0) {
-			/* Try config file auth */
-			if (rpc_auth_auto(&rpc, cfg.datadir) < 0) {
-				fprintf(stderr, "error: Could not find authentication\n");
-				fprintf(stderr, "Tried: %s\n", cookie_path);
-				fprintf(stderr, "Try: -rpcuser=<user> -rpcpassword=<password>\n");
-				return 1;
-			}
+		if (rpc_auth_cookie(&rpc, cookie_path) < 0 && !cfg.getutxos) {
+			fprintf(stderr, "error: Could not find authentication\n");
+			fprintf(stderr, "Tried: %s\n", cookie_path);
+			fprintf(stderr, "Try: -rpcuser=<user> -rpcpassword=<password>\n");
+			return 1;
 		}
 	}
 
+	/* Go through a running btc-cli -daemon for this node, if any */
+	{
+		char sock_path[108];
+		if (daemon_socket_path(cfg.daemon_socket, cfg.host, cfg.port, 0,
+		                       sock_path, sizeof(sock_path)) == 0)
+			rpc_set_local(&rpc, sock_path);
+	}
+
+	/* -exporter connects, and reconnects, on its own: a node that is
+	 * down shows in its metrics instead of stopping it */
+	if (cfg.exporter[0])
+		return exporter_run(&rpc, cfg.exporter, cfg.exporter_interval);
+
 	/* Connect to node (with retry if -rpcwait) */
 	if (cfg.rpcwait) {
 		if (rpc_connect_wait(&rpc, cfg.rpcwait_timeout) < 0) {
@@ -1503,119 +2978,68 @@ int main(int argc, char **argv)
 
 	/* Handle -batch mode: read commands from stdin, send as batch */
 	if (cfg.batch_mode) {
-		ret = 0;
-		char line[4096];
-		/* Build batch JSON array */
-		size_t batch_size = 4096;
-		size_t batch_pos = 0;
-		char *batch = malloc(batch_size);
-		int req_id = 1;
-		if (!batch) { rpc_disconnect(&rpc); return 1; }
-		batch[batch_pos++] = '[';
-
-		while (fgets(line, sizeof(line), stdin)) {
-			/* Trim newline */
-			char *nl = strchr(line, '\n');
-			if (nl) *nl = '\0';
-			nl = strchr(line, '\r');
-			if (nl) *nl = '\0';
-			if (line[0] == '\0') continue;
-
-			/* Parse: method arg1 arg2 ... */
-			char *save_ptr = NULL;
-			char *tok = strtok_r(line, " \t", &save_ptr);
-			if (!tok) continue;
-			char method_name[256];
-			strncpy(method_name, tok, sizeof(method_name) - 1);
-			method_name[sizeof(method_name) - 1] = '\0';
-
-			/* Collect args */
-			char *args[64];
-			int nargs = 0;
-			while ((tok = strtok_r(NULL, " \t", &save_ptr)) != NULL && nargs < 64)
-				args[nargs++] = tok;
-
-			/* Build params */
-			char *params = build_raw_params(nargs, args);
-			if (!params) continue;
-
-			/* Build JSON-RPC request object */
-			size_t needed = strlen(method_name) + strlen(params) + 128;
-			while (batch_pos + needed > batch_size) {
-				batch_size *= 2;
-				batch = realloc(batch, batch_size);
-				if (!batch) { free(params); rpc_disconnect(&rpc); return 1; }
-			}
-
-			if (req_id > 1) batch[batch_pos++] = ',';
-			batch_pos += snprintf(batch + batch_pos, batch_size - batch_pos,
-				"{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":%s}",
-				req_id++, method_name, params);
-			free(params);
-		}
+		ret = handle_batch(&rpc, cfg.batch_size, cfg.batch_connections);
+		rpc_disconnect(&rpc);
+		return ret;
+	}
 
-		batch[batch_pos++] = ']';
-		batch[batch_pos] = '\0';
+	/* Handle -subscribe: ZMQ notifications at the node's endpoints */
+	if (cfg.subscribe[0]) {
+		ret = zmtp_run(&rpc, cfg.subscribe, NULL, cfg.host);
+		rpc_disconnect(&rpc);
+		return ret;
+	}
 
-		if (req_id == 1) {
-			/* No commands read */
-			free(batch);
-			rpc_disconnect(&rpc);
-			return 0;
-		}
+	/* Handle -getutxos: outpoints from a file or stdin, over REST */
+	if (cfg.getutxos) {
+		ret = handle_getutxos(&rpc, cfg.getutxos_file, cfg.network);
+		rpc_disconnect(&rpc);
+		return ret;
+	}
 
-		/* Send batch request */
-		char *response = rpc_call_batch(&rpc, batch);
-		free(batch);
+	/* Handle -track-txs: confirmation events for many transactions */
+	if (cfg.track_txs) {
+		ret = handle_track_txs(&rpc, cfg.track_txs_file,
+		                       cfg.wait_confirms > 0 ? cfg.wait_confirms : TRACK_CONFIRMATIONS,
+		                       cfg.wallet[0] != 0);
+		rpc_disconnect(&rpc);
+		return ret;
+	}
 
-		if (response) {
-			/* Pretty print the batch response array */
-			const char *p = response;
-			while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
-
-			if (*p == '[') {
-				/* Parse individual results from the batch response array */
-				const char *arr_end = json_find_closing(p);
-				if (arr_end) {
-					const char *obj = strchr(p + 1, '{');
-					while (obj && obj < arr_end) {
-						const char *obj_end = json_find_closing(obj);
-						if (!obj_end) break;
-
-						size_t olen = obj_end - obj + 1;
-						char *entry = malloc(olen + 1);
-						if (entry) {
-							int error_code;
-							memcpy(entry, obj, olen);
-							entry[olen] = '\0';
-							char *res = method_extract_result(entry, &error_code);
-							if (res) {
-								const char *rp = res;
-								while (*rp == ' ' || *rp == '\t' || *rp == '\n') rp++;
-								if (*rp == '{' || *rp == '[')
-									fprint_json_pretty(stdout, res, 0);
-								else
-									printf("%s\n", res);
-								free(res);
-							} else if (error_code == 0) {
-								/* null result */
-							}
-							if (error_code != 0) ret = 1;
-							free(entry);
-						}
-						obj = strchr(obj_end + 1, '{');
-					}
-				}
-			} else {
-				/* Unexpected — just print it */
-				printf("%s\n", response);
-			}
-			free(response);
-		} else {
-			fprintf(stderr, "error: Batch RPC call failed\n");
-			ret = 1;
+	/* Handle -stats-range: getblockstats reduced to a summary */
+	if (cfg.stats_range[0]) {
+		char stats_cache[512], *summary = NULL;
+		const char *cache = stats_cache;
+		HashIdx *hashidx = NULL;
+
+		if (strcmp(cfg.stats_cache, "none") == 0)
+			cache = NULL;
+		else if (cfg.stats_cache[0])
+			cache = cfg.stats_cache;
+		else if (config_cache_path(cfg.network, "stats", stats_cache, sizeof(stats_cache)) < 0)
+			cache = NULL;
+		if (hashidx_file(&cfg, hashidx_path, sizeof(hashidx_path)) == 0)
+			hashidx = hashidx_open(hashidx_path);
+		ret = stats_run(&rpc, cfg.stats_range, cfg.stats_bucket, cache,
+		                hashidx, cfg.batch_connections, &summary);
+		if (summary) {
+			fprint_json_pretty(stdout, summary, 0);
+			free(summary);
 		}
+		hashidx_close(hashidx);
+		rpc_disconnect(&rpc);
+		return ret;
+	}
 
+	/* Handle -range: a block range as NDJSON */
+	if (cfg.range[0] && command) {
+		HashIdx *hashidx = NULL;
+
+		if (hashidx_file(&cfg, hashidx_path, sizeof(hashidx_path)) == 0)
+			hashidx = hashidx_open(hashidx_path);
+		ret = handle_range(&rpc, cfg.range, command, argc - cfg.cmd_index - 1,
+		                   &argv[cfg.cmd_index + 1], hashidx, cfg.batch_connections);
+		hashidx_close(hashidx);
 		rpc_disconnect(&rpc);
 		return ret;
 	}
@@ -1628,6 +3052,34 @@ int main(int argc, char **argv)
 	if (cfg.verify)
 		method_set_verify(cfg.verify, cfg.verify_peers, cfg.network);
 
+	/* Decode blocks and transactions fetched over REST */
+	if (cfg.rest)
+		method_set_rest(1, cfg.network);
+
+	/* Keep immutable results on disk. Regtest chains differ from node to
+	 * node, so each gets its own file. */
+	if (cfg.cache_dir[0]) {
+		const char *chain = config_network_subdir(cfg.network);
+		char cache_path[1024];
+
+		mkdir(cfg.cache_dir, 0700);
+		if (cfg.network == NET_REGTEST)
+			snprintf(cache_path, sizeof(cache_path), "%s/cache-regtest-%s-%d.bin",
+			         cfg.cache_dir, cfg.host, cfg.port);
+		else
+			snprintf(cache_path, sizeof(cache_path), "%s/cache-%s.bin",
+			         cfg.cache_dir, chain[0] ? chain : "main");
+		method_set_cache(cache_path, (size_t)cfg.cache_size << 20);
+	}
+
+	/* Resolve heights through the index, opened when first needed. Only
+	 * getblock and getblockheader take heights, so other commands skip
+	 * even finding its directory. */
+	if (command && (strcmp(command, "getblock") == 0 ||
+	                strcmp(command, "getblockheader") == 0) &&
+	    hashidx_file(&cfg, hashidx_path, sizeof(hashidx_path)) == 0)
+		method_set_hashidx(hashidx_path);
+
 	/* Set up fallback broadcast if configured */
 	if (fallback_has_any(&cfg.fallback))
 		method_set_fallback(&cfg.fallback);
@@ -1731,11 +3183,36 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	do { /* -watch=N loop: execute, format, output, repeat */
+	/* Plain -format=csv calls stream their rows (see call_csv_stream) */
+	char *stream_params = NULL;
+	if (cfg.format == 2 && !cfg.field[0] && !cfg.human && !cfg.sats_mode &&
+	    cfg.wait_confirms == 0) {
+		if (method)
+			stream_params = method_call_params(method, all_argc, all_argv);
+		else
+			stream_params = build_raw_params(all_argc, all_argv);
+	}
+
+	/* -wait and -watch=onblock re-run the command when the tip moves. The
+	 * tip is learned before the first run, so a block that arrives while
+	 * it runs is not waited for. */
+	ChainTip tip = { "", -1 };
+	if ((cfg.wait_confirms > 0 || cfg.watch_onblock) &&
+	    (ret = wait_tip(&rpc, 0, 0, &tip)) != 0) {
+		free(stream_params);
+		rpc_disconnect(&rpc);
+		return ret;
+	}
+
+	do { /* -watch loop: execute, format, output, repeat */
 
 	/* Execute command handler */
-	if (method) {
-		ret = method->handler(&rpc, all_argc, all_argv, &result);
+	if (stream_params) {
+		ret = call_csv_stream(&rpc, command, stream_params, &result);
+		if (!result)
+			goto watch_next;
+	} else if (method) {
+		ret = method->handler(&rpc, method, all_argc, all_argv, &result);
 	} else {
 		/* Unknown method: forward to server (matches bitcoin-cli behavior) */
 		char *params = build_raw_params(all_argc, all_argv);
@@ -1751,13 +3228,12 @@ int main(int argc, char **argv)
 			}
 		} else {
 			int error_code;
-			result = method_extract_result(response, &error_code);
-			free(response);
+			result = method_take_result(response, &error_code);
 			ret = error_code != 0 ? abs(error_code) : 0;
 		}
 	}
 
-	/* Handle -wait=N: poll until confirmations >= N */
+	/* Handle -wait=N: re-run on each new tip until confirmations >= N */
 	if (cfg.wait_confirms > 0 && ret == 0 && result) {
 		while (1) {
 			const char *rp = result;
@@ -1772,21 +3248,22 @@ int main(int argc, char **argv)
 				break;  /* Not a JSON object, can't check confirmations */
 			}
 
-			sleep(2);
+			ret = wait_new_tip(&rpc, &tip);
+			if (ret != 0)
+				break;
 
 			/* Re-execute command */
 			free(result);
 			result = NULL;
 			if (method) {
-				ret = method->handler(&rpc, all_argc, all_argv, &result);
+				ret = method->handler(&rpc, method, all_argc, all_argv, &result);
 			} else {
 				char *params = build_raw_params(all_argc, all_argv);
 				char *response = rpc_call(&rpc, command, params ? params : "[]");
 				free(params);
 				if (response) {
 					int error_code;
-					result = method_extract_result(response, &error_code);
-					free(response);
+					result = method_take_result(response, &error_code);
 					ret = error_code != 0 ? abs(error_code) : 0;
 				} else {
 					ret = 28;
@@ -1816,64 +3293,59 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Apply -field extraction */
+	/* Apply -field extraction: containers are printed in place from the
+	 * result, scalars are copied out */
+	const char *out_json = result;
+	size_t out_len = result ? strlen(result) : 0;
 	if (result && cfg.field[0] && ret == 0) {
 		const char *p = result;
 		while (*p == ' ' || *p == '\t' || *p == '\n') p++;
 		if (*p == '{' || *p == '[') {
-			char *extracted = format_extract_field(result, cfg.field);
-			if (extracted) {
-				free(result);
-				result = extracted;
-			} else {
+			size_t vlen;
+			const char *val = format_find_field(result, cfg.field, &vlen);
+			if (!val) {
 				fprintf(stderr, "error: field '%s' not found\n", cfg.field);
 				free(result);
 				result = NULL;
 				ret = 1;
-			}
-		}
-	}
-
-	/* Apply -human transformation */
-	if (result && cfg.human && ret == 0) {
-		const char *rp = result;
-		while (*rp == ' ' || *rp == '\t' || *rp == '\n') rp++;
-		if (*rp == '{' || *rp == '[') {
-			char *humanized = format_human(result);
-			if (humanized) {
+			} else if (*val == '{' || *val == '[') {
+				out_json = val;
+				out_len = vlen;
+			} else {
+				/* Strings are extracted without quotes */
+				if (*val == '"') {
+					val++;
+					vlen -= 2;
+				}
+				char *extracted = strndup(val, vlen);
 				free(result);
-				result = humanized;
+				result = extracted;
+				out_json = result;
+				out_len = vlen;
 			}
 		}
 	}
 
-	/* Apply -sats conversion */
-	if (result && cfg.sats_mode && ret == 0) {
+	/* Apply -sats to a bare number; JSON is converted as it prints */
+	if (result && cfg.sats_mode && ret == 0 && out_json == result) {
 		const char *rp = result;
 		while (*rp == ' ' || *rp == '\t' || *rp == '\n') rp++;
-		if (*rp == '{' || *rp == '[') {
-			/* JSON structure — use format_sats */
-			char *converted = format_sats(result);
-			if (converted) {
-				free(result);
-				result = converted;
-			}
-		} else {
+		const char *dot = (*rp == '{' || *rp == '[') ? NULL : strchr(rp, '.');
+		if (dot) {
 			/* Bare number — check if it's a BTC amount (8 decimal places) */
-			const char *dot = strchr(rp, '.');
-			if (dot) {
-				int decimals = 0;
-				const char *dp = dot + 1;
-				while (*dp && *dp >= '0' && *dp <= '9') { decimals++; dp++; }
-				if (decimals == 8 && (*dp == '\0' || *dp == '\n')) {
-					double btc = strtod(rp, NULL);
-					long long sats = (long long)(btc * 100000000.0 +
-					                 (btc >= 0 ? 0.5 : -0.5));
-					char satbuf[32];
-					snprintf(satbuf, sizeof(satbuf), "%lld", sats);
-					free(result);
-					result = strdup(satbuf);
-				}
+			int decimals = 0;
+			const char *dp = dot + 1;
+			while (*dp && *dp >= '0' && *dp <= '9') { decimals++; dp++; }
+			if (decimals == 8 && (*dp == '\0' || *dp == '\n')) {
+				double btc = strtod(rp, NULL);
+				long long sats = (long long)(btc * 100000000.0 +
+				                 (btc >= 0 ? 0.5 : -0.5));
+				char satbuf[32];
+				snprintf(satbuf, sizeof(satbuf), "%lld", sats);
+				free(result);
+				result = strdup(satbuf);
+				out_json = result;
+				out_len = result ? strlen(result) : 0;
 			}
 		}
 	}
@@ -1881,30 +3353,48 @@ int main(int argc, char **argv)
 	/* Output result */
 	if (result) {
 		/* Check if result looks like JSON */
-		const char *p = result;
-		while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+		const char *p = out_json;
+		while (out_len > 0 && (*p == ' ' || *p == '\t' || *p == '\n')) {
+			p++;
+			out_len--;
+		}
 
 		/* Errors go to stderr, normal output to stdout */
 		FILE *dest = (ret != 0) ? stderr : stdout;
 
-		/* Apply -format=table or -format=csv for arrays */
-		if (cfg.format == 1 && *p == '[' && ret == 0) {
-			if (format_table(dest, result) == 0) {
-				free(result);
-				result = NULL;
-				goto watch_next;
+		/* -human and -sats apply only to successful results */
+		int flags = use_color ? FORMAT_COLOR : 0;
+		if (ret == 0 && cfg.human)
+			flags |= FORMAT_HUMAN;
+		if (ret == 0 && cfg.sats_mode)
+			flags |= FORMAT_SATS;
+
+		if ((cfg.format == 1 || cfg.format == 2) && *p == '[' && ret == 0) {
+			/* -format=table/csv lay out the transformed text */
+			char *text = strndup(p, out_len);
+			if (text && cfg.human) {
+				char *humanized = format_human(text);
+				if (humanized) {
+					free(text);
+					text = humanized;
+				}
 			}
-		} else if (cfg.format == 2 && *p == '[' && ret == 0) {
-			if (format_csv(dest, result) == 0) {
-				free(result);
-				result = NULL;
-				goto watch_next;
+			if (text && cfg.sats_mode) {
+				char *converted = format_sats(text);
+				if (converted) {
+					free(text);
+					text = converted;
+				}
 			}
-		}
-
-		if (*p == '{' || *p == '[') {
-			/* Pretty print JSON */
-			fprint_json_pretty(dest, result, 0);
+			if (text) {
+				int done = cfg.format == 1 ? format_table(dest, text) : format_csv(dest, text);
+				if (done != 0)
+					fprint_json_pretty(dest, text, 0);
+				free(text);
+			}
+		} else if (*p == '{' || *p == '[') {
+			/* Pretty print JSON, transforming values as they go */
+			format_print_json(dest, p, out_len, 0, flags);
 		} else {
 			/* Plain output */
 			fprintf(dest, "%s\n", result);
@@ -1914,13 +3404,15 @@ int main(int argc, char **argv)
 	}
 
 watch_next:
-	/* -watch=N: sleep and repeat */
-	if (cfg.watch_interval > 0 && ret == 0) {
+	/* -watch=N: sleep and repeat; -watch=onblock: repeat on a new tip */
+	if ((cfg.watch_interval > 0 || cfg.watch_onblock) && ret == 0) {
 		fflush(stdout);
-		sleep(cfg.watch_interval);
+		if (cfg.watch_onblock)
+			ret = wait_new_tip(&rpc, &tip);
+		else
+			sleep(cfg.watch_interval);
 		/* Clear screen and print timestamp header */
-		printf("\033[H\033[2J");
-		{
+		if (ret == 0) {
 			time_t now = time(NULL);
 			struct tm *tm = localtime(&now);
 			char tbuf[32];
@@ -1928,18 +3420,24 @@ watch_next:
 				strftime(tbuf, sizeof(tbuf), "%H:%M:%S", tm);
 			else
 				snprintf(tbuf, sizeof(tbuf), "?");
-			printf("Every %ds: %s  [%s]\n\n", cfg.watch_interval,
-			       command ? command : "", tbuf);
+			printf("\033[H\033[2J");
+			if (cfg.watch_onblock)
+				printf("Block %lld: %s  [%s]\n\n", (long long)tip.height,
+				       command ? command : "", tbuf);
+			else
+				printf("Every %ds: %s  [%s]\n\n", cfg.watch_interval,
+				       command ? command : "", tbuf);
 		}
 	}
 
-	} while (cfg.watch_interval > 0 && ret == 0);
+	} while ((cfg.watch_interval > 0 || cfg.watch_onblock) && ret == 0);
 
 	/* Cleanup stdin resources */
 	if (stdin_buf) free(stdin_buf);
 	if (stdin_args) free(stdin_args);
 	if (all_argv != cmd_argv) free(all_argv);
 	if (wp_argv) free(wp_argv);
+	free(stream_params);
 
 	/* Cleanup */
 	rpc_disconnect(&rpc);
@@ -0,0 +1,207 @@
+/* Persistent cache of immutable RPC results (-cache)
+ *
+ * The file is created at its full size (sparse, so only what is written
+ * takes disk space) and mapped whole:
+ *
+ *   header   magic, size limit, end of the records, bucket count
+ *   buckets  offset of the newest record per hash bucket (0 = none)
+ *   records  appended one after another, each linking to the previous
+ *            record of its bucket
+ *
+ * Records are never changed once written; a record is published by
+ * updating its bucket and the end offset after it has been written.
+ * Access is serialized between processes with flock(). When a record
+ * does not fit, the table is emptied and the data blocks given back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "BTCCACH1"
+#define CACHE_BUCKETS 65536
+/* Room for the header, the buckets and some records at least */
+#define CACHE_MIN_LIMIT (4u << 20)
+
+typedef struct {
+	char magic[8];
+	uint64_t limit;
+	uint64_t end;       /* Offset past the last record */
+	uint32_t buckets;
+	uint32_t reserved;
+} CacheHeader;
+
+typedef struct {
+	uint64_t next;      /* Previous record in the bucket, 0 = none */
+	uint64_t hash;
+	uint32_t keylen;
+	uint32_t len;
+	int64_t stamp;
+	/* key, then value, padded to 8 bytes */
+} CacheRecord;
+
+struct Cache {
+	int fd;
+	uint8_t *map;
+	size_t limit;
+};
+
+#define HEADER(c) ((CacheHeader *)(c)->map)
+#define BUCKETS(c) ((uint64_t *)((c)->map + sizeof(CacheHeader)))
+#define DATA_START (sizeof(CacheHeader) + CACHE_BUCKETS * sizeof(uint64_t))
+
+/* FNV-1a */
+static uint64_t key_hash(const char *key, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= (uint8_t)key[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/* Empty the table and give the data blocks back to the filesystem */
+static void cache_reset(Cache *c)
+{
+	CacheHeader *h = HEADER(c);
+
+	memset(BUCKETS(c), 0, CACHE_BUCKETS * sizeof(uint64_t));
+	h->end = DATA_START;
+	if (ftruncate(c->fd, DATA_START) == 0)
+		(void)ftruncate(c->fd, c->limit);
+}
+
+Cache *cache_open(const char *path, size_t limit)
+{
+	Cache *c;
+	struct stat st;
+	CacheHeader h;
+	int fresh;
+
+	if (limit < CACHE_MIN_LIMIT)
+		limit = CACHE_MIN_LIMIT;
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+	c->limit = limit;
+	c->fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (c->fd < 0) {
+		free(c);
+		return NULL;
+	}
+	flock(c->fd, LOCK_EX);
+	if (fstat(c->fd, &st) < 0)
+		goto fail;
+	/* A file in use keeps the size in its header whatever this process
+	 * was asked for: the others have it mapped at that size, and would
+	 * fault on pages cut off under them. Only a new file, or one made
+	 * for another layout, is sized (and started over) here. */
+	fresh = pread(c->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+	        memcmp(h.magic, CACHE_MAGIC, 8) != 0 ||
+	        h.buckets != CACHE_BUCKETS || h.limit < CACHE_MIN_LIMIT ||
+	        h.limit > SIZE_MAX || h.end < DATA_START || h.end > h.limit;
+	if (!fresh)
+		c->limit = (size_t)h.limit;
+	/* An interrupted cache_reset() can leave it short */
+	if ((uint64_t)st.st_size != c->limit && ftruncate(c->fd, c->limit) < 0)
+		goto fail;
+	c->map = mmap(NULL, c->limit, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+	if (c->map == MAP_FAILED) {
+		c->map = NULL;
+		goto fail;
+	}
+	if (fresh) {
+		memset(HEADER(c), 0, sizeof(CacheHeader));
+		HEADER(c)->limit = c->limit;
+		HEADER(c)->buckets = CACHE_BUCKETS;
+		cache_reset(c);
+		memcpy(HEADER(c)->magic, CACHE_MAGIC, 8);
+	}
+	flock(c->fd, LOCK_UN);
+	return c;
+
+fail:
+	flock(c->fd, LOCK_UN);
+	cache_close(c);
+	return NULL;
+}
+
+char *cache_get(Cache *c, const char *key, size_t keylen, int64_t *stamp)
+{
+	uint64_t hash = key_hash(key, keylen);
+	uint64_t off;
+	char *value = NULL;
+
+	flock(c->fd, LOCK_SH);
+	off = BUCKETS(c)[hash % CACHE_BUCKETS];
+	/* Offsets only ever point backwards; anything else is damage */
+	while (off >= DATA_START && off + sizeof(CacheRecord) <= HEADER(c)->end &&
+	       HEADER(c)->end <= c->limit) {
+		const CacheRecord *r = (const CacheRecord *)(c->map + off);
+		const char *k = (const char *)(r + 1);
+
+		if (off + sizeof(*r) + (uint64_t)r->keylen + r->len > HEADER(c)->end ||
+		    r->next >= off)
+			break;
+		if (r->hash == hash && r->keylen == keylen && memcmp(k, key, keylen) == 0) {
+			value = malloc(r->len + 1);
+			if (value) {
+				memcpy(value, k + keylen, r->len);
+				value[r->len] = '\0';
+				*stamp = r->stamp;
+			}
+			break;
+		}
+		off = r->next;
+	}
+	flock(c->fd, LOCK_UN);
+	return value;
+}
+
+int cache_put(Cache *c, const char *key, size_t keylen, const char *value,
+              size_t len, int64_t stamp)
+{
+	uint64_t hash = key_hash(key, keylen);
+	size_t size = (sizeof(CacheRecord) + keylen + len + 7) & ~(size_t)7;
+	uint64_t *bucket = &BUCKETS(c)[hash % CACHE_BUCKETS];
+	CacheRecord *r;
+
+	if (size > c->limit - DATA_START)
+		return -1;
+	flock(c->fd, LOCK_EX);
+	if (HEADER(c)->end + size > c->limit)
+		cache_reset(c);
+	r = (CacheRecord *)(c->map + HEADER(c)->end);
+	r->next = *bucket;
+	r->hash = hash;
+	r->keylen = (uint32_t)keylen;
+	r->len = (uint32_t)len;
+	r->stamp = stamp;
+	memcpy(r + 1, key, keylen);
+	memcpy((char *)(r + 1) + keylen, value, len);
+	*bucket = HEADER(c)->end;
+	HEADER(c)->end += size;
+	flock(c->fd, LOCK_UN);
+	return 0;
+}
+
+void cache_close(Cache *c)
+{
+	if (!c)
+		return;
+	if (c->map)
+		munmap(c->map, c->limit);
+	if (c->fd >= 0)
+		close(c->fd);
+	free(c);
+}
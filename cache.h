@@ -0,0 +1,29 @@
+/* Persistent cache of immutable RPC results (-cache) */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Cache Cache;
+
+/* Open (creating it if needed) the cache file at path. A new file is
+ * bounded to limit bytes; an existing one keeps the bound it was made
+ * with. The file is a sparse, memory-mapped hash table of append-only
+ * records; when a record no longer fits it is emptied and refilled.
+ * Several processes may share it. Returns NULL if it cannot be used. */
+Cache *cache_open(const char *path, size_t limit);
+
+/* Copy of the value stored under key (caller frees), with its stamp in
+ * *stamp, or NULL if there is none */
+char *cache_get(Cache *cache, const char *key, size_t keylen, int64_t *stamp);
+
+/* Store value under key; the newest record for a key wins. Returns 0, or
+ * -1 if the value can never fit. */
+int cache_put(Cache *cache, const char *key, size_t keylen,
+              const char *value, size_t len, int64_t stamp);
+
+void cache_close(Cache *cache);
+
+#endif
@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 /* Default Bitcoin datadir */
 const char *config_default_datadir(void)
@@ -37,6 +39,33 @@ const char *config_network_subdir(Network net)
 	}
 }
 
+int config_cache_path(Network net, const char *name, char *path, size_t size)
+{
+	const char *base = getenv("XDG_CACHE_HOME");
+	const char *chain = config_network_subdir(net);
+	char dir[512];
+	int n;
+
+	if (base && base[0]) {
+		n = snprintf(dir, sizeof(dir), "%s/btc-cli", base);
+	} else {
+		const char *home = getenv("HOME");
+		if (!home || !home[0])
+			return -1;
+		n = snprintf(dir, sizeof(dir), "%s/.cache", home);
+		if (n < 0 || (size_t)n >= sizeof(dir))
+			return -1;
+		mkdir(dir, 0700);
+		n = snprintf(dir, sizeof(dir), "%s/.cache/btc-cli", home);
+	}
+	if (n < 0 || (size_t)n >= sizeof(dir))
+		return -1;
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+		return -1;
+	n = snprintf(path, size, "%s/%s-%s.bin", dir, name, chain[0] ? chain : "main");
+	return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
 static int parse_option(Config *cfg, const char *arg)
 {
 	/* Network selection */
@@ -139,6 +168,39 @@ static int parse_option(Config *cfg, const char *arg)
 		}
 		return 1;
 	}
+	if (strncmp(arg, "-rpcconnecttimeout=", 19) == 0) {
+		cfg->connect_timeout = atoi(arg + 19);
+		if (cfg->connect_timeout < 0) cfg->connect_timeout = 0;
+		return 1;
+	}
+	if (strcmp(arg, "-rpcfastopen") == 0) {
+		cfg->fastopen = 1;
+		return 1;
+	}
+	if (strcmp(arg, "-rest") == 0) {
+		cfg->rest = 1;
+		return 1;
+	}
+	if (strcmp(arg, "-getutxos") == 0) {
+		cfg->getutxos = 1;
+		cfg->getutxos_file[0] = '\0';
+		return 1;
+	}
+	if (strcmp(arg, "-track-txs") == 0) {
+		cfg->track_txs = 1;
+		cfg->track_txs_file[0] = '\0';
+		return 1;
+	}
+	if (strncmp(arg, "-track-txs=", 11) == 0) {
+		cfg->track_txs = 1;
+		strncpy(cfg->track_txs_file, arg + 11, sizeof(cfg->track_txs_file) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-getutxos=", 10) == 0) {
+		cfg->getutxos = 1;
+		strncpy(cfg->getutxos_file, arg + 10, sizeof(cfg->getutxos_file) - 1);
+		return 1;
+	}
 	if (strncmp(arg, "-rpcclienttimeout=", 18) == 0) {
 		cfg->rpc_timeout = atoi(arg + 18);
 		return 1;
@@ -189,6 +251,55 @@ static int parse_option(Config *cfg, const char *arg)
 		cfg->batch_mode = 1;
 		return 1;
 	}
+	if (strncmp(arg, "-batch-size=", 12) == 0) {
+		cfg->batch_size = atoi(arg + 12);
+		if (cfg->batch_size < 1) cfg->batch_size = 1;
+		return 1;
+	}
+	if (strncmp(arg, "-batch-connections=", 19) == 0) {
+		cfg->batch_connections = atoi(arg + 19);
+		if (cfg->batch_connections < 1) cfg->batch_connections = 1;
+		if (cfg->batch_connections > 64) cfg->batch_connections = 64;
+		return 1;
+	}
+	if (strncmp(arg, "-range=", 7) == 0) {
+		strncpy(cfg->range, arg + 7, sizeof(cfg->range) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-stats-range=", 13) == 0) {
+		strncpy(cfg->stats_range, arg + 13, sizeof(cfg->stats_range) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-stats-bucket=", 14) == 0) {
+		cfg->stats_bucket = atoi(arg + 14);
+		if (cfg->stats_bucket < 0) cfg->stats_bucket = 0;
+		return 1;
+	}
+	if (strncmp(arg, "-stats-cache=", 13) == 0) {
+		strncpy(cfg->stats_cache, arg + 13, sizeof(cfg->stats_cache) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-cache=", 7) == 0) {
+		strncpy(cfg->cache_dir, arg + 7, sizeof(cfg->cache_dir) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-cache-size=", 12) == 0) {
+		cfg->cache_size = atoi(arg + 12);
+		if (cfg->cache_size < 4) cfg->cache_size = 4;
+		return 1;
+	}
+	if (strncmp(arg, "-hashindex=", 11) == 0) {
+		strncpy(cfg->hashindex, arg + 11, sizeof(cfg->hashindex) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-subscribe=", 11) == 0) {
+		strncpy(cfg->subscribe, arg + 11, sizeof(cfg->subscribe) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-subscribe-endpoint=", 20) == 0) {
+		strncpy(cfg->subscribe_endpoint, arg + 20, sizeof(cfg->subscribe_endpoint) - 1);
+		return 1;
+	}
 	if (strcmp(arg, "-health") == 0) {
 		cfg->health = 1;
 		return 1;
@@ -197,9 +308,32 @@ static int parse_option(Config *cfg, const char *arg)
 		cfg->progress = 1;
 		return 1;
 	}
+	if (strcmp(arg, "-daemon") == 0) {
+		cfg->daemon = 1;
+		return 1;
+	}
+	if (strncmp(arg, "-daemonsocket=", 14) == 0) {
+		strncpy(cfg->daemon_socket, arg + 14, sizeof(cfg->daemon_socket) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-exporter=", 10) == 0) {
+		strncpy(cfg->exporter, arg + 10, sizeof(cfg->exporter) - 1);
+		return 1;
+	}
+	if (strncmp(arg, "-exporter-interval=", 19) == 0) {
+		cfg->exporter_interval = atoi(arg + 19);
+		if (cfg->exporter_interval < 1) cfg->exporter_interval = 1;
+		return 1;
+	}
+	if (strcmp(arg, "-watch=onblock") == 0) {
+		cfg->watch_onblock = 1;
+		cfg->watch_interval = 0;
+		return 1;
+	}
 	if (strncmp(arg, "-watch=", 7) == 0) {
 		cfg->watch_interval = atoi(arg + 7);
 		if (cfg->watch_interval < 1) cfg->watch_interval = 1;
+		cfg->watch_onblock = 0;
 		return 1;
 	}
 	if (strncmp(arg, "-wait=", 6) == 0) {
@@ -275,7 +409,25 @@ static int parse_option(Config *cfg, const char *arg)
 	if (strncmp(arg, "-rpcconnect=", 12) == 0) {
 		const char *val = arg + 12;
 		const char *colon = strrchr(val, ':');
-		if (colon && colon != val) {
+		const char *bracket = val[0] == '[' ? strchr(val, ']') : NULL;
+		if (bracket) {
+			/* [IPv6]:port — the host is stored without brackets */
+			size_t hostlen = bracket - val - 1;
+			if (hostlen >= sizeof(cfg->host))
+				hostlen = sizeof(cfg->host) - 1;
+			memcpy(cfg->host, val + 1, hostlen);
+			cfg->host[hostlen] = '\0';
+			if (bracket[1] == ':' && bracket[2]) {
+				int port = atoi(bracket + 2);
+				if (port > 0 && port <= 65535 && !cfg->port_set) {
+					cfg->port = port;
+					cfg->port_set = 1;
+				}
+			}
+		} else if (colon && strchr(val, ':') != colon) {
+			/* Bare IPv6 address, no port */
+			strncpy(cfg->host, val, sizeof(cfg->host) - 1);
+		} else if (colon && colon != val) {
 			/* Always extract host before the colon */
 			size_t hostlen = colon - val;
 			if (hostlen >= sizeof(cfg->host))
@@ -337,7 +489,13 @@ static const char *known_flags[] = {
 	"-generate", "-version", "-version=", "-rpcwait", "-stdinrpcpass",
 	"-stdinwalletpassphrase", "-color", "-verify", "-human",
 	"-sats", "-batch", "-health", "-progress",
-	"-watch=", "-wait=",
+	"-watch=", "-wait=", "-batch-size=", "-batch-connections=",
+	"-range=", "-stats-range=", "-stats-bucket=", "-stats-cache=",
+	"-daemon", "-daemonsocket=", "-rpcconnecttimeout=", "-rpcfastopen",
+	"-exporter=", "-exporter-interval=",
+	"-rest", "-getutxos", "-getutxos=", "-cache=", "-cache-size=",
+	"-track-txs", "-track-txs=",
+	"-hashindex=", "-subscribe=", "-subscribe-endpoint=",
 	"-rpcconnect=", "-rpcport=", "-rpcuser=", "-rpcpassword=",
 	"-rpccookiefile=", "-rpcwallet=", "-datadir=", "-conf=",
 	"-rpcclienttimeout=", "-rpcwaittimeout=", "-chain=",
@@ -410,7 +568,12 @@ int config_parse_args(Config *cfg, int argc, char **argv)
 	cfg->network = NET_MAINNET;
 	cfg->netinfo = -1;
 	cfg->rpc_timeout = 900;
+	cfg->connect_timeout = 5000;
 	cfg->verify_peers = 3;
+	cfg->batch_size = 1000;
+	cfg->batch_connections = 1;
+	cfg->cache_size = 256;
+	cfg->exporter_interval = 10;
 	strncpy(cfg->host, "127.0.0.1", sizeof(cfg->host) - 1);
 	strncpy(cfg->datadir, config_default_datadir(), sizeof(cfg->datadir) - 1);
 	cfg->cmd_index = -1;
@@ -638,6 +801,122 @@ void config_print_usage(const char *prog)
 	"  -batch\n"
 	"       Read commands from stdin (one per line), send as JSON-RPC batch\n"
 	"\n"
+	"  -batch-size=<n>\n"
+	"       With -batch, send at most N commands per JSON-RPC batch and print\n"
+	"       each batch's results as they arrive (default: 1000)\n"
+	"\n"
+	"  -batch-connections=<n>\n"
+	"       With -batch, spread the batches over N parallel RPC connections\n"
+	"       (default: 1, max: 64). Output stays in input order\n"
+	"\n"
+	"  -range=<start>:<end>\n"
+	"       With getblock [verbosity], write blocks <start> to <end> (or to\n"
+	"       the tip if <end> is left out) as one JSON value per line, in\n"
+	"       height order. Hashes are resolved in bulk and several blocks are\n"
+	"       fetched ahead while earlier ones are written; -batch-connections\n"
+	"       spreads the fetches over more connections\n"
+	"\n"
+	"  -stats-range=<start>:<end>\n"
+	"       Summarize getblockstats over heights <start> to <end> (or to the\n"
+	"       tip): sum, mean, min, max and 10/25/50/75/90th percentiles of tx\n"
+	"       count, block weight, subsidy and total fee (satoshis) and of the\n"
+	"       average and median feerate (sat/vB). Calls are batched and spread\n"
+	"       over -batch-connections; results are cached per height, so a\n"
+	"       later, longer range only fetches the new heights\n"
+	"\n"
+	"  -stats-bucket=<n>\n"
+	"       With -stats-range, also summarize each run of <n> heights aligned\n"
+	"       to multiples of <n> (2016 for difficulty epochs)\n"
+	"\n"
+	"  -stats-cache=<file>\n"
+	"       Per-height cache for -stats-range, or \"none\" (default:\n"
+	"       stats-<chain>.bin in $XDG_CACHE_HOME/btc-cli or ~/.cache/btc-cli)\n"
+	"\n"
+	"  -rpcconnecttimeout=<n>\n"
+	"       Give up connecting to the node after N milliseconds, or 0 to wait\n"
+	"       as long as the OS does. A node with several addresses (IPv6 and\n"
+	"       IPv4) has them tried in parallel (default: 5000)\n"
+	"\n"
+	"  -rpcfastopen\n"
+	"       Use TCP Fast Open, sending each new connection's first request\n"
+	"       with its SYN once the node has handed out a cookie\n"
+	"       (net.ipv4.tcp_fastopen must allow it on both ends)\n"
+	"\n"
+	"  -rest\n"
+	"       Fetch blocks and transactions for getblock (verbosity 0-2),\n"
+	"       getblockheader and getrawtransaction (hex only) in binary over\n"
+	"       the node's REST interface (bitcoind -rest) and decode them\n"
+	"       locally. Decoded blocks carry no \"fee\" members; calls REST\n"
+	"       cannot serve go over RPC\n"
+	"\n"
+	"  -cache=<dir>\n"
+	"       Keep results that can no longer change in cache-<chain>.bin in\n"
+	"       <dir> and answer repeated calls from it: getblockhash and\n"
+	"       getblock, getblockheader and getrawtransaction (with a blockhash\n"
+	"       or as objects) at least 100 blocks deep, raw blocks and headers,\n"
+	"       decoderawtransaction and decodescript. Confirmations are brought\n"
+	"       up to date with a getblockcount\n"
+	"\n"
+	"  -cache-size=<n>\n"
+	"       Size bound of the -cache file in MiB when it is created; it is\n"
+	"       emptied when full (default: 256)\n"
+	"\n"
+	"  -hashindex=<file>\n"
+	"       Height to block hash index used to resolve heights for getblock,\n"
+	"       getblockheader, -range and -stats-range, or \"none\" (default:\n"
+	"       hashes-<chain>.bin in $XDG_CACHE_HOME/btc-cli or ~/.cache/btc-cli).\n"
+	"       It is checked against the node's chain tips and cut back on a reorg\n"
+	"\n"
+	"  -track-txs[=<file>]\n"
+	"       Follow the transactions listed in the file (default: stdin), one\n"
+	"       txid per line, until each has -wait=<n> confirmations (default:\n"
+	"       6), and print an event per milestone as one JSON object per line:\n"
+	"       mempool, confirmed, final, unconfirmed (reorg), dropped, replaced\n"
+	"       or notfound. All are looked up in one batch each time the tip\n"
+	"       changes, with gettransaction under -rpcwallet and otherwise with\n"
+	"       getrawtransaction. One the node does not know when tracking\n"
+	"       starts is reported notfound and dropped; without -rpcwallet, one\n"
+	"       confirmed before then is only found with -txindex\n"
+	"\n"
+	"  -subscribe=<topic>[,<topic>...]\n"
+	"       Stream the node's ZMQ notifications (hashblock, hashtx, rawblock,\n"
+	"       rawtx, sequence) as one JSON object per line, with the\n"
+	"       publisher's sequence number and a \"missed\" count where it\n"
+	"       skips. Endpoints come from getzmqnotifications; lost connections\n"
+	"       are reconnected. Runs until interrupted\n"
+	"\n"
+	"  -subscribe-endpoint=<address>\n"
+	"       Subscribe at tcp://<host>:<port> or ipc://<path> instead of asking\n"
+	"       the node\n"
+	"\n"
+	"  -getutxos[=<file>]\n"
+	"       Look up outpoints, one <txid>:<n> per line of the file (default:\n"
+	"       stdin), over the node's REST interface, mempool included, and\n"
+	"       print one JSON object per outpoint in input order: txid, vout,\n"
+	"       unspent, bestblock and, if unspent, confirmations, value and\n"
+	"       scriptPubKey as gettxout shows them. Needs bitcoind -rest\n"
+	"\n"
+	"  -daemon\n"
+	"       Keep a pool of connections to the node open and serve them on a\n"
+	"       local socket. Other btc-cli invocations for the same node find\n"
+	"       the socket and send their requests through it (each request\n"
+	"       still carries its own credentials). Runs in the foreground\n"
+	"\n"
+	"  -daemonsocket=<path>\n"
+	"       Socket used by -daemon and looked for by other invocations\n"
+	"       (default: btc-cli-<host>-<port>.sock in $XDG_RUNTIME_DIR, or\n"
+	"       in /tmp/btc-cli-<uid>)\n"
+	"\n"
+	"  -exporter=<addr>:<port>\n"
+	"       Serve node metrics for Prometheus over HTTP at /metrics, and\n"
+	"       /healthz (200 when synced with peers, as -health, else 503).\n"
+	"       Blockchain, mempool, network totals, peers and the wallet's\n"
+	"       balances are fetched in one batch every -exporter-interval and\n"
+	"       scrapes are served from the last one. Runs until interrupted\n"
+	"\n"
+	"  -exporter-interval=<n>\n"
+	"       Seconds between refreshes for -exporter (default: 10)\n"
+	"\n"
 	"  -completions=<shell>\n"
 	"       Generate shell completion script (bash, zsh, or fish)\n"
 	"\n"
@@ -680,11 +959,13 @@ void config_print_usage(const char *prog)
 	"  -progress\n"
 	"       Show blockchain sync progress with percentage and block count\n"
 	"\n"
-	"  -watch=<n>\n"
-	"       Repeat any RPC command every N seconds (like watch(1))\n"
+	"  -watch=<n>|onblock\n"
+	"       Repeat any RPC command every N seconds (like watch(1)), or once\n"
+	"       for each new chain tip, waiting for it with waitforblockheight\n"
 	"\n"
 	"  -wait=<n>\n"
-	"       Wait until transaction has N confirmations before returning\n"
+	"       Wait until transaction has N confirmations before returning,\n"
+	"       checking again each time the chain tip changes\n"
 	"\n"
 	"  -help=<command>\n"
 	"       Show help for a specific RPC command\n"
@@ -3,6 +3,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 /* Network types */
 typedef enum {
 	NET_MAINNET = 0,
@@ -71,6 +73,13 @@ typedef struct {
 	int stdinrpcpass;  /* Read RPC password from stdin */
 	int color;         /* Color output mode */
 	int rpc_timeout;   /* -rpcclienttimeout (seconds, default 900) */
+	int connect_timeout; /* -rpcconnecttimeout (ms, default 5000) */
+	int fastopen;      /* -rpcfastopen: TCP Fast Open */
+	int rest;          /* -rest: blocks and transactions over REST */
+	int getutxos;      /* -getutxos[=file]: bulk UTXO lookups over REST */
+	char getutxos_file[512]; /* Its outpoint list, "" or "-" for stdin */
+	int track_txs;     /* -track-txs[=file]: follow many transactions */
+	char track_txs_file[512]; /* Its txid list, "" or "-" for stdin */
 	int stdinwalletpassphrase;  /* Read wallet passphrase from stdin */
 	char signetchallenge[1024]; /* Custom signet challenge script hex */
 	char signetseednode[256];   /* Custom signet seed node host:port */
@@ -79,9 +88,25 @@ typedef struct {
 	int sats_mode;     /* -sats: display BTC amounts as satoshis */
 	int format;        /* 0=default, 1=table, 2=csv */
 	int batch_mode;    /* -batch: read commands from stdin */
+	int batch_size;    /* -batch-size=N: requests per batch sent */
+	int batch_connections; /* -batch-connections=K: parallel RPC sockets */
+	char range[64];    /* -range=START:END: block range for getblock */
+	char stats_range[64]; /* -stats-range=START:END: getblockstats summary */
+	int stats_bucket;  /* -stats-bucket=N: also per N heights */
+	char stats_cache[512]; /* -stats-cache=file, "none" for no cache */
+	char cache_dir[512]; /* -cache=DIR: keep immutable results on disk */
+	int cache_size;    /* -cache-size=MiB: bound on each cache file */
+	char hashindex[512]; /* -hashindex=file, "none" for no index */
+	char subscribe[64]; /* -subscribe=topic[,topic...]: ZMQ notifications */
+	char subscribe_endpoint[256]; /* -subscribe-endpoint=tcp://host:port */
 	int health;        /* -health: node health check */
 	int progress;      /* -progress: sync progress display */
 	int watch_interval; /* -watch=N: repeat every N seconds */
+	int watch_onblock;  /* -watch=onblock: repeat on each new tip */
+	int daemon;        /* -daemon: serve a local RPC connection pool */
+	char daemon_socket[108]; /* -daemonsocket=path: its Unix socket */
+	char exporter[256]; /* -exporter=addr:port: serve Prometheus metrics */
+	int exporter_interval; /* -exporter-interval=N: refresh every N seconds */
 	int wait_confirms;  /* -wait=N: wait for N confirmations */
 	char completions[16]; /* -completions=bash|zsh|fish */
 	int verify;        /* -verify: P2P tx propagation check */
@@ -113,6 +138,11 @@ const char *config_default_datadir(void);
 /* Get network subdirectory name */
 const char *config_network_subdir(Network net);
 
+/* Cache file <name>-<chain>.bin in $XDG_CACHE_HOME/btc-cli, or in
+ * ~/.cache/btc-cli; the directories are created. Returns 0, or -1 if
+ * there is no such directory. */
+int config_cache_path(Network net, const char *name, char *path, size_t size);
+
 /* Print usage */
 void config_print_usage(const char *prog);
 
@@ -0,0 +1,551 @@
+/* Local RPC connection pool (-daemon)
+ *
+ * Each local connection is paired with an upstream connection to the node
+ * and its bytes are relayed both ways. HTTP framing is followed on the way
+ * through only to know when a pair sits between messages: the upstream
+ * connection then goes back to the pool when the local side closes,
+ * instead of being torn down with it.
+ */
+
+#define _GNU_SOURCE
+#include "daemon.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define DAEMON_MAX_CONNS 128  /* Local connections served at once */
+#define DAEMON_MAX_IDLE 8     /* Idle upstream connections kept open */
+#define DAEMON_IDLE_SECS 20   /* ...for this long (bitcoind's -rpcservertimeout is 30) */
+#define DAEMON_BUF 65536      /* Relay buffer per direction */
+
+/* HTTP framing of one direction of a relayed connection */
+typedef struct {
+	char head[8192];          /* Header of the message being read */
+	size_t head_len;
+	size_t body_left;         /* Body bytes of the message still to come */
+	int in_body;
+	unsigned long messages;   /* Complete messages seen */
+	int unframed;             /* Lost track: the connection cannot be reused */
+} HttpTrack;
+
+/* Bytes read from one side and not yet written to the other */
+typedef struct {
+	char data[DAEMON_BUF];
+	size_t off, len;
+} RelayBuf;
+
+typedef struct {
+	int fd;                   /* Local connection */
+	int up;                   /* Upstream connection to the node */
+	int up_closed;            /* Node closed up: flush to fd, then close */
+	RelayBuf to_up;
+	RelayBuf to_fd;
+	HttpTrack req;            /* fd -> up */
+	HttpTrack resp;           /* up -> fd */
+} DaemonConn;
+
+typedef struct {
+	const RpcClient *upstream;
+	int listen_fd;
+	DaemonConn *conns[DAEMON_MAX_CONNS];
+	int nconns;
+	int idle[DAEMON_MAX_IDLE];        /* Oldest first */
+	time_t idle_since[DAEMON_MAX_IDLE];
+	int idle_count;
+	struct sockaddr_storage node;     /* Where new upstream connections go */
+	socklen_t node_len;               /* 0 = not known */
+	int connecting;                   /* Upstream connection being made, or -1 */
+	time_t connect_since;
+} Daemon;
+
+static volatile sig_atomic_t daemon_stop = 0;
+
+static void daemon_signal(int sig)
+{
+	(void)sig;
+	daemon_stop = 1;
+}
+
+int daemon_socket_path(const char *explicit_path, const char *host, int port,
+                       int create, char *path, size_t size)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+	char tmpdir[64];
+	int n;
+
+	if (explicit_path && explicit_path[0]) {
+		n = snprintf(path, size, "%s", explicit_path);
+		return (n < 0 || (size_t)n >= size) ? -1 : 0;
+	}
+
+	if (!dir || !dir[0]) {
+		struct stat st;
+
+		snprintf(tmpdir, sizeof(tmpdir), "/tmp/btc-cli-%u", (unsigned)getuid());
+		if (create)
+			mkdir(tmpdir, 0700);
+		/* Whoever can place a socket here sees our credentials */
+		if (lstat(tmpdir, &st) < 0 || !S_ISDIR(st.st_mode) ||
+		    st.st_uid != getuid() || (st.st_mode & 077))
+			return -1;
+		dir = tmpdir;
+	}
+
+	n = snprintf(path, size, "%s/btc-cli-%s-%d.sock", dir, host, port);
+	return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+/* Value of a header (name includes the ':'), or NULL */
+static const char *header_value(const char *head, const char *name)
+{
+	size_t n = strlen(name);
+	const char *p = head;
+
+	while ((p = strchr(p, '\n')) != NULL) {
+		p++;
+		if (strncasecmp(p, name, n) == 0) {
+			p += n;
+			while (*p == ' ' || *p == '\t')
+				p++;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+/* A message header is complete: work out how long its body is */
+static void track_head(HttpTrack *t, int response)
+{
+	const char *cl, *conn, *te;
+	long status = 0;
+
+	t->head[t->head_len] = '\0';
+	t->head_len = 0;
+
+	if (response && strncmp(t->head, "HTTP/", 5) == 0) {
+		const char *sp = strchr(t->head, ' ');
+		status = sp ? strtol(sp + 1, NULL, 10) : 0;
+	}
+
+	conn = header_value(t->head, "Connection:");
+	te = header_value(t->head, "Transfer-Encoding:");
+	if ((conn && strncasecmp(conn, "close", 5) == 0) || te) {
+		t->unframed = 1;
+		return;
+	}
+
+	cl = header_value(t->head, "Content-Length:");
+	if (cl)
+		t->body_left = strtoul(cl, NULL, 10);
+	else if (!response || (status >= 100 && status < 200) ||
+	         status == 204 || status == 304)
+		t->body_left = 0;
+	else {
+		t->unframed = 1;  /* Body runs to the end of the connection */
+		return;
+	}
+
+	if (t->body_left > 0)
+		t->in_body = 1;
+	else
+		t->messages++;
+}
+
+static void track(HttpTrack *t, const char *data, size_t len, int response)
+{
+	while (len > 0 && !t->unframed) {
+		if (t->in_body) {
+			size_t n = len < t->body_left ? len : t->body_left;
+			t->body_left -= n;
+			data += n;
+			len -= n;
+			if (t->body_left == 0) {
+				t->in_body = 0;
+				t->messages++;
+			}
+			continue;
+		}
+		if (t->head_len == sizeof(t->head) - 1) {
+			t->unframed = 1;
+			break;
+		}
+		t->head[t->head_len++] = *data++;
+		len--;
+		if (t->head_len >= 4 &&
+		    memcmp(t->head + t->head_len - 4, "\r\n\r\n", 4) == 0)
+			track_head(t, response);
+	}
+}
+
+/* Between messages in both directions, with every request answered */
+static int at_boundary(const DaemonConn *c)
+{
+	return !c->up_closed && c->to_up.len == 0 &&
+	       !c->req.unframed && !c->resp.unframed &&
+	       c->req.head_len == 0 && !c->req.in_body &&
+	       c->resp.head_len == 0 && !c->resp.in_body &&
+	       c->req.messages == c->resp.messages;
+}
+
+/* Write out what b holds, as far as fd takes it without blocking.
+ * Returns -1 if the peer is gone. */
+static int relay_flush(int fd, RelayBuf *b)
+{
+	while (b->off < b->len) {
+		ssize_t n = send(fd, b->data + b->off, b->len - b->off,
+		                 MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return -1;
+		}
+		b->off += n;
+	}
+	b->off = b->len = 0;
+	return 0;
+}
+
+/* Read from one side into the (empty) buffer and pass it on to the other.
+ * Returns 0, -1 if from is closed, -2 if to is. */
+static int relay(int from, int to, RelayBuf *b, HttpTrack *t, int response)
+{
+	ssize_t n = recv(from, b->data, sizeof(b->data), MSG_DONTWAIT);
+
+	if (n < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+	if (n == 0)
+		return -1;
+	b->off = 0;
+	b->len = n;
+	track(t, b->data, n, response);
+	return relay_flush(to, b) < 0 ? -2 : 0;
+}
+
+static void park_upstream(Daemon *d, int sock)
+{
+	if (d->idle_count == DAEMON_MAX_IDLE) {
+		/* Replace the oldest */
+		close(d->idle[0]);
+		memmove(d->idle, d->idle + 1, (DAEMON_MAX_IDLE - 1) * sizeof(d->idle[0]));
+		memmove(d->idle_since, d->idle_since + 1,
+		        (DAEMON_MAX_IDLE - 1) * sizeof(d->idle_since[0]));
+		d->idle_count--;
+	}
+	d->idle[d->idle_count] = sock;
+	d->idle_since[d->idle_count] = time(NULL);
+	d->idle_count++;
+}
+
+/* Close idle connections before the node times them out */
+static void expire_idle(Daemon *d)
+{
+	time_t cutoff = time(NULL) - DAEMON_IDLE_SECS;
+	int n = 0;
+
+	while (n < d->idle_count && d->idle_since[n] <= cutoff)
+		close(d->idle[n++]);
+	if (n > 0) {
+		d->idle_count -= n;
+		memmove(d->idle, d->idle + n, d->idle_count * sizeof(d->idle[0]));
+		memmove(d->idle_since, d->idle_since + n,
+		        d->idle_count * sizeof(d->idle_since[0]));
+	}
+}
+
+/* The connection being made is writable: pool it if it is up */
+static void finish_upstream(Daemon *d)
+{
+	int err = 0;
+	socklen_t len = sizeof(err);
+
+	if (getsockopt(d->connecting, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+		fcntl(d->connecting, F_SETFL, fcntl(d->connecting, F_GETFL) & ~O_NONBLOCK);
+		park_upstream(d, d->connecting);
+	} else {
+		close(d->connecting);
+	}
+	d->connecting = -1;
+}
+
+/* Start a connection to the node for the pool, unless one is on its way.
+ * It is not waited for: the poll loop pools it once it is up. */
+static void start_upstream(Daemon *d)
+{
+	int done;
+
+	if (d->connecting >= 0 || d->node_len == 0)
+		return;
+	d->connecting = rpc_connect_start(d->upstream, (struct sockaddr *)&d->node,
+	                                  d->node_len, &done);
+	d->connect_since = time(NULL);
+	if (d->connecting >= 0 && done)
+		finish_upstream(d);
+}
+
+/* Connect to the node before serving, waiting for it: the connection
+ * warms the pool, and the address that answered is where later ones go.
+ * Without the node, they go to the first address it resolves to.
+ * Returns -1 if the node is not there. */
+static int warm_upstream(Daemon *d)
+{
+	RpcClient client = *d->upstream;
+	struct addrinfo hints, *res;
+	char port[16];
+	int up;
+
+	client.sock = -1;
+	client.local_path[0] = '\0';
+	up = rpc_connect(&client) == 0;
+	if (up) {
+		d->node_len = sizeof(d->node);
+		if (getpeername(client.sock, (struct sockaddr *)&d->node, &d->node_len) < 0)
+			d->node_len = 0;
+		park_upstream(d, client.sock);
+	}
+	if (d->node_len > 0)
+		return 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV;
+	snprintf(port, sizeof(port), "%d", d->upstream->port);
+	if (getaddrinfo(d->upstream->host, port, &hints, &res) == 0) {
+		if (res->ai_addrlen <= sizeof(d->node)) {
+			memcpy(&d->node, res->ai_addr, res->ai_addrlen);
+			d->node_len = res->ai_addrlen;
+		}
+		freeaddrinfo(res);
+	}
+	return up ? 0 : -1;
+}
+
+/* The most recently used idle upstream connection that is still open, or
+ * -1. Once the pool is empty a new connection is started, but not waited
+ * for: a connect in the poll loop would hold up every relayed connection
+ * for as long as the node takes to answer. */
+static int take_upstream(Daemon *d)
+{
+	while (d->idle_count > 0) {
+		int sock = d->idle[--d->idle_count];
+		struct pollfd p;
+
+		/* Readable while idle means closed by the node */
+		p.fd = sock;
+		p.events = POLLIN;
+		p.revents = 0;
+		if (poll(&p, 1, 0) == 0) {
+			if (d->idle_count == 0)
+				start_upstream(d);
+			return sock;
+		}
+		close(sock);
+	}
+	start_upstream(d);
+	return -1;
+}
+
+static void accept_conn(Daemon *d)
+{
+	DaemonConn *c;
+	int fd, up;
+
+	fd = accept(d->listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+
+	/* The client waits for one byte: '+' to go ahead, or anything else
+	 * to connect to the node itself, as it does while the pool is empty */
+	up = take_upstream(d);
+	c = up >= 0 ? calloc(1, sizeof(DaemonConn)) : NULL;
+	if (!c) {
+		if (up >= 0)
+			close(up);
+		send(fd, "-", 1, MSG_NOSIGNAL);
+		close(fd);
+		return;
+	}
+	if (send(fd, "+", 1, MSG_NOSIGNAL) != 1) {
+		park_upstream(d, up);
+		free(c);
+		close(fd);
+		return;
+	}
+	c->fd = fd;
+	c->up = up;
+	d->conns[d->nconns++] = c;
+}
+
+static void close_conn(Daemon *d, int i)
+{
+	DaemonConn *c = d->conns[i];
+
+	if (at_boundary(c) && !daemon_stop)
+		park_upstream(d, c->up);
+	else
+		close(c->up);
+	close(c->fd);
+	free(c);
+	d->conns[i] = d->conns[--d->nconns];
+}
+
+/* Handle poll results for connection i; closes it when done */
+static void serve_conn(Daemon *d, int i, short fd_ev, short up_ev)
+{
+	DaemonConn *c = d->conns[i];
+	int drop = 0;
+	int r;
+
+	if ((up_ev & POLLOUT) && relay_flush(c->up, &c->to_up) < 0)
+		c->up_closed = drop = 1;
+	if ((fd_ev & POLLOUT) && relay_flush(c->fd, &c->to_fd) < 0)
+		drop = 1;
+
+	if (!drop && (fd_ev & (POLLIN | POLLHUP | POLLERR)) && c->to_up.len == 0) {
+		r = relay(c->fd, c->up, &c->to_up, &c->req, 0);
+		if (r == -2)
+			c->up_closed = 1;
+		if (r < 0)
+			drop = 1;
+	}
+	if (!drop && (up_ev & (POLLIN | POLLHUP | POLLERR)) && c->to_fd.len == 0) {
+		r = relay(c->up, c->fd, &c->to_fd, &c->resp, 1);
+		if (r == -1)
+			c->up_closed = 1;
+		else if (r == -2)
+			drop = 1;
+	}
+
+	/* Once the node has hung up, pass on what it sent, then hang up too */
+	if (c->up_closed && c->to_fd.len == 0)
+		drop = 1;
+	if (drop)
+		close_conn(d, i);
+}
+
+int daemon_run(const RpcClient *upstream, const char *path)
+{
+	static Daemon d;
+	static struct pollfd pfd[2 + 2 * DAEMON_MAX_CONNS];
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	mode_t old_mask;
+	int sock, i;
+
+	memset(&d, 0, sizeof(d));
+	d.upstream = upstream;
+	d.connecting = -1;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "error: Socket path too long: %s\n", path);
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, strlen(path));
+
+	/* Refuse to take over a live socket; clear away a stale one */
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock >= 0 && connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		fprintf(stderr, "error: A btc-cli daemon is already listening on %s\n", path);
+		close(sock);
+		return 1;
+	}
+	if (sock >= 0)
+		close(sock);
+	unlink(path);
+
+	d.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (d.listen_fd < 0) {
+		fprintf(stderr, "error: Could not create socket: %s\n", strerror(errno));
+		return 1;
+	}
+	old_mask = umask(077);
+	if (bind(d.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(d.listen_fd, 64) < 0) {
+		umask(old_mask);
+		fprintf(stderr, "error: Could not listen on %s: %s\n", path, strerror(errno));
+		close(d.listen_fd);
+		return 1;
+	}
+	umask(old_mask);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = daemon_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	/* Warm the pool, and say so early if the node is not there */
+	if (warm_upstream(&d) < 0)
+		fprintf(stderr, "warning: Could not connect to %s:%d yet\n",
+		        upstream->host, upstream->port);
+	fprintf(stderr, "btc-cli daemon listening on %s\n", path);
+
+	while (!daemon_stop) {
+		int n = 1;
+
+		pfd[0].fd = d.nconns < DAEMON_MAX_CONNS ? d.listen_fd : -1;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < d.nconns; i++) {
+			DaemonConn *c = d.conns[i];
+
+			pfd[n].fd = c->fd;
+			pfd[n].events = (c->to_up.len == 0 && !c->up_closed ? POLLIN : 0) |
+			                (c->to_fd.len ? POLLOUT : 0);
+			n++;
+			pfd[n].fd = c->up_closed ? -1 : c->up;
+			pfd[n].events = (c->to_fd.len == 0 ? POLLIN : 0) |
+			                (c->to_up.len ? POLLOUT : 0);
+			n++;
+		}
+		pfd[n].fd = d.connecting;
+		pfd[n].events = POLLOUT;
+		pfd[n].revents = 0;
+
+		if (poll(pfd, n + 1, d.idle_count > 0 || d.connecting >= 0 ? 1000 : -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "error: poll: %s\n", strerror(errno));
+			break;
+		}
+
+		/* Backwards: closing i moves the last connection into its slot */
+		for (i = d.nconns - 1; i >= 0; i--)
+			serve_conn(&d, i, pfd[1 + 2 * i].revents, pfd[2 + 2 * i].revents);
+		if (pfd[n].revents && d.connecting >= 0)
+			finish_upstream(&d);
+		if (pfd[0].revents & POLLIN)
+			accept_conn(&d);
+		expire_idle(&d);
+		/* Give up on a connect the node does not answer in time */
+		if (d.connecting >= 0 && upstream->connect_timeout > 0 &&
+		    (time(NULL) - d.connect_since) * 1000 >= upstream->connect_timeout) {
+			close(d.connecting);
+			d.connecting = -1;
+		}
+	}
+
+	while (d.nconns > 0)
+		close_conn(&d, d.nconns - 1);
+	for (i = 0; i < d.idle_count; i++)
+		close(d.idle[i]);
+	if (d.connecting >= 0)
+		close(d.connecting);
+	close(d.listen_fd);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,28 @@
+/* Local RPC connection pool (-daemon) */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stddef.h>
+#include "rpc.h"
+
+/* Path of the daemon socket for host:port. An explicit path
+ * (-daemonsocket) is used as given; otherwise the socket lives in
+ * $XDG_RUNTIME_DIR, or in a private /tmp/btc-cli-<uid> directory, which
+ * is created if create is set. Returns 0, or -1 if there is no safe place
+ * for it.
+ */
+int daemon_socket_path(const char *explicit_path, const char *host, int port,
+                       int create, char *path, size_t size);
+
+/* Listen on path and relay the HTTP traffic of each local connection to
+ * the node over a pooled keep-alive connection (made like rpc_connect
+ * would on upstream). A client that finds the pool empty is told to
+ * connect to the node itself while the pool is refilled in the
+ * background. Requests are passed through untouched, so the node still
+ * authenticates every one of them. Runs until SIGINT or SIGTERM; returns
+ * the process exit code.
+ */
+int daemon_run(const RpcClient *upstream, const char *path);
+
+#endif
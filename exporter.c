@@ -0,0 +1,696 @@
+/* Prometheus metrics exporter (-exporter)
+ *
+ * A small HTTP server run from one poll() loop, like -daemon's. Every
+ * interval a single JSON-RPC batch goes to the node: getblockchaininfo,
+ * getmempoolinfo, getnettotals, getnetworkinfo, getpeerinfo, and for the
+ * wallet getwalletinfo and getbalances (left out of the metrics when
+ * there is no wallet to ask). Its response is read once the socket turns
+ * readable, so requests keep being served while the node works on it.
+ * The metrics text is rendered once per refresh and every /metrics
+ * request is answered from it: scrapes never reach the node.
+ */
+
+#define _GNU_SOURCE
+#include "exporter.h"
+#include "json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define EXPORTER_MAX_CONNS 64    /* HTTP connections served at once */
+#define EXPORTER_REQ_MAX 4096    /* Longest request head accepted */
+#define EXPORTER_CONN_MS 10000   /* For a client to send its request and take the reply */
+#define EXPORTER_MIN_WAIT_MS 5000 /* Least time given the node to answer a refresh */
+#define EXPORTER_MAX_GROUPS 64   /* Network and connection type pairs of peers counted */
+
+/* The batch, in id order */
+enum {
+	C_CHAIN, C_MEMPOOL, C_NETTOTALS, C_NETWORK, C_PEERS, C_WALLETINFO,
+	C_BALANCES, EXPORTER_CALLS
+};
+static const char *const call_methods[EXPORTER_CALLS] = {
+	"getblockchaininfo", "getmempoolinfo", "getnettotals", "getnetworkinfo",
+	"getpeerinfo", "getwalletinfo", "getbalances"
+};
+
+/* Growable output text */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+	int failed;
+} Buf;
+
+typedef struct {
+	int fd;
+	char req[EXPORTER_REQ_MAX];
+	size_t req_len;
+	char *resp;               /* Reply being written, NULL while reading */
+	size_t resp_len, resp_off;
+	long long deadline;       /* Closed if not done by then (ms) */
+} ExporterConn;
+
+typedef struct {
+	RpcClient *rpc;
+	int interval_ms;
+	int listen_fd;
+	ExporterConn *conns[EXPORTER_MAX_CONNS];
+	int nconns;
+
+	char batch[1024];
+	int pending;              /* Batch sent, response not read yet */
+	long long sent_ms;
+	long long next_ms;        /* Next refresh due */
+	unsigned long errors;     /* Failed refreshes */
+
+	/* The snapshot requests are answered from */
+	char *metrics;            /* Prometheus text format */
+	size_t metrics_len;
+	int up;                   /* The last refresh succeeded */
+	int healthy;              /* ...and found the node synced, with peers */
+	char reason[160];         /* Why /healthz fails */
+	time_t updated;           /* Last successful refresh, 0 = none yet */
+} Exporter;
+
+static volatile sig_atomic_t exporter_stop = 0;
+
+static void exporter_signal(int sig)
+{
+	(void)sig;
+	exporter_stop = 1;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void buf_printf(Buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (b->failed)
+		return;
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+		va_end(ap);
+		if (n < 0) {
+			b->failed = 1;
+			return;
+		}
+		if ((size_t)n < b->cap - b->len) {
+			b->len += n;
+			return;
+		}
+		size_t cap = b->cap * 2 + n + 256;
+		char *data = realloc(b->data, cap);
+		if (!data) {
+			b->failed = 1;
+			return;
+		}
+		b->data = data;
+		b->cap = cap;
+	}
+}
+
+/* A label value, with \, " and newlines escaped as the format wants */
+static void buf_label(Buf *b, const char *s)
+{
+	for (; *s; s++) {
+		if (*s == '\\' || *s == '"')
+			buf_printf(b, "\\%c", *s);
+		else if (*s == '\n')
+			buf_printf(b, "\\n");
+		else
+			buf_printf(b, "%c", *s);
+	}
+}
+
+static void metric_head(Buf *b, const char *name, const char *type,
+                        const char *help)
+{
+	buf_printf(b, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void gauge(Buf *b, const char *name, const char *help, double v)
+{
+	metric_head(b, name, "gauge", help);
+	buf_printf(b, "%s %.15g\n", name, v);
+}
+
+static void counter(Buf *b, const char *name, const char *help, double v)
+{
+	metric_head(b, name, "counter", help);
+	buf_printf(b, "%s %.15g\n", name, v);
+}
+
+static double num(const JsonTape *t, int obj, const char *key)
+{
+	return json_tape_double(t, json_tape_get(t, obj, key));
+}
+
+/* The exporter's own metrics, given whether or not the node answered */
+static void render_exporter(Exporter *x, Buf *b, double took)
+{
+	gauge(b, "bitcoin_up", "Whether the last refresh from the node succeeded", x->up);
+	counter(b, "bitcoin_exporter_refresh_errors_total",
+	        "Refreshes from the node that failed", (double)x->errors);
+	gauge(b, "bitcoin_exporter_last_refresh_timestamp_seconds",
+	      "Time of the last successful refresh", (double)x->updated);
+	if (took >= 0)
+		gauge(b, "bitcoin_exporter_refresh_duration_seconds",
+		      "Round-trip time of the last refresh", took);
+}
+
+static void render_chain(Buf *b, const JsonTape *t, int r)
+{
+	char chain[64];
+
+	json_tape_string(t, json_tape_get(t, r, "chain"), chain, sizeof(chain));
+	metric_head(b, "bitcoin_chain_info", "gauge", "The chain the node is on");
+	buf_printf(b, "bitcoin_chain_info{chain=\"");
+	buf_label(b, chain);
+	buf_printf(b, "\"} 1\n");
+	gauge(b, "bitcoin_blocks", "Height of the active chain's tip", num(t, r, "blocks"));
+	gauge(b, "bitcoin_headers", "Height of the best header chain", num(t, r, "headers"));
+	gauge(b, "bitcoin_verification_progress", "Estimated fraction of the chain verified",
+	      num(t, r, "verificationprogress"));
+	gauge(b, "bitcoin_initial_block_download", "Whether the node is in initial block download",
+	      json_tape_bool(t, json_tape_get(t, r, "initialblockdownload")));
+	gauge(b, "bitcoin_difficulty", "Proof-of-work difficulty of the tip", num(t, r, "difficulty"));
+	gauge(b, "bitcoin_median_time_seconds", "Median time past of the tip",
+	      num(t, r, "mediantime"));
+	/* Since v23 */
+	if (json_tape_get(t, r, "time") >= 0)
+		gauge(b, "bitcoin_tip_time_seconds", "Block time of the tip", num(t, r, "time"));
+	gauge(b, "bitcoin_size_on_disk_bytes", "Size of the block and undo files",
+	      num(t, r, "size_on_disk"));
+	gauge(b, "bitcoin_pruned", "Whether the node prunes old blocks",
+	      json_tape_bool(t, json_tape_get(t, r, "pruned")));
+}
+
+static void render_mempool(Buf *b, const JsonTape *t, int r)
+{
+	gauge(b, "bitcoin_mempool_loaded", "Whether the mempool is fully loaded",
+	      json_tape_bool(t, json_tape_get(t, r, "loaded")));
+	gauge(b, "bitcoin_mempool_transactions", "Transactions in the mempool", num(t, r, "size"));
+	gauge(b, "bitcoin_mempool_vsize_bytes", "Sum of the virtual sizes of mempool transactions",
+	      num(t, r, "bytes"));
+	gauge(b, "bitcoin_mempool_usage_bytes", "Memory used by the mempool", num(t, r, "usage"));
+	gauge(b, "bitcoin_mempool_max_bytes", "Memory limit of the mempool", num(t, r, "maxmempool"));
+	gauge(b, "bitcoin_mempool_total_fee_btc", "Fees of all mempool transactions",
+	      num(t, r, "total_fee"));
+	gauge(b, "bitcoin_mempool_min_fee_btc_per_kvb", "Minimum feerate for mempool acceptance",
+	      num(t, r, "mempoolminfee"));
+	gauge(b, "bitcoin_min_relay_fee_btc_per_kvb", "Minimum relay feerate",
+	      num(t, r, "minrelaytxfee"));
+}
+
+static void render_network(Buf *b, const JsonTape *t, int r)
+{
+	char subver[256];
+
+	json_tape_string(t, json_tape_get(t, r, "subversion"), subver, sizeof(subver));
+	metric_head(b, "bitcoin_version_info", "gauge", "Version of the node");
+	buf_printf(b, "bitcoin_version_info{version=\"%lld\",subversion=\"",
+	           (long long)json_tape_int(t, json_tape_get(t, r, "version")));
+	buf_label(b, subver);
+	buf_printf(b, "\",protocol=\"%lld\"} 1\n",
+	           (long long)json_tape_int(t, json_tape_get(t, r, "protocolversion")));
+	metric_head(b, "bitcoin_connections", "gauge", "Peer connections by direction");
+	buf_printf(b, "bitcoin_connections{direction=\"in\"} %.15g\n", num(t, r, "connections_in"));
+	buf_printf(b, "bitcoin_connections{direction=\"out\"} %.15g\n", num(t, r, "connections_out"));
+	gauge(b, "bitcoin_network_active", "Whether P2P networking is enabled",
+	      json_tape_bool(t, json_tape_get(t, r, "networkactive")));
+}
+
+/* Peers counted by network and connection type */
+static void render_peers(Buf *b, const JsonTape *t, int r)
+{
+	struct { char network[16]; char type[32]; int count; } groups[EXPORTER_MAX_GROUPS];
+	int ngroups = 0, e, i;
+
+	if (t->tok[r].type != JSON_ARRAY)
+		return;
+	for (e = json_tape_child(t, r); e > 0; e = json_tape_next(t, e)) {
+		char network[16], type[32];
+
+		json_tape_string(t, json_tape_get(t, e, "network"), network, sizeof(network));
+		json_tape_string(t, json_tape_get(t, e, "connection_type"), type, sizeof(type));
+		for (i = 0; i < ngroups; i++)
+			if (strcmp(groups[i].network, network) == 0 &&
+			    strcmp(groups[i].type, type) == 0)
+				break;
+		if (i == ngroups) {
+			if (ngroups == EXPORTER_MAX_GROUPS)
+				continue;
+			memcpy(groups[i].network, network, sizeof(network));
+			memcpy(groups[i].type, type, sizeof(type));
+			groups[i].count = 0;
+			ngroups++;
+		}
+		groups[i].count++;
+	}
+	metric_head(b, "bitcoin_peers", "gauge", "Connected peers by network and connection type");
+	for (i = 0; i < ngroups; i++) {
+		buf_printf(b, "bitcoin_peers{network=\"");
+		buf_label(b, groups[i].network);
+		buf_printf(b, "\",connection_type=\"");
+		buf_label(b, groups[i].type);
+		buf_printf(b, "\"} %d\n", groups[i].count);
+	}
+}
+
+/* Balances of the wallet, by the states getbalances reports under "mine" */
+static void render_wallet(Buf *b, const JsonTape *t, int info, int bal,
+                          const char *fallback_name)
+{
+	char name[256];
+	int mine = json_tape_get(t, bal, "mine"), e;
+
+	if (json_tape_string(t, json_tape_get(t, info, "walletname"), name, sizeof(name)) < 0)
+		snprintf(name, sizeof(name), "%s", fallback_name);
+	metric_head(b, "bitcoin_wallet_balance_btc", "gauge", "Balance of the wallet by state");
+	for (e = json_tape_child(t, mine); e > 0; e = json_tape_next(t, e)) {
+		size_t klen;
+		const char *key = json_tape_key(t, e, &klen);
+
+		if (t->tok[e].type != JSON_NUMBER)
+			continue;
+		buf_printf(b, "bitcoin_wallet_balance_btc{wallet=\"");
+		buf_label(b, name);
+		buf_printf(b, "\",state=\"%.*s\"} %.15g\n", (int)klen, key, json_tape_double(t, e));
+	}
+	if (info < 0)
+		return;
+	metric_head(b, "bitcoin_wallet_transactions", "gauge", "Transactions in the wallet");
+	buf_printf(b, "bitcoin_wallet_transactions{wallet=\"");
+	buf_label(b, name);
+	buf_printf(b, "\"} %.15g\n", num(t, info, "txcount"));
+}
+
+/* Replace the snapshot with the text in b */
+static void snapshot(Exporter *x, Buf *b)
+{
+	if (b->failed) {
+		free(b->data);
+		return;
+	}
+	free(x->metrics);
+	x->metrics = b->data;
+	x->metrics_len = b->len;
+}
+
+static void refresh_failed(Exporter *x, const char *why)
+{
+	Buf b = {0};
+
+	x->pending = 0;
+	x->errors++;
+	x->up = 0;
+	x->healthy = 0;
+	snprintf(x->reason, sizeof(x->reason), "node unreachable: %s", why);
+	rpc_disconnect(x->rpc);
+	render_exporter(x, &b, -1);
+	snapshot(x, &b);
+}
+
+static void refresh_start(Exporter *x, long long now)
+{
+	RpcClient *rpc = x->rpc;
+
+	x->next_ms = now + x->interval_ms;
+	/* bitcoind closes a keep-alive connection idle for its
+	 * -rpcservertimeout (30 s); notice before sending rather than by
+	 * the lack of a response */
+	if (rpc->sock >= 0) {
+		struct pollfd p = { rpc->sock, POLLIN, 0 };
+		if (poll(&p, 1, 0) != 0)
+			rpc_disconnect(rpc);
+	}
+	if (rpc_batch_send(rpc, x->batch) < 0) {
+		char why[300];
+		snprintf(why, sizeof(why), "could not connect to %s:%d", rpc->host, rpc->port);
+		refresh_failed(x, why);
+		return;
+	}
+	x->pending = 1;
+	x->sent_ms = now;
+}
+
+static void refresh_finish(Exporter *x)
+{
+	const char *view = rpc_batch_recv_view(x->rpc, NULL);
+	int res[EXPORTER_CALLS], e, i;
+	int64_t connections;
+	double vp, took = (now_ms() - x->sent_ms) / 1000.0;
+	JsonTape tape;
+	Buf b = {0};
+
+	memset(&tape, 0, sizeof(tape));
+	if (!view || json_tape_parse(&tape, view, strlen(view)) < 0 ||
+	    tape.count == 0 || tape.tok[0].type != JSON_ARRAY) {
+		char why[64];
+		if (x->rpc->last_http_error)
+			snprintf(why, sizeof(why), "HTTP %d", x->rpc->last_http_error);
+		else
+			snprintf(why, sizeof(why), "%s", view ? "invalid response" : "connection lost");
+		json_tape_free(&tape);
+		refresh_failed(x, why);
+		return;
+	}
+
+	/* Results by id; an element with an error counts as missing */
+	for (i = 0; i < EXPORTER_CALLS; i++)
+		res[i] = -1;
+	for (e = json_tape_child(&tape, 0); e > 0; e = json_tape_next(&tape, e)) {
+		int64_t id = json_tape_int(&tape, json_tape_get(&tape, e, "id"));
+		int err = json_tape_get(&tape, e, "error");
+		int r = json_tape_get(&tape, e, "result");
+
+		if (id >= 0 && id < EXPORTER_CALLS && r >= 0 &&
+		    (err < 0 || tape.tok[err].type == JSON_NULL) &&
+		    tape.tok[r].type != JSON_NULL)
+			res[id] = r;
+	}
+	if (res[C_CHAIN] < 0) {
+		json_tape_free(&tape);
+		refresh_failed(x, "getblockchaininfo failed");
+		return;
+	}
+
+	x->pending = 0;
+	x->up = 1;
+	x->updated = time(NULL);
+
+	/* The same test as -health: synced, and connected to someone */
+	vp = num(&tape, res[C_CHAIN], "verificationprogress");
+	connections = json_tape_int(&tape, json_tape_get(&tape, res[C_NETWORK], "connections"));
+	x->healthy = 0;
+	if (json_tape_bool(&tape, json_tape_get(&tape, res[C_CHAIN], "initialblockdownload")) ||
+	    vp < 0.9999)
+		snprintf(x->reason, sizeof(x->reason), "not synced: %.2f%% verified", vp * 100.0);
+	else if (connections <= 0)
+		snprintf(x->reason, sizeof(x->reason), "no peers");
+	else
+		x->healthy = 1;
+
+	render_exporter(x, &b, took);
+	gauge(&b, "bitcoin_healthy", "Whether the node is synced and has peers (as -health)",
+	      x->healthy);
+	render_chain(&b, &tape, res[C_CHAIN]);
+	if (res[C_MEMPOOL] >= 0)
+		render_mempool(&b, &tape, res[C_MEMPOOL]);
+	if (res[C_NETTOTALS] >= 0) {
+		counter(&b, "bitcoin_net_received_bytes_total", "Bytes received from peers",
+		        num(&tape, res[C_NETTOTALS], "totalbytesrecv"));
+		counter(&b, "bitcoin_net_sent_bytes_total", "Bytes sent to peers",
+		        num(&tape, res[C_NETTOTALS], "totalbytessent"));
+	}
+	if (res[C_NETWORK] >= 0)
+		render_network(&b, &tape, res[C_NETWORK]);
+	if (res[C_PEERS] >= 0)
+		render_peers(&b, &tape, res[C_PEERS]);
+	if (res[C_BALANCES] >= 0)
+		render_wallet(&b, &tape, res[C_WALLETINFO], res[C_BALANCES], x->rpc->wallet);
+	snapshot(x, &b);
+	json_tape_free(&tape);
+}
+
+/* Queue a reply (the body left out for HEAD) and stop reading */
+static void conn_reply(ExporterConn *c, int head_only, const char *status,
+                       const char *type, const char *body, size_t len)
+{
+	char head[256];
+	int n = snprintf(head, sizeof(head),
+	                 "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+	                 "%sConnection: close\r\n\r\n", status, type, len,
+	                 strncmp(status, "405", 3) == 0 ? "Allow: GET, HEAD\r\n" : "");
+
+	if (head_only)
+		len = 0;
+	c->resp = malloc(n + len);
+	if (!c->resp) {
+		c->resp_len = 0;
+		return;
+	}
+	memcpy(c->resp, head, n);
+	if (len)
+		memcpy(c->resp + n, body, len);
+	c->resp_len = n + len;
+	c->resp_off = 0;
+}
+
+static void conn_request(Exporter *x, ExporterConn *c)
+{
+	static const char text[] = "text/plain; charset=utf-8";
+	char method[8], path[256], *q;
+	int head_only;
+
+	if (sscanf(c->req, "%7s %255s", method, path) != 2) {
+		conn_reply(c, 0, "400 Bad Request", text, "bad request\n", 12);
+		return;
+	}
+	if ((q = strchr(path, '?')) != NULL)
+		*q = '\0';
+	head_only = strcmp(method, "HEAD") == 0;
+	if (!head_only && strcmp(method, "GET") != 0) {
+		conn_reply(c, 0, "405 Method Not Allowed", text, "method not allowed\n", 19);
+	} else if (strcmp(path, "/metrics") == 0) {
+		conn_reply(c, head_only, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+		           x->metrics ? x->metrics : "", x->metrics_len);
+	} else if (strcmp(path, "/healthz") == 0) {
+		char body[200];
+		int n;
+
+		if (x->up && x->healthy) {
+			conn_reply(c, head_only, "200 OK", text, "ok\n", 3);
+			return;
+		}
+		n = snprintf(body, sizeof(body), "%s\n",
+		             x->updated || x->errors ? x->reason : "starting");
+		conn_reply(c, head_only, "503 Service Unavailable", text, body, n);
+	} else {
+		conn_reply(c, head_only, "404 Not Found", text, "not found\n", 10);
+	}
+}
+
+static void close_conn(Exporter *x, int i)
+{
+	ExporterConn *c = x->conns[i];
+
+	close(c->fd);
+	free(c->resp);
+	free(c);
+	x->conns[i] = x->conns[--x->nconns];
+}
+
+/* Handle poll results for connection i; closes it when done */
+static void serve_conn(Exporter *x, int i, short ev, long long now)
+{
+	ExporterConn *c = x->conns[i];
+	ssize_t n;
+
+	if (!c->resp && (ev & (POLLIN | POLLHUP | POLLERR))) {
+		n = recv(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR)
+				return;
+			close_conn(x, i);
+			return;
+		}
+		c->req_len += n;
+		c->req[c->req_len] = '\0';
+		if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n"))
+			conn_request(x, c);
+		else if (c->req_len == sizeof(c->req) - 1)
+			conn_reply(c, 0, "431 Request Header Fields Too Large",
+			           "text/plain; charset=utf-8", "request too large\n", 18);
+		if (c->resp && c->resp_len == 0) {
+			close_conn(x, i);
+			return;
+		}
+	} else if (c->resp && (ev & (POLLOUT | POLLHUP | POLLERR))) {
+		n = send(c->fd, c->resp + c->resp_off, c->resp_len - c->resp_off, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			return;
+		if (n <= 0 || (c->resp_off += n) == c->resp_len) {
+			close_conn(x, i);
+			return;
+		}
+	}
+	if (now >= c->deadline)
+		close_conn(x, i);
+}
+
+static void accept_conn(Exporter *x, long long now)
+{
+	ExporterConn *c;
+	int fd = accept(x->listen_fd, NULL, NULL);
+
+	if (fd < 0)
+		return;
+	c = calloc(1, sizeof(*c));
+	if (!c) {
+		close(fd);
+		return;
+	}
+	c->fd = fd;
+	c->deadline = now + EXPORTER_CONN_MS;
+	x->conns[x->nconns++] = c;
+}
+
+/* Listen on host:port, [host]:port or :port (all interfaces) */
+static int exporter_listen(const char *listen_addr)
+{
+	struct addrinfo hints, *res, *ai;
+	char name[256];
+	const char *p = listen_addr, *port;
+	size_t n;
+	int fd = -1, one = 1, rc;
+
+	if (*p == '[') {
+		const char *end = strchr(p, ']');
+
+		if (!end || end[1] != ':')
+			goto invalid;
+		p++;
+		n = end - p;
+		port = end + 2;
+	} else {
+		const char *colon = strrchr(p, ':');
+
+		if (!colon)
+			goto invalid;
+		n = colon - p;
+		port = colon + 1;
+	}
+	if (n >= sizeof(name) || !*port)
+		goto invalid;
+	memcpy(name, p, n);
+	name[n] = '\0';
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	rc = getaddrinfo(n && strcmp(name, "*") != 0 ? name : NULL, port, &hints, &res);
+	if (rc != 0) {
+		fprintf(stderr, "error: Could not resolve %s: %s\n", listen_addr, gai_strerror(rc));
+		return -1;
+	}
+	errno = EADDRNOTAVAIL;
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0)
+			break;
+		rc = errno;
+		close(fd);
+		fd = -1;
+		errno = rc;
+	}
+	freeaddrinfo(res);
+	if (fd < 0)
+		fprintf(stderr, "error: Could not listen on %s: %s\n", listen_addr, strerror(errno));
+	return fd;
+
+invalid:
+	fprintf(stderr, "error: Invalid -exporter address: %s (use <host>:<port>)\n", listen_addr);
+	return -1;
+}
+
+int exporter_run(RpcClient *rpc, const char *listen_addr, int interval)
+{
+	static Exporter x;
+	static struct pollfd pfd[2 + EXPORTER_MAX_CONNS];
+	struct sigaction sa;
+	size_t len = 0;
+	int i;
+
+	memset(&x, 0, sizeof(x));
+	x.rpc = rpc;
+	x.interval_ms = interval * 1000;
+	x.listen_fd = exporter_listen(listen_addr);
+	if (x.listen_fd < 0)
+		return 1;
+
+	x.batch[len++] = '[';
+	for (i = 0; i < EXPORTER_CALLS; i++)
+		len += snprintf(x.batch + len, sizeof(x.batch) - len,
+		                "%s{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":[]}",
+		                i ? "," : "", i, call_methods[i]);
+	snprintf(x.batch + len, sizeof(x.batch) - len, "]");
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = exporter_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fprintf(stderr, "btc-cli exporter listening on %s\n", listen_addr);
+
+	while (!exporter_stop) {
+		long long now = now_ms(), due;
+		int wait_ms = EXPORTER_MIN_WAIT_MS > x.interval_ms ? EXPORTER_MIN_WAIT_MS : x.interval_ms;
+		int n = 2;
+
+		if (!x.pending && now >= x.next_ms)
+			refresh_start(&x, now);
+		if (x.pending && now - x.sent_ms >= wait_ms)
+			refresh_failed(&x, "no response");
+
+		/* Sleep until the next refresh or the next connection deadline */
+		due = x.pending ? x.sent_ms + wait_ms : x.next_ms;
+		pfd[0].fd = x.nconns < EXPORTER_MAX_CONNS ? x.listen_fd : -1;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = x.pending ? rpc->sock : -1;
+		pfd[1].events = POLLIN;
+		for (i = 0; i < x.nconns; i++) {
+			ExporterConn *c = x.conns[i];
+
+			pfd[n].fd = c->fd;
+			pfd[n].events = c->resp ? POLLOUT : POLLIN;
+			n++;
+			if (c->deadline < due)
+				due = c->deadline;
+		}
+
+		if (poll(pfd, n, due > now ? (int)(due - now) : 0) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "error: poll: %s\n", strerror(errno));
+			break;
+		}
+
+		now = now_ms();
+		if (pfd[1].revents)
+			refresh_finish(&x);
+		/* Backwards: closing i moves the last connection into its slot */
+		for (i = x.nconns - 1; i >= 0; i--)
+			serve_conn(&x, i, pfd[2 + i].revents, now);
+		if (pfd[0].revents & POLLIN)
+			accept_conn(&x, now);
+	}
+
+	while (x.nconns > 0)
+		close_conn(&x, x.nconns - 1);
+	close(x.listen_fd);
+	free(x.metrics);
+	rpc_disconnect(rpc);
+	return 0;
+}
@@ -0,0 +1,17 @@
+/* Prometheus metrics exporter (-exporter) */
+
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "rpc.h"
+
+/* Listen for HTTP on listen_addr (host:port, [v6]:port, or :port for all
+ * interfaces) and serve the node's metrics in the Prometheus text format
+ * at /metrics and its health at /healthz. The metrics are fetched from
+ * the node in one JSON-RPC batch every interval seconds, without holding
+ * up requests meanwhile; each request is answered from the last one.
+ * Runs until SIGINT or SIGTERM; returns the process exit code.
+ */
+int exporter_run(RpcClient *rpc, const char *listen_addr, int interval);
+
+#endif
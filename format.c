@@ -8,10 +8,20 @@
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* ANSI color codes */
+#define C_RESET   "\033[0m"
+#define C_KEY     "\033[36m"   /* Cyan for keys */
+#define C_STRING  "\033[32m"   /* Green for strings */
+#define C_NUMBER  "\033[33m"   /* Yellow for numbers */
+#define C_BOOL    "\033[35m"   /* Magenta for true/false/null */
+#define C_BRACE   "\033[1m"    /* Bold for {} [] */
 
 /* ─── -field=path ───────────────────────────────────────────────────── */
 
-char *format_extract_field(const char *json, const char *path)
+const char *format_find_field(const char *json, const char *path, size_t *len)
 {
 	char segment[256];
 	const char *p = path;
@@ -55,12 +65,8 @@ char *format_extract_field(const char *json, const char *path)
 					if (!end) { current = NULL; break; }
 					elem = end + 1;
 				} else if (*elem == '"') {
-					elem++;
-					while (*elem && *elem != '"') {
-						if (*elem == '\\') elem++;
-						elem++;
-					}
-					if (*elem == '"') elem++;
+					elem = json_skip_string(elem);
+					if (!elem) { current = NULL; break; }
 				} else {
 					while (*elem && *elem != ',' && *elem != ']')
 						elem++;
@@ -73,7 +79,7 @@ char *format_extract_field(const char *json, const char *path)
 			if (!current) return NULL;
 		} else if (*current == '{') {
 			/* Object key lookup */
-			const char *val = json_find_value(current, segment);
+			const char *val = json_object_get(current, segment);
 			if (!val) return NULL;
 			current = val;
 		} else {
@@ -86,48 +92,49 @@ char *format_extract_field(const char *json, const char *path)
 
 	if (!current) return NULL;
 
-	/* Extract the value at current position */
+	/* Measure the value at current position */
 	while (*current == ' ' || *current == '\t' || *current == '\n' || *current == '\r')
 		current++;
 
 	if (*current == '"') {
-		/* String — extract without quotes */
-		const char *start = current + 1;
-		const char *end = start;
-		while (*end && *end != '"') {
-			if (*end == '\\') end++;
-			end++;
-		}
-		size_t len = end - start;
-		char *result = malloc(len + 1);
-		if (!result) return NULL;
-		memcpy(result, start, len);
-		result[len] = '\0';
-		return result;
+		const char *end = json_skip_string(current);
+		if (!end) return NULL;
+		*len = end - current;
 	} else if (*current == '{' || *current == '[') {
 		const char *end = json_find_closing(current);
 		if (!end) return NULL;
-		size_t len = end - current + 1;
-		char *result = malloc(len + 1);
-		if (!result) return NULL;
-		memcpy(result, current, len);
-		result[len] = '\0';
-		return result;
+		*len = end - current + 1;
 	} else if (strncmp(current, "null", 4) == 0) {
-		return strdup("null");
+		*len = 4;
 	} else {
 		/* Number or boolean */
 		const char *end = current;
 		while (*end && *end != ',' && *end != '}' && *end != ']' &&
 		       *end != ' ' && *end != '\n' && *end != '\r')
 			end++;
-		size_t len = end - current;
-		char *result = malloc(len + 1);
-		if (!result) return NULL;
-		memcpy(result, current, len);
-		result[len] = '\0';
-		return result;
+		*len = end - current;
 	}
+	return current;
+}
+
+char *format_extract_field(const char *json, const char *path)
+{
+	size_t len;
+	const char *val = format_find_field(json, path, &len);
+	char *result;
+
+	if (!val) return NULL;
+
+	/* Strings are extracted without quotes */
+	if (*val == '"') {
+		val++;
+		len -= 2;
+	}
+	result = malloc(len + 1);
+	if (!result) return NULL;
+	memcpy(result, val, len);
+	result[len] = '\0';
+	return result;
 }
 
 /* ─── -sats ─────────────────────────────────────────────────────────── */
@@ -167,7 +174,6 @@ char *format_sats(const char *json)
 
 	const char *p = json;
 	size_t pos = 0;
-	int in_string = 0;
 	int after_colon = 0;
 
 	while (*p) {
@@ -178,18 +184,22 @@ char *format_sats(const char *json)
 			if (!buf) return NULL;
 		}
 
-		if (*p == '"' && (p == json || *(p-1) != '\\')) {
-			in_string = !in_string;
-			buf[pos++] = *p++;
+		if (*p == '"') {
+			/* Copy the whole string; amounts are never inside one */
+			const char *end = json_skip_string(p);
+			size_t span = end ? (size_t)(end - p) : strlen(p);
+			if (pos + span + 32 > bufsize) {
+				bufsize = pos + span + 256;
+				buf = realloc(buf, bufsize);
+				if (!buf) return NULL;
+			}
+			memcpy(buf + pos, p, span);
+			pos += span;
+			p += span;
 			after_colon = 0;
 			continue;
 		}
 
-		if (in_string) {
-			buf[pos++] = *p++;
-			continue;
-		}
-
 		if (*p == ':') {
 			buf[pos++] = *p++;
 			after_colon = 1;
@@ -293,110 +303,82 @@ static void extract_value(const char *val, char *out, size_t out_size)
 	}
 }
 
-int format_table(FILE *out, const char *json)
+/* Parse a JSON array for table/csv output and collect column names from
+ * its first object. Returns the tape index of that object, or -1. */
+static int table_parse(JsonTape *t, const char *json,
+                       char keys[][128], int *ncols)
 {
+	int first, v;
+
+	*ncols = 0;
+	memset(t, 0, sizeof(*t));
+
 	/* Skip whitespace */
 	while (*json == ' ' || *json == '\t' || *json == '\n' || *json == '\r')
 		json++;
 
 	if (*json != '[') return -1;
+	if (json_tape_parse(t, json, strlen(json)) < 0) return -1;
+
+	for (first = json_tape_child(t, 0); first >= 0; first = json_tape_next(t, first))
+		if (t->tok[first].type == JSON_OBJECT)
+			break;
+	if (first < 0) return -1;
+
+	for (v = json_tape_child(t, first); v >= 0 && *ncols < TABLE_MAX_COLS;
+	     v = json_tape_next(t, v)) {
+		size_t klen;
+		const char *key = json_tape_key(t, v, &klen);
+		if (klen >= 128) klen = 127;
+		memcpy(keys[*ncols], key, klen);
+		keys[*ncols][klen] = '\0';
+		(*ncols)++;
+	}
+
+	return *ncols > 0 ? first : -1;
+}
+
+/* Raw text of column key in the row object at row, or NULL */
+static const char *row_value(const JsonTape *t, int row, const char *key)
+{
+	int v = json_tape_get(t, row, key);
+	return v >= 0 ? json_tape_text(t, v) : NULL;
+}
 
-	/* Collect keys from first object */
+int format_table(FILE *out, const char *json)
+{
+	JsonTape t;
 	char keys[TABLE_MAX_COLS][128];
 	int widths[TABLE_MAX_COLS];
-	int ncols = 0;
+	int ncols, first, row, c;
 
-	const char *first_obj = strchr(json + 1, '{');
-	if (!first_obj) return -1;
-
-	/* Parse keys from first object */
-	{
-		const char *end = json_find_closing(first_obj);
-		if (!end) return -1;
-		const char *p = first_obj + 1;
-		while (p < end && ncols < TABLE_MAX_COLS) {
-			/* Find next key */
-			const char *kstart = strchr(p, '"');
-			if (!kstart || kstart >= end) break;
-			kstart++;
-			const char *kend = strchr(kstart, '"');
-			if (!kend || kend >= end) break;
-
-			size_t klen = kend - kstart;
-			if (klen >= sizeof(keys[0])) klen = sizeof(keys[0]) - 1;
-			memcpy(keys[ncols], kstart, klen);
-			keys[ncols][klen] = '\0';
-			widths[ncols] = (int)klen;
-			ncols++;
-
-			/* Skip past value */
-			p = kend + 1;
-			while (p < end && *p != ':') p++;
-			if (p < end) p++;
-			while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
-			if (p < end) {
-				if (*p == '{' || *p == '[') {
-					const char *vend = json_find_closing(p);
-					if (vend) p = vend + 1;
-				} else if (*p == '"') {
-					p++;
-					while (p < end && *p != '"') {
-						if (*p == '\\') p++;
-						p++;
-					}
-					if (p < end) p++;
-				} else {
-					while (p < end && *p != ',' && *p != '}') p++;
-				}
-			}
-			while (p < end && (*p == ',' || *p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
-				p++;
-		}
+	first = table_parse(&t, json, keys, &ncols);
+	if (first < 0) {
+		json_tape_free(&t);
+		return -1;
 	}
-
-	if (ncols == 0) return -1;
+	for (c = 0; c < ncols; c++)
+		widths[c] = (int)strlen(keys[c]);
 
 	/* First pass: compute column widths from all rows */
-	{
-		const char *arr_end = json_find_closing(json);
-		if (!arr_end) return -1;
-		const char *obj = first_obj;
-		while (obj && obj < arr_end) {
-			const char *obj_end = json_find_closing(obj);
-			if (!obj_end) break;
-
-			/* Extract each column's value width */
-			size_t obj_len = obj_end - obj + 1;
-			char *obj_copy = malloc(obj_len + 1);
-			if (obj_copy) {
-				int c;
-				memcpy(obj_copy, obj, obj_len);
-				obj_copy[obj_len] = '\0';
-				for (c = 0; c < ncols; c++) {
-					const char *val = json_find_value(obj_copy, keys[c]);
-					char valbuf[TABLE_MAX_WIDTH + 4];
-					extract_value(val, valbuf, sizeof(valbuf));
-					int vlen = (int)strlen(valbuf);
-					if (vlen > widths[c]) widths[c] = vlen;
-				}
-				free(obj_copy);
-			}
-
-			obj = strchr(obj_end + 1, '{');
+	for (row = first; row >= 0; row = json_tape_next(&t, row)) {
+		if (t.tok[row].type != JSON_OBJECT)
+			continue;
+		for (c = 0; c < ncols; c++) {
+			char valbuf[TABLE_MAX_WIDTH + 4];
+			extract_value(row_value(&t, row, keys[c]), valbuf, sizeof(valbuf));
+			int vlen = (int)strlen(valbuf);
+			if (vlen > widths[c]) widths[c] = vlen;
 		}
 	}
 
 	/* Cap widths */
-	{
-		int c;
-		for (c = 0; c < ncols; c++) {
-			if (widths[c] > TABLE_MAX_WIDTH) widths[c] = TABLE_MAX_WIDTH;
-		}
+	for (c = 0; c < ncols; c++) {
+		if (widths[c] > TABLE_MAX_WIDTH) widths[c] = TABLE_MAX_WIDTH;
 	}
 
 	/* Print header */
 	{
-		int c;
 		for (c = 0; c < ncols; c++) {
 			if (c > 0) fprintf(out, "  ");
 			fprintf(out, "%-*s", widths[c], keys[c]);
@@ -412,35 +394,19 @@ int format_table(FILE *out, const char *json)
 	}
 
 	/* Print rows */
-	{
-		const char *arr_end = json_find_closing(json);
-		if (!arr_end) return -1;
-		const char *obj = first_obj;
-		while (obj && obj < arr_end) {
-			const char *obj_end = json_find_closing(obj);
-			if (!obj_end) break;
-
-			size_t obj_len = obj_end - obj + 1;
-			char *obj_copy = malloc(obj_len + 1);
-			if (obj_copy) {
-				int c;
-				memcpy(obj_copy, obj, obj_len);
-				obj_copy[obj_len] = '\0';
-				for (c = 0; c < ncols; c++) {
-					const char *val = json_find_value(obj_copy, keys[c]);
-					char valbuf[TABLE_MAX_WIDTH + 4];
-					extract_value(val, valbuf, sizeof(valbuf));
-					if (c > 0) fprintf(out, "  ");
-					fprintf(out, "%-*s", widths[c], valbuf);
-				}
-				fprintf(out, "\n");
-				free(obj_copy);
-			}
-
-			obj = strchr(obj_end + 1, '{');
+	for (row = first; row >= 0; row = json_tape_next(&t, row)) {
+		if (t.tok[row].type != JSON_OBJECT)
+			continue;
+		for (c = 0; c < ncols; c++) {
+			char valbuf[TABLE_MAX_WIDTH + 4];
+			extract_value(row_value(&t, row, keys[c]), valbuf, sizeof(valbuf));
+			if (c > 0) fprintf(out, "  ");
+			fprintf(out, "%-*s", widths[c], valbuf);
 		}
+		fprintf(out, "\n");
 	}
 
+	json_tape_free(&t);
 	return 0;
 }
 
@@ -473,107 +439,282 @@ static void csv_write_value(FILE *out, const char *val)
 
 int format_csv(FILE *out, const char *json)
 {
-	/* Skip whitespace */
-	while (*json == ' ' || *json == '\t' || *json == '\n' || *json == '\r')
-		json++;
-
-	if (*json != '[') return -1;
-
-	/* Collect keys from first object */
+	JsonTape t;
 	char keys[TABLE_MAX_COLS][128];
-	int ncols = 0;
-
-	const char *first_obj = strchr(json + 1, '{');
-	if (!first_obj) return -1;
+	int ncols, first, row, c;
 
-	/* Parse keys from first object */
-	{
-		const char *end = json_find_closing(first_obj);
-		if (!end) return -1;
-		const char *p = first_obj + 1;
-		while (p < end && ncols < TABLE_MAX_COLS) {
-			const char *kstart = strchr(p, '"');
-			if (!kstart || kstart >= end) break;
-			kstart++;
-			const char *kend = strchr(kstart, '"');
-			if (!kend || kend >= end) break;
-
-			size_t klen = kend - kstart;
-			if (klen >= sizeof(keys[0])) klen = sizeof(keys[0]) - 1;
-			memcpy(keys[ncols], kstart, klen);
-			keys[ncols][klen] = '\0';
-			ncols++;
-
-			/* Skip past value */
-			p = kend + 1;
-			while (p < end && *p != ':') p++;
-			if (p < end) p++;
-			while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) p++;
-			if (p < end) {
-				if (*p == '{' || *p == '[') {
-					const char *vend = json_find_closing(p);
-					if (vend) p = vend + 1;
-				} else if (*p == '"') {
-					p++;
-					while (p < end && *p != '"') {
-						if (*p == '\\') p++;
-						p++;
-					}
-					if (p < end) p++;
-				} else {
-					while (p < end && *p != ',' && *p != '}') p++;
-				}
-			}
-			while (p < end && (*p == ',' || *p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
-				p++;
-		}
+	first = table_parse(&t, json, keys, &ncols);
+	if (first < 0) {
+		json_tape_free(&t);
+		return -1;
 	}
 
-	if (ncols == 0) return -1;
-
 	/* Print header row */
-	{
-		int c;
+	for (c = 0; c < ncols; c++) {
+		if (c > 0) fputc(',', out);
+		csv_write_value(out, keys[c]);
+	}
+	fputc('\n', out);
+
+	/* Print data rows */
+	for (row = first; row >= 0; row = json_tape_next(&t, row)) {
+		if (t.tok[row].type != JSON_OBJECT)
+			continue;
 		for (c = 0; c < ncols; c++) {
+			char valbuf[1024];
+			extract_value(row_value(&t, row, keys[c]), valbuf, sizeof(valbuf));
 			if (c > 0) fputc(',', out);
-			csv_write_value(out, keys[c]);
+			csv_write_value(out, valbuf);
 		}
 		fputc('\n', out);
 	}
 
-	/* Print data rows */
-	{
-		const char *arr_end = json_find_closing(json);
-		if (!arr_end) return -1;
-		const char *obj = first_obj;
-		while (obj && obj < arr_end) {
-			const char *obj_end = json_find_closing(obj);
-			if (!obj_end) break;
-
-			size_t obj_len = obj_end - obj + 1;
-			char *obj_copy = malloc(obj_len + 1);
-			if (obj_copy) {
-				int c;
-				memcpy(obj_copy, obj, obj_len);
-				obj_copy[obj_len] = '\0';
-				for (c = 0; c < ncols; c++) {
-					const char *val = json_find_value(obj_copy, keys[c]);
-					char valbuf[1024];
-					extract_value(val, valbuf, sizeof(valbuf));
-					if (c > 0) fputc(',', out);
-					csv_write_value(out, valbuf);
-				}
-				fputc('\n', out);
-				free(obj_copy);
-			}
+	json_tape_free(&t);
+	return 0;
+}
+
+/* ─── -format=csv (streaming) ───────────────────────────────────────── */
+
+/* Largest raw text kept per cell; extract_value() never uses more */
+#define CSV_CELL_MAX 4096
+
+/* Rebuilds compact JSON text from stream events */
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t cap;
+	size_t max;       /* Stop growing past this (0 = unlimited) */
+	int depth;
+	char comma[JSON_STREAM_MAX_DEPTH + 1];  /* Separator due at each depth */
+} TextSink;
+
+static void sink_put(TextSink *ts, const char *s, size_t n)
+{
+	if (ts->max && ts->len + n > ts->max)
+		n = ts->len < ts->max ? ts->max - ts->len : 0;
+	if (ts->len + n + 1 > ts->cap) {
+		size_t cap = ts->cap ? ts->cap : 256;
+		while (cap < ts->len + n + 1)
+			cap *= 2;
+		char *buf = realloc(ts->buf, cap);
+		if (!buf) return;
+		ts->buf = buf;
+		ts->cap = cap;
+	}
+	memcpy(ts->buf + ts->len, s, n);
+	ts->len += n;
+	ts->buf[ts->len] = '\0';
+}
+
+static void sink_event(TextSink *ts, JsonEvent ev, const char *text, size_t len)
+{
+	if (ev == JSON_EV_OBJECT_END || ev == JSON_EV_ARRAY_END) {
+		if (ts->depth > 0) ts->depth--;
+		sink_put(ts, text, len);
+		ts->comma[ts->depth] = 1;
+		return;
+	}
+	if (ts->comma[ts->depth])
+		sink_put(ts, ",", 1);
+	sink_put(ts, text, len);
+	if (ev == JSON_EV_KEY) {
+		sink_put(ts, ":", 1);
+		ts->comma[ts->depth] = 0;
+		return;
+	}
+	ts->comma[ts->depth] = 1;
+	if ((ev == JSON_EV_OBJECT_START || ev == JSON_EV_ARRAY_START) &&
+	    ts->depth < JSON_STREAM_MAX_DEPTH)
+		ts->comma[++ts->depth] = 0;
+}
+
+static void sink_reset(TextSink *ts)
+{
+	ts->len = 0;
+	ts->depth = 0;
+	ts->comma[0] = 0;
+	if (ts->buf) ts->buf[0] = '\0';
+}
+
+struct CsvStream {
+	FILE *out;
+	int depth;          /* Nesting depth before the current event */
+	int result_next;    /* Last depth-1 key was "result" */
+	int in_rows;        /* Inside the result array */
+	int in_row;         /* Inside an object element of it */
+	int rows_done;
+	int header_done;
+	TextSink capture;   /* Response so far, until the header is written */
+	int capturing;
+	char keys[TABLE_MAX_COLS][128];
+	int alias[TABLE_MAX_COLS];  /* First column with the same key */
+	int ncols;
+	int col;            /* Column of the current row member, -1 to skip */
+	int have[TABLE_MAX_COLS];
+	TextSink cell[TABLE_MAX_COLS];
+};
+
+CsvStream *format_csv_stream_new(FILE *out)
+{
+	CsvStream *cs = calloc(1, sizeof(CsvStream));
+	int c;
+	if (!cs) return NULL;
+	cs->out = out;
+	cs->capturing = 1;
+	cs->col = -1;
+	for (c = 0; c < TABLE_MAX_COLS; c++)
+		cs->cell[c].max = CSV_CELL_MAX;
+	return cs;
+}
+
+static void csv_stream_row(CsvStream *cs)
+{
+	int c;
 
-			obj = strchr(obj_end + 1, '{');
+	if (!cs->header_done) {
+		if (cs->ncols == 0) {
+			/* format_csv() rejects this; leave it to the caller */
+			cs->rows_done = 1;
+			return;
+		}
+		for (c = 0; c < cs->ncols; c++) {
+			if (c > 0) fputc(',', cs->out);
+			csv_write_value(cs->out, cs->keys[c]);
 		}
+		fputc('\n', cs->out);
+		cs->header_done = 1;
+		cs->capturing = 0;
+		free(cs->capture.buf);
+		memset(&cs->capture, 0, sizeof(cs->capture));
+	}
+
+	for (c = 0; c < cs->ncols; c++) {
+		char valbuf[1024];
+		int a = cs->alias[c];
+		extract_value(cs->have[a] ? cs->cell[a].buf : NULL, valbuf, sizeof(valbuf));
+		if (c > 0) fputc(',', cs->out);
+		csv_write_value(cs->out, valbuf);
+	}
+	fputc('\n', cs->out);
+}
+
+/* Column for a row member's key, or -1; the first row defines them */
+static int csv_stream_column(CsvStream *cs, const char *key, size_t klen)
+{
+	int c;
+
+	for (c = 0; c < cs->ncols; c++) {
+		if (klen < sizeof(cs->keys[0]) && cs->keys[c][klen] == '\0' &&
+		    memcmp(cs->keys[c], key, klen) == 0)
+			break;
+	}
+	if (!cs->header_done && cs->ncols < TABLE_MAX_COLS) {
+		int n = cs->ncols++;
+		if (klen >= sizeof(cs->keys[0]))
+			klen = sizeof(cs->keys[0]) - 1;
+		memcpy(cs->keys[n], key, klen);
+		cs->keys[n][klen] = '\0';
+		cs->alias[n] = c < n ? c : n;
 	}
+	/* Only the first occurrence counts, as with a lookup */
+	if (c >= cs->ncols || cs->have[c])
+		return -1;
+	return c;
+}
 
+int format_csv_event(void *ctx, JsonEvent ev, const char *text, size_t len)
+{
+	CsvStream *cs = ctx;
+	int d = cs->depth;
+	int c;
+
+	if (cs->capturing)
+		sink_event(&cs->capture, ev, text, len);
+	if (ev == JSON_EV_OBJECT_START || ev == JSON_EV_ARRAY_START)
+		cs->depth++;
+	else if (ev == JSON_EV_OBJECT_END || ev == JSON_EV_ARRAY_END)
+		cs->depth--;
+
+	if (cs->rows_done)
+		return 0;
+
+	/* Response object: find the "result" member */
+	if (d == 1) {
+		if (ev == JSON_EV_KEY) {
+			cs->result_next = len == 8 && memcmp(text, "\"result\"", 8) == 0;
+		} else if (cs->result_next) {
+			cs->result_next = 0;
+			if (ev == JSON_EV_ARRAY_START)
+				cs->in_rows = 1;
+			else
+				cs->rows_done = 1;  /* Not an array */
+		}
+		return 0;
+	}
+	if (!cs->in_rows)
+		return 0;
+
+	/* Elements of the result array */
+	if (d == 2) {
+		if (ev == JSON_EV_ARRAY_END) {
+			cs->rows_done = 1;
+		} else if (ev == JSON_EV_OBJECT_START) {
+			cs->in_row = 1;
+			cs->col = -1;
+			for (c = 0; c < cs->ncols; c++) {
+				cs->have[c] = 0;
+				sink_reset(&cs->cell[c]);
+			}
+		} else if (!cs->header_done) {
+			/* Columns come from the first object; a leading non-object
+			 * element is left to format_csv() */
+			cs->rows_done = 1;
+		}
+		return 0;
+	}
+	if (!cs->in_row)
+		return 0;
+
+	if (d == 3 && ev == JSON_EV_OBJECT_END) {
+		cs->in_row = 0;
+		csv_stream_row(cs);
+	} else if (d == 3 && ev == JSON_EV_KEY) {
+		cs->col = csv_stream_column(cs, text + 1, len - 2);
+	} else if (cs->col >= 0) {
+		/* A member's value, or something nested inside it */
+		sink_event(&cs->cell[cs->col], ev, text, len);
+		if (cs->depth == 3) {
+			cs->have[cs->col] = 1;
+			cs->col = -1;
+		}
+	}
 	return 0;
 }
 
+int format_csv_stream_end(CsvStream *cs, int parse_status, char **response)
+{
+	int ret;
+	int c;
+
+	*response = NULL;
+	if (cs->header_done) {
+		ret = parse_status == 0 ? 0 : -1;
+	} else if (parse_status == 0 && cs->capture.buf) {
+		/* Nothing written: hand back the whole response */
+		*response = cs->capture.buf;
+		cs->capture.buf = NULL;
+		ret = 1;
+	} else {
+		ret = -1;
+	}
+
+	free(cs->capture.buf);
+	for (c = 0; c < TABLE_MAX_COLS; c++)
+		free(cs->cell[c].buf);
+	free(cs);
+	return ret;
+}
+
 /* ─── -human ────────────────────────────────────────────────────────── */
 
 /* Key categories for humanization */
@@ -706,7 +847,6 @@ char *format_human(const char *json)
 
 	const char *p = json;
 	size_t pos = 0;
-	int in_string = 0;
 
 	/* Track the last key we saw */
 	const char *last_key = NULL;
@@ -721,51 +861,32 @@ char *format_human(const char *json)
 			if (!buf) return NULL;
 		}
 
-		if (*p == '"' && (p == json || *(p-1) != '\\')) {
-			if (!in_string) {
-				/* Opening quote — find closing quote */
-				const char *end = p + 1;
-				while (*end && !(*end == '"' && *(end-1) != '\\'))
-					end++;
-
-				if (expect_value) {
-					/* This is a string value, not a number — copy as-is */
-					expect_value = 0;
-					size_t span = end - p + 1;
-					if (pos + span + 1 > bufsize) {
-						bufsize = pos + span + 256;
-						buf = realloc(buf, bufsize);
-						if (!buf) return NULL;
-					}
-					memcpy(buf + pos, p, span);
-					pos += span;
-					p = end + 1;
-					continue;
-				}
+		if (*p == '"') {
+			/* Copy the whole string as-is */
+			const char *end = json_skip_string(p);
+			size_t span = end ? (size_t)(end - p) : strlen(p);
 
+			if (expect_value) {
+				/* This is a string value, not a number */
+				expect_value = 0;
+			} else if (end) {
 				/* Check if this is a key (followed by ':') */
-				const char *after = end + 1;
+				const char *after = end;
 				while (*after == ' ' || *after == '\t' || *after == '\n' || *after == '\r')
 					after++;
 				if (*after == ':') {
-					/* It's a key */
 					last_key = p + 1;
-					last_key_len = end - p - 1;
-					/* Copy the key string as-is */
-					size_t span = end - p + 1;
-					memcpy(buf + pos, p, span);
-					pos += span;
-					p = end + 1;
-					continue;
+					last_key_len = span - 2;
 				}
 			}
-			in_string = !in_string;
-			buf[pos++] = *p++;
-			continue;
-		}
-
-		if (in_string) {
-			buf[pos++] = *p++;
+			if (pos + span + 128 > bufsize) {
+				bufsize = pos + span + 256;
+				buf = realloc(buf, bufsize);
+				if (!buf) return NULL;
+			}
+			memcpy(buf + pos, p, span);
+			pos += span;
+			p += span;
 			continue;
 		}
 
@@ -839,3 +960,262 @@ char *format_human(const char *json)
 	buf[pos] = '\0';
 	return buf;
 }
+
+/* ─── Pretty printing ───────────────────────────────────────────────── */
+
+/* Output is staged here and handed to write(2) in large blocks */
+#define PRINT_BUF_SIZE 65536
+
+typedef struct {
+	FILE *out;
+	int fd;         /* -1 if out has no descriptor; use fwrite() */
+	size_t len;
+	char buf[PRINT_BUF_SIZE];
+} PrintBuf;
+
+static PrintBuf print_buf;
+
+/* Characters that end a number/true/false/null token */
+static const unsigned char token_end[256] = {
+	[' '] = 1, ['\t'] = 1, ['\n'] = 1, ['\r'] = 1, [','] = 1, [':'] = 1,
+	['{'] = 1, ['}'] = 1, ['['] = 1, [']'] = 1, ['"'] = 1,
+};
+
+/* Newline followed by indentation, sliced per level */
+static const char newline_indent[] = "\n"
+	"                                                                "
+	"                                                                ";
+
+#define PB_LIT(pb, s) pb_write(pb, s, sizeof(s) - 1)
+
+static void pb_write_out(PrintBuf *pb, const char *p, size_t len)
+{
+	if (pb->fd < 0) {
+		fwrite(p, 1, len, pb->out);
+		return;
+	}
+	while (len > 0) {
+		ssize_t n = write(pb->fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+}
+
+static void pb_flush(PrintBuf *pb)
+{
+	pb_write_out(pb, pb->buf, pb->len);
+	pb->len = 0;
+}
+
+static void pb_write(PrintBuf *pb, const char *s, size_t n)
+{
+	if (pb->len + n > PRINT_BUF_SIZE) {
+		pb_flush(pb);
+		if (n > PRINT_BUF_SIZE) {
+			pb_write_out(pb, s, n);
+			return;
+		}
+	}
+	memcpy(pb->buf + pb->len, s, n);
+	pb->len += n;
+}
+
+static void pb_putc(PrintBuf *pb, char c)
+{
+	if (pb->len == PRINT_BUF_SIZE)
+		pb_flush(pb);
+	pb->buf[pb->len++] = c;
+}
+
+static void pb_newline(PrintBuf *pb, int level)
+{
+	size_t spaces = level > 0 ? (size_t)level * 2 : 0;
+	size_t chunk = sizeof(newline_indent) - 2;
+
+	pb_write(pb, newline_indent, 1 + (spaces < chunk ? spaces : chunk));
+	while (spaces > chunk) {
+		spaces -= chunk;
+		pb_write(pb, newline_indent + 1, spaces < chunk ? spaces : chunk);
+	}
+}
+
+/* Write a number, true, false or null, colored per character */
+static void print_scalar(PrintBuf *pb, const char *tok, size_t len, int color)
+{
+	size_t i;
+
+	if (!color) {
+		pb_write(pb, tok, len);
+		return;
+	}
+	for (i = 0; i < len; i++) {
+		char c = tok[i];
+		if (c == 't' || c == 'f' || c == 'n')
+			PB_LIT(pb, C_BOOL);
+		else if ((c >= '0' && c <= '9') || c == '-' || c == '.')
+			PB_LIT(pb, C_NUMBER);
+		pb_putc(pb, c);
+	}
+}
+
+/* -sats on one number: the -?digits[.digits] prefix is converted if it
+ * has exactly 8 decimals; anything after it is kept */
+static int print_sats(PrintBuf *pb, const char *tok, size_t len, int color)
+{
+	char numbuf[64];
+	size_t n = 0;
+
+	if (n < len && tok[n] == '-') n++;
+	while (n < len && isdigit((unsigned char)tok[n])) n++;
+	if (n < len && tok[n] == '.') {
+		n++;
+		while (n < len && isdigit((unsigned char)tok[n])) n++;
+	}
+	if (n >= sizeof(numbuf)) return 0;
+	memcpy(numbuf, tok, n);
+	numbuf[n] = '\0';
+	if (!is_btc_amount(numbuf)) return 0;
+
+	double btc = strtod(numbuf, NULL);
+	long long sats = (long long)(btc * 100000000.0 + (btc >= 0 ? 0.5 : -0.5));
+	char satbuf[32];
+	int slen = snprintf(satbuf, sizeof(satbuf), "%lld", sats);
+	print_scalar(pb, satbuf, (size_t)slen, color);
+	print_scalar(pb, tok + n, len - n, color);
+	return 1;
+}
+
+void format_print_json(FILE *out, const char *json, size_t len, int indent, int flags)
+{
+	PrintBuf *pb = &print_buf;
+	const char *p = json;
+	const char *end = json + len;
+	const char *key = NULL;     /* Key of the member being printed */
+	size_t key_len = 0;
+	int after_colon = 0;        /* Next token is a member's value */
+	int color = flags & FORMAT_COLOR;
+	int level = indent;
+
+	/* Whatever stdio holds goes first */
+	fflush(out);
+	pb->out = out;
+	pb->fd = fileno(out);
+	pb->len = 0;
+
+	while (p < end) {
+		char c = *p;
+
+		switch (c) {
+		case '"': {
+			const char *q = json_skip_string(p);
+			const char *ahead;
+			int is_key;
+
+			if (!q || q > end) q = end;
+			ahead = q;
+			while (ahead < end && (*ahead == ' ' || *ahead == '\t' ||
+			                       *ahead == '\n' || *ahead == '\r'))
+				ahead++;
+			is_key = ahead < end && *ahead == ':';
+			if (is_key) {
+				key = p + 1;
+				key_len = q - p - 2;
+			}
+			if (color) {
+				if (is_key) PB_LIT(pb, C_KEY);
+				else PB_LIT(pb, C_STRING);
+			}
+			pb_write(pb, p, q - p);
+			if (color) PB_LIT(pb, C_RESET);
+			after_colon = 0;
+			p = q;
+			continue;
+		}
+		case '{':
+		case '[': {
+			/* Empty container — print compacted on same line */
+			const char *peek = p + 1;
+			char closing = (c == '{') ? '}' : ']';
+			while (peek < end && (*peek == ' ' || *peek == '\t' ||
+			                      *peek == '\n' || *peek == '\r'))
+				peek++;
+			if (color) PB_LIT(pb, C_BRACE);
+			pb_putc(pb, c);
+			if (peek < end && *peek == closing) {
+				pb_putc(pb, closing);
+				p = peek;
+				if (color) PB_LIT(pb, C_RESET);
+			} else {
+				if (color) PB_LIT(pb, C_RESET);
+				pb_newline(pb, ++level);
+			}
+			after_colon = 0;
+			break;
+		}
+		case '}':
+		case ']':
+			pb_newline(pb, --level);
+			if (color) PB_LIT(pb, C_BRACE);
+			pb_putc(pb, c);
+			if (color) PB_LIT(pb, C_RESET);
+			break;
+		case ',':
+			pb_putc(pb, ',');
+			pb_newline(pb, level);
+			after_colon = 0;
+			break;
+		case ':':
+			PB_LIT(pb, ": ");
+			after_colon = 1;
+			break;
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\r':
+			break;
+		default: {
+			/* Numbers, booleans, null */
+			const char *tok = p;
+			size_t tlen;
+			int done = 0;
+
+			while (p < end && !token_end[(unsigned char)*p])
+				p++;
+			tlen = p - tok;
+
+			if (*tok == '-' || isdigit((unsigned char)*tok)) {
+				if ((flags & FORMAT_HUMAN) && after_colon && key) {
+					char human_buf[128];
+					int hlen = humanize_number(human_buf, sizeof(human_buf), tok, tlen,
+					                           classify_key(key, key_len));
+					if (hlen > 0) {
+						/* Printed as the string it becomes */
+						if (color) PB_LIT(pb, C_STRING);
+						pb_write(pb, human_buf, hlen);
+						if (color) PB_LIT(pb, C_RESET);
+						after_colon = 0;
+						continue;
+					}
+				}
+				if ((flags & FORMAT_SATS) &&
+				    (after_colon || (tok > json && (tok[-1] == '[' || tok[-1] == ','))))
+					done = print_sats(pb, tok, tlen, color);
+			}
+			if (!done)
+				print_scalar(pb, tok, tlen, color);
+			if (color && (p == end || *p == ',' || *p == '}' || *p == ']' ||
+			              *p == ' ' || *p == '\n'))
+				PB_LIT(pb, C_RESET);
+			after_colon = 0;
+			continue;
+		}
+		}
+		p++;
+	}
+	pb_putc(pb, '\n');
+	pb_flush(pb);
+}
@@ -1,9 +1,11 @@
-/* Output formatting extensions: -field, -sats, -format=table/csv */
+/* Output formatting extensions: -field, -sats, -human, -format=table/csv,
+ * pretty printing */
 
 #ifndef FORMAT_H
 #define FORMAT_H
 
 #include <stdio.h>
+#include "json.h"
 
 /* Extract a JSON field by dotted path (e.g., "softforks.taproot.active")
  * Returns malloc'd string with the extracted value, or NULL if not found.
@@ -11,6 +13,12 @@
  */
 char *format_extract_field(const char *json, const char *path);
 
+/* Locate the value at a -field path without copying it.
+ * Returns a pointer into json and sets *len to the length of the raw
+ * value (strings keep their quotes), or NULL if not found.
+ */
+const char *format_find_field(const char *json, const char *path, size_t *len);
+
 /* Convert BTC amounts (8-decimal floats) to satoshis in JSON output.
  * Returns malloc'd string with converted output. Caller frees.
  */
@@ -26,10 +34,36 @@ int format_table(FILE *out, const char *json);
  */
 int format_csv(FILE *out, const char *json);
 
+/* Streaming -format=csv: pass format_csv_event as the JsonStream callback
+ * (with the CsvStream as ctx) and feed it a JSON-RPC response. Rows are
+ * written as each object of the result array completes, so the response
+ * is never held in memory.
+ * format_csv_stream_end() frees cs and returns 0 if the table was written,
+ * -1 on a malformed response, or 1 if the result is not an array of
+ * objects: *response is then the (malloc'd) response rebuilt as compact
+ * JSON, for the non-streaming output path.
+ */
+typedef struct CsvStream CsvStream;
+CsvStream *format_csv_stream_new(FILE *out);
+int format_csv_event(void *ctx, JsonEvent ev, const char *text, size_t len);
+int format_csv_stream_end(CsvStream *cs, int parse_status, char **response);
+
 /* Humanize JSON values: timestamps to dates, byte sizes to KB/MB/GB,
  * durations to d/h/m, large numbers to K/M/B/T, progress to %.
  * Returns malloc'd string with transformed output. Caller frees.
  */
 char *format_human(const char *json);
 
+/* Flags for format_print_json() */
+#define FORMAT_COLOR  0x01   /* ANSI colors */
+#define FORMAT_HUMAN  0x02   /* Apply -human to values as they print */
+#define FORMAT_SATS   0x04   /* Apply -sats to values as they print */
+
+/* Pretty print the JSON text json[0..len) to out, starting at indent
+ * level indent. -human and -sats are applied in the same pass, so the
+ * output matches format_human()/format_sats() followed by printing,
+ * without building either intermediate copy.
+ */
+void format_print_json(FILE *out, const char *json, size_t len, int indent, int flags);
+
 #endif
@@ -0,0 +1,366 @@
+/* Local height -> block hash index (-hashindex)
+ *
+ * The file is a header followed by one 32-byte hash per height at
+ * HASHIDX_HEADER + height * 32, in the byte order they are shown in. An
+ * all-zero hash (including the holes of a sparse file) is unknown. The
+ * header's count is one past the highest height recorded and the file is
+ * always at least that long.
+ *
+ * All hashes below count come from one chain, the one the index was last
+ * synced against, so checking the highest of them against the node
+ * checks them all; when it no longer matches, the heights from the fork
+ * point up are cut off.
+ *
+ * The address range for HASHIDX_MAX_HEIGHTS heights is mapped once and
+ * only the part within the file is ever touched. Changes are made under
+ * an exclusive flock(), reads under a shared one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hashidx.h"
+#include "json.h"
+#include "methods.h"
+
+#define HASHIDX_MAGIC "BTCHIDX1"
+#define HASHIDX_HEADER 32
+#define HASHIDX_MAX_HEIGHTS (1 << 22)
+/* The file grows by this many heights at a time */
+#define HASHIDX_GROW 4096
+
+typedef struct {
+	char magic[8];
+	uint64_t count;     /* One past the highest height recorded */
+	uint8_t reserved[16];
+} HashIdxHeader;
+
+struct HashIdx {
+	int fd;
+	uint8_t *map;
+};
+
+#define MAP_SIZE ((size_t)HASHIDX_HEADER + (size_t)HASHIDX_MAX_HEIGHTS * 32)
+#define HEADER(x) ((HashIdxHeader *)(x)->map)
+#define ENTRY(x, h) ((x)->map + HASHIDX_HEADER + (size_t)(h) * 32)
+
+static const uint8_t zero_hash[32];
+
+static int hex_to_hash(const char *hex, uint8_t *hash)
+{
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		char c = hex[i];
+		int v = c >= '0' && c <= '9' ? c - '0' :
+		        c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+		        c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+		if (v < 0)
+			return -1;
+		if (i % 2 == 0)
+			hash[i / 2] = (uint8_t)(v << 4);
+		else
+			hash[i / 2] |= (uint8_t)v;
+	}
+	return hex[64] == '\0' ? 0 : -1;
+}
+
+static void hash_to_hex(const uint8_t *hash, char *hex)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		hex[2 * i] = digits[hash[i] >> 4];
+		hex[2 * i + 1] = digits[hash[i] & 15];
+	}
+	hex[64] = '\0';
+}
+
+HashIdx *hashidx_open(const char *path)
+{
+	HashIdx *x = calloc(1, sizeof(*x));
+	struct stat st;
+
+	if (!x)
+		return NULL;
+	x->fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (x->fd < 0) {
+		free(x);
+		return NULL;
+	}
+	flock(x->fd, LOCK_EX);
+	if (fstat(x->fd, &st) < 0 ||
+	    (st.st_size < HASHIDX_HEADER && ftruncate(x->fd, HASHIDX_HEADER) < 0) ||
+	    fstat(x->fd, &st) < 0)
+		goto fail;
+	x->map = mmap(NULL, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, x->fd, 0);
+	if (x->map == MAP_FAILED) {
+		x->map = NULL;
+		goto fail;
+	}
+	/* A file of another layout, or one cut short, starts over */
+	if (memcmp(HEADER(x)->magic, HASHIDX_MAGIC, 8) != 0 ||
+	    HEADER(x)->count > HASHIDX_MAX_HEIGHTS ||
+	    HASHIDX_HEADER + HEADER(x)->count * 32 > (uint64_t)st.st_size) {
+		if (ftruncate(x->fd, HASHIDX_HEADER) < 0)
+			goto fail;
+		memset(HEADER(x), 0, sizeof(HashIdxHeader));
+		memcpy(HEADER(x)->magic, HASHIDX_MAGIC, 8);
+	}
+	flock(x->fd, LOCK_UN);
+	return x;
+
+fail:
+	flock(x->fd, LOCK_UN);
+	hashidx_close(x);
+	return NULL;
+}
+
+/* Callers hold the lock */
+static int entry_get(HashIdx *x, int64_t height, char *hex)
+{
+	if (height < 0 || (uint64_t)height >= HEADER(x)->count ||
+	    memcmp(ENTRY(x, height), zero_hash, 32) == 0)
+		return -1;
+	hash_to_hex(ENTRY(x, height), hex);
+	return 0;
+}
+
+static int entry_put(HashIdx *x, int64_t height, const char *hex)
+{
+	uint8_t hash[32];
+
+	if (height < 0 || height >= HASHIDX_MAX_HEIGHTS || hex_to_hash(hex, hash) < 0)
+		return -1;
+	if ((uint64_t)height >= HEADER(x)->count) {
+		/* Grow the file first, so the mapping is never used past its end */
+		uint64_t size = HASHIDX_HEADER +
+		                ((uint64_t)height / HASHIDX_GROW + 1) * HASHIDX_GROW * 32;
+		struct stat st;
+
+		if (fstat(x->fd, &st) < 0 ||
+		    ((uint64_t)st.st_size < size && ftruncate(x->fd, size) < 0))
+			return -1;
+		HEADER(x)->count = height + 1;
+	}
+	memcpy(ENTRY(x, height), hash, 32);
+	return 0;
+}
+
+/* Drop the heights from count up; the file is cut to match, so the
+ * hashes past count are zero when it grows again */
+static void entries_truncate(HashIdx *x, uint64_t count)
+{
+	if (count >= HEADER(x)->count)
+		return;
+	HEADER(x)->count = count;
+	(void)ftruncate(x->fd, HASHIDX_HEADER + count * 32);
+}
+
+int hashidx_get(HashIdx *x, int64_t height, char *hex)
+{
+	int ret;
+
+	flock(x->fd, LOCK_SH);
+	ret = entry_get(x, height, hex);
+	flock(x->fd, LOCK_UN);
+	return ret;
+}
+
+void hashidx_put(HashIdx *x, int64_t height, const char *hex)
+{
+	flock(x->fd, LOCK_EX);
+	entry_put(x, height, hex);
+	flock(x->fd, LOCK_UN);
+}
+
+int64_t hashidx_tip(HashIdx *x)
+{
+	int64_t tip;
+
+	flock(x->fd, LOCK_SH);
+	tip = (int64_t)HEADER(x)->count - 1;
+	flock(x->fd, LOCK_UN);
+	return tip;
+}
+
+/* The string result of a batch element, or NULL */
+static const char *element_hash(JsonTape *t, int elem, char *hex)
+{
+	int r = elem > 0 ? json_tape_get(t, elem, "result") : -1;
+
+	return r > 0 && json_tape_string(t, r, hex, 65) == 64 ? hex : NULL;
+}
+
+/* How many heights of the index to keep when its highest hash (at top)
+ * is not the node's any more: up to the fork point of the chain it was
+ * on. That chain is one of the node's other tips, or leads to one; if
+ * the index has that tip's hash the fork point is known, otherwise the
+ * lowest fork point of the tips above top is checked with another call.
+ * 0 if the index has nothing in common with the node's chain. */
+static uint64_t fork_keep(HashIdx *x, RpcClient *rpc, JsonTape *t, int tips,
+                          int64_t top)
+{
+	int64_t low = -1;
+	char hex[65], mine[65], params[32];
+	char *response, *result;
+	int tip, code = 0, same;
+
+	if (tips <= 0 || t->tok[tips].type != JSON_ARRAY)
+		return 0;
+	for (tip = json_tape_child(t, tips); tip > 0; tip = json_tape_next(t, tip)) {
+		int status = json_tape_get(t, tip, "status");
+		int height = json_tape_get(t, tip, "height");
+		int branchlen = json_tape_get(t, tip, "branchlen");
+		int hash = json_tape_get(t, tip, "hash");
+		char st[32];
+		int64_t h, fork;
+
+		if (status < 0 || height < 0 || branchlen < 0 || hash < 0 ||
+		    json_tape_string(t, status, st, sizeof(st)) < 0 ||
+		    strcmp(st, "active") == 0)
+			continue;
+		h = json_tape_int(t, height);
+		fork = h - json_tape_int(t, branchlen);
+		if (h < top || fork > top)
+			continue;
+		flock(x->fd, LOCK_SH);
+		same = entry_get(x, h, mine) == 0 &&
+		       json_tape_string(t, hash, hex, sizeof(hex)) == 64 &&
+		       strcmp(hex, mine) == 0;
+		flock(x->fd, LOCK_UN);
+		if (same)
+			return fork + 1;
+		if (low < 0 || fork < low)
+			low = fork;
+	}
+	if (low < 0)
+		return 0;
+
+	flock(x->fd, LOCK_SH);
+	same = entry_get(x, low, mine) == 0;
+	flock(x->fd, LOCK_UN);
+	if (!same)
+		return 0;
+	snprintf(params, sizeof(params), "[%lld]", (long long)low);
+	response = rpc_call(rpc, "getblockhash", params);
+	result = response ? method_take_result(response, &code) : NULL;
+	same = result && code == 0 && strcmp(result, mine) == 0;
+	free(result);
+	return same ? (uint64_t)low + 1 : 0;
+}
+
+int hashidx_sync(HashIdx *x, RpcClient *rpc, int64_t first, int count)
+{
+	char top_hex[65], hex[65], best[65];
+	char *batch, *b, *response;
+	int *elems = NULL;
+	int64_t top;
+	int64_t best_height = -1;
+	int i, n = 0, idx, ret = -1;
+	JsonTape tape;
+
+	/* The highest hash recorded */
+	flock(x->fd, LOCK_SH);
+	for (top = (int64_t)HEADER(x)->count - 1; top >= 0; top--)
+		if (entry_get(x, top, top_hex) == 0)
+			break;
+	flock(x->fd, LOCK_UN);
+
+	batch = malloc((size_t)(count + 2) * 96 + 2);
+	if (!batch)
+		return -1;
+	b = batch;
+	b += sprintf(b, "[{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"getchaintips\",\"params\":[]},"
+	             "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"getblockhash\",\"params\":[%lld]}",
+	             (long long)(top > 0 ? top : 0));
+	for (i = 0; i < count; i++)
+		b += sprintf(b, ",{\"jsonrpc\":\"2.0\",\"id\":%d,"
+		             "\"method\":\"getblockhash\",\"params\":[%lld]}",
+		             i + 2, (long long)(first + i));
+	strcpy(b, "]");
+	response = rpc_call_batch(rpc, batch);
+	free(batch);
+
+	memset(&tape, 0, sizeof(tape));
+	elems = malloc(sizeof(int) * (count + 2));
+	if (!response || !elems ||
+	    json_tape_parse(&tape, response, strlen(response)) < 0 ||
+	    tape.count == 0 || tape.tok[0].type != JSON_ARRAY)
+		goto done;
+	/* Elements come back in the order they were sent */
+	for (idx = json_tape_child(&tape, 0); idx > 0 && n < count + 2;
+	     idx = json_tape_next(&tape, idx))
+		elems[n++] = idx;
+	if (n < 2)
+		goto done;
+	ret = 0;
+
+	if (top >= 0) {
+		const char *check = element_hash(&tape, elems[1], hex);
+		uint64_t keep = HEADER(x)->count;
+
+		if (!check || strcmp(check, top_hex) != 0)
+			keep = fork_keep(x, rpc, &tape,
+			                 json_tape_get(&tape, elems[0], "result"), top);
+		flock(x->fd, LOCK_EX);
+		/* Unless another process has been at it meanwhile */
+		if (entry_get(x, top, hex) == 0 && strcmp(hex, top_hex) == 0)
+			entries_truncate(x, keep);
+		flock(x->fd, LOCK_UN);
+	}
+
+	/* The tip, with hash and height from the same getchaintips entry:
+	 * the calls of a batch are not atomic, so a hash from another call
+	 * could be of a block that connected in between */
+	{
+		int tips = json_tape_get(&tape, elems[0], "result");
+		int tip;
+
+		for (tip = tips > 0 ? json_tape_child(&tape, tips) : -1; tip > 0;
+		     tip = json_tape_next(&tape, tip)) {
+			int status = json_tape_get(&tape, tip, "status");
+			int height = json_tape_get(&tape, tip, "height");
+			int hash = json_tape_get(&tape, tip, "hash");
+			char st[16];
+
+			if (status > 0 && height > 0 && hash > 0 &&
+			    json_tape_string(&tape, status, st, sizeof(st)) > 0 &&
+			    strcmp(st, "active") == 0 &&
+			    json_tape_string(&tape, hash, best, sizeof(best)) == 64)
+				best_height = json_tape_int(&tape, height);
+		}
+	}
+
+	flock(x->fd, LOCK_EX);
+	if (best_height >= 0)
+		entry_put(x, best_height, best);
+	for (i = 2; i < n; i++)
+		if (element_hash(&tape, elems[i], hex))
+			entry_put(x, first + i - 2, hex);
+	flock(x->fd, LOCK_UN);
+
+done:
+	json_tape_free(&tape);
+	free(elems);
+	free(response);
+	return ret;
+}
+
+void hashidx_close(HashIdx *x)
+{
+	if (!x)
+		return;
+	if (x->map)
+		munmap(x->map, MAP_SIZE);
+	if (x->fd >= 0)
+		close(x->fd);
+	free(x);
+}
@@ -0,0 +1,37 @@
+/* Local height -> block hash index (-hashindex) */
+
+#ifndef HASHIDX_H
+#define HASHIDX_H
+
+#include <stdint.h>
+#include "rpc.h"
+
+typedef struct HashIdx HashIdx;
+
+/* Open (creating it if needed) the index file at path: 32-byte hashes at
+ * fixed offsets by height, memory-mapped. Several processes may share
+ * it. Returns NULL if it cannot be used. */
+HashIdx *hashidx_open(const char *path);
+
+/* The hash at height as 64 hex digits in hex, if the index has it.
+ * Returns 0, or -1 if it does not. */
+int hashidx_get(HashIdx *idx, int64_t height, char *hex);
+
+/* Record the node's hash for height (64 hex digits). Only hashes of the
+ * chain the index was last synced against belong in it. */
+void hashidx_put(HashIdx *idx, int64_t height, const char *hex);
+
+/* The highest height the index has a hash for: the node's tip when it
+ * was last synced, or -1 if it is empty */
+int64_t hashidx_tip(HashIdx *idx);
+
+/* Check the index against the node's chain (getchaintips, whose active
+ * tip is recorded, and the hash of its highest height) and drop the heights
+ * a reorg replaced, filling in the count heights from first (which may
+ * be 0) from the same batch call. Heights past the tip are skipped.
+ * Returns 0, or -1 if the node could not be asked. */
+int hashidx_sync(HashIdx *idx, RpcClient *rpc, int64_t first, int count);
+
+void hashidx_close(HashIdx *idx);
+
+#endif
@@ -3,9 +3,13 @@
 #include "json.h"
 #include <string.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <ctype.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
 const char *json_skip_ws(const char *p)
 {
 	while (*p && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
@@ -13,6 +17,132 @@ const char *json_skip_ws(const char *p)
 	return p;
 }
 
+/* ─── Structural scanning ───────────────────────────────────────────── */
+
+/*
+ * scan(p, a, b, c) returns the first byte at or after p that is a, b, c
+ * or the terminating NUL. Navigation only needs to stop at quotes,
+ * backslashes and brackets, so the vector kernels test 16 or 32 bytes
+ * per step and skip everything else (hex strings, numbers, keys).
+ *
+ * The vector kernels use aligned loads: an aligned block never crosses a
+ * page boundary, so reading the rest of the block that holds the NUL is
+ * safe even though it is past the end of the string (as in strlen()).
+ * Bits for bytes before p in the first block are masked off.
+ */
+typedef const char *(*ScanFn)(const char *p, char a, char b, char c);
+
+/* Portable fallback: test 8 bytes per step with word arithmetic. A set
+ * high bit in swar_zero(x) marks (at least) the first zero byte of x. */
+#define SWAR_ONES  0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+#define swar_zero(x) (((x) - SWAR_ONES) & ~(x) & SWAR_HIGHS)
+
+static const char *scan_scalar(const char *p, char a, char b, char c)
+{
+	const uint64_t ma = SWAR_ONES * (unsigned char)a;
+	const uint64_t mb = SWAR_ONES * (unsigned char)b;
+	const uint64_t mc = SWAR_ONES * (unsigned char)c;
+
+	/* Bytewise up to an aligned word */
+	while ((uintptr_t)p & 7) {
+		if (!*p || *p == a || *p == b || *p == c)
+			return p;
+		p++;
+	}
+	for (;;) {
+		uint64_t x;
+		memcpy(&x, p, 8);
+		if (swar_zero(x) | swar_zero(x ^ ma) | swar_zero(x ^ mb) | swar_zero(x ^ mc))
+			break;
+		p += 8;
+	}
+	/* The match is within this word */
+	while (*p && *p != a && *p != b && *p != c)
+		p++;
+	return p;
+}
+
+#ifdef JSON_SCAN_X86
+__attribute__((target("sse2")))
+static const char *scan_sse2(const char *p, char a, char b, char c)
+{
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	const __m128i vc = _mm_set1_epi8(c);
+	const __m128i zero = _mm_setzero_si128();
+	size_t off = (uintptr_t)p & 15;
+	const __m128i *blk = (const __m128i *)(p - off);
+	unsigned int mask;
+
+	for (;;) {
+		__m128i v = _mm_load_si128(blk);
+		__m128i hit = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, vc), _mm_cmpeq_epi8(v, zero)));
+		mask = (unsigned int)_mm_movemask_epi8(hit) >> off << off;
+		if (mask)
+			return (const char *)blk + __builtin_ctz(mask);
+		off = 0;
+		blk++;
+	}
+}
+
+__attribute__((target("avx2")))
+static const char *scan_avx2(const char *p, char a, char b, char c)
+{
+	const __m256i va = _mm256_set1_epi8(a);
+	const __m256i vb = _mm256_set1_epi8(b);
+	const __m256i vc = _mm256_set1_epi8(c);
+	const __m256i zero = _mm256_setzero_si256();
+	size_t off = (uintptr_t)p & 31;
+	const __m256i *blk = (const __m256i *)(p - off);
+	uint32_t mask;
+
+	for (;;) {
+		__m256i v = _mm256_load_si256(blk);
+		__m256i hit = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, vc), _mm256_cmpeq_epi8(v, zero)));
+		mask = (uint32_t)_mm256_movemask_epi8(hit) >> off << off;
+		if (mask)
+			return (const char *)blk + __builtin_ctz(mask);
+		off = 0;
+		blk++;
+	}
+}
+#endif
+
+/* First call picks the widest kernel the CPU supports */
+static const char *scan_init(const char *p, char a, char b, char c);
+static ScanFn scan = scan_init;
+
+static const char *scan_init(const char *p, char a, char b, char c)
+{
+	scan = scan_scalar;
+#ifdef JSON_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		scan = scan_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		scan = scan_sse2;
+#endif
+	return scan(p, a, b, c);
+}
+
+const char *json_skip_string(const char *p)
+{
+	p++;
+	for (;;) {
+		p = scan(p, '"', '\\', '\\');
+		if (*p == '"')
+			return p + 1;
+		if (*p == '\0' || p[1] == '\0')
+			return NULL;
+		p += 2;  /* Escaped character */
+	}
+}
+
 const char *json_find_closing(const char *p)
 {
 	char open, close;
@@ -23,48 +153,82 @@ const char *json_find_closing(const char *p)
 	else return NULL;
 
 	p++;
-	while (*p && depth > 0) {
+	for (;;) {
+		p = scan(p, '"', open, close);
 		if (*p == '"') {
-			p++;
-			while (*p && *p != '"') {
-				if (*p == '\\' && *(p+1)) p++;
-				p++;
-			}
-			if (*p == '"') p++;
+			p = json_skip_string(p);
+			if (!p) return NULL;
 		} else if (*p == open) {
 			depth++; p++;
 		} else if (*p == close) {
-			depth--;
-			if (depth == 0) return p;
+			if (--depth == 0) return p;
 			p++;
 		} else {
-			p++;
+			return NULL;
 		}
 	}
-	return NULL;
 }
 
-const char *json_find_value(const char *json, const char *key)
+/* Skip one value (string, container, or scalar); returns pointer past it */
+static const char *skip_value(const char *p)
+{
+	if (*p == '{' || *p == '[') {
+		const char *closing = json_find_closing(p);
+		return closing ? closing + 1 : NULL;
+	}
+	if (*p == '"')
+		return json_skip_string(p);
+	while (*p && *p != ',' && *p != ']' && *p != '}' && !isspace((unsigned char)*p))
+		p++;
+	return p;
+}
+
+const char *json_object_get(const char *obj, const char *key)
 {
-	char pattern[512];
+	size_t klen = strlen(key);
 	const char *p;
 
-	snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-	p = json;
-	while ((p = strstr(p, pattern)) != NULL) {
-		p += strlen(pattern);
+	if (!obj)
+		return NULL;
+	p = json_skip_ws(obj);
+	if (*p != '{')
+		return NULL;
+	p++;
+
+	while (1) {
+		const char *kstart;
+		int match;
+
 		p = json_skip_ws(p);
-		if (*p == ':') {
-			p++;
-			return json_skip_ws(p);
-		}
+		if (*p != '"')
+			return NULL;
+		kstart = p + 1;
+		p = json_skip_string(p);
+		if (!p)
+			return NULL;
+		match = (size_t)(p - 1 - kstart) == klen && memcmp(kstart, key, klen) == 0;
+
+		p = json_skip_ws(p);
+		if (*p != ':')
+			return NULL;
+		p = json_skip_ws(p + 1);
+		if (match)
+			return p;
+
+		/* Not this member — skip its value without descending */
+		p = skip_value(p);
+		if (!p)
+			return NULL;
+		p = json_skip_ws(p);
+		if (*p != ',')
+			return NULL;
+		p++;
 	}
-	return NULL;
 }
 
 int json_get_string(const char *json, const char *key, char *out, size_t out_size)
 {
-	const char *val = json_find_value(json, key);
+	const char *val = json_object_get(json, key);
 	const char *p;
 	size_t i = 0;
 
@@ -96,63 +260,35 @@ int json_get_string(const char *json, const char *key, char *out, size_t out_siz
 
 int64_t json_get_int(const char *json, const char *key)
 {
-	const char *val = json_find_value(json, key);
+	const char *val = json_object_get(json, key);
 	if (!val) return 0;
 	return strtoll(val, NULL, 10);
 }
 
 double json_get_double(const char *json, const char *key)
 {
-	const char *val = json_find_value(json, key);
+	const char *val = json_object_get(json, key);
 	if (!val) return 0.0;
 	return strtod(val, NULL);
 }
 
 int json_is_null(const char *json, const char *key)
 {
-	const char *val = json_find_value(json, key);
+	const char *val = json_object_get(json, key);
 	if (!val) return 0;
 	return (strncmp(val, "null", 4) == 0);
 }
 
 const char *json_find_array(const char *json, const char *key)
 {
-	char pattern[512];
-	const char *p;
-
-	snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-	p = json;
-	while ((p = strstr(p, pattern)) != NULL) {
-		p += strlen(pattern);
-		p = json_skip_ws(p);
-		if (*p == ':') {
-			p++;
-			p = json_skip_ws(p);
-			if (*p == '[')
-				return p;
-		}
-	}
-	return NULL;
+	const char *val = json_object_get(json, key);
+	return val && *val == '[' ? val : NULL;
 }
 
 const char *json_find_object(const char *json, const char *key)
 {
-	char pattern[512];
-	const char *p;
-
-	snprintf(pattern, sizeof(pattern), "\"%s\"", key);
-	p = json;
-	while ((p = strstr(p, pattern)) != NULL) {
-		p += strlen(pattern);
-		p = json_skip_ws(p);
-		if (*p == ':') {
-			p++;
-			p = json_skip_ws(p);
-			if (*p == '{')
-				return p;
-		}
-	}
-	return NULL;
+	const char *val = json_object_get(json, key);
+	return val && *val == '{' ? val : NULL;
 }
 
 const char *json_array_next(const char *pos, const char **end)
@@ -179,13 +315,8 @@ const char *json_array_next(const char *pos, const char **end)
 			return NULL;
 		}
 	} else if (*p == '"') {
-		p++;
-		while (*p && *p != '"') {
-			if (*p == '\\' && *(p+1)) p++;
-			p++;
-		}
-		if (*p == '"') p++;
-		*end = p;
+		const char *str_end = json_skip_string(p);
+		*end = str_end ? str_end : p + strlen(p);
 	} else {
 		while (*p && *p != ',' && *p != ']' && *p != '}' && !isspace(*p))
 			p++;
@@ -215,3 +346,504 @@ char *json_element_copy(const char *elem, const char *elem_end, char *buf, size_
 	buf[len] = 0;
 	return buf;
 }
+
+/* ─── Tape parser ───────────────────────────────────────────────────── */
+
+static int tape_push(JsonTape *t, JsonType type, size_t start)
+{
+	if (t->count == t->cap) {
+		int cap = t->cap ? t->cap * 2 : 64;
+		JsonTok *tok = realloc(t->tok, cap * sizeof(JsonTok));
+		if (!tok)
+			return -1;
+		t->tok = tok;
+		t->cap = cap;
+	}
+	t->tok[t->count].type = type;
+	t->tok[t->count].start = (uint32_t)start;
+	t->tok[t->count].len = 0;
+	t->tok[t->count].next = 0;
+	t->tok[t->count].count = 0;
+	return t->count++;
+}
+
+/* Offset just past the closing quote of the string starting at i */
+static size_t tape_scan_string(const char *s, size_t i, size_t len)
+{
+	for (i++; i < len; i++) {
+		if (s[i] == '\\')
+			i++;
+		else if (s[i] == '"')
+			return i + 1;
+	}
+	return 0;
+}
+
+/* Nesting is tracked on an explicit stack so deep documents cannot
+ * overflow the C stack */
+#define TAPE_MAX_DEPTH 1024
+
+int json_tape_parse(JsonTape *t, const char *json, size_t len)
+{
+	int stack[TAPE_MAX_DEPTH];  /* Open containers */
+	int last[TAPE_MAX_DEPTH];   /* Last child (or key) of each container */
+	int depth = 0;
+	int expect_key = 0;         /* Next string in an object is a key */
+	size_t i = 0;
+
+	memset(t, 0, sizeof(*t));
+	t->src = json;
+	if (len > UINT32_MAX)
+		return -1;
+
+	for (;;) {
+		while (i < len && (json[i] == ' ' || json[i] == '\t' ||
+		       json[i] == '\n' || json[i] == '\r'))
+			i++;
+		if (i >= len)
+			break;
+
+		char c = json[i];
+		int idx;
+
+		if (c == ',' || c == ':') {
+			if (depth == 0)
+				goto fail;
+			if (c == ',')
+				expect_key = t->tok[stack[depth - 1]].type == JSON_OBJECT;
+			i++;
+			continue;
+		}
+		if (c == '}' || c == ']') {
+			if (depth == 0)
+				goto fail;
+			idx = stack[--depth];
+			if ((c == '}') != (t->tok[idx].type == JSON_OBJECT))
+				goto fail;
+			t->tok[idx].len = (uint32_t)(i + 1 - t->tok[idx].start);
+			expect_key = 0;
+			i++;
+			if (depth == 0)
+				break;
+			continue;
+		}
+		if (depth == 0 && t->count > 0)
+			goto fail;  /* Trailing data after the root value */
+
+		/* A new value (or object key): link it to its previous sibling */
+		if (c == '{') idx = tape_push(t, JSON_OBJECT, i);
+		else if (c == '[') idx = tape_push(t, JSON_ARRAY, i);
+		else if (c == '"') idx = tape_push(t, expect_key ? JSON_KEY : JSON_STRING, i);
+		else if (c == 't') idx = tape_push(t, JSON_TRUE, i);
+		else if (c == 'f') idx = tape_push(t, JSON_FALSE, i);
+		else if (c == 'n') idx = tape_push(t, JSON_NULL, i);
+		else if (c == '-' || (c >= '0' && c <= '9')) idx = tape_push(t, JSON_NUMBER, i);
+		else goto fail;
+		if (idx < 0)
+			goto fail;
+
+		if (depth > 0) {
+			JsonTok *parent = &t->tok[stack[depth - 1]];
+			/* Object members are linked key to key; values hang off
+			 * their key at key + 1 */
+			if (parent->type == JSON_ARRAY || t->tok[idx].type == JSON_KEY) {
+				if (parent->count > 0)
+					t->tok[last[depth - 1]].next = (uint32_t)idx;
+				last[depth - 1] = idx;
+				parent->count++;
+			}
+		}
+
+		if (c == '{' || c == '[') {
+			if (depth == TAPE_MAX_DEPTH)
+				goto fail;
+			stack[depth++] = idx;
+			expect_key = c == '{';
+			i++;
+			continue;
+		}
+		if (c == '"') {
+			size_t end = tape_scan_string(json, i, len);
+			if (!end)
+				goto fail;
+			t->tok[idx].len = (uint32_t)(end - i);
+			i = end;
+			expect_key = 0;
+		} else {
+			size_t end = i;
+			while (end < len && json[end] != ',' && json[end] != ']' &&
+			       json[end] != '}' && json[end] != ' ' && json[end] != '\t' &&
+			       json[end] != '\n' && json[end] != '\r')
+				end++;
+			t->tok[idx].len = (uint32_t)(end - i);
+			i = end;
+		}
+		if (depth == 0)
+			break;
+	}
+
+	if (depth != 0 || t->count == 0)
+		goto fail;
+	return 0;
+
+fail:
+	json_tape_free(t);
+	return -1;
+}
+
+void json_tape_free(JsonTape *t)
+{
+	free(t->tok);
+	t->tok = NULL;
+	t->count = 0;
+	t->cap = 0;
+}
+
+int json_tape_get(const JsonTape *t, int obj, const char *key)
+{
+	size_t klen = strlen(key);
+	int k;
+
+	if (obj < 0 || obj >= t->count || t->tok[obj].type != JSON_OBJECT ||
+	    t->tok[obj].count == 0)
+		return -1;
+
+	for (k = obj + 1; ; k = (int)t->tok[k].next) {
+		const JsonTok *kt = &t->tok[k];
+		if (kt->len - 2 == klen &&
+		    memcmp(t->src + kt->start + 1, key, klen) == 0)
+			return k + 1;
+		if (!kt->next)
+			return -1;
+	}
+}
+
+int json_tape_child(const JsonTape *t, int idx)
+{
+	if (idx < 0 || idx >= t->count || t->tok[idx].count == 0)
+		return -1;
+	if (t->tok[idx].type == JSON_OBJECT)
+		return idx + 2;  /* Value of the first member */
+	if (t->tok[idx].type == JSON_ARRAY)
+		return idx + 1;
+	return -1;
+}
+
+int json_tape_next(const JsonTape *t, int idx)
+{
+	if (idx < 0)
+		return -1;
+	if (idx > 0 && t->tok[idx - 1].type == JSON_KEY) {
+		/* Object member value: step to the next key's value */
+		uint32_t k = t->tok[idx - 1].next;
+		return k ? (int)k + 1 : -1;
+	}
+	return t->tok[idx].next ? (int)t->tok[idx].next : -1;
+}
+
+const char *json_tape_key(const JsonTape *t, int idx, size_t *len)
+{
+	if (idx <= 0 || t->tok[idx - 1].type != JSON_KEY)
+		return NULL;
+	*len = t->tok[idx - 1].len - 2;
+	return t->src + t->tok[idx - 1].start + 1;
+}
+
+int json_tape_string(const JsonTape *t, int idx, char *out, size_t out_size)
+{
+	const char *p, *end;
+	size_t i = 0;
+
+	if (idx < 0 || (t->tok[idx].type != JSON_STRING &&
+	    t->tok[idx].type != JSON_KEY)) {
+		if (out_size > 0) out[0] = 0;
+		return -1;
+	}
+	p = t->src + t->tok[idx].start + 1;
+	end = t->src + t->tok[idx].start + t->tok[idx].len - 1;
+	while (p < end && i < out_size - 1) {
+		if (*p == '\\' && p + 1 < end) {
+			p++;
+			switch (*p) {
+			case 'n': out[i++] = '\n'; break;
+			case 'r': out[i++] = '\r'; break;
+			case 't': out[i++] = '\t'; break;
+			default: out[i++] = *p; break;
+			}
+		} else {
+			out[i++] = *p;
+		}
+		p++;
+	}
+	out[i] = 0;
+	return (int)i;
+}
+
+int64_t json_tape_int(const JsonTape *t, int idx)
+{
+	if (idx < 0 || t->tok[idx].type != JSON_NUMBER)
+		return 0;
+	return strtoll(t->src + t->tok[idx].start, NULL, 10);
+}
+
+double json_tape_double(const JsonTape *t, int idx)
+{
+	if (idx < 0 || t->tok[idx].type != JSON_NUMBER)
+		return 0.0;
+	return strtod(t->src + t->tok[idx].start, NULL);
+}
+
+int json_tape_bool(const JsonTape *t, int idx)
+{
+	return idx >= 0 && t->tok[idx].type == JSON_TRUE;
+}
+
+/* ─── Streaming parser ──────────────────────────────────────────────── */
+
+enum {
+	JS_VALUE,    /* Expecting a value */
+	JS_KEY,      /* Expecting an object key */
+	JS_COLON,    /* Expecting ':' after a key */
+	JS_AFTER,    /* After a value: ',' or the container's close */
+	JS_STRING,   /* Inside a string or key */
+	JS_LITERAL,  /* Inside a number, true, false or null */
+	JS_DONE      /* Root value complete; only whitespace may follow */
+};
+
+void json_stream_init(JsonStream *js, JsonCallback cb, void *ctx)
+{
+	memset(js, 0, sizeof(*js));
+	js->cb = cb;
+	js->ctx = ctx;
+	js->state = JS_VALUE;
+}
+
+void json_stream_free(JsonStream *js)
+{
+	free(js->tok);
+	js->tok = NULL;
+	js->tok_len = 0;
+	js->tok_cap = 0;
+}
+
+/* Save part of a token that continues in the next chunk */
+static int stream_save(JsonStream *js, const char *p, size_t len)
+{
+	if (js->tok_len + len > js->tok_cap) {
+		size_t cap = js->tok_cap ? js->tok_cap : 256;
+		while (cap < js->tok_len + len)
+			cap *= 2;
+		char *tok = realloc(js->tok, cap);
+		if (!tok)
+			return -1;
+		js->tok = tok;
+		js->tok_cap = cap;
+	}
+	memcpy(js->tok + js->tok_len, p, len);
+	js->tok_len += len;
+	return 0;
+}
+
+static void stream_emit(JsonStream *js, JsonEvent ev, const char *text, size_t len)
+{
+	if (js->status == 0 && js->cb(js->ctx, ev, text, len) != 0)
+		js->status = 1;
+}
+
+/* Emit a token that ends at end within this chunk and began at start, or
+ * in an earlier chunk if part of it was saved */
+static void stream_emit_token(JsonStream *js, JsonEvent ev,
+                              const char *start, const char *end)
+{
+	if (js->tok_len > 0) {
+		if (stream_save(js, start, end - start) < 0) {
+			js->status = -1;
+			return;
+		}
+		stream_emit(js, ev, js->tok, js->tok_len);
+		js->tok_len = 0;
+	} else {
+		stream_emit(js, ev, start, end - start);
+	}
+}
+
+/* Classify a complete number or literal; -1 if invalid */
+static int stream_literal(const char *text, size_t len)
+{
+	size_t i;
+	if (len == 4 && memcmp(text, "true", 4) == 0) return JSON_EV_TRUE;
+	if (len == 5 && memcmp(text, "false", 5) == 0) return JSON_EV_FALSE;
+	if (len == 4 && memcmp(text, "null", 4) == 0) return JSON_EV_NULL;
+	for (i = 0; i < len; i++) {
+		char c = text[i];
+		if (!((c >= '0' && c <= '9') || c == '-' || c == '+' ||
+		      c == '.' || c == 'e' || c == 'E'))
+			return -1;
+	}
+	return JSON_EV_NUMBER;
+}
+
+static void stream_end_literal(JsonStream *js, const char *start, const char *end)
+{
+	const char *text = start;
+	size_t len = end - start;
+	int ev;
+
+	if (js->tok_len > 0) {
+		if (stream_save(js, start, end - start) < 0) {
+			js->status = -1;
+			return;
+		}
+		text = js->tok;
+		len = js->tok_len;
+	}
+	ev = stream_literal(text, len);
+	if (ev < 0)
+		js->status = -1;
+	else
+		stream_emit(js, (JsonEvent)ev, text, len);
+	js->tok_len = 0;
+	js->state = js->depth > 0 ? JS_AFTER : JS_DONE;
+}
+
+int json_stream_feed(JsonStream *js, const char *data, size_t len)
+{
+	const char *p = data;
+	const char *end = data + len;
+	const char *tok_start = data;  /* Start of the current token in this chunk */
+
+	while (p < end && js->status == 0) {
+		char c;
+
+		if (js->state == JS_STRING) {
+			const char *q, *bs;
+			if (js->escape) {
+				js->escape = 0;
+				p++;
+				continue;
+			}
+			/* Jump to the closing quote unless a backslash comes first */
+			q = memchr(p, '"', end - p);
+			bs = memchr(p, '\\', (q ? q : end) - p);
+			if (bs) {
+				p = bs + 1;
+				if (p < end)
+					p++;
+				else
+					js->escape = 1;
+				continue;
+			}
+			if (!q) {
+				p = end;
+				continue;
+			}
+			p = q + 1;
+			stream_emit_token(js, js->is_key ? JSON_EV_KEY : JSON_EV_STRING,
+			                  tok_start, p);
+			if (js->is_key)
+				js->state = JS_COLON;
+			else
+				js->state = js->depth > 0 ? JS_AFTER : JS_DONE;
+			continue;
+		}
+
+		if (js->state == JS_LITERAL) {
+			while (p < end && *p != ',' && *p != ']' && *p != '}' &&
+			       *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+				p++;
+			if (p < end)
+				stream_end_literal(js, tok_start, p);
+			continue;
+		}
+
+		c = *p;
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			p++;
+			continue;
+		}
+		if (js->state == JS_DONE) {
+			js->status = -1;
+			break;
+		}
+
+		switch (c) {
+		case '{':
+		case '[':
+			if (js->state != JS_VALUE || js->depth == JSON_STREAM_MAX_DEPTH) {
+				js->status = -1;
+				break;
+			}
+			js->stack[js->depth++] = c;
+			js->first = 1;
+			js->state = c == '{' ? JS_KEY : JS_VALUE;
+			stream_emit(js, c == '{' ? JSON_EV_OBJECT_START : JSON_EV_ARRAY_START, p, 1);
+			p++;
+			break;
+		case '}':
+		case ']':
+			if (js->depth == 0 || js->stack[js->depth - 1] != (c == '}' ? '{' : '[') ||
+			    !(js->state == JS_AFTER ||
+			      (js->first && js->state == (c == '}' ? JS_KEY : JS_VALUE)))) {
+				js->status = -1;
+				break;
+			}
+			js->depth--;
+			js->first = 0;
+			js->state = js->depth > 0 ? JS_AFTER : JS_DONE;
+			stream_emit(js, c == '}' ? JSON_EV_OBJECT_END : JSON_EV_ARRAY_END, p, 1);
+			p++;
+			break;
+		case ',':
+			if (js->state != JS_AFTER || js->depth == 0) {
+				js->status = -1;
+				break;
+			}
+			js->first = 0;
+			js->state = js->stack[js->depth - 1] == '{' ? JS_KEY : JS_VALUE;
+			p++;
+			break;
+		case ':':
+			if (js->state != JS_COLON) {
+				js->status = -1;
+				break;
+			}
+			js->state = JS_VALUE;
+			p++;
+			break;
+		case '"':
+			if (js->state != JS_KEY && js->state != JS_VALUE) {
+				js->status = -1;
+				break;
+			}
+			js->is_key = js->state == JS_KEY;
+			js->first = 0;
+			js->state = JS_STRING;
+			tok_start = p++;
+			break;
+		default:
+			if (js->state != JS_VALUE) {
+				js->status = -1;
+				break;
+			}
+			js->first = 0;
+			js->state = JS_LITERAL;
+			tok_start = p++;
+			break;
+		}
+	}
+
+	/* Keep a token that continues in the next chunk */
+	if (js->status == 0 && (js->state == JS_STRING || js->state == JS_LITERAL) &&
+	    stream_save(js, tok_start, end - tok_start) < 0)
+		js->status = -1;
+	return js->status;
+}
+
+int json_stream_finish(JsonStream *js)
+{
+	if (js->status == 0 && js->state == JS_LITERAL && js->depth == 0)
+		stream_end_literal(js, "", "");
+	if (js->status != 0)
+		return js->status;
+	return js->state == JS_DONE ? 0 : -1;
+}
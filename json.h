@@ -6,17 +6,104 @@
 #include <stddef.h>
 #include <stdint.h>
 
-const char *json_find_value(const char *json, const char *key);
+/* Look up key among the direct members of the object at obj only (NULL
+ * if obj is NULL or not an object). The helpers below look up the same
+ * way: json is the object itself, not a document that contains it. */
+const char *json_object_get(const char *obj, const char *key);
 int json_get_string(const char *json, const char *key, char *out, size_t out_size);
 int64_t json_get_int(const char *json, const char *key);
 double json_get_double(const char *json, const char *key);
 int json_is_null(const char *json, const char *key);
+/* The member's value if it is an array (object), else NULL */
 const char *json_find_array(const char *json, const char *key);
 const char *json_find_object(const char *json, const char *key);
 const char *json_array_next(const char *pos, const char **end);
 int json_array_count(const char *arr);
 const char *json_skip_ws(const char *p);
 const char *json_find_closing(const char *p);
+/* p at an opening quote: returns the byte past the closing quote, or NULL
+ * if the string is unterminated */
+const char *json_skip_string(const char *p);
 char *json_element_copy(const char *elem, const char *elem_end, char *buf, size_t buf_size);
 
+/* Tape parser: tokenizes a document once into a flat array of tokens.
+ * Containers record their child count and each member links to its next
+ * sibling, so lookups are scoped to one object and skip nested values in
+ * O(1). Tokens point into the source text, which must outlive the tape. */
+typedef enum {
+	JSON_NULL, JSON_FALSE, JSON_TRUE, JSON_NUMBER, JSON_STRING,
+	JSON_KEY, JSON_ARRAY, JSON_OBJECT
+} JsonType;
+
+typedef struct {
+	uint32_t start;  /* Offset in the source (at the quote or bracket) */
+	uint32_t len;    /* Length of the raw text, including quotes/brackets */
+	uint32_t next;   /* Next sibling element or key (0 = last) */
+	uint32_t count;  /* Container: number of elements or members */
+	uint8_t type;    /* JsonType */
+} JsonTok;
+
+typedef struct {
+	const char *src;
+	JsonTok *tok;
+	int count;
+	int cap;
+} JsonTape;
+
+/* Parse len bytes of json (index 0 is the root); returns 0 or -1 */
+int json_tape_parse(JsonTape *t, const char *json, size_t len);
+void json_tape_free(JsonTape *t);
+/* Value of member key in the object at obj, or -1 */
+int json_tape_get(const JsonTape *t, int obj, const char *key);
+/* First element / member value of a container, and the one after idx */
+int json_tape_child(const JsonTape *t, int idx);
+int json_tape_next(const JsonTape *t, int idx);
+/* Key of the object member whose value is at idx (not NUL-terminated) */
+const char *json_tape_key(const JsonTape *t, int idx, size_t *len);
+int json_tape_string(const JsonTape *t, int idx, char *out, size_t out_size);
+int64_t json_tape_int(const JsonTape *t, int idx);
+double json_tape_double(const JsonTape *t, int idx);
+int json_tape_bool(const JsonTape *t, int idx);
+
+/* Start of the raw text of the token at idx */
+#define json_tape_text(t, idx) ((t)->src + (t)->tok[idx].start)
+
+/* Streaming (push) parser: feed a document in chunks of any size, e.g. as
+ * they come off a socket, and receive one callback per token. Token text
+ * is raw JSON (strings and keys keep their quotes and escapes) and is only
+ * valid during the callback. A callback returning nonzero stops parsing. */
+typedef enum {
+	JSON_EV_OBJECT_START, JSON_EV_OBJECT_END,
+	JSON_EV_ARRAY_START, JSON_EV_ARRAY_END,
+	JSON_EV_KEY, JSON_EV_STRING, JSON_EV_NUMBER,
+	JSON_EV_TRUE, JSON_EV_FALSE, JSON_EV_NULL
+} JsonEvent;
+
+typedef int (*JsonCallback)(void *ctx, JsonEvent ev, const char *text, size_t len);
+
+#define JSON_STREAM_MAX_DEPTH 512
+
+typedef struct {
+	JsonCallback cb;
+	void *ctx;
+	int state;        /* What the next byte may be */
+	int depth;
+	char stack[JSON_STREAM_MAX_DEPTH];  /* '{' or '[' per open container */
+	int first;        /* Container just opened (may close immediately) */
+	int is_key;       /* String being read is an object key */
+	int escape;       /* Last byte of the previous chunk was a backslash */
+	char *tok;        /* Token split across chunks */
+	size_t tok_len;
+	size_t tok_cap;
+	int status;       /* 0 = ok, -1 = syntax error, 1 = stopped by callback */
+} JsonStream;
+
+void json_stream_init(JsonStream *js, JsonCallback cb, void *ctx);
+/* Returns js->status */
+int json_stream_feed(JsonStream *js, const char *data, size_t len);
+/* End of input: flushes a trailing number; returns 0 if a complete
+ * document was parsed, nonzero otherwise */
+int json_stream_finish(JsonStream *js);
+void json_stream_free(JsonStream *js);
+
 #endif
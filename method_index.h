@@ -0,0 +1,173 @@
+/* Generated from methods[] in methods.c by make; do not edit.
+ * Method names in strcmp order with their index in methods[]. */
+static const MethodIndex method_index[] = {
+	{"abandontransaction", 69},
+	{"abortrescan", 70},
+	{"addmultisigaddress", 162},
+	{"addnode", 89},
+	{"analyzepsbt", 79},
+	{"backupwallet", 43},
+	{"bumpfee", 37},
+	{"clearbanned", 93},
+	{"combinepsbt", 80},
+	{"combinerawtransaction", 87},
+	{"converttopsbt", 83},
+	{"createmultisig", 125},
+	{"createpsbt", 77},
+	{"createrawtransaction", 18},
+	{"createwallet", 40},
+	{"createwalletdescriptor", 134},
+	{"decodepsbt", 78},
+	{"decoderawtransaction", 19},
+	{"decodescript", 20},
+	{"deriveaddresses", 126},
+	{"descriptorprocesspsbt", 135},
+	{"disconnectnode", 90},
+	{"dumpprivkey", 45},
+	{"dumptxoutset", 136},
+	{"dumpwallet", 52},
+	{"echo", 168},
+	{"encryptwallet", 54},
+	{"enumeratesigners", 137},
+	{"estimatesmartfee", 33},
+	{"finalizepsbt", 81},
+	{"fundrawtransaction", 88},
+	{"generateblock", 102},
+	{"generatetoaddress", 101},
+	{"generatetodescriptor", 103},
+	{"getaddednodeinfo", 96},
+	{"getaddressesbylabel", 65},
+	{"getaddressinfo", 14},
+	{"getaddrmaninfo", 138},
+	{"getbalance", 10},
+	{"getbalances", 11},
+	{"getbestblockhash", 2},
+	{"getblock", 4},
+	{"getblockchaininfo", 0},
+	{"getblockcount", 1},
+	{"getblockfilter", 108},
+	{"getblockfrompeer", 139},
+	{"getblockhash", 3},
+	{"getblockheader", 5},
+	{"getblockstats", 109},
+	{"getblocktemplate", 104},
+	{"getchainstates", 140},
+	{"getchaintips", 7},
+	{"getchaintxstats", 110},
+	{"getconnectioncount", 28},
+	{"getdeploymentinfo", 141},
+	{"getdescriptoractivity", 142},
+	{"getdescriptorinfo", 127},
+	{"getdifficulty", 6},
+	{"gethdkeys", 143},
+	{"getindexinfo", 128},
+	{"getmemoryinfo", 131},
+	{"getmempoolancestors", 111},
+	{"getmempooldescendants", 112},
+	{"getmempoolentry", 113},
+	{"getmempoolinfo", 8},
+	{"getmininginfo", 99},
+	{"getnettotals", 94},
+	{"getnetworkhashps", 100},
+	{"getnetworkinfo", 26},
+	{"getnewaddress", 13},
+	{"getnodeaddresses", 95},
+	{"getorphantxs", 166},
+	{"getpeerinfo", 27},
+	{"getprioritisedtransactions", 144},
+	{"getrawaddrman", 167},
+	{"getrawchangeaddress", 64},
+	{"getrawmempool", 9},
+	{"getrawtransaction", 25},
+	{"getreceivedbyaddress", 60},
+	{"getreceivedbylabel", 61},
+	{"getrpcinfo", 132},
+	{"gettransaction", 58},
+	{"gettxout", 114},
+	{"gettxoutproof", 115},
+	{"gettxoutsetinfo", 116},
+	{"gettxspendingprevout", 145},
+	{"getunconfirmedbalance", 75},
+	{"getwalletinfo", 12},
+	{"getzmqnotifications", 146},
+	{"help", 29},
+	{"importaddress", 47},
+	{"importdescriptors", 49},
+	{"importmempool", 147},
+	{"importmulti", 51},
+	{"importprivkey", 46},
+	{"importprunedfunds", 148},
+	{"importpubkey", 48},
+	{"importwallet", 53},
+	{"invalidateblock", 120},
+	{"joinpsbts", 82},
+	{"keypoolrefill", 74},
+	{"listaddressgroupings", 76},
+	{"listbanned", 92},
+	{"listdescriptors", 50},
+	{"listlabels", 66},
+	{"listlockunspent", 72},
+	{"listreceivedbyaddress", 62},
+	{"listreceivedbylabel", 63},
+	{"listsinceblock", 59},
+	{"listtransactions", 16},
+	{"listunspent", 15},
+	{"listwalletdir", 149},
+	{"listwallets", 17},
+	{"loadtxoutset", 150},
+	{"loadwallet", 41},
+	{"lockunspent", 73},
+	{"logging", 133},
+	{"migratewallet", 151},
+	{"newkeypool", 163},
+	{"ping", 97},
+	{"preciousblock", 119},
+	{"prioritisetransaction", 107},
+	{"pruneblockchain", 122},
+	{"psbtbumpfee", 38},
+	{"reconsiderblock", 121},
+	{"removeprunedfunds", 152},
+	{"rescanblockchain", 71},
+	{"restorewallet", 44},
+	{"savemempool", 123},
+	{"scanblocks", 153},
+	{"scantxoutset", 118},
+	{"send", 36},
+	{"sendall", 154},
+	{"sendmany", 35},
+	{"sendrawtransaction", 23},
+	{"sendtoaddress", 34},
+	{"setban", 91},
+	{"sethdseed", 165},
+	{"setlabel", 67},
+	{"setnetworkactive", 98},
+	{"settxfee", 39},
+	{"setwalletflag", 155},
+	{"signmessage", 68},
+	{"signmessagewithprivkey", 129},
+	{"signrawtransactionwithkey", 22},
+	{"signrawtransactionwithwallet", 21},
+	{"simulaterawtransaction", 156},
+	{"stop", 30},
+	{"submitblock", 105},
+	{"submitheader", 106},
+	{"submitpackage", 157},
+	{"testmempoolaccept", 24},
+	{"unloadwallet", 42},
+	{"upgradewallet", 164},
+	{"uptime", 31},
+	{"utxoupdatepsbt", 84},
+	{"validateaddress", 32},
+	{"verifychain", 124},
+	{"verifymessage", 130},
+	{"verifytxoutproof", 117},
+	{"waitforblock", 158},
+	{"waitforblockheight", 159},
+	{"waitfornewblock", 160},
+	{"walletcreatefundedpsbt", 85},
+	{"walletdisplayaddress", 161},
+	{"walletlock", 56},
+	{"walletpassphrase", 55},
+	{"walletpassphrasechange", 57},
+	{"walletprocesspsbt", 86},
+};
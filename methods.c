@@ -5,10 +5,14 @@
 #include "sendtx.h"
 #include "verify.h"
 #include "fallback.h"
+#include "block.h"
+#include "cache.h"
+#include "hashidx.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 
 /* Global flag for named parameter mode */
 static int g_named_mode = 0;
@@ -21,6 +25,9 @@ static Network g_network = NET_MAINNET;
 /* Fallback broadcast settings */
 static FallbackConfig g_fallback_cfg;
 
+/* -rest: fetch blocks and transactions over REST and decode them here */
+static int g_rest = 0;
+
 void method_set_named_mode(int enabled)
 {
 	g_named_mode = enabled;
@@ -38,13 +45,194 @@ void method_set_fallback(const FallbackConfig *cfg)
 	g_fallback_cfg = *cfg;
 }
 
+void method_set_rest(int enabled, Network net)
+{
+	g_rest = enabled;
+	g_network = net;
+}
+
+/* -cache: results that cannot change, kept on disk */
+static Cache *g_cache = NULL;
+
+void method_set_cache(const char *path, size_t limit)
+{
+	g_cache = cache_open(path, limit);
+	if (!g_cache)
+		fprintf(stderr, "warning: Cannot use cache file %s\n", path);
+}
+
+/* Results that carry confirmations are cached only this deep, and
+ * getblockhash only this far below the tip, so that only a reorg deeper
+ * than that could make them stale */
+#define CACHE_DEPTH 100
+
+/* Methods whose results are cached, under the rules of cache_keep() */
+static int cache_method(const char *method)
+{
+	static const char *names[] = {
+		"getblock", "getblockheader", "getrawtransaction", "getblockhash",
+		"decoderawtransaction", "decodescript"
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (strcmp(method, names[i]) == 0)
+			return 1;
+	return 0;
+}
+
+/* The cache key: method, a NUL, then params without the whitespace
+ * outside strings */
+static char *cache_key(const char *method, const char *params, size_t *len)
+{
+	size_t mlen = strlen(method);
+	char *key = malloc(mlen + 1 + strlen(params) + 1), *k;
+	const char *p;
+	int in_string = 0;
+
+	if (!key)
+		return NULL;
+	memcpy(key, method, mlen + 1);
+	k = key + mlen + 1;
+	for (p = params; *p; p++) {
+		if (in_string) {
+			*k++ = *p;
+			if (*p == '\\' && p[1])
+				*k++ = *++p;
+			else if (*p == '"')
+				in_string = 0;
+		} else if (*p == '"') {
+			in_string = 1;
+			*k++ = *p;
+		} else if (!isspace((unsigned char)*p)) {
+			*k++ = *p;
+		}
+	}
+	*len = k - key;
+	return key;
+}
+
+static int64_t cache_tip(RpcClient *rpc)
+{
+	const char *response = rpc_call_view(rpc, "getblockcount", "[]", NULL);
+	const char *result = response ? json_object_get(response, "result") : NULL;
+
+	return result && isdigit((unsigned char)*result) ? strtoll(result, NULL, 10) : -1;
+}
+
+/* The cached result of method with params (caller frees), or NULL. A
+ * cached object's confirmations are brought up to date from the height
+ * it was stamped with, which takes a getblockcount. */
+static char *cache_find(RpcClient *rpc, const char *method, const char *params)
+{
+	char *key, *value, *fresh;
+	const char *conf;
+	size_t keylen, numlen, at;
+	int64_t height = 0, tip;
+	char num[24];
+
+	if (!g_cache || !cache_method(method) ||
+	    !(key = cache_key(method, params, &keylen)))
+		return NULL;
+	value = cache_get(g_cache, key, keylen, &height);
+	free(key);
+	if (!value || *value != '{' || !(conf = json_object_get(value, "confirmations")))
+		return value;
+
+	tip = cache_tip(rpc);
+	if (tip < height) {
+		free(value);
+		return NULL;
+	}
+	at = conf - value;
+	numlen = strspn(conf, "-0123456789");
+	snprintf(num, sizeof(num), "%lld", (long long)(tip - height + 1));
+	fresh = malloc(strlen(value) - numlen + strlen(num) + 1);
+	if (fresh) {
+		memcpy(fresh, value, at);
+		strcpy(fresh + at, num);
+		strcat(fresh, conf + numlen);
+	}
+	free(value);
+	return fresh;
+}
+
+/* Keep a successful result if it can no longer change: decoded data,
+ * raw blocks and headers, objects at least CACHE_DEPTH confirmations
+ * deep (stamped with their block height), raw transactions asked for
+ * with their block hash, and hashes of heights CACHE_DEPTH below the
+ * tip */
+static void cache_keep(RpcClient *rpc, const char *method, const char *params,
+                       const char *result)
+{
+	int64_t stamp = 0, tip;
+	size_t keylen;
+	char *key;
+
+	if (!g_cache || !result || !cache_method(method))
+		return;
+	if (strcmp(method, "getblockhash") == 0) {
+		const char *p = params + strcspn(params, "0123456789");
+		tip = cache_tip(rpc);
+		if (!*p || tip < 0 || strtoll(p, NULL, 10) > tip - CACHE_DEPTH)
+			return;
+	} else if (*result == '{') {
+		const char *conf = json_object_get(result, "confirmations");
+		const char *height = json_object_get(result, "height");
+		int64_t n;
+
+		if (!conf) {
+			/* A transaction without confirmations is in the mempool */
+			if (strcmp(method, "getrawtransaction") == 0)
+				return;
+		} else {
+			n = strtoll(conf, NULL, 10);
+			if (n < CACHE_DEPTH)
+				return;
+			if (height) {
+				stamp = strtoll(height, NULL, 10);
+			} else {
+				tip = cache_tip(rpc);
+				if (tip < 0)
+					return;
+				stamp = tip - n + 1;
+			}
+		}
+	} else if (strcmp(method, "getrawtransaction") == 0) {
+		/* Hex: only pinned to a block by the blockhash argument */
+		JsonTape tape;
+		int idx = -1;
+
+		if (json_tape_parse(&tape, params, strlen(params)) == 0 && tape.count > 0) {
+			if (tape.tok[0].type == JSON_OBJECT)
+				idx = json_tape_get(&tape, 0, "blockhash");
+			else if (tape.tok[0].type == JSON_ARRAY && tape.tok[0].count >= 3)
+				idx = json_tape_next(&tape, json_tape_next(&tape, json_tape_child(&tape, 0)));
+		}
+		if (idx > 0 && tape.tok[idx].type != JSON_STRING)
+			idx = -1;
+		json_tape_free(&tape);
+		if (idx <= 0)
+			return;
+	}
+	if ((key = cache_key(method, params, &keylen)) != NULL) {
+		cache_put(g_cache, key, keylen, result, strlen(result), stamp);
+		free(key);
+	}
+}
+
 /* Forward declarations of handlers */
-static int cmd_generic(RpcClient *rpc, const char *method, int argc, char **argv, char **out);
+static int cmd_generic(RpcClient *rpc, const MethodDef *m, int argc, char **argv, char **out);
+/* A rest_* handler below */
+typedef int (*RestHandler)(RpcClient *rpc, int argc, char **argv, char **out);
+static int generic_call(RpcClient *rpc, const MethodDef *m, int argc,
+                        char **argv, char **out, RestHandler rest);
 
 /* Generic handler macro - most methods just pass through */
 #define GENERIC_HANDLER(name) \
-	static int cmd_##name(RpcClient *rpc, int argc, char **argv, char **out) { \
-		return cmd_generic(rpc, #name, argc, argv, out); \
+	static int cmd_##name(RpcClient *rpc, const MethodDef *m, int argc, \
+	                      char **argv, char **out) { \
+		return cmd_generic(rpc, m, argc, argv, out); \
 	}
 
 /* Generate handlers for all Phase 1 methods */
@@ -53,8 +241,269 @@ GENERIC_HANDLER(getblockchaininfo)
 GENERIC_HANDLER(getblockcount)
 GENERIC_HANDLER(getbestblockhash)
 GENERIC_HANDLER(getblockhash)
+/* A 64-digit hex hash, as REST paths take them */
+static int rest_hash_arg(const char *s)
+{
+	int i;
+
+	for (i = 0; i < 64; i++)
+		if (!isxdigit((unsigned char)s[i]))
+			return 0;
+	return s[64] == '\0';
+}
+
+/* Verbosity argument: a digit for numeric parameters (getblock), true or
+ * false for boolean ones. Anything else is sent quoted over RPC and left
+ * for the node to reject, so REST declines it (-1). */
+static int rest_verbosity(const char *s, int numeric)
+{
+	if (numeric)
+		return isdigit((unsigned char)s[0]) && s[1] == '\0' ? s[0] - '0' : -1;
+	if (strcmp(s, "true") == 0)
+		return 1;
+	return strcmp(s, "false") == 0 ? 0 : -1;
+}
+
+/* The header object of /rest/headers/<hash>.json?count=1, copied out of
+ * the receive buffer */
+static char *rest_header_json(RpcClient *rpc, const char *hash, size_t *len)
+{
+	char path[128];
+	const char *body, *obj, *end;
+	char *copy;
+
+	snprintf(path, sizeof(path), "/rest/headers/%s.json?count=1", hash);
+	body = rpc_rest_view(rpc, path, NULL);
+	if (!body || *(body = json_skip_ws(body)) != '[')
+		return NULL;
+	obj = json_skip_ws(body + 1);
+	if (*obj != '{' || !(end = json_find_closing(obj)))
+		return NULL;
+	*len = end - obj + 1;
+	copy = malloc(*len + 1);
+	if (!copy)
+		return NULL;
+	memcpy(copy, obj, *len);
+	copy[*len] = '\0';
+	return copy;
+}
+
+/* The rest_* handlers return -1 to leave the call to RPC: without -rest,
+ * for arguments REST cannot serve, and when REST fails (the node's REST
+ * interface is off, or the block or transaction is unknown, which RPC
+ * then reports properly). */
+
+static int rest_getblock(RpcClient *rpc, int argc, char **argv, char **out)
+{
+	char path[128], *header = NULL;
+	size_t header_len = 0, len;
+	const char *body;
+	int verbosity = argc >= 2 ? rest_verbosity(argv[1], 1) : 1;
+
+	/* Verbosity 3 needs the undo data for prevouts */
+	if (!g_rest || argc < 1 || argc > 2 || !rest_hash_arg(argv[0]) ||
+	    verbosity < 0 || verbosity > 2)
+		return -1;
+	if (verbosity > 0 && !(header = rest_header_json(rpc, argv[0], &header_len)))
+		return -1;
+
+	snprintf(path, sizeof(path), "/rest/block/%s.bin", argv[0]);
+	body = rpc_rest_view(rpc, path, &len);
+	if (body)
+		*out = verbosity == 0 ? block_hex((const uint8_t *)body, len)
+		     : block_to_json((const uint8_t *)body, len, header, header_len,
+		                     verbosity, g_network);
+	free(header);
+	return body && *out ? 0 : -1;
+}
+
+static int rest_getblockheader(RpcClient *rpc, int argc, char **argv, char **out)
+{
+	char path[128];
+	const char *body;
+	size_t len;
+	int verbose = argc >= 2 ? rest_verbosity(argv[1], 0) : 1;
+
+	if (!g_rest || argc < 1 || argc > 2 || !rest_hash_arg(argv[0]) || verbose < 0)
+		return -1;
+	if (verbose)
+		return (*out = rest_header_json(rpc, argv[0], &len)) ? 0 : -1;
+
+	snprintf(path, sizeof(path), "/rest/headers/%s.bin?count=1", argv[0]);
+	body = rpc_rest_view(rpc, path, &len);
+	if (!body || len != 80)
+		return -1;
+	return (*out = block_hex((const uint8_t *)body, len)) ? 0 : -1;
+}
+
+/* The REST endpoint finds transactions in the mempool or with -txindex.
+ * Only the hex form comes from it: the verbose one has the block context
+ * (blockhash, confirmations, time) that the REST body lacks, so it goes
+ * over RPC, as does a call with a blockhash argument. */
+static int rest_getrawtransaction(RpcClient *rpc, int argc, char **argv,
+                                  char **out)
+{
+	char path[128];
+	const char *body;
+	size_t len;
+	int verbosity = argc >= 2 ? rest_verbosity(argv[1], 0) : 0;
+
+	if (!g_rest || argc < 1 || argc > 2 || !rest_hash_arg(argv[0]) ||
+	    verbosity != 0)
+		return -1;
+
+	snprintf(path, sizeof(path), "/rest/tx/%s.bin", argv[0]);
+	body = rpc_rest_view(rpc, path, &len);
+	if (!body)
+		return -1;
+	*out = block_hex((const uint8_t *)body, len);
+	return *out ? 0 : -1;
+}
+
+/* Hash of the block at height (a decimal string) in *hash, from the
+ * cache when it is deep enough. Returns 0, or the exit code with the
+ * error message in *hash. */
+static int resolve_height(RpcClient *rpc, const char *height, char **hash)
+{
+	char params[64];
+	char *response;
+	int error_code;
+
+	snprintf(params, sizeof(params), "[%s]", height);
+	if ((*hash = cache_find(rpc, "getblockhash", params)) != NULL)
+		return 0;
+	response = rpc_call(rpc, "getblockhash", params);
+	if (!response) {
+		*hash = strdup("error: Could not connect to the server");
+		return 28;
+	}
+	*hash = method_take_result(response, &error_code);
+	if (error_code != 0 || !*hash) {
+		if (!*hash)
+			*hash = strdup("error: getblockhash failed");
+		return error_code != 0 ? abs(error_code) : 1;
+	}
+	cache_keep(rpc, "getblockhash", params, *hash);
+	return 0;
+}
+
+static char *build_call_params(const MethodDef *m, int argc, char **argv);
+
+/* -hashindex: heights resolved from a local index, opened when first
+ * needed */
+static char g_hashidx_path[1024];
+static HashIdx *g_hashidx = NULL;
+/* Heights filled in around one the index lacks */
+#define HASHIDX_FILL 1000
+
+void method_set_hashidx(const char *path)
+{
+	snprintf(g_hashidx_path, sizeof(g_hashidx_path), "%s", path);
+}
+
+static HashIdx *hashidx(void)
+{
+	if (!g_hashidx && g_hashidx_path[0]) {
+		g_hashidx = hashidx_open(g_hashidx_path);
+		g_hashidx_path[0] = '\0';
+	}
+	return g_hashidx;
+}
+
+/* Fill in the index around height, asking for no heights past the
+ * node's tip: for one past the tip the index has, that is brought up to
+ * date first, and a height past the new tip is left for the usual call
+ * to report */
+static void index_fill(HashIdx *idx, RpcClient *rpc, int64_t height)
+{
+	int64_t first = height - height % HASHIDX_FILL;
+	int64_t tip = hashidx_tip(idx);
+
+	if (height > tip &&
+	    (hashidx_sync(idx, rpc, 0, 0) < 0 || height > (tip = hashidx_tip(idx))))
+		return;
+	hashidx_sync(idx, rpc, first,
+	             tip - first + 1 < HASHIDX_FILL ? (int)(tip - first + 1) : HASHIDX_FILL);
+}
+
+/* Call m for the block at height argv[0] with the hash the index
+ * has for it, in one batch with getblockhash for the height, which
+ * confirms the hash: one round trip instead of two. A height the index
+ * lacks is filled in, with those around it, in the round trip its
+ * getblockhash would have taken. Returns the exit code, or -1 to go on
+ * with the hash in *hash (NULL to resolve the height the usual way). */
+static int indexed_call(RpcClient *rpc, const MethodDef *m, int argc,
+                        char **argv, char **out, char **hash)
+{
+	const char *method = m->name;
+	HashIdx *idx = hashidx();
+	int64_t height = strtoll(argv[0], NULL, 10);
+	char params[64], hex[65], found[65];
+	char *saved = argv[0], *call_params, *batch, *response;
+	JsonTape tape;
+	int first, second, result, ret = -1;
+
+	*hash = NULL;
+	if (!idx || g_rest)
+		return -1;
+	snprintf(params, sizeof(params), "[%s]", argv[0]);
+	if ((*hash = cache_find(rpc, "getblockhash", params)) != NULL)
+		return -1;
+	if (hashidx_get(idx, height, hex) < 0) {
+		index_fill(idx, rpc, height);
+		if (hashidx_get(idx, height, hex) == 0)
+			*hash = strdup(hex);
+		return -1;
+	}
+
+	argv[0] = hex;
+	call_params = build_call_params(m, argc, argv);
+	argv[0] = saved;
+	if (!call_params)
+		return -1;
+	batch = malloc(strlen(call_params) + strlen(method) + 200);
+	if (!batch) {
+		free(call_params);
+		return -1;
+	}
+	sprintf(batch, "[{\"jsonrpc\":\"2.0\",\"id\":0,\"method\":\"getblockhash\",\"params\":%s},"
+	        "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"%s\",\"params\":%s}]",
+	        params, method, call_params);
+	response = rpc_call_batch(rpc, batch);
+	free(batch);
+
+	memset(&tape, 0, sizeof(tape));
+	if (response && json_tape_parse(&tape, response, strlen(response)) == 0 &&
+	    tape.count > 0 && tape.tok[0].type == JSON_ARRAY &&
+	    (first = json_tape_child(&tape, 0)) > 0 &&
+	    (second = json_tape_next(&tape, first)) > 0) {
+		result = json_tape_get(&tape, first, "result");
+		if (result < 0 || json_tape_string(&tape, result, found, sizeof(found)) != 64) {
+			/* The height is gone: let the usual call report it */
+		} else if (strcmp(found, hex) == 0) {
+			char *elem = strndup(json_tape_text(&tape, second), tape.tok[second].len);
+			int code = 0;
+
+			if (elem) {
+				*out = method_take_result(elem, &code);
+				ret = code != 0 ? abs(code) : 0;
+				if (code == 0)
+					cache_keep(rpc, method, call_params, *out);
+			}
+		} else {
+			/* A reorg replaced it: cut the index back */
+			index_fill(idx, rpc, height);
+			*hash = strdup(found);
+		}
+	}
+	json_tape_free(&tape);
+	free(response);
+	free(call_params);
+	return ret;
+}
+
 /* Smart getblock: auto-resolve numeric height to hash */
-static int cmd_getblock(RpcClient *rpc, int argc, char **argv, char **out)
+static int cmd_getblock(RpcClient *rpc, const MethodDef *m, int argc, char **argv, char **out)
 {
 	if (argc >= 1 && argv[0][0] != '\0') {
 		const char *s = argv[0];
@@ -63,32 +512,25 @@ static int cmd_getblock(RpcClient *rpc, int argc, char **argv, char **out)
 		while (*s) { if (!isdigit(*s)) { all_digits = 0; break; } s++; len++; }
 		/* Only treat as height if all digits AND not 64 chars (block hash length) */
 		if (all_digits && len < 64) {
-			char params[64];
-			char *response;
-			int error_code;
-			snprintf(params, sizeof(params), "[%s]", argv[0]);
-			response = rpc_call(rpc, "getblockhash", params);
-			if (!response) {
-				*out = strdup("error: Could not connect to the server");
-				return 28;
-			}
-			char *hash = method_extract_result(response, &error_code);
-			free(response);
-			if (error_code != 0 || !hash) {
-				*out = hash ? hash : strdup("error: getblockhash failed");
-				return error_code != 0 ? abs(error_code) : 1;
+			char *hash;
+			int ret = indexed_call(rpc, m, argc, argv, out, &hash);
+			if (ret >= 0)
+				return ret;
+			if (!hash && (ret = resolve_height(rpc, argv[0], &hash)) != 0) {
+				*out = hash;
+				return ret;
 			}
 			argv[0] = hash;
-			int ret = cmd_generic(rpc, "getblock", argc, argv, out);
+			ret = generic_call(rpc, m, argc, argv, out, rest_getblock);
 			free(hash);
 			return ret;
 		}
 	}
-	return cmd_generic(rpc, "getblock", argc, argv, out);
+	return generic_call(rpc, m, argc, argv, out, rest_getblock);
 }
 
 /* Smart getblockheader: auto-resolve numeric height to hash */
-static int cmd_getblockheader(RpcClient *rpc, int argc, char **argv, char **out)
+static int cmd_getblockheader(RpcClient *rpc, const MethodDef *m, int argc, char **argv, char **out)
 {
 	if (argc >= 1 && argv[0][0] != '\0') {
 		const char *s = argv[0];
@@ -97,28 +539,21 @@ static int cmd_getblockheader(RpcClient *rpc, int argc, char **argv, char **out)
 		while (*s) { if (!isdigit(*s)) { all_digits = 0; break; } s++; len++; }
 		/* Only treat as height if all digits AND not 64 chars (block hash length) */
 		if (all_digits && len < 64) {
-			char params[64];
-			char *response;
-			int error_code;
-			snprintf(params, sizeof(params), "[%s]", argv[0]);
-			response = rpc_call(rpc, "getblockhash", params);
-			if (!response) {
-				*out = strdup("error: Could not connect to the server");
-				return 28;
-			}
-			char *hash = method_extract_result(response, &error_code);
-			free(response);
-			if (error_code != 0 || !hash) {
-				*out = hash ? hash : strdup("error: getblockhash failed");
-				return error_code != 0 ? abs(error_code) : 1;
+			char *hash;
+			int ret = indexed_call(rpc, m, argc, argv, out, &hash);
+			if (ret >= 0)
+				return ret;
+			if (!hash && (ret = resolve_height(rpc, argv[0], &hash)) != 0) {
+				*out = hash;
+				return ret;
 			}
 			argv[0] = hash;
-			int ret = cmd_generic(rpc, "getblockheader", argc, argv, out);
+			ret = generic_call(rpc, m, argc, argv, out, rest_getblockheader);
 			free(hash);
 			return ret;
 		}
 	}
-	return cmd_generic(rpc, "getblockheader", argc, argv, out);
+	return generic_call(rpc, m, argc, argv, out, rest_getblockheader);
 }
 GENERIC_HANDLER(getdifficulty)
 GENERIC_HANDLER(getchaintips)
@@ -142,7 +577,10 @@ GENERIC_HANDLER(decodescript)
 GENERIC_HANDLER(signrawtransactionwithwallet)
 GENERIC_HANDLER(signrawtransactionwithkey)
 GENERIC_HANDLER(testmempoolaccept)
-GENERIC_HANDLER(getrawtransaction)
+static int cmd_getrawtransaction(RpcClient *rpc, const MethodDef *m, int argc, char **argv, char **out)
+{
+	return generic_call(rpc, m, argc, argv, out, rest_getrawtransaction);
+}
 
 /* Network */
 GENERIC_HANDLER(getnetworkinfo)
@@ -324,7 +762,7 @@ GENERIC_HANDLER(upgradewallet)
 GENERIC_HANDLER(sethdseed)
 
 /* Custom sendrawtransaction handler with retry + verify + fallback */
-static int cmd_sendrawtransaction(RpcClient *rpc, int argc, char **argv, char **out)
+static int cmd_sendrawtransaction(RpcClient *rpc, const MethodDef *m, int argc, char **argv, char **out)
 {
 	SendTxResult result;
 	const char *hexstring = (argc >= 1) ? argv[0] : NULL;
@@ -332,6 +770,7 @@ static int cmd_sendrawtransaction(RpcClient *rpc, int argc, char **argv, char **
 	int rpc_ok;
 	int fallback_ok = 0;
 
+	(void)m;
 	if (!hexstring) {
 		*out = strdup("error: sendrawtransaction requires hexstring");
 		return 1;
@@ -1245,15 +1684,27 @@ static const MethodDef methods[] = {
 	{NULL, NULL, NULL, NULL, {}, 0}
 };
 
-/* Find method by name */
+/* Find method by name: a binary search of method_index, the names of
+ * methods[] in strcmp order (generated from the table by make) */
+typedef struct {
+	const char *name;
+	int index;
+} MethodIndex;
+
+#include "method_index.h"
+
+static int method_index_cmp(const void *key, const void *entry)
+{
+	return strcmp(key, ((const MethodIndex *)entry)->name);
+}
+
 const MethodDef *method_find(const char *name)
 {
-	const MethodDef *m;
-	for (m = methods; m->name != NULL; m++) {
-		if (strcmp(m->name, name) == 0)
-			return m;
-	}
-	return NULL;
+	const MethodIndex *e = bsearch(name, method_index,
+	                               sizeof(method_index) / sizeof(method_index[0]),
+	                               sizeof(method_index[0]), method_index_cmp);
+
+	return e ? &methods[e->index] : NULL;
 }
 
 /* List all methods */
@@ -1324,38 +1775,41 @@ const char **method_list_names(int *count)
 	return names;
 }
 
-/* Read file contents for @file.json syntax (returns malloc'd string, caller frees) */
-static char *read_file_arg(const char *path)
+/* Read file contents for @file.json syntax into a params buffer */
+long method_read_file_arg(const char *path, char **buf, size_t *bufsize,
+                          size_t at)
 {
 	FILE *f;
 	long len;
-	char *buf;
 	size_t nread;
 
 	f = fopen(path, "r");
-	if (!f) {
-		fprintf(stderr, "error: Could not read file: %s\n", path);
-		return NULL;
-	}
+	if (!f)
+		return -1;
 	fseek(f, 0, SEEK_END);
 	len = ftell(f);
 	fseek(f, 0, SEEK_SET);
 	if (len <= 0 || len > 10 * 1024 * 1024) {  /* 10MB limit */
 		fclose(f);
-		return NULL;
+		return -2;
+	}
+	/* Room for the content plus what the caller appends after it */
+	while (at + len + 64 > *bufsize) {
+		char *newbuf = realloc(*buf, *bufsize * 2);
+		if (!newbuf) { fclose(f); return -2; }
+		*buf = newbuf;
+		*bufsize *= 2;
 	}
-	buf = malloc(len + 1);
-	if (!buf) { fclose(f); return NULL; }
-	nread = fread(buf, 1, len, f);
+	nread = fread(*buf + at, 1, len, f);
 	fclose(f);
-	buf[nread] = '\0';
 
 	/* Trim trailing whitespace/newlines */
-	while (nread > 0 && (buf[nread-1] == '\n' || buf[nread-1] == '\r' ||
-	       buf[nread-1] == ' ' || buf[nread-1] == '\t'))
-		buf[--nread] = '\0';
+	while (nread > 0 && ((*buf)[at+nread-1] == '\n' || (*buf)[at+nread-1] == '\r' ||
+	       (*buf)[at+nread-1] == ' ' || (*buf)[at+nread-1] == '\t'))
+		nread--;
+	(*buf)[at + nread] = '\0';
 
-	return buf;
+	return (long)nread;
 }
 
 /* Check if string looks like a number */
@@ -1376,6 +1830,35 @@ static int is_bool(const char *s)
 	return strcmp(s, "true") == 0 || strcmp(s, "false") == 0;
 }
 
+/* Whether an argument of this type is sent as a JSON string */
+static int param_needs_quotes(const ParamDef *p, const char *arg)
+{
+	switch (p->type) {
+	case PARAM_INT:
+	case PARAM_FLOAT:
+	case PARAM_AMOUNT:
+		/* Numbers go unquoted */
+		return 0;
+
+	case PARAM_BOOL:
+		/* Booleans go unquoted */
+		return !is_bool(arg);
+
+	case PARAM_ARRAY:
+	case PARAM_OBJECT:
+		/* Already JSON, pass through */
+		return 0;
+
+	case PARAM_HEIGHT_OR_HASH:
+		/* If all digits, send as number; otherwise quote as string */
+		return !(is_number(arg) && strchr(arg, '.') == NULL);
+
+	default:
+		/* Strings get quoted */
+		return 1;
+	}
+}
+
 /* Build JSON params array from argv */
 char *method_build_params(const MethodDef *method, int argc, char **argv)
 {
@@ -1392,7 +1875,6 @@ char *method_build_params(const MethodDef *method, int argc, char **argv)
 	for (i = 0; i < argc && i < method->param_count; i++) {
 		const ParamDef *p = &method->params[i];
 		const char *arg = argv[i];
-		char *file_content = NULL;
 		size_t arglen;
 
 		if (i > 0) buf[pos++] = ',';
@@ -1403,11 +1885,21 @@ char *method_build_params(const MethodDef *method, int argc, char **argv)
 			continue;
 		}
 
-		/* @file.json syntax — read arg from file */
+		/* @file.json syntax — read arg from file, directly into buf
+		 * after the space its opening quote would take. Unquoted values
+		 * get a space there instead, which JSON allows. */
 		if (arg[0] == '@' && arg[1] != '\0') {
-			file_content = read_file_arg(arg + 1);
-			if (file_content)
-				arg = file_content;
+			long n = method_read_file_arg(arg + 1, &buf, &bufsize, pos + 1);
+			if (n >= 0) {
+				int quote = param_needs_quotes(p, buf + pos + 1);
+				buf[pos] = quote ? '"' : ' ';
+				pos += 1 + n;
+				if (quote)
+					buf[pos++] = '"';
+				continue;
+			}
+			if (n == -1)
+				fprintf(stderr, "error: Could not read file: %s\n", arg + 1);
 		}
 
 		arglen = strlen(arg);
@@ -1416,48 +1908,14 @@ char *method_build_params(const MethodDef *method, int argc, char **argv)
 		while (pos + arglen + 64 > bufsize) {
 			bufsize *= 2;
 			char *newbuf = realloc(buf, bufsize);
-			if (!newbuf) { free(buf); free(file_content); return NULL; }
+			if (!newbuf) { free(buf); return NULL; }
 			buf = newbuf;
 		}
 
-		/* Format based on type */
-		switch (p->type) {
-		case PARAM_INT:
-		case PARAM_FLOAT:
-		case PARAM_AMOUNT:
-			/* Numbers go unquoted */
-			pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-			break;
-
-		case PARAM_BOOL:
-			/* Booleans go unquoted */
-			if (is_bool(arg))
-				pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-			else
-				pos += snprintf(buf + pos, bufsize - pos, "\"%s\"", arg);
-			break;
-
-		case PARAM_ARRAY:
-		case PARAM_OBJECT:
-			/* Already JSON, pass through */
-			pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-			break;
-
-		case PARAM_HEIGHT_OR_HASH:
-			/* If all digits, send as number; otherwise quote as string */
-			if (is_number(arg) && strchr(arg, '.') == NULL)
-				pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
-			else
-				pos += snprintf(buf + pos, bufsize - pos, "\"%s\"", arg);
-			break;
-
-		default:
-			/* Strings get quoted */
+		if (param_needs_quotes(p, arg))
 			pos += snprintf(buf + pos, bufsize - pos, "\"%s\"", arg);
-			break;
-		}
-
-		free(file_content);
+		else
+			pos += snprintf(buf + pos, bufsize - pos, "%s", arg);
 	}
 
 	buf[pos++] = ']';
@@ -1591,9 +2049,10 @@ char *method_extract_result(const char *response, int *error_code)
 	if (!response)
 		return NULL;
 
-	/* Check for error */
-	error = json_find_object(response, "error");
-	if (error) {
+	/* Check for error (a member of the response object itself, not a
+	 * key of the same name nested inside the result) */
+	error = json_object_get(response, "error");
+	if (error && *error == '{') {
 		int code = (int)json_get_int(error, "code");
 		if (code != 0) {
 			*error_code = code;
@@ -1610,27 +2069,8 @@ char *method_extract_result(const char *response, int *error_code)
 		}
 	}
 
-	/* Check if error is null */
-	if (!json_is_null(response, "error")) {
-		/* error field exists and is not null - check for error object */
-		const char *err_obj = json_find_value(response, "error");
-		if (err_obj && *err_obj == '{') {
-			int code = (int)json_get_int(err_obj, "code");
-			if (code != 0) {
-				*error_code = code;
-				char msg[2048];
-				if (json_get_string(err_obj, "message", msg, sizeof(msg)) > 0) {
-					size_t needed = strlen(msg) + 64;
-					out = malloc(needed);
-					snprintf(out, needed, "error code: %d\nerror message:\n%s", code, msg);
-					return out;
-				}
-			}
-		}
-	}
-
 	/* Find result field */
-	result = json_find_value(response, "result");
+	result = json_object_get(response, "result");
 	if (!result)
 		return strdup(response);  /* Fallback to raw response */
 
@@ -1701,6 +2141,32 @@ char *method_extract_result(const char *response, int *error_code)
 	return strdup(response);
 }
 
+char *method_take_result(char *response, int *error_code)
+{
+	const char *error, *result, *end;
+	char *out;
+
+	*error_code = 0;
+	if (!response)
+		return NULL;
+
+	/* Arrays and objects are moved to the front of the response buffer;
+	 * everything else goes through method_extract_result() */
+	error = json_object_get(response, "error");
+	result = json_object_get(response, "result");
+	if ((!error || *error != '{') && result && (*result == '{' || *result == '[') &&
+	    (end = json_find_closing(result)) != NULL) {
+		size_t len = end - result + 1;
+		memmove(response, result, len);
+		response[len] = '\0';
+		return response;
+	}
+
+	out = method_extract_result(response, error_code);
+	free(response);
+	return out;
+}
+
 /* Check if args contain key=value matching known param names (auto-named detection) */
 static int has_named_args(const MethodDef *m, int argc, char **argv)
 {
@@ -1721,35 +2187,63 @@ static int has_named_args(const MethodDef *m, int argc, char **argv)
 	return 0;
 }
 
+/* Build params - use named mode if enabled, or auto-detect key=value */
+static char *build_call_params(const MethodDef *m, int argc, char **argv)
+{
+	if (g_named_mode || has_named_args(m, argc, argv))
+		return method_build_named_params(m, argc, argv);
+	return method_build_params(m, argc, argv);
+}
+
+char *method_call_params(const MethodDef *m, int argc, char **argv)
+{
+	/* These resolve heights or retry/verify around the call */
+	if (m->handler == cmd_getblock || m->handler == cmd_getblockheader ||
+	    m->handler == cmd_sendrawtransaction ||
+	    (g_rest && m->handler == cmd_getrawtransaction) ||
+	    (g_cache && cache_method(m->name)))
+		return NULL;
+	return build_call_params(m, argc, argv);
+}
+
 /* Generic command handler - builds params and calls RPC */
-static int cmd_generic(RpcClient *rpc, const char *method, int argc, char **argv, char **out)
+static int cmd_generic(RpcClient *rpc, const MethodDef *m, int argc, char **argv, char **out)
+{
+	return generic_call(rpc, m, argc, argv, out, NULL);
+}
+
+/* Call m: from the cache, else over REST when rest is given and serves
+ * the arguments, else over RPC. A result from either is kept in the
+ * cache. */
+static int generic_call(RpcClient *rpc, const MethodDef *m, int argc,
+                        char **argv, char **out, RestHandler rest)
 {
-	const MethodDef *m = method_find(method);
+	const char *method = m->name;
 	char *params;
 	char *response;
 	int error_code;
 
-	if (!m) {
-		*out = strdup("Unknown method");
-		return 1;
-	}
-
-	/* Build params - use named mode if enabled, or auto-detect key=value */
-	if (g_named_mode || has_named_args(m, argc, argv))
-		params = method_build_named_params(m, argc, argv);
-	else
-		params = method_build_params(m, argc, argv);
-
+	params = build_call_params(m, argc, argv);
 	if (!params) {
 		*out = strdup("Failed to build parameters");
 		return 1;
 	}
 
+	if ((*out = cache_find(rpc, method, params)) != NULL) {
+		free(params);
+		return 0;
+	}
+	if (rest && rest(rpc, argc, argv, out) == 0) {
+		cache_keep(rpc, method, params, *out);
+		free(params);
+		return 0;
+	}
+
 	/* Make RPC call */
 	response = rpc_call(rpc, method, params);
-	free(params);
 
 	if (!response) {
+		free(params);
 		if (rpc->last_http_error == 401) {
 			*out = strdup("error: Authorization failed: Incorrect rpcuser or rpcpassword");
 			return 29;
@@ -1759,8 +2253,10 @@ static int cmd_generic(RpcClient *rpc, const char *method, int argc, char **argv
 	}
 
 	/* Extract result */
-	*out = method_extract_result(response, &error_code);
-	free(response);
+	*out = method_take_result(response, &error_code);
+	if (error_code == 0)
+		cache_keep(rpc, method, params, *out);
+	free(params);
 
 	return error_code != 0 ? abs(error_code) : 0;
 }
@@ -32,14 +32,18 @@ typedef struct {
 /* Maximum parameters per method */
 #define MAX_PARAMS 16
 
+struct MethodDef;
+
 /* Method handler function type
+ * m: the method's own entry, as method_find returned it
  * Returns: 0 on success, non-zero on error
  * out: allocated string with result (caller frees)
  */
-typedef int (*MethodHandler)(RpcClient *rpc, int argc, char **argv, char **out);
+typedef int (*MethodHandler)(RpcClient *rpc, const struct MethodDef *m,
+                             int argc, char **argv, char **out);
 
 /* Method definition */
-typedef struct {
+typedef struct MethodDef {
 	const char *name;
 	const char *category;
 	const char *description;
@@ -60,6 +64,14 @@ void method_list_category(const char *category);
 /* Print help for specific method */
 void method_print_help(const MethodDef *method);
 
+/* Read the @file argument at path into *buf at offset at (growing the
+ * buffer), trimmed of trailing whitespace and NUL-terminated.
+ * Returns the content length; -1 if the file cannot be opened, -2 if it
+ * is empty or over 10MB (or on allocation failure).
+ */
+long method_read_file_arg(const char *path, char **buf, size_t *bufsize,
+                          size_t at);
+
 /* Build JSON params array from argv
  * Handles type conversion based on method definition
  * Returns allocated string (caller frees)
@@ -72,12 +84,24 @@ char *method_build_params(const MethodDef *method, int argc, char **argv);
  */
 char *method_build_named_params(const MethodDef *method, int argc, char **argv);
 
+/* Params for calling method directly, as its handler would build them.
+ * Returns NULL if the handler does more than a single pass-through call
+ * (or on allocation failure); the caller must then use the handler.
+ */
+char *method_call_params(const MethodDef *method, int argc, char **argv);
+
 /* Extract result from JSON-RPC response
  * Handles error checking
  * Returns allocated string (caller frees), or NULL on error
  */
 char *method_extract_result(const char *response, int *error_code);
 
+/* Like method_extract_result, but takes ownership of response (which must
+ * be malloc'd). An array or object result is returned in the response's
+ * own buffer rather than copied.
+ */
+char *method_take_result(char *response, int *error_code);
+
 /* Set named parameter mode (for -named flag) */
 void method_set_named_mode(int enabled);
 
@@ -87,6 +111,17 @@ void method_set_verify(int enabled, int peers, Network net);
 /* Configure fallback broadcast for sendrawtransaction */
 void method_set_fallback(const FallbackConfig *cfg);
 
+/* Serve getblock, getblockheader and getrawtransaction over REST (-rest) */
+void method_set_rest(int enabled, Network net);
+
+/* Answer cacheable calls from, and keep their results in, the cache file
+ * at path bounded to limit bytes (-cache) */
+void method_set_cache(const char *path, size_t limit);
+
+/* Resolve heights for getblock and getblockheader through the height
+ * index file at path (-hashindex) */
+void method_set_hashidx(const char *path);
+
 /* Get array of all method names (NULL-terminated). Returns static pointer. */
 const char **method_list_names(int *count);
 
@@ -12,6 +12,8 @@ BITCOIND="${BITCOIND:-/home/obscurity/bitcoin-30.2/bin/bitcoind}"
 DATADIR="/tmp/parity-scan-$$"
 PORT=19555
 RPCPORT=$PORT
+ZMQPORT=19558
+EXPORTERPORT=19559
 
 # ─── Colors ───────────────────────────────────────────────────────────
 RED='\033[0;31m'
@@ -256,8 +258,11 @@ $RPCAUTH_LINE
 [regtest]
 rpcport=$RPCPORT
 server=1
+rest=1
 txindex=1
 fallbackfee=0.00001
+zmqpubhashblock=tcp://127.0.0.1:$ZMQPORT
+zmqpubsequence=tcp://127.0.0.1:$ZMQPORT
 ENDCONF
 
 echo "Starting bitcoind..."
@@ -2187,6 +2192,26 @@ if [ -n "$WAIT_ADDR" ]; then
 else
     fail "I19.01 -wait=1" "could not get address"
 fi
+# An unconfirmed transaction: -wait=2 returns as the second block comes in
+WAIT_TXID=$(btc sendtoaddress "$WAIT_ADDR" 0.001 2>/dev/null) || true
+WAIT_TMP="/tmp/parity-wait-$$"
+"$BTC_CLI" $CONN_ARGS -wait=2 -field=confirmations gettransaction "$WAIT_TXID" > "$WAIT_TMP" 2>/dev/null &
+WAIT_PID=$!
+sleep 1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+sleep 1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+sleep 1
+if kill -0 "$WAIT_PID" 2>/dev/null; then
+    kill "$WAIT_PID" 2>/dev/null
+    fail "I19.02 -wait=2 follows new blocks" "still waiting after 2 blocks"
+elif [ "$(cat "$WAIT_TMP" 2>/dev/null)" = "2" ]; then
+    pass "I19.02 -wait=2 follows new blocks"
+else
+    fail "I19.02 -wait=2 follows new blocks" "$(head -c 200 "$WAIT_TMP" 2>/dev/null)"
+fi
+wait "$WAIT_PID" 2>/dev/null || true
+rm -f "$WAIT_TMP"
 
 # I20: offline help
 subsection "I20: offline help"
@@ -2213,6 +2238,464 @@ if [ -n "$WATCH_OUT" ]; then
 else
     fail "I21.01 -watch=1" "no output produced"
 fi
+# -watch=onblock runs once up front and once per block
+"$BTC_CLI" $CONN_ARGS -watch=onblock getblockcount > "$WATCH_TMP" 2>/dev/null &
+WATCH_PID=$!
+sleep 1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+sleep 1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+sleep 1
+kill "$WATCH_PID" 2>/dev/null || true
+wait "$WATCH_PID" 2>/dev/null || true
+WATCH_RUNS=$(grep -c '^[0-9][0-9]*$' "$WATCH_TMP" 2>/dev/null) || true
+rm -f "$WATCH_TMP"
+if [ "$WATCH_RUNS" = "3" ]; then
+    pass "I21.02 -watch=onblock runs once per new tip"
+else
+    fail "I21.02 -watch=onblock runs once per new tip" "runs: $WATCH_RUNS"
+fi
+
+# I22: -batch-connections=K (chunks spread over K sockets, output in input order)
+subsection "I22: -batch-connections"
+BATCH_IN=""
+for i in $(seq 0 40); do
+    BATCH_IN="${BATCH_IN}getblockhash 0\ngetblockcount\n"
+done
+BATCH_ONE=$(printf "$BATCH_IN" | btc -batch 2>/dev/null) || true
+BATCH_PAR=$(printf "$BATCH_IN" | btc -batch -batch-connections=4 2>/dev/null) || true
+if [ -n "$BATCH_ONE" ] && [ "$BATCH_ONE" = "$BATCH_PAR" ]; then
+    pass "I22.01 -batch-connections=4 matches single-connection -batch"
+else
+    fail "I22.01 -batch-connections=4" "output differs from -batch (${#BATCH_PAR} vs ${#BATCH_ONE} bytes)"
+fi
+
+# I23: -batch-size=N (streamed sub-batches, same output as one batch)
+subsection "I23: -batch-size"
+BATCH_SMALL=$(printf "$BATCH_IN" | btc -batch -batch-size=5 2>/dev/null) || true
+if [ -n "$BATCH_ONE" ] && [ "$BATCH_ONE" = "$BATCH_SMALL" ]; then
+    pass "I23.01 -batch-size=5 matches single -batch"
+else
+    fail "I23.01 -batch-size=5" "output differs from -batch (${#BATCH_SMALL} vs ${#BATCH_ONE} bytes)"
+fi
+
+# I24: -format=csv streams array results, falls back for everything else
+subsection "I24: streaming -format=csv"
+TIPS_JSON=$(btc getchaintips 2>/dev/null) || true
+TIPS_N=$(printf '%s\n' "$TIPS_JSON" | grep -c '"status"') || true
+TIPS_CSV_N=$(btc -format=csv getchaintips 2>/dev/null | wc -l) || true
+if [ "$TIPS_N" -gt 0 ] && [ "$TIPS_CSV_N" -eq $((TIPS_N + 1)) ]; then
+    pass "I24.01 -format=csv getchaintips has header + $TIPS_N rows"
+else
+    fail "I24.01 -format=csv getchaintips" "$TIPS_CSV_N lines for $TIPS_N tips"
+fi
+COUNT_PLAIN=$(btc getblockcount 2>/dev/null) || true
+COUNT_CSV=$(btc -format=csv getblockcount 2>/dev/null) || true
+if [ -n "$COUNT_PLAIN" ] && [ "$COUNT_PLAIN" = "$COUNT_CSV" ]; then
+    pass "I24.02 -format=csv on a scalar result prints it as-is"
+else
+    fail "I24.02 -format=csv getblockcount" "'$COUNT_CSV' vs '$COUNT_PLAIN'"
+fi
+
+# I25: -human and -sats together (single pass, value-for-value)
+subsection "I25: -human -sats combined"
+PLAIN_OUT=$(btc getblockchaininfo 2>/dev/null) || true
+FUSED_OUT=$(btc -human -sats getblockchaininfo 2>/dev/null) || true
+if [ -n "$PLAIN_OUT" ] && [ "$(echo "$PLAIN_OUT" | wc -l)" -eq "$(echo "$FUSED_OUT" | wc -l)" ] &&
+   echo "$FUSED_OUT" | grep -q '"time": "[0-9]\{4\}-'; then
+    pass "I25.01 -human -sats keeps layout and humanizes time"
+else
+    fail "I25.01 -human -sats" "${FUSED_OUT:0:200}"
+fi
+
+# I26: @file params are read straight into the request
+subsection "I26: @file params"
+ATFILE=$(mktemp)
+echo 0 > "$ATFILE"
+DIRECT_OUT=$(btc getblockhash 0 2>/dev/null) || true
+ATFILE_OUT=$(btc getblockhash "@$ATFILE" 2>/dev/null) || true
+rm -f "$ATFILE"
+if [ -n "$DIRECT_OUT" ] && [ "$DIRECT_OUT" = "$ATFILE_OUT" ]; then
+    pass "I26.01 getblockhash @file matches inline argument"
+else
+    fail "I26.01 getblockhash @file" "${ATFILE_OUT:0:200}"
+fi
+
+# I27: -daemon relays other invocations' requests over its pooled connection
+subsection "I27: -daemon connection pool"
+DAEMON_SOCK="/tmp/parity-daemon-$$.sock"
+"$BTC_CLI" $CONN_ARGS -daemon -daemonsocket="$DAEMON_SOCK" 2>/dev/null &
+DAEMON_PID=$!
+for _ in 1 2 3 4 5 6 7 8 9 10; do [ -S "$DAEMON_SOCK" ] && break; sleep 0.2; done
+DIRECT_OUT=$(btc getblockchaininfo 2>/dev/null) || true
+POOLED_OUT=$(btc -daemonsocket="$DAEMON_SOCK" getblockchaininfo 2>/dev/null) || true
+kill "$DAEMON_PID" 2>/dev/null; wait "$DAEMON_PID" 2>/dev/null
+if [ -n "$POOLED_OUT" ] && [ "$DIRECT_OUT" = "$POOLED_OUT" ] && [ ! -e "$DAEMON_SOCK" ]; then
+    pass "I27.01 getblockchaininfo through -daemon matches direct call"
+else
+    fail "I27.01 -daemon" "${POOLED_OUT:0:200}"
+fi
+
+# I28: connect path — getaddrinfo names and a fast failure on a dead port
+subsection "I28: connect deadline"
+NAMED_OUT=$("$BTC_CLI" $CONN_ARGS -rpcconnect=localhost -rpcconnecttimeout=1000 getblockcount 2>/dev/null) || true
+DIRECT_OUT=$(btc getblockcount 2>/dev/null) || true
+if [ -n "$NAMED_OUT" ] && [ "$NAMED_OUT" = "$DIRECT_OUT" ]; then
+    pass "I28.01 -rpcconnect=localhost resolves and connects"
+else
+    fail "I28.01 -rpcconnect=localhost" "${NAMED_OUT:0:200}"
+fi
+DEAD_START=$(date +%s%N)
+"$BTC_CLI" -regtest -rpcport=1 -rpcuser=x -rpcpassword=y -rpcconnecttimeout=500 getblockcount >/dev/null 2>&1
+DEAD_RC=$?
+DEAD_MS=$(( ($(date +%s%N) - DEAD_START) / 1000000 ))
+if [ "$DEAD_RC" -ne 0 ] && [ "$DEAD_MS" -lt 2000 ]; then
+    pass "I28.02 dead port fails in ${DEAD_MS}ms"
+else
+    fail "I28.02 dead port" "rc=$DEAD_RC after ${DEAD_MS}ms"
+fi
+
+# I29: -rest decodes blocks and transactions fetched in binary
+subsection "I29: REST transport"
+REST_HASH=$(ref getbestblockhash 2>/dev/null)
+for REST_VERB in 0 1; do
+    REST_OUT=$(btc -rest getblock "$REST_HASH" $REST_VERB 2>/dev/null) || true
+    RPC_OUT=$(ref getblock "$REST_HASH" $REST_VERB 2>/dev/null) || true
+    if [ -n "$REST_OUT" ] && [ "$REST_OUT" = "$RPC_OUT" ]; then
+        pass "I29.0$((REST_VERB + 1)) -rest getblock verbosity $REST_VERB"
+    else
+        fail "I29.0$((REST_VERB + 1)) -rest getblock verbosity $REST_VERB" "${REST_OUT:0:200}"
+    fi
+done
+# Verbosity 2 matches apart from the fees, which need undo data
+REST_OUT=$(btc -rest getblock "$REST_HASH" 2 2>/dev/null) || true
+RPC_OUT=$(ref getblock "$REST_HASH" 2 2>/dev/null) || true
+REST_SAME=$(python3 -c "
+import json, sys
+a = json.loads(sys.argv[1]); b = json.loads(sys.argv[2])
+for tx in b['tx']: tx.pop('fee', None)
+print('yes' if a == b else 'no')" "$REST_OUT" "$RPC_OUT" 2>/dev/null) || true
+if [ "$REST_SAME" = "yes" ]; then
+    pass "I29.03 -rest getblock verbosity 2"
+else
+    fail "I29.03 -rest getblock verbosity 2" "${REST_OUT:0:200}"
+fi
+REST_TXID=$(ref getblock "$REST_HASH" 1 2>/dev/null | python3 -c "import sys,json; print(json.load(sys.stdin)['tx'][-1])" 2>/dev/null) || true
+REST_OUT=$(btc -rest getrawtransaction "$REST_TXID" 2>/dev/null) || true
+RPC_OUT=$(ref getrawtransaction "$REST_TXID" 2>/dev/null) || true
+if [ -n "$REST_OUT" ] && [ "$REST_OUT" = "$RPC_OUT" ]; then
+    pass "I29.04 -rest getrawtransaction"
+else
+    fail "I29.04 -rest getrawtransaction" "${REST_OUT:0:200}"
+fi
+# Verbose, it goes over RPC and keeps the block fields REST lacks
+REST_OUT=$(btc -rest getrawtransaction "$REST_TXID" true 2>/dev/null) || true
+RPC_OUT=$(ref getrawtransaction "$REST_TXID" true 2>/dev/null) || true
+REST_SAME=$(python3 -c "
+import json, sys
+a = json.loads(sys.argv[1]); b = json.loads(sys.argv[2])
+print('yes' if a == b and 'confirmations' in a else 'no')" "$REST_OUT" "$RPC_OUT" 2>/dev/null) || true
+if [ "$REST_SAME" = "yes" ]; then
+    pass "I29.05 -rest getrawtransaction true"
+else
+    fail "I29.05 -rest getrawtransaction true" "${REST_OUT:0:200}"
+fi
+REST_OUT=$(btc -rest getblockheader "$REST_HASH" 2>/dev/null) || true
+RPC_OUT=$(ref getblockheader "$REST_HASH" 2>/dev/null) || true
+if [ -n "$REST_OUT" ] && [ "$REST_OUT" = "$RPC_OUT" ]; then
+    pass "I29.06 -rest getblockheader"
+else
+    fail "I29.06 -rest getblockheader" "${REST_OUT:0:200}"
+fi
+# Unknown blocks fall back to RPC for its error
+REST_OUT=$(btc -rest getblock 0000000000000000000000000000000000000000000000000000000000000001 2>&1) || true
+if echo "$REST_OUT" | grep -q "Block not found"; then
+    pass "I29.07 unknown block reports the RPC error"
+else
+    fail "I29.07 unknown block" "${REST_OUT:0:200}"
+fi
+
+# I30: -getutxos looks outpoints up over /rest/getutxos
+subsection "I30: Bulk UTXO lookups"
+GU_UTXO=$(ref listunspent 2>/dev/null | python3 -c "import sys,json; u=json.load(sys.stdin); print('%s:%d' % (u[0]['txid'], u[0]['vout']) if u else '')" 2>/dev/null) || true
+GU_OUT=$(printf '%s\n' "$GU_UTXO" | btc -getutxos 2>/dev/null) || true
+RPC_OUT=$(ref gettxout "${GU_UTXO%:*}" "${GU_UTXO#*:}" 2>/dev/null) || true
+GU_SAME=$(python3 -c "
+import json, sys
+a = json.loads(sys.argv[1]); b = json.loads(sys.argv[2])
+b.pop('coinbase', None)
+print('yes' if a.pop('txid') + ':' + str(a.pop('vout')) == sys.argv[3] and a.pop('unspent') is True and a == b else 'no')" "$GU_OUT" "$RPC_OUT" "$GU_UTXO" 2>/dev/null) || true
+if [ "$GU_SAME" = "yes" ]; then
+    pass "I30.01 -getutxos matches gettxout"
+else
+    fail "I30.01 -getutxos matches gettxout" "${GU_OUT:0:200}"
+fi
+# Unknown outpoints come back unspent:false, in input order
+GU_OUT=$(printf '%064d-0\n%s\n' 0 "$GU_UTXO" | btc -getutxos 2>/dev/null) || true
+GU_FLAGS=$(echo "$GU_OUT" | python3 -c "import sys,json; print(' '.join(str(json.loads(l)['unspent']) for l in sys.stdin))" 2>/dev/null) || true
+if [ "$GU_FLAGS" = "False True" ]; then
+    pass "I30.02 unknown outpoint reported as spent"
+else
+    fail "I30.02 unknown outpoint reported as spent" "$GU_FLAGS"
+fi
+# A bad line is reported and fails the run, the rest are still looked up
+GU_RC=0
+GU_OUT=$(printf 'notanoutpoint\n%s\n' "$GU_UTXO" | btc -getutxos 2>/dev/null) || GU_RC=$?
+if [ "$GU_RC" -ne 0 ] && [ "$(echo "$GU_OUT" | grep -c '"unspent":true')" -eq 1 ]; then
+    pass "I30.03 invalid outpoint line fails the run"
+else
+    fail "I30.03 invalid outpoint line fails the run" "rc=$GU_RC ${GU_OUT:0:200}"
+fi
+
+# I31: -range exports a block range as NDJSON in height order
+subsection "I31: Block range export"
+RANGE_TIP=$(ref getblockcount 2>/dev/null) || RANGE_TIP=0
+RANGE_FROM=$(( RANGE_TIP > 20 ? RANGE_TIP - 20 : 0 ))
+RANGE_OUT=$(btc -batch-connections=2 -range=$RANGE_FROM:$RANGE_TIP getblock 2 2>/dev/null) || true
+RANGE_SAME=$(echo "$RANGE_OUT" | python3 -c "
+import json, sys, subprocess
+cli, conn, first = sys.argv[1], sys.argv[2].split(), int(sys.argv[3])
+lines = sys.stdin.read().splitlines()
+ok = len(lines) == int(sys.argv[4]) - first + 1
+for i, line in enumerate(lines if ok else []):
+    h = subprocess.run([cli] + conn + ['getblockhash', str(first + i)], capture_output=True, text=True).stdout.strip()
+    b = subprocess.run([cli] + conn + ['getblock', h, '2'], capture_output=True, text=True).stdout
+    ok = ok and json.loads(line) == json.loads(b)
+print('yes' if ok else 'no')" "$BITCOIN_CLI" "$CONN_ARGS" "$RANGE_FROM" "$RANGE_TIP" 2>/dev/null) || true
+if [ "$RANGE_SAME" = "yes" ]; then
+    pass "I31.01 -range matches getblock per height"
+else
+    fail "I31.01 -range matches getblock per height" "${RANGE_OUT:0:200}"
+fi
+# Past the tip: the blocks up to it, then the height error
+RANGE_RC=0
+RANGE_LINES=$(btc -range=$RANGE_TIP:$((RANGE_TIP + 5)) getblock 2>/dev/null | wc -l) || RANGE_RC=$?
+RANGE_ERR=$(btc -range=$RANGE_TIP:$((RANGE_TIP + 5)) getblock 2>&1 >/dev/null) || RANGE_RC=$?
+if [ "$RANGE_LINES" -eq 1 ] && [ "$RANGE_RC" -ne 0 ] && echo "$RANGE_ERR" | grep -q "out of range"; then
+    pass "I31.02 range past the tip stops with the height error"
+else
+    fail "I31.02 range past the tip" "lines=$RANGE_LINES rc=$RANGE_RC $RANGE_ERR"
+fi
+
+# I32: -stats-range reduces getblockstats, caching per height
+subsection "I32: Block statistics over a range"
+STATS_TIP=$(ref getblockcount 2>/dev/null) || STATS_TIP=0
+STATS_FROM=$(( STATS_TIP > 30 ? STATS_TIP - 30 : 0 ))
+STATS_CACHE="$DATADIR/stats-cache.bin"
+STATS_OUT=$(btc -stats-cache="$STATS_CACHE" -batch-connections=2 -stats-range=$STATS_FROM:$STATS_TIP -stats-bucket=10 2>/dev/null) || true
+STATS_SAME=$(echo "$STATS_OUT" | python3 -c "
+import json, sys, subprocess
+cli, conn, a, b = sys.argv[1], sys.argv[2].split(), int(sys.argv[3]), int(sys.argv[4])
+got = json.load(sys.stdin)
+st = {h: json.loads(subprocess.run([cli] + conn + ['getblockstats', str(h)], capture_output=True, text=True).stdout) for h in range(a, b + 1)}
+def summ(hs, o):
+    for name, f in [('txs', 'txs'), ('total_weight', 'total_weight'), ('subsidy', 'subsidy'), ('totalfee', 'totalfee'), ('avgfeerate', 'avgfeerate')]:
+        v = sorted(st[h][f] for h in hs)
+        if o[name]['sum'] != sum(v) or o[name]['min'] != v[0] or o[name]['max'] != v[-1] or o[name]['p50'] != v[(len(v) + 1) // 2 - 1]:
+            return False
+    v = sorted(st[h]['feerate_percentiles'][2] for h in hs)
+    return o['medianfeerate']['max'] == v[-1]
+ok = got['blocks'] == b - a + 1 and summ(range(a, b + 1), got)
+ok = ok and all(summ(range(k['start'], k['end'] + 1), k) for k in got['buckets'])
+ok = ok and sum(k['blocks'] for k in got['buckets']) == got['blocks']
+print('yes' if ok else 'no')" "$BITCOIN_CLI" "$CONN_ARGS" "$STATS_FROM" "$STATS_TIP" 2>/dev/null) || true
+if [ "$STATS_SAME" = "yes" ]; then
+    pass "I32.01 -stats-range matches getblockstats"
+else
+    fail "I32.01 -stats-range matches getblockstats" "${STATS_OUT:0:200}"
+fi
+# The same range again comes entirely from the cache
+STATS_CACHED=$(btc -stats-cache="$STATS_CACHE" -stats-range=$STATS_FROM:$STATS_TIP 2>/dev/null | python3 -c "import sys,json; o=json.load(sys.stdin); print(o['fetched'], o['cached'])" 2>/dev/null) || true
+if [ "$STATS_CACHED" = "0 $((STATS_TIP - STATS_FROM + 1))" ]; then
+    pass "I32.02 repeated range served from the cache"
+else
+    fail "I32.02 repeated range served from the cache" "$STATS_CACHED"
+fi
+
+# I33: -cache answers repeated calls for immutable results from disk
+subsection "I33: Persistent result cache"
+CACHE_DIR="$DATADIR/btc-cli-cache"
+CACHE_HASH=$(ref getblockhash 1 2>/dev/null) || true
+CACHE_FIRST=$(btc -cache="$CACHE_DIR" getblock 1 2>/dev/null) || true
+CACHE_AGAIN=$(btc -cache="$CACHE_DIR" getblock 1 2>/dev/null) || true
+CACHE_REF=$(ref getblock "$CACHE_HASH" 2>/dev/null) || true
+if [ -n "$CACHE_REF" ] && [ "$CACHE_FIRST" = "$CACHE_REF" ] && [ "$CACHE_AGAIN" = "$CACHE_REF" ] &&
+   ls "$CACHE_DIR"/cache-regtest-*.bin >/dev/null 2>&1; then
+    pass "I33.01 cached getblock matches getblock"
+else
+    fail "I33.01 cached getblock matches getblock" "${CACHE_AGAIN:0:200}"
+fi
+# A cached block's confirmations follow the tip
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+CACHE_AGAIN=$(btc -cache="$CACHE_DIR" getblock 1 2>/dev/null) || true
+CACHE_REF=$(ref getblock "$CACHE_HASH" 2>/dev/null) || true
+if [ -n "$CACHE_REF" ] && [ "$CACHE_AGAIN" = "$CACHE_REF" ]; then
+    pass "I33.02 cached confirmations follow the tip"
+else
+    fail "I33.02 cached confirmations follow the tip" "${CACHE_AGAIN:0:200}"
+fi
+
+# I34: -hashindex resolves heights locally and is cut back on a reorg
+subsection "I34: Height to hash index"
+HIDX_FILE="$DATADIR/hashes.bin"
+HIDX_TIP=$(ref getblockcount 2>/dev/null) || HIDX_TIP=0
+HIDX_REF=$(ref getblock "$(ref getblockhash "$HIDX_TIP" 2>/dev/null)" 2>/dev/null) || true
+HIDX_FIRST=$(btc -hashindex="$HIDX_FILE" getblock "$HIDX_TIP" 2>/dev/null) || true
+HIDX_AGAIN=$(btc -hashindex="$HIDX_FILE" getblock "$HIDX_TIP" 2>/dev/null) || true
+if [ -n "$HIDX_REF" ] && [ "$HIDX_FIRST" = "$HIDX_REF" ] && [ "$HIDX_AGAIN" = "$HIDX_REF" ] &&
+   [ -s "$HIDX_FILE" ]; then
+    pass "I34.01 indexed getblock <height> matches getblock"
+else
+    fail "I34.01 indexed getblock <height> matches getblock" "${HIDX_AGAIN:0:200}"
+fi
+# Replace the tip: the indexed hash for its height is stale now
+ref invalidateblock "$(ref getblockhash "$HIDX_TIP" 2>/dev/null)" >/dev/null 2>&1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+HIDX_REF=$(ref getblockheader "$(ref getblockhash "$HIDX_TIP" 2>/dev/null)" 2>/dev/null) || true
+HIDX_AFTER=$(btc -hashindex="$HIDX_FILE" getblockheader "$HIDX_TIP" 2>/dev/null) || true
+if [ -n "$HIDX_REF" ] && [ "$HIDX_AFTER" = "$HIDX_REF" ]; then
+    pass "I34.02 reorg detected, index cut back"
+else
+    fail "I34.02 reorg detected, index cut back" "${HIDX_AFTER:0:200}"
+fi
+
+# I35: -subscribe streams ZMQ notifications from the node's endpoints
+subsection "I35: ZMQ subscriber"
+ZMQ_OUT="$DATADIR/zmq.ndjson"
+"$BTC_CLI" $CONN_ARGS -subscribe=hashblock,sequence > "$ZMQ_OUT" 2>/dev/null &
+ZMQ_PID=$!
+sleep 1
+ZMQ_HASHES=$(ref generatetoaddress 2 "$ADDR" 2>/dev/null | python3 -c "import sys,json; print(' '.join(json.load(sys.stdin)))" 2>/dev/null) || true
+sleep 1
+kill -INT "$ZMQ_PID" 2>/dev/null
+wait "$ZMQ_PID" 2>/dev/null
+ZMQ_GOT=$(python3 -c "
+import sys, json
+ev = [json.loads(l) for l in open(sys.argv[1])]
+blocks = [e['hash'] for e in ev if e['topic'] == 'hashblock']
+seqs = [e['seq'] for e in ev if e['topic'] == 'hashblock']
+conn = [e['hash'] for e in ev if e['topic'] == 'sequence' and e['event'] == 'connected']
+ok = seqs == list(range(seqs[0], seqs[0] + len(seqs))) if seqs else False
+print(' '.join(blocks) if ok and blocks == conn and not any('missed' in e for e in ev) else 'bad')
+" "$ZMQ_OUT" 2>/dev/null) || true
+if [ -n "$ZMQ_HASHES" ] && [ "$ZMQ_GOT" = "$ZMQ_HASHES" ]; then
+    pass "I35.01 -subscribe hashblock/sequence report each new block in order"
+else
+    fail "I35.01 -subscribe hashblock/sequence report each new block in order" "${ZMQ_GOT:0:200}"
+fi
+ZMQ_ERR=$(btc_both -subscribe=hashblock,rawblock) || true
+if echo "$ZMQ_ERR" | grep -q "does not publish rawblock"; then
+    pass "I35.02 -subscribe names a topic the node does not publish"
+else
+    fail "I35.02 -subscribe names a topic the node does not publish" "${ZMQ_ERR:0:200}"
+fi
+
+# I36: -track-txs follows many transactions to their final confirmation
+subsection "I36: -track-txs"
+TRACK_IN="$DATADIR/track.txids"
+TRACK_OUT="$DATADIR/track.ndjson"
+: > "$TRACK_IN"
+for i in 1 2 3; do
+    ref -rpcwallet=test_wallet sendtoaddress "$ADDR" 0.001 >> "$TRACK_IN" 2>/dev/null
+done
+echo "not-a-txid" >> "$TRACK_IN"
+"$BTC_CLI" $CONN_ARGS -rpcwallet=test_wallet -track-txs="$TRACK_IN" -wait=2 > "$TRACK_OUT" 2>"$TRACK_OUT.err" &
+TRACK_PID=$!
+sleep 1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+sleep 1
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    kill -0 "$TRACK_PID" 2>/dev/null || break
+    sleep 1
+done
+if kill -0 "$TRACK_PID" 2>/dev/null; then
+    kill "$TRACK_PID" 2>/dev/null
+    TRACK_RC=timeout
+else
+    wait "$TRACK_PID"
+    TRACK_RC=$?
+fi
+TRACK_GOT=$(python3 -c "
+import sys, json
+want = [l.strip() for l in open(sys.argv[1]) if len(l.strip()) == 64]
+ev = [json.loads(l) for l in open(sys.argv[2])]
+seen = lambda t, e: [x for x in ev if x['txid'] == t and x['event'] == e]
+ok = len(want) == 3 and all(seen(t, 'mempool') and seen(t, 'confirmed') and
+    [x['confirmations'] for x in seen(t, 'final')] == [2] for t in want)
+print('ok' if ok else 'bad')
+" "$TRACK_IN" "$TRACK_OUT" 2>/dev/null) || true
+if [ "$TRACK_GOT" = "ok" ] && [ "$TRACK_RC" = "1" ] && grep -q "line 4: not a txid" "$TRACK_OUT.err"; then
+    pass "I36.01 -track-txs reports mempool, confirmed and final for each, then exits"
+else
+    fail "I36.01 -track-txs reports mempool, confirmed and final for each, then exits" "rc=$TRACK_RC $(head -c 200 "$TRACK_OUT")"
+fi
+
+NOTFOUND_TXID=00000000000000000000000000000000000000000000000000000000000000ff
+TRACK_NF=$(echo "$NOTFOUND_TXID" | timeout 10 "$BTC_CLI" $CONN_ARGS -track-txs 2>/dev/null)
+TRACK_RC=$?
+if [ "$TRACK_RC" = 0 ] && [ "$TRACK_NF" = "{\"txid\":\"$NOTFOUND_TXID\",\"event\":\"notfound\"}" ]; then
+    pass "I36.02 -track-txs reports an unknown txid notfound once and exits"
+else
+    fail "I36.02 -track-txs reports an unknown txid notfound once and exits" "rc=$TRACK_RC $TRACK_NF"
+fi
+
+# Without a wallet, a transaction bumped and the bump mined is replaced
+RBF_TXID=$(ref -rpcwallet=test_wallet sendtoaddress "$ADDR" 0.001 "" "" false true 2>/dev/null) || true
+TRACK_OUT="$DATADIR/track-rbf.ndjson"
+echo "$RBF_TXID" | "$BTC_CLI" $CONN_ARGS -track-txs > "$TRACK_OUT" 2>/dev/null &
+TRACK_PID=$!
+sleep 1
+RBF_BY=$(ref -rpcwallet=test_wallet bumpfee "$RBF_TXID" 2>/dev/null | python3 -c "import sys,json; print(json.load(sys.stdin)['txid'])" 2>/dev/null) || true
+ref generatetoaddress 1 "$ADDR" >/dev/null 2>&1
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    kill -0 "$TRACK_PID" 2>/dev/null || break
+    sleep 1
+done
+kill "$TRACK_PID" 2>/dev/null || true
+if [ -n "$RBF_BY" ] && grep -q "{\"txid\":\"$RBF_TXID\",\"event\":\"replaced\",\"replaced_by\":\"$RBF_BY\"}" "$TRACK_OUT"; then
+    pass "I36.03 -track-txs without a wallet reports a bumped transaction replaced"
+else
+    fail "I36.03 -track-txs without a wallet reports a bumped transaction replaced" "by=$RBF_BY $(head -c 300 "$TRACK_OUT")"
+fi
+
+# I37: -exporter serves the node's metrics and -health's verdict over HTTP
+subsection "I37: Prometheus exporter"
+"$BTC_CLI" $CONN_ARGS -rpcwallet=test_wallet -exporter=127.0.0.1:$EXPORTERPORT -exporter-interval=1 2>/dev/null &
+EXPORTER_PID=$!
+sleep 2
+EXPORTER_BLOCKS=$(ref getblockcount)
+EXPORTER_GOT=$(python3 -c "
+import sys, urllib.request
+m = {}
+for l in urllib.request.urlopen('http://127.0.0.1:%s/metrics' % sys.argv[1], timeout=5).read().decode().splitlines():
+    if l and not l.startswith('#'):
+        k, v = l.rsplit(' ', 1)
+        m[k] = float(v)
+ok = m.get('bitcoin_up') == 1 and 'bitcoin_mempool_transactions' in m and \
+    'bitcoin_net_sent_bytes_total' in m and 'bitcoin_wallet_balance_btc{wallet=\"test_wallet\",state=\"trusted\"}' in m
+print(int(m['bitcoin_blocks']) if ok else 'bad')
+" "$EXPORTERPORT" 2>/dev/null) || true
+if [ -n "$EXPORTER_BLOCKS" ] && [ "$EXPORTER_GOT" = "$EXPORTER_BLOCKS" ]; then
+    pass "I37.01 -exporter /metrics has chain, mempool, network and wallet metrics"
+else
+    fail "I37.01 -exporter /metrics has chain, mempool, network and wallet metrics" "got=${EXPORTER_GOT:0:100} blocks=$EXPORTER_BLOCKS"
+fi
+btc -health >/dev/null && HEALTH_CODE=200 || HEALTH_CODE=503
+EXPORTER_CODE=$(python3 -c "
+import sys, urllib.request, urllib.error
+try:
+    print(urllib.request.urlopen('http://127.0.0.1:%s/healthz' % sys.argv[1], timeout=5).status)
+except urllib.error.HTTPError as e:
+    print(e.code)
+" "$EXPORTERPORT" 2>/dev/null) || true
+if [ "$EXPORTER_CODE" = "$HEALTH_CODE" ]; then
+    pass "I37.02 -exporter /healthz agrees with -health ($HEALTH_CODE)"
+else
+    fail "I37.02 -exporter /healthz agrees with -health" "healthz=$EXPORTER_CODE health=$HEALTH_CODE"
+fi
+kill "$EXPORTER_PID" 2>/dev/null
+wait "$EXPORTER_PID" 2>/dev/null
 
 # ═══════════════════════════════════════════════════════════════════════
 # SUMMARY
@@ -1,19 +1,30 @@
 /* Bitcoin Core JSON-RPC over raw TCP sockets */
 
-#define _GNU_SOURCE  /* for strdup */
+#define _GNU_SOURCE  /* for strdup, memmem */
 #include "rpc.h"
+#include "json.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
-#include <arpa/inet.h>
 #include <netdb.h>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define RPC_ENGINE_EPOLL 1  /* Otherwise the engine waits with poll() */
+#endif
+
 static const char b64_table[] =
 	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
@@ -58,6 +69,8 @@ int rpc_auth_cookie(RpcClient *client, const char *cookie_path)
 	size_t cookie_len;
 	size_t nread;
 
+	client->head_len = 0;  /* Cached request head carries the old auth */
+
 	f = fopen(cookie_path, "r");
 	if (!f)
 		return -1;
@@ -98,6 +111,7 @@ void rpc_auth_userpass(RpcClient *client, const char *user, const char *pass)
 	char b64[700];
 	int cred_len;
 
+	client->head_len = 0;
 	cred_len = snprintf(credentials, sizeof(credentials), "%s:%s", user, pass);
 	if (cred_len >= (int)sizeof(credentials)) {
 		client->auth[0] = '\0';
@@ -112,217 +126,608 @@ void rpc_auth_userpass(RpcClient *client, const char *user, const char *pass)
 		client->auth[0] = '\0';
 }
 
-static int rpc_auth_from_config(RpcClient *client, const char *datadir)
+void rpc_set_local(RpcClient *client, const char *path)
 {
-	char path[1024];
-	FILE *f;
-	char line[1024];
-	char user[256] = {0};
-	char pass[256] = {0};
+	snprintf(client->local_path, sizeof(client->local_path), "%s", path);
+}
 
-	snprintf(path, sizeof(path), "%s/bitcoin.conf", datadir);
+static void apply_timeout(RpcClient *client)
+{
+	if (client->timeout > 0) {
+		struct timeval tv;
+		tv.tv_sec = client->timeout;
+		tv.tv_usec = 0;
+		setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(client->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	}
+}
 
-	f = fopen(path, "r");
-	if (!f)
-		return -1;
+/* Connect through a btc-cli -daemon. It answers with one byte once it has
+ * a connection to the node for us: '+', or anything else if it has none. */
+static int connect_local(RpcClient *client)
+{
+	struct sockaddr_un addr;
+	char ok = 0;
 
-	while (fgets(line, sizeof(line), f)) {
-		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
-			continue;
+	client->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (client->sock < 0)
+		return -1;
 
-		line[strcspn(line, "\r\n")] = '\0';
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, client->local_path, strlen(client->local_path));
 
-		if (strncmp(line, "rpcuser=", 8) == 0)
-			strncpy(user, line + 8, sizeof(user) - 1);
-		if (strncmp(line, "rpcpassword=", 12) == 0)
-			strncpy(pass, line + 12, sizeof(pass) - 1);
+	if (connect(client->sock, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+		apply_timeout(client);
+		if (recv(client->sock, &ok, 1, 0) == 1 && ok == '+')
+			return 0;
 	}
-	fclose(f);
+	close(client->sock);
+	client->sock = -1;
+	return -1;
+}
 
-	if (user[0] && pass[0]) {
-		rpc_auth_userpass(client, user, pass);
-		return 0;
-	}
+/* Start a connect_local without waiting for the daemon's answer: the
+ * socket, non-blocking, or -1 if there is no daemon to answer */
+static int local_start(const RpcClient *client)
+{
+	struct sockaddr_un addr;
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
 
+	if (sock < 0)
+		return -1;
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, client->local_path, strlen(client->local_path));
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+		return sock;
+	close(sock);
 	return -1;
 }
 
-int rpc_auth_auto(RpcClient *client, const char *datadir)
+/* Connection attempts to further addresses of the node start this long
+ * after the last one while it is still pending (RFC 8305, "Happy
+ * Eyeballs"); one that fails outright moves on at once */
+#define RPC_CONNECT_STAGGER_MS 250
+
+/* At most this many addresses of a node are tried */
+#define RPC_CONNECT_MAX_ADDRS 16
+
+static long long now_ms(void)
 {
-	char path[1024];
-	const char *networks[] = {"signet", "testnet3", "testnet4", "regtest", "", NULL};
-	int i;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-	/* Try cookie file in each network subdir */
-	for (i = 0; networks[i] != NULL; i++) {
-		if (networks[i][0])
-			snprintf(path, sizeof(path), "%s/%s/.cookie", datadir, networks[i]);
-		else
-			snprintf(path, sizeof(path), "%s/.cookie", datadir);
+int rpc_connect_start(const RpcClient *client, const struct sockaddr *addr,
+                      socklen_t addrlen, int *done)
+{
+	int sock, flag = 1;
 
-		if (rpc_auth_cookie(client, path) == 0)
-			return 0;
-	}
+	*done = 0;
+	sock = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
 
-	/* Fallback to config file */
-	if (rpc_auth_from_config(client, datadir) == 0)
-		return 0;
+	/* Disable Nagle — send small requests immediately */
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
 
+	/* Notice a node that vanishes during a long call (e.g. waitfornewblock) */
+	setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &flag, sizeof(flag));
+#ifdef TCP_KEEPIDLE
+	{
+		int idle = 60, intvl = 10, cnt = 3;
+		setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+		setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+		setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
+	}
+#endif
+
+#ifdef TCP_FASTOPEN_CONNECT
+	/* The SYN waits for the first request and carries it, if the node
+	 * has given us a cookie before; connect() itself returns at once */
+	if (client->fastopen)
+		setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &flag, sizeof(flag));
+#else
+	(void)client;
+#endif
+
+	if (connect(sock, addr, addrlen) == 0) {
+		*done = 1;
+		return sock;
+	}
+	if (errno == EINPROGRESS)
+		return sock;
+	close(sock);
 	return -1;
 }
 
-int rpc_connect(RpcClient *client)
+/* Resolve the node's name into addrs, alternating address families,
+ * keeping the resolver's order within each and starting with the family
+ * it put first. Returns how many, or -1; *res is freed by the caller. */
+static int resolve_node(const RpcClient *client, struct addrinfo **res,
+                        const struct addrinfo **addrs)
 {
-	struct sockaddr_in addr;
-	in_addr_t ip;
+	struct addrinfo hints, *ai;
+	const struct addrinfo *first[RPC_CONNECT_MAX_ADDRS];
+	const struct addrinfo *other[RPC_CONNECT_MAX_ADDRS];
+	char port[16];
+	int naddrs = 0, nfirst = 0, nother = 0, i, j;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICSERV;  /* Not AI_ADDRCONFIG: it hides ::1 on hosts without global IPv6 */
+	snprintf(port, sizeof(port), "%d", client->port);
+	if (getaddrinfo(client->host, port, &hints, res) != 0)
+		return -1;
 
-	/* Skip DNS for numeric IP addresses */
-	ip = inet_addr(client->host);
-	if (ip == INADDR_NONE) {
-		struct hostent *he = gethostbyname(client->host);
-		if (!he)
-			return -1;
-		memcpy(&ip, he->h_addr_list[0], sizeof(ip));
+	for (ai = *res; ai; ai = ai->ai_next) {
+		if (ai->ai_family == (*res)->ai_family) {
+			if (nfirst < RPC_CONNECT_MAX_ADDRS)
+				first[nfirst++] = ai;
+		} else if (nother < RPC_CONNECT_MAX_ADDRS) {
+			other[nother++] = ai;
+		}
 	}
+	for (i = 0, j = 0; naddrs < RPC_CONNECT_MAX_ADDRS && (i < nfirst || j < nother); ) {
+		if (i < nfirst)
+			addrs[naddrs++] = first[i++];
+		if (j < nother && naddrs < RPC_CONNECT_MAX_ADDRS)
+			addrs[naddrs++] = other[j++];
+	}
+	return naddrs;
+}
 
-	client->sock = socket(AF_INET, SOCK_STREAM, 0);
-	if (client->sock < 0)
+/* Connect to the node over TCP: resolve its name, then race connections
+ * to its addresses, alternating address families, until one succeeds or
+ * client->connect_timeout (ms) passes */
+static int connect_tcp(RpcClient *client)
+{
+	struct addrinfo *res;
+	const struct addrinfo *addrs[RPC_CONNECT_MAX_ADDRS];
+	struct pollfd pending[RPC_CONNECT_MAX_ADDRS];
+	long long deadline = 0, last_start = 0;
+	int naddrs, npending = 0, next = 0, sock = -1;
+	int i;
+
+	naddrs = resolve_node(client, &res, addrs);
+	if (naddrs < 0)
 		return -1;
 
-	/* Disable Nagle — send small requests immediately */
-	{
-		int flag = 1;
-		setsockopt(client->sock, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+	if (client->connect_timeout > 0)
+		deadline = now_ms() + client->connect_timeout;
+
+	for (;;) {
+		long long now = now_ms();
+		int wait = -1, ready;
+
+		/* Start the next attempt when the last has had its head start,
+		 * or straight away if none is pending */
+		while (next < naddrs && (npending == 0 ||
+		       now - last_start >= RPC_CONNECT_STAGGER_MS)) {
+			int done;
+			int s = rpc_connect_start(client, addrs[next]->ai_addr,
+			                          addrs[next]->ai_addrlen, &done);
+			next++;
+			if (s < 0)
+				continue;
+			if (done) {
+				sock = s;
+				goto out;
+			}
+			pending[npending].fd = s;
+			pending[npending].events = POLLOUT;
+			npending++;
+			last_start = now;
+			break;
+		}
+		if (npending == 0 && next >= naddrs)
+			goto out;  /* Every address failed */
+
+		if (next < naddrs)
+			wait = (int)(last_start + RPC_CONNECT_STAGGER_MS - now);
+		if (deadline) {
+			if (now >= deadline)
+				goto out;
+			if (wait < 0 || deadline - now < wait)
+				wait = (int)(deadline - now);
+		}
+
+		ready = poll(pending, npending, wait);
+		if (ready < 0 && errno != EINTR)
+			goto out;
+		for (i = 0; ready > 0 && i < npending; i++) {
+			int err = 0;
+			socklen_t len = sizeof(err);
+
+			if (!pending[i].revents)
+				continue;
+			getsockopt(pending[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if (err == 0) {
+				sock = pending[i].fd;
+				pending[i] = pending[--npending];
+				goto out;
+			}
+			close(pending[i].fd);
+			pending[i--] = pending[--npending];
+		}
 	}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(client->port);
-	addr.sin_addr.s_addr = ip;
+out:
+	for (i = 0; i < npending; i++)
+		close(pending[i].fd);
+	freeaddrinfo(res);
+	if (sock < 0)
+		return -1;
 
-	if (connect(client->sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-		close(client->sock);
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+	client->sock = sock;
+	return 0;
+}
+
+int rpc_connect(RpcClient *client)
+{
+	if (client->local_path[0] && connect_local(client) == 0)
+		return 0;
+
+	if (connect_tcp(client) < 0) {
 		client->sock = -1;
 		return -1;
 	}
 
 	/* Apply socket timeout if set */
-	if (client->timeout > 0) {
-		struct timeval tv;
-		tv.tv_sec = client->timeout;
-		tv.tv_usec = 0;
-		setsockopt(client->sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-		setsockopt(client->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	apply_timeout(client);
+
+	return 0;
+}
+
+/* Build path: / or /wallet/<name> (wallet NULL = client's -rpcwallet) */
+static void build_path(const RpcClient *client, const char *wallet,
+                       char *path, size_t size)
+{
+	if (!wallet)
+		wallet = client->wallet;
+	if (wallet[0])
+		snprintf(path, size, "/wallet/%s", wallet);
+	else
+		path[0] = '/', path[1] = '\0';
+}
+
+/* Request line and the headers that do not change between requests,
+ * formatted once and kept on the client until the path or auth changes */
+static const char *request_head(RpcClient *client, const char *path,
+                                size_t *len)
+{
+	if (client->head_len == 0 || strcmp(client->head_path, path) != 0) {
+		/* IPv6 literals are bracketed in Host */
+		int v6 = strchr(client->host, ':') != NULL;
+		int n = snprintf(client->head, sizeof(client->head),
+			"POST %s HTTP/1.1\r\n"
+			"Host: %s%s%s:%d\r\n"
+			"Authorization: %s\r\n"
+			"Content-Type: application/json\r\n",
+			path, v6 ? "[" : "", client->host, v6 ? "]" : "",
+			client->port, client->auth);
+		if (n < 0 || n >= (int)sizeof(client->head))
+			n = 0;
+		snprintf(client->head_path, sizeof(client->head_path), "%s", path);
+		client->head_len = n;
 	}
+	*len = client->head_len;
+	return client->head;
+}
 
+/* An HTTP request as the pieces handed to writev(): the cached head, the
+ * Content-Length line, then the body. Body pieces point at the caller's
+ * buffers (method name, params) — nothing is copied to frame them. */
+typedef struct {
+	struct iovec iov[8];
+	int count;
+	char length_line[64];
+	char envelope[64];
+} RpcFrame;
+
+/* Fill in the head and Content-Length for body pieces iov[2..count) */
+static void frame_finish(RpcClient *client, RpcFrame *f, const char *wallet,
+                         int count)
+{
+	char path[512];
+	size_t body_len = 0;
+	int i;
+
+	build_path(client, wallet, path, sizeof(path));
+	for (i = 2; i < count; i++)
+		body_len += f->iov[i].iov_len;
+
+	f->iov[0].iov_base = (void *)request_head(client, path, &f->iov[0].iov_len);
+	f->iov[1].iov_base = f->length_line;
+	f->iov[1].iov_len = snprintf(f->length_line, sizeof(f->length_line),
+		"Content-Length: %zu\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n", body_len);
+	f->count = count;
+}
+
+static void frame_piece(RpcFrame *f, int i, const char *data, size_t len)
+{
+	f->iov[i].iov_base = (void *)data;
+	f->iov[i].iov_len = len;
+}
+
+/* Frame a JSON-RPC request object:
+ * {"jsonrpc":"2.0","id":N,"method":"<method>","params":<params>} */
+static void frame_call(RpcClient *client, RpcFrame *f, const char *wallet,
+                       const char *method, const char *params)
+{
+	int n = snprintf(f->envelope, sizeof(f->envelope),
+		"{\"jsonrpc\":\"2.0\",\"id\":%u,\"method\":\"", ++client->next_id);
+
+	if (!params)
+		params = "[]";
+	frame_piece(f, 2, f->envelope, n);
+	frame_piece(f, 3, method, strlen(method));
+	frame_piece(f, 4, "\",\"params\":", 11);
+	frame_piece(f, 5, params, strlen(params));
+	frame_piece(f, 6, "}", 1);
+	frame_finish(client, f, wallet, 7);
+}
+
+/* Frame a pre-built body (a batch array) */
+static void frame_raw(RpcClient *client, RpcFrame *f, const char *body)
+{
+	frame_piece(f, 2, body, strlen(body));
+	frame_finish(client, f, NULL, 3);
+}
+
+/* Write a frame with writev(), retrying on short writes. The frame itself
+ * is left intact so it can be sent again. */
+static int send_frame(int sock, const RpcFrame *f)
+{
+	struct iovec iov[8];
+	int i = 0, count = f->count;
+
+	memcpy(iov, f->iov, count * sizeof(iov[0]));
+	while (i < count) {
+		ssize_t n = writev(sock, iov + i, count - i);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		while (i < count && (size_t)n >= iov[i].iov_len)
+			n -= iov[i++].iov_len;
+		if (i < count) {
+			iov[i].iov_base = (char *)iov[i].iov_base + n;
+			iov[i].iov_len -= n;
+		}
+	}
 	return 0;
 }
 
-static char *read_http_response(int sock, int *http_status_out)
+/* Send a request; if the keep-alive connection was closed by the server,
+ * reconnect and retry once */
+static int send_with_retry(RpcClient *client, const RpcFrame *f)
 {
-	char *buffer;
-	size_t buf_size = 4096;
-	size_t total = 0;
-	ssize_t n;
-	char *body_start;
+	if (send_frame(client->sock, f) == 0)
+		return 0;
+
+	rpc_disconnect(client);
+	if (rpc_connect(client) < 0)
+		return -1;
+	return send_frame(client->sock, f);
+}
+
+/* First allocation of a client's receive buffer */
+#define RPC_RECV_INITIAL 4096
+
+/* Bodies at least this large are handed over with the receive buffer
+ * (see take_body) instead of copied out of it */
+#define RPC_RECV_HANDOFF (1024 * 1024)
+
+/* Make room for need bytes plus a NUL in the receive buffer. With exact,
+ * the buffer grows to just that (the size is known from Content-Length);
+ * otherwise it doubles. */
+static int recv_reserve(RpcRecvBuf *rb, size_t need, int exact)
+{
+	size_t size;
+	char *grown;
+
+	if (need + 1 <= rb->size)
+		return 0;
+	size = rb->size ? rb->size : RPC_RECV_INITIAL;
+	if (exact)
+		size = need + 1;
+	while (size < need + 1)
+		size *= 2;
+	grown = realloc(rb->data, size);
+	if (!grown)
+		return -1;
+	rb->data = grown;
+	rb->size = size;
+	return 0;
+}
+
+/* Parse the headers of a response at data (len bytes received so far).
+ * Returns -1 if they are not complete yet. */
+static int parse_http_head(char *data, size_t len, size_t *header_len_out,
+                           int *http_status_out, long *content_length_out)
+{
+	char *body_start = memmem(data, len, "\r\n\r\n", 4);
 	char *cl_header;
-	int content_length = 0;
-	size_t header_len;
-	size_t body_received;
+	long content_length = -1;
 	int http_status = 0;
 
-	if (http_status_out)
-		*http_status_out = 0;
+	if (!body_start)
+		return -1;
+	body_start += 4;
 
-	buffer = malloc(buf_size);
-	if (!buffer)
-		return NULL;
+	/* Check HTTP status code */
+	if (strncmp(data, "HTTP/1.", 7) == 0)
+		http_status = atoi(data + 9);
+
+	/* Content-Length, searched within the headers only */
+	{
+		char saved = *body_start;
+		*body_start = '\0';
+		cl_header = strstr(data, "Content-Length:");
+		if (!cl_header)
+			cl_header = strstr(data, "content-length:");
+		if (cl_header)
+			content_length = atol(cl_header + 15);
+		*body_start = saved;
+	}
 
-	while (total < buf_size - 1) {
-		n = recv(sock, buffer + total, buf_size - total - 1, 0);
+	*header_len_out = body_start - data;
+	*http_status_out = http_status;
+	*content_length_out = content_length;
+	return 0;
+}
+
+/* Read the next response up to the end of its headers into the receive
+ * buffer, after whatever part of it the previous read already took in.
+ * On return the buffer holds the headers and any body bytes that came
+ * with them. */
+static int read_http_head(RpcClient *client, size_t *header_len_out,
+                          int *http_status_out, long *content_length_out)
+{
+	RpcRecvBuf *rb = &client->recv;
+	ssize_t n;
+
+	/* Bring the start of this response (read along with the last one)
+	 * to the front; usually there is none */
+	if (rb->next < rb->len) {
+		rb->data[rb->next] = rb->held;
+		memmove(rb->data, rb->data + rb->next, rb->len - rb->next);
+		rb->len -= rb->next;
+	} else {
+		rb->len = 0;
+	}
+	rb->next = 0;
+	if (recv_reserve(rb, rb->len, 0) < 0)
+		return -1;
+	rb->data[rb->len] = '\0';
+
+	/* Read until the headers are complete */
+	while (parse_http_head(rb->data, rb->len, header_len_out, http_status_out,
+	                       content_length_out) < 0) {
+		if (recv_reserve(rb, rb->len + 1, 0) < 0)
+			return -1;
+		n = recv(client->sock, rb->data + rb->len, rb->size - rb->len - 1, 0);
+		if (n <= 0) {
+			rb->len = 0;
+			return -1;
+		}
+		rb->len += n;
+		rb->data[rb->len] = '\0';
+	}
+	return 0;
+}
+
+/* Read one HTTP response into the receive buffer. The body is left in
+ * place at data + *body_off and NUL-terminated; bytes that arrive past its
+ * end (the start of the next pipelined response) stay for the next read. */
+static int read_http_message(RpcClient *client, int *http_status_out,
+                             size_t *body_off, size_t *body_len)
+{
+	RpcRecvBuf *rb = &client->recv;
+	size_t header_len, msg_len;
+	long content_length;
+	ssize_t n;
+
+	*http_status_out = 0;
+	if (read_http_head(client, &header_len, http_status_out, &content_length) < 0)
+		return -1;
+
+	/* Size the buffer for the whole message up front. Without
+	 * Content-Length the server closes the connection after the body. */
+	msg_len = content_length >= 0 ? header_len + (size_t)content_length : (size_t)-1;
+	if (msg_len != (size_t)-1 && recv_reserve(rb, msg_len, 1) < 0) {
+		rb->len = 0;
+		return -1;
+	}
+	while (rb->len < msg_len) {
+		if (recv_reserve(rb, rb->len + 1, 0) < 0)
+			break;
+		n = recv(client->sock, rb->data + rb->len, rb->size - rb->len - 1, 0);
 		if (n <= 0)
 			break;
-		total += n;
-		buffer[total] = '\0';
-
-		body_start = strstr(buffer, "\r\n\r\n");
-		if (!body_start && total >= buf_size - 1) {
-			/* Headers didn't fit — grow buffer */
-			buf_size *= 2;
-			buffer = realloc(buffer, buf_size);
-			if (!buffer)
-				return NULL;
-			continue;
-		}
-		if (body_start) {
-			body_start += 4;
-
-			/* Check HTTP status code */
-			if (strncmp(buffer, "HTTP/1.", 7) == 0)
-				http_status = atoi(buffer + 9);
-
-			if (http_status_out)
-				*http_status_out = http_status;
-
-			/* For non-2xx: return JSON body for HTTP 500 (RPC errors),
-			 * synthetic error for 401 (auth failure),
-			 * and NULL for everything else */
-			if (http_status < 200 || http_status >= 300) {
-				if (http_status == 401) {
-					free(buffer);
-					return NULL;
-				}
-				if (http_status != 500) {
-					free(buffer);
-					return NULL;
-				}
-				/* HTTP 500: fall through to read JSON error body */
-			}
+		rb->len += n;
+	}
+	if (rb->len < msg_len)
+		msg_len = rb->len;
+
+	rb->next = msg_len;
+	rb->held = rb->data[msg_len];
+	rb->data[msg_len] = '\0';
+	*body_off = header_len;
+	*body_len = msg_len - header_len;
+	return 0;
+}
 
-			cl_header = strstr(buffer, "Content-Length:");
-			if (!cl_header)
-				cl_header = strstr(buffer, "content-length:");
-			if (cl_header)
-				content_length = atoi(cl_header + 15);
-
-			header_len = body_start - buffer;
-			body_received = total - header_len;
-
-			while (body_received < (size_t)content_length) {
-				if (total >= buf_size - 1) {
-					buf_size *= 2;
-					buffer = realloc(buffer, buf_size);
-					if (!buffer)
-						return NULL;
-				}
+/* Read one response and return its body as a view, or NULL. Bodies of
+ * non-2xx statuses are NULL too, except HTTP 500 (RPC errors); they are
+ * consumed either way, keeping the connection in sync for pipelined
+ * responses. */
+static const char *read_http_view(RpcClient *client, int *http_status_out,
+                                  size_t *len)
+{
+	size_t off, body_len;
+	int http_status;
 
-				n = recv(sock, buffer + total, buf_size - total - 1, 0);
-				if (n <= 0)
-					break;
-				total += n;
-				body_received += n;
-			}
-			buffer[total] = '\0';
+	if (read_http_message(client, &http_status, &off, &body_len) < 0) {
+		if (http_status_out)
+			*http_status_out = 0;
+		return NULL;
+	}
+	if (http_status_out)
+		*http_status_out = http_status;
+	if (http_status >= 400)
+		client->last_http_error = http_status;
+	if ((http_status < 200 || http_status >= 300) && http_status != 500)
+		return NULL;
+	if (len)
+		*len = body_len;
+	return client->recv.data + off;
+}
 
-			/* Move body to start of buffer to avoid strdup */
-			body_start = buffer + header_len;
-			body_received = total - header_len;
-			memmove(buffer, body_start, body_received + 1);
-			return buffer;
-		}
+/* Give the caller its own copy of a body returned by read_http_view. A
+ * large body that is all the buffer holds is moved to the front and the
+ * buffer itself handed over, rather than copied. */
+static char *take_body(RpcClient *client, const char *view, size_t len)
+{
+	RpcRecvBuf *rb = &client->recv;
+	char *body;
+
+	if (!view)
+		return NULL;
+	if (len >= RPC_RECV_HANDOFF && rb->next == rb->len) {
+		body = rb->data;
+		memmove(body, view, len + 1);
+		memset(rb, 0, sizeof(*rb));
+		return body;
 	}
+	body = malloc(len + 1);
+	if (body)
+		memcpy(body, view, len + 1);
+	return body;
+}
 
-	free(buffer);
-	return NULL;
+/* Read one HTTP response, as a string the caller frees */
+static char *read_http_response(RpcClient *client, int *http_status_out)
+{
+	size_t len;
+	const char *view = read_http_view(client, http_status_out, &len);
+	return take_body(client, view, len);
 }
 
-char *rpc_call(RpcClient *client, const char *method, const char *params)
+const char *rpc_call_view(RpcClient *client, const char *method,
+                          const char *params, size_t *len)
 {
-	char body[1024];
-	char request[2048];
-	char path[512];
-	int body_len, req_len;
-	ssize_t sent;
+	RpcFrame frame;
 
 	client->last_http_error = 0;
 
@@ -332,144 +737,299 @@ char *rpc_call(RpcClient *client, const char *method, const char *params)
 			return NULL;
 	}
 
-	/* Build path: / or /wallet/<name> */
-	if (client->wallet[0])
-		snprintf(path, sizeof(path), "/wallet/%s", client->wallet);
-	else
-		path[0] = '/', path[1] = '\0';
+	frame_call(client, &frame, NULL, method, params);
+	if (send_with_retry(client, &frame) < 0)
+		return NULL;
 
-	/* Build JSON-RPC body on stack */
-	const char *params_str = params ? params : "[]";
-	body_len = snprintf(body, sizeof(body),
-		"{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"%s\",\"params\":%s}",
-		method, params_str);
-
-	/* Handle oversized bodies (rare — large params) */
-	if (body_len >= (int)sizeof(body)) {
-		char *heap_body = malloc(body_len + 1);
-		char *heap_req;
-		int heap_req_len;
-		if (!heap_body) return NULL;
-		snprintf(heap_body, body_len + 1,
-			"{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"%s\",\"params\":%s}",
-			method, params_str);
-		heap_req = malloc(body_len + 512);
-		if (!heap_req) { free(heap_body); return NULL; }
-		heap_req_len = snprintf(heap_req, body_len + 512,
-			"POST %s HTTP/1.1\r\n"
-			"Host: %s:%d\r\n"
-			"Authorization: %s\r\n"
-			"Content-Type: application/json\r\n"
-			"Content-Length: %d\r\n"
-			"Connection: keep-alive\r\n"
-			"\r\n"
-			"%s",
-			path, client->host, client->port, client->auth,
-			body_len, heap_body);
-		free(heap_body);
-		sent = send(client->sock, heap_req, heap_req_len, 0);
-		if (sent < 0) {
-			close(client->sock);
-			client->sock = -1;
-			if (rpc_connect(client) < 0) { free(heap_req); return NULL; }
-			sent = send(client->sock, heap_req, heap_req_len, 0);
-			if (sent < 0) { free(heap_req); return NULL; }
-		}
-		free(heap_req);
-		goto read_response;
-	}
+	return read_http_view(client, NULL, len);
+}
+
+char *rpc_call(RpcClient *client, const char *method, const char *params)
+{
+	size_t len;
+	const char *view = rpc_call_view(client, method, params, &len);
+	return take_body(client, view, len);
+}
 
-	/* Build full HTTP request on stack — zero heap allocation */
-	req_len = snprintf(request, sizeof(request),
-		"POST %s HTTP/1.1\r\n"
-		"Host: %s:%d\r\n"
-		"Authorization: %s\r\n"
-		"Content-Type: application/json\r\n"
-		"Content-Length: %d\r\n"
+/* Frame a REST GET. REST takes no credentials and no body, so the head
+ * is formatted into the caller's buffer rather than the cached one. */
+static int frame_rest(RpcClient *client, RpcFrame *f, char *head, size_t size,
+                      const char *path)
+{
+	int v6 = strchr(client->host, ':') != NULL;
+	int n = snprintf(head, size,
+		"GET %s HTTP/1.1\r\n"
+		"Host: %s%s%s:%d\r\n"
 		"Connection: keep-alive\r\n"
-		"\r\n"
-		"%s",
-		path,
-		client->host, client->port,
-		client->auth,
-		body_len,
-		body);
-
-	sent = send(client->sock, request, req_len, 0);
-
-	if (sent < 0) {
-		/* Connection may have been closed by server; reconnect and retry once */
-		close(client->sock);
-		client->sock = -1;
+		"\r\n",
+		path, v6 ? "[" : "", client->host, v6 ? "]" : "", client->port);
+
+	if (n < 0 || (size_t)n >= size)
+		return -1;
+	frame_piece(f, 0, head, n);
+	f->count = 1;
+	return 0;
+}
+
+const char *rpc_rest_view(RpcClient *client, const char *path, size_t *len)
+{
+	RpcFrame frame;
+	char head[1024];
+	const char *view;
+	int http_status;
+
+	client->last_http_error = 0;
+	if (frame_rest(client, &frame, head, sizeof(head), path) < 0)
+		return NULL;
+	if (client->sock < 0) {
 		if (rpc_connect(client) < 0)
 			return NULL;
-		sent = send(client->sock, request, req_len, 0);
-		if (sent < 0)
-			return NULL;
 	}
+	if (send_with_retry(client, &frame) < 0)
+		return NULL;
 
-read_response:
-	{
-		int http_status = 0;
-		char *result = read_http_response(client->sock, &http_status);
-		if (http_status >= 400)
-			client->last_http_error = http_status;
-		return result;
+	view = read_http_view(client, &http_status, len);
+	return http_status == 200 ? view : NULL;
+}
+
+int rpc_rest_pipelined(RpcClient *client, const char *const *paths, int count,
+                       RpcRestCallback cb, void *arg)
+{
+	char head[2048];
+	int done = 0;
+	int i;
+
+	client->last_http_error = 0;
+	if (client->sock < 0) {
+		if (rpc_connect(client) < 0)
+			return 0;
+	}
+
+	while (done < count) {
+		int window = count - done;
+
+		if (window > RPC_PIPELINE_WINDOW)
+			window = RPC_PIPELINE_WINDOW;
+
+		for (i = 0; i < window; i++) {
+			RpcFrame frame;
+			int sent;
+
+			if (frame_rest(client, &frame, head, sizeof(head), paths[done + i]) < 0)
+				return done;
+			/* Only the first write may find a stale keep-alive socket */
+			if (done == 0 && i == 0)
+				sent = send_with_retry(client, &frame);
+			else
+				sent = send_frame(client->sock, &frame);
+			if (sent < 0) {
+				rpc_disconnect(client);
+				return done;
+			}
+		}
+
+		for (i = 0; i < window; i++) {
+			size_t len = 0;
+			int http_status;
+			const char *body = read_http_view(client, &http_status, &len);
+
+			if (http_status == 0) {
+				rpc_disconnect(client);
+				return done;
+			}
+			cb(arg, done, http_status == 200 ? body : NULL, len, http_status);
+			done++;
+		}
 	}
+
+	return done;
 }
 
-char *rpc_call_batch(RpcClient *client, const char *batch_json)
+/* Receive buffer for rpc_call_stream: the body is parsed in pieces of
+ * this size, never held whole */
+#define RPC_STREAM_CHUNK 65536
+
+int rpc_call_stream(RpcClient *client, const char *method, const char *params,
+                    JsonStream *js)
 {
-	char path[512];
-	char *heap_req;
-	int body_len, heap_req_len;
-	ssize_t sent;
+	RpcFrame frame;
+	RpcRecvBuf *rb = &client->recv;
+	int http_status;
+	int feed;
+	long content_length;
+	size_t header_len, have, remaining;
+	ssize_t n;
 
 	client->last_http_error = 0;
 
 	if (client->sock < 0) {
 		if (rpc_connect(client) < 0)
-			return NULL;
+			return -1;
 	}
 
-	if (client->wallet[0])
-		snprintf(path, sizeof(path), "/wallet/%s", client->wallet);
-	else
-		path[0] = '/', path[1] = '\0';
+	frame_call(client, &frame, NULL, method, params);
+	if (send_with_retry(client, &frame) < 0)
+		return -1;
 
-	body_len = (int)strlen(batch_json);
-	heap_req = malloc(body_len + 512);
-	if (!heap_req) return NULL;
+	if (read_http_head(client, &header_len, &http_status, &content_length) < 0)
+		return -1;
+	if (http_status >= 400)
+		client->last_http_error = http_status;
+
+	/* Only JSON-RPC bodies (2xx, or 500 carrying an RPC error) go to the
+	 * parser; others are read and dropped to keep the connection in sync */
+	feed = (http_status >= 200 && http_status < 300) || http_status == 500;
+
+	/* Body bytes that arrived with the headers; any past its end start
+	 * the next pipelined response and stay in the buffer */
+	have = rb->len - header_len;
+	rb->next = rb->len;
+	if (content_length >= 0 && have > (size_t)content_length) {
+		have = content_length;
+		rb->next = header_len + have;
+		rb->held = rb->data[rb->next];
+	}
+	if (feed)
+		json_stream_feed(js, rb->data + header_len, have);
+	remaining = content_length >= 0 ? (size_t)content_length - have : (size_t)-1;
+
+	/* Parse the rest as it arrives through the receive buffer, which it
+	 * then no longer holds anything of. If the callback stops early, the
+	 * body is still drained. */
+	if (remaining > 0) {
+		rb->len = rb->next = 0;
+		if (recv_reserve(rb, RPC_STREAM_CHUNK, 1) < 0) {
+			rpc_disconnect(client);
+			return -1;
+		}
+	}
+	while (remaining > 0) {
+		size_t want = remaining < rb->size ? remaining : rb->size;
+		n = recv(client->sock, rb->data, want, 0);
+		if (n <= 0)
+			break;
+		if (feed && js->status == 0)
+			json_stream_feed(js, rb->data, (size_t)n);
+		if (remaining != (size_t)-1)
+			remaining -= (size_t)n;
+	}
 
-	heap_req_len = snprintf(heap_req, body_len + 512,
-		"POST %s HTTP/1.1\r\n"
-		"Host: %s:%d\r\n"
-		"Authorization: %s\r\n"
-		"Content-Type: application/json\r\n"
-		"Content-Length: %d\r\n"
-		"Connection: keep-alive\r\n"
-		"\r\n"
-		"%s",
-		path, client->host, client->port, client->auth,
-		body_len, batch_json);
+	if (remaining > 0 && remaining != (size_t)-1) {
+		/* Truncated body */
+		rpc_disconnect(client);
+		return -1;
+	}
+	if (content_length < 0)
+		rpc_disconnect(client);  /* Body ended with the connection */
+	if (feed)
+		json_stream_finish(js);
+	return http_status;
+}
 
-	sent = send(client->sock, heap_req, heap_req_len, 0);
-	if (sent < 0) {
-		close(client->sock);
-		client->sock = -1;
-		if (rpc_connect(client) < 0) { free(heap_req); return NULL; }
-		sent = send(client->sock, heap_req, heap_req_len, 0);
-		if (sent < 0) { free(heap_req); return NULL; }
+int rpc_batch_send(RpcClient *client, const char *batch_json)
+{
+	RpcFrame frame;
+
+	client->last_http_error = 0;
+
+	if (client->sock < 0) {
+		if (rpc_connect(client) < 0)
+			return -1;
 	}
-	free(heap_req);
 
-	{
-		int http_status = 0;
-		char *result = read_http_response(client->sock, &http_status);
-		if (http_status >= 400)
-			client->last_http_error = http_status;
-		return result;
+	frame_raw(client, &frame, batch_json);
+	return send_with_retry(client, &frame);
+}
+
+char *rpc_batch_recv(RpcClient *client)
+{
+	return read_http_response(client, NULL);
+}
+
+const char *rpc_batch_recv_view(RpcClient *client, size_t *len)
+{
+	return read_http_view(client, NULL, len);
+}
+
+char *rpc_call_batch(RpcClient *client, const char *batch_json)
+{
+	if (rpc_batch_send(client, batch_json) < 0)
+		return NULL;
+	return rpc_batch_recv(client);
+}
+
+/* Check that a response carries the id of the request it answers */
+static int response_id_matches(const char *response, unsigned int id)
+{
+	const char *val = json_object_get(response, "id");
+	return val && strtoul(val, NULL, 10) == id;
+}
+
+int rpc_call_pipelined(RpcClient *client, RpcRequest *reqs, int count)
+{
+	int done = 0;
+	int i;
+
+	client->last_http_error = 0;
+	for (i = 0; i < count; i++) {
+		reqs[i].response = NULL;
+		reqs[i].http_status = 0;
+	}
+
+	if (client->sock < 0) {
+		if (rpc_connect(client) < 0)
+			return 0;
+	}
+
+	while (done < count) {
+		int window = count - done;
+		unsigned int first_id = client->next_id + 1;
+
+		if (window > RPC_PIPELINE_WINDOW)
+			window = RPC_PIPELINE_WINDOW;
+
+		/* Write the whole window before reading anything */
+		for (i = 0; i < window; i++) {
+			const RpcRequest *r = &reqs[done + i];
+			RpcFrame frame;
+			int sent;
+
+			frame_call(client, &frame, r->wallet, r->method, r->params);
+			/* Only the first write may find a stale keep-alive socket */
+			if (done == 0 && i == 0)
+				sent = send_with_retry(client, &frame);
+			else
+				sent = send_frame(client->sock, &frame);
+			if (sent < 0) {
+				rpc_disconnect(client);
+				return done;
+			}
+		}
+
+		/* HTTP/1.1 answers pipelined requests in order */
+		for (i = 0; i < window; i++) {
+			RpcRequest *r = &reqs[done];
+
+			r->response = read_http_response(client, &r->http_status);
+			if (r->http_status == 0) {
+				/* Connection lost mid-window */
+				free(r->response);
+				r->response = NULL;
+				rpc_disconnect(client);
+				return done;
+			}
+			if (r->response && !response_id_matches(r->response, first_id + i)) {
+				/* Out of sync — nothing after this can be trusted */
+				free(r->response);
+				r->response = NULL;
+				rpc_disconnect(client);
+				return done;
+			}
+			done++;
+		}
 	}
+
+	return done;
 }
 
 void rpc_disconnect(RpcClient *client)
@@ -478,4 +1038,812 @@ void rpc_disconnect(RpcClient *client)
 		close(client->sock);
 		client->sock = -1;
 	}
+	/* Unread pipelined bytes belong to the old connection; the buffer
+	 * itself goes too */
+	free(client->recv.data);
+	memset(&client->recv, 0, sizeof(client->recv));
+}
+
+/*
+ * Asynchronous engine
+ *
+ * Jobs are framed when submitted and queued on their node. Each poll
+ * hands queued jobs to the node's least loaded connection, up to the
+ * engine's depth per connection, writes what the sockets take, and reads
+ * and completes whatever responses have arrived, in order per connection.
+ * Connections are made the way rpc_connect makes them, but without
+ * waiting: the attempts are sockets of the event loop like the others.
+ */
+
+/* A node's idle connection older than this is reconnected rather than
+ * reused, since the node may have timed it out (-rpcservertimeout, 30s) */
+#define RPC_ENGINE_IDLE_SECS 20
+
+/* Receive space made available for each read */
+#define RPC_ENGINE_READ 65536
+
+typedef struct RpcJob {
+	struct RpcJob *next;
+	RpcCallback cb;
+	void *arg;
+	unsigned int id;          /* JSON-RPC id the response must carry, 0 for batches */
+	size_t len;               /* Framed HTTP request, stored after the struct */
+	size_t sent;              /* Bytes of it written */
+} RpcJob;
+
+typedef struct {
+	RpcJob *head, *tail;
+} RpcJobQueue;
+
+typedef struct {
+	RpcClient client;         /* Socket and receive buffer */
+	int node;
+	RpcJobQueue inflight;     /* Dispatched jobs, in request order */
+	RpcJob *unsent;           /* First of them not completely written */
+	int count;                /* Jobs in inflight */
+	size_t start;             /* Next response's offset in client.recv */
+	time_t last_io;
+	int dead;                 /* Retired after a connect failure or timeout */
+	unsigned int events;      /* Interest registered with epoll, 0 = none */
+	int connecting;           /* Jobs wait in inflight until it is connected */
+	int local;                /* Socket waiting for the -daemon's answer, or -1 */
+	int pending[RPC_CONNECT_MAX_ADDRS];  /* Attempts at the node's addresses */
+	int npending;
+	int next_addr;            /* Next of the node's addresses to try */
+	long long last_start;     /* When the last attempt started (ms) */
+	long long deadline;       /* Connect deadline (ms), 0 = the OS's */
+} RpcConn;
+
+typedef struct {
+	RpcClient template;       /* Settings, head cache and request ids */
+	struct sockaddr_storage addr[RPC_CONNECT_MAX_ADDRS];  /* As resolve_node */
+	socklen_t addrlen[RPC_CONNECT_MAX_ADDRS];
+	int naddrs;
+	RpcJobQueue queue;        /* Jobs waiting for a connection */
+	RpcConn *conns;
+	int nconns;
+	int live;                 /* Connections not retired */
+} RpcNode;
+
+struct RpcEngine {
+	RpcNode *nodes;
+	int nnodes;
+	int depth;                /* Jobs in flight per connection */
+	int pending;              /* Jobs queued or in flight */
+	unsigned long completed;
+#ifdef RPC_ENGINE_EPOLL
+	int epfd;
+#else
+	struct pollfd *pfds;
+	RpcConn **pfd_conns;
+	int pfd_cap;
+#endif
+};
+
+static void queue_push(RpcJobQueue *q, RpcJob *job)
+{
+	job->next = NULL;
+	if (q->tail)
+		q->tail->next = job;
+	else
+		q->head = job;
+	q->tail = job;
+}
+
+static RpcJob *queue_pop(RpcJobQueue *q)
+{
+	RpcJob *job = q->head;
+	if (job) {
+		q->head = job->next;
+		if (!q->head)
+			q->tail = NULL;
+	}
+	return job;
+}
+
+/* Register the events a connection waits for: responses whenever it is
+ * open (so a node hanging up on an idle one is noticed), and room to
+ * write while a request is partly sent */
+static void conn_watch(RpcEngine *engine, RpcConn *c)
+{
+#ifdef RPC_ENGINE_EPOLL
+	struct epoll_event ev;
+	unsigned int want = EPOLLIN | (c->unsent ? EPOLLOUT : 0);
+
+	if (c->client.sock < 0 || want == c->events)
+		return;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = want;
+	ev.data.ptr = c;
+	epoll_ctl(engine->epfd, c->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+	          c->client.sock, &ev);
+	c->events = want;
+#else
+	(void)engine;
+	(void)c;
+#endif
+}
+
+/* Wait for a connect attempt's socket to become writable, or for the
+ * daemon's answer (events: POLLOUT or POLLIN) */
+static void attempt_watch(RpcEngine *engine, RpcConn *c, int sock, int events)
+{
+#ifdef RPC_ENGINE_EPOLL
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events == POLLOUT ? EPOLLOUT : EPOLLIN;
+	ev.data.ptr = c;
+	epoll_ctl(engine->epfd, EPOLL_CTL_ADD, sock, &ev);
+#else
+	(void)engine;
+	(void)c;
+	(void)sock;
+	(void)events;
+#endif
+}
+
+/* Close the connect attempts still pending */
+static void conn_abort(RpcConn *c)
+{
+	int i;
+
+	if (c->local >= 0)
+		close(c->local);
+	c->local = -1;
+	for (i = 0; i < c->npending; i++)
+		close(c->pending[i]);
+	c->npending = 0;
+	c->connecting = 0;
+}
+
+static int conn_write(RpcEngine *engine, RpcConn *c);
+static void conn_fail(RpcEngine *engine, RpcConn *c, int retire);
+
+/* A connect attempt made it: sock (watched for events, if any, by
+ * attempt_watch) is the connection. The jobs that waited for it are
+ * written; one that fails this first write is not tried again. */
+static void conn_connected(RpcEngine *engine, RpcConn *c, int sock, int events)
+{
+	int i;
+
+	for (i = 0; i < c->npending; i++)
+		if (c->pending[i] != sock)
+			close(c->pending[i]);
+	c->npending = 0;
+	c->connecting = 0;
+	c->client.sock = sock;
+#ifdef RPC_ENGINE_EPOLL
+	c->events = events == POLLOUT ? EPOLLOUT : events ? EPOLLIN : 0;
+#else
+	(void)events;
+#endif
+	c->last_io = time(NULL);
+	if (conn_write(engine, c) < 0)
+		conn_fail(engine, c, 1);
+}
+
+/* Start the next attempt at the node's addresses when the last has had
+ * its head start, or straight away if none is pending (as connect_tcp).
+ * Returns -1 once none is pending and none is left to start. */
+static int conn_attempt(RpcEngine *engine, RpcConn *c, long long now)
+{
+	RpcNode *node = &engine->nodes[c->node];
+
+	while (c->next_addr < node->naddrs &&
+	       (c->npending == 0 || now - c->last_start >= RPC_CONNECT_STAGGER_MS)) {
+		int done, i = c->next_addr++;
+		int s = rpc_connect_start(&c->client, (struct sockaddr *)&node->addr[i],
+		                          node->addrlen[i], &done);
+		if (s < 0)
+			continue;
+		if (done) {
+			c->pending[c->npending++] = s;
+			conn_connected(engine, c, s, 0);
+			return 0;
+		}
+		c->pending[c->npending++] = s;
+		c->last_start = now;
+		attempt_watch(engine, c, s, POLLOUT);
+		break;
+	}
+	return c->npending > 0 ? 0 : -1;
+}
+
+/* Start connecting: through the -daemon when there is one, otherwise (or
+ * when it has no connection for us) to the node's addresses. A
+ * connection none of whose attempts can start is retired. */
+static int conn_open(RpcEngine *engine, RpcConn *c)
+{
+	RpcNode *node = &engine->nodes[c->node];
+	long long now = now_ms();
+
+	c->client = node->template;
+	c->client.sock = -1;
+	memset(&c->client.recv, 0, sizeof(c->client.recv));
+	c->start = 0;
+	c->events = 0;
+	c->connecting = 1;
+	c->local = -1;
+	c->npending = 0;
+	c->next_addr = 0;
+	c->deadline = c->client.connect_timeout > 0 ? now + c->client.connect_timeout : 0;
+	c->last_io = time(NULL);
+	if (c->client.local_path[0] && (c->local = local_start(&c->client)) >= 0) {
+		attempt_watch(engine, c, c->local, POLLIN);
+		return 0;
+	}
+	if (conn_attempt(engine, c, now) < 0) {
+		c->connecting = 0;
+		c->dead = 1;
+		node->live--;
+		return -1;
+	}
+	return 0;
+}
+
+/* Carry a connect on after its sockets have events: the daemon's answer,
+ * or attempts that connected or failed. One with nothing left to try
+ * is retired. */
+static void conn_progress(RpcEngine *engine, RpcConn *c)
+{
+	struct pollfd pfds[RPC_CONNECT_MAX_ADDRS];
+	int i, ready;
+
+	if (c->local >= 0) {
+		char ok = 0;
+		ssize_t n = recv(c->local, &ok, 1, 0);
+
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return;
+		if (n == 1 && ok == '+') {
+			int sock = c->local;
+
+			c->local = -1;
+			conn_connected(engine, c, sock, POLLIN);
+			return;
+		}
+		close(c->local);
+		c->local = -1;
+	} else {
+		for (i = 0; i < c->npending; i++) {
+			pfds[i].fd = c->pending[i];
+			pfds[i].events = POLLOUT;
+			pfds[i].revents = 0;
+		}
+		ready = poll(pfds, c->npending, 0);
+		for (i = 0; ready > 0 && i < c->npending; i++) {
+			int err = 0;
+			socklen_t len = sizeof(err);
+
+			if (!pfds[i].revents)
+				continue;
+			getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+			if (err == 0) {
+				conn_connected(engine, c, pfds[i].fd, POLLOUT);
+				return;
+			}
+			close(pfds[i].fd);
+			pfds[i] = pfds[c->npending - 1];
+			c->pending[i] = c->pending[--c->npending];
+			i--;
+		}
+	}
+	if (conn_attempt(engine, c, now_ms()) < 0)
+		conn_fail(engine, c, 1);
+}
+
+static void job_done(RpcEngine *engine, RpcJob *job, const char *body,
+                     size_t len, int http_status)
+{
+	/* As read_http_view: no body for non-2xx statuses other than 500 */
+	if ((http_status < 200 || http_status >= 300) && http_status != 500)
+		body = NULL;
+	engine->pending--;
+	engine->completed++;
+	job->cb(job->arg, body, body ? len : 0, http_status);
+	free(job);
+}
+
+/* Close a connection. Requests not completely written go back to the
+ * node's queue; those the node already has fail, as their outcome is
+ * unknown. With retire, the connection is not used again. */
+static void conn_fail(RpcEngine *engine, RpcConn *c, int retire)
+{
+	RpcNode *node = &engine->nodes[c->node];
+	RpcJobQueue requeue = { NULL, NULL };
+	RpcJob *job;
+
+	conn_abort(c);
+	rpc_disconnect(&c->client);
+	c->events = 0;
+	c->start = 0;
+	while ((job = queue_pop(&c->inflight)) != NULL) {
+		c->count--;
+		if (job->sent < job->len) {
+			job->sent = 0;
+			queue_push(&requeue, job);
+		} else {
+			job_done(engine, job, NULL, 0, 0);
+		}
+	}
+	c->unsent = NULL;
+	if (requeue.head) {
+		requeue.tail->next = node->queue.head;
+		node->queue.head = requeue.head;
+		if (!node->queue.tail)
+			node->queue.tail = requeue.tail;
+	}
+	if (retire && !c->dead) {
+		c->dead = 1;
+		node->live--;
+	}
+}
+
+/* Write as much of the unsent requests as the socket takes */
+static int conn_write(RpcEngine *engine, RpcConn *c)
+{
+	if (c->connecting)
+		return 0;
+	while (c->unsent) {
+		RpcJob *job = c->unsent;
+		ssize_t n = send(c->client.sock, (char *)(job + 1) + job->sent,
+		                 job->len - job->sent, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -1;
+		}
+		job->sent += n;
+		c->last_io = time(NULL);
+		if (job->sent == job->len)
+			c->unsent = job->next;
+	}
+	conn_watch(engine, c);
+	return 0;
+}
+
+/* Complete the jobs whose responses are in the receive buffer. At EOF,
+ * a response without Content-Length ends there. */
+static int conn_deliver(RpcEngine *engine, RpcConn *c, int eof)
+{
+	RpcRecvBuf *rb = &c->client.recv;
+
+	while (c->inflight.head && c->inflight.head != c->unsent) {
+		RpcJob *job = c->inflight.head;
+		size_t header_len, msg_len;
+		long content_length;
+		int http_status;
+		char saved;
+
+		if (parse_http_head(rb->data + c->start, rb->len - c->start,
+		                    &header_len, &http_status, &content_length) < 0)
+			break;
+		if (content_length >= 0)
+			msg_len = header_len + (size_t)content_length;
+		else if (eof)
+			msg_len = rb->len - c->start;
+		else
+			break;
+		if (rb->len - c->start < msg_len) {
+			/* Make room for the rest of it at once */
+			if (c->start > 0) {
+				memmove(rb->data, rb->data + c->start, rb->len - c->start);
+				rb->len -= c->start;
+				c->start = 0;
+			}
+			if (recv_reserve(rb, msg_len, 1) < 0)
+				return -1;
+			break;
+		}
+
+		/* NUL-terminate the body in place for the callback */
+		saved = rb->data[c->start + msg_len];
+		rb->data[c->start + msg_len] = '\0';
+		if (job->id && http_status >= 200 && http_status < 300 &&
+		    !response_id_matches(rb->data + c->start + header_len, job->id))
+			return -1;  /* Out of sync */
+		queue_pop(&c->inflight);
+		c->count--;
+		job_done(engine, job, rb->data + c->start + header_len,
+		         msg_len - header_len, http_status);
+		rb->data[c->start + msg_len] = saved;
+		c->start += msg_len;
+	}
+	if (c->start == rb->len)
+		c->start = rb->len = 0;
+	return 0;
+}
+
+/* Read what has arrived and complete the jobs it answers */
+static int conn_read(RpcEngine *engine, RpcConn *c)
+{
+	RpcRecvBuf *rb = &c->client.recv;
+
+	for (;;) {
+		ssize_t n;
+
+		if (rb->size - rb->len < RPC_ENGINE_READ / 4 && c->start > 0) {
+			memmove(rb->data, rb->data + c->start, rb->len - c->start);
+			rb->len -= c->start;
+			c->start = 0;
+		}
+		if (recv_reserve(rb, rb->len + RPC_ENGINE_READ, 0) < 0)
+			return -1;
+		n = recv(c->client.sock, rb->data + rb->len, rb->size - rb->len - 1, 0);
+		if (n == 0) {
+			conn_deliver(engine, c, 1);
+			return -1;
+		}
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return -1;
+		}
+		rb->len += n;
+		c->last_io = time(NULL);
+		if (conn_deliver(engine, c, 0) < 0)
+			return -1;
+	}
+}
+
+/* Hand queued jobs to the least loaded connections of a node */
+static void node_dispatch(RpcEngine *engine, RpcNode *node)
+{
+	RpcJob *job;
+	int i, fresh;
+
+	while (node->queue.head) {
+		RpcConn *best = NULL;
+
+		for (i = 0; i < node->nconns; i++) {
+			RpcConn *c = &node->conns[i];
+			if (c->dead || c->count >= engine->depth)
+				continue;
+			if (!best || c->count < best->count)
+				best = c;
+		}
+		if (!best)
+			break;
+
+		if (best->client.sock >= 0 && best->count == 0 &&
+		    time(NULL) - best->last_io >= RPC_ENGINE_IDLE_SECS)
+			conn_fail(engine, best, 0);
+		fresh = best->client.sock < 0 && !best->connecting;
+		if (fresh && conn_open(engine, best) < 0)
+			continue;
+
+		job = queue_pop(&node->queue);
+		queue_push(&best->inflight, job);
+		best->count++;
+		if (!best->unsent)
+			best->unsent = job;
+		/* A connection that fails its first write is not tried again */
+		if (conn_write(engine, best) < 0)
+			conn_fail(engine, best, fresh);
+	}
+
+	/* With every connection retired, nothing can run the rest */
+	if (node->live == 0)
+		while ((job = queue_pop(&node->queue)) != NULL)
+			job_done(engine, job, NULL, 0, 0);
+}
+
+RpcEngine *rpc_engine_new(int depth)
+{
+	RpcEngine *engine = calloc(1, sizeof(RpcEngine));
+
+	if (!engine)
+		return NULL;
+	engine->depth = depth > 0 ? depth : 1;
+#ifdef RPC_ENGINE_EPOLL
+	engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (engine->epfd < 0) {
+		free(engine);
+		return NULL;
+	}
+#endif
+	return engine;
+}
+
+int rpc_engine_add_node(RpcEngine *engine, const RpcClient *client,
+                        int connections)
+{
+	RpcNode *nodes, *node;
+	struct addrinfo *res = NULL;
+	const struct addrinfo *addrs[RPC_CONNECT_MAX_ADDRS];
+	int i;
+
+	if (connections < 1)
+		connections = 1;
+	nodes = realloc(engine->nodes, (engine->nnodes + 1) * sizeof(RpcNode));
+	if (!nodes)
+		return -1;
+	engine->nodes = nodes;
+	node = &nodes[engine->nnodes];
+	memset(node, 0, sizeof(*node));
+	node->conns = calloc(connections, sizeof(RpcConn));
+	if (!node->conns)
+		return -1;
+	node->template = *client;
+	node->template.sock = -1;
+	memset(&node->template.recv, 0, sizeof(node->template.recv));
+	node->nconns = node->live = connections;
+
+	/* Resolved once: the connections' attempts go to these */
+	node->naddrs = resolve_node(client, &res, addrs);
+	for (i = 0; i < node->naddrs; i++) {
+		memcpy(&node->addr[i], addrs[i]->ai_addr, addrs[i]->ai_addrlen);
+		node->addrlen[i] = addrs[i]->ai_addrlen;
+	}
+	if (res)
+		freeaddrinfo(res);
+
+	/* Start connecting up front; the first poll finishes it */
+	for (i = 0; i < connections; i++) {
+		node->conns[i].client.sock = -1;
+		node->conns[i].local = -1;
+		node->conns[i].node = engine->nnodes;
+		conn_open(engine, &node->conns[i]);
+	}
+	return engine->nnodes++;
+}
+
+int rpc_engine_live(const RpcEngine *engine, int node)
+{
+	return engine->nodes[node].live;
+}
+
+static int engine_submit(RpcEngine *engine, int node, const RpcFrame *f,
+                         unsigned int id, RpcCallback cb, void *arg)
+{
+	size_t len = 0, off = 0;
+	RpcJob *job;
+	int i;
+
+	for (i = 0; i < f->count; i++)
+		len += f->iov[i].iov_len;
+	job = malloc(sizeof(RpcJob) + len);
+	if (!job)
+		return -1;
+	for (i = 0; i < f->count; i++) {
+		memcpy((char *)(job + 1) + off, f->iov[i].iov_base, f->iov[i].iov_len);
+		off += f->iov[i].iov_len;
+	}
+	job->cb = cb;
+	job->arg = arg;
+	job->id = id;
+	job->len = len;
+	job->sent = 0;
+	queue_push(&engine->nodes[node].queue, job);
+	engine->pending++;
+	return 0;
+}
+
+int rpc_engine_call(RpcEngine *engine, int node, const char *method,
+                    const char *params, const char *wallet,
+                    RpcCallback cb, void *arg)
+{
+	RpcClient *t = &engine->nodes[node].template;
+	RpcFrame frame;
+
+	frame_call(t, &frame, wallet, method, params);
+	return engine_submit(engine, node, &frame, t->next_id, cb, arg);
+}
+
+int rpc_engine_batch(RpcEngine *engine, int node, const char *batch_json,
+                     RpcCallback cb, void *arg)
+{
+	RpcFrame frame;
+
+	frame_raw(&engine->nodes[node].template, &frame, batch_json);
+	return engine_submit(engine, node, &frame, 0, cb, arg);
+}
+
+int rpc_engine_pending(const RpcEngine *engine)
+{
+	return engine->pending;
+}
+
+/* Milliseconds until the first busy connection times out, a connect
+ * reaches its deadline or the next attempt of one is due, or -1 */
+static int engine_deadline(RpcEngine *engine, time_t now)
+{
+	long long now_conn = now_ms();
+	int n, i, ms = -1;
+
+	for (n = 0; n < engine->nnodes; n++) {
+		RpcNode *node = &engine->nodes[n];
+		for (i = 0; i < node->nconns; i++) {
+			RpcConn *c = &node->conns[i];
+			int left;
+			if (c->connecting && c->local < 0 && c->next_addr < node->naddrs) {
+				left = (int)(c->last_start + RPC_CONNECT_STAGGER_MS - now_conn);
+				if (ms < 0 || left < ms)
+					ms = left < 0 ? 0 : left;
+			}
+			if (c->connecting && c->deadline) {
+				left = (int)(c->deadline - now_conn);
+				if (ms < 0 || left < ms)
+					ms = left < 0 ? 0 : left;
+			}
+			if (c->count == 0 || c->client.timeout <= 0)
+				continue;
+			left = (int)(c->last_io + c->client.timeout - now) * 1000;
+			if (left < 0)
+				left = 0;
+			if (ms < 0 || left < ms)
+				ms = left;
+		}
+	}
+	return ms;
+}
+
+static void conn_ready(RpcEngine *engine, RpcConn *c, int readable,
+                       int writable)
+{
+	if (c->connecting) {
+		conn_progress(engine, c);
+		return;
+	}
+	if (c->client.sock < 0)
+		return;
+	if (writable && conn_write(engine, c) < 0) {
+		conn_fail(engine, c, 0);
+		return;
+	}
+	if (readable && conn_read(engine, c) < 0)
+		conn_fail(engine, c, 0);
+}
+
+int rpc_engine_poll(RpcEngine *engine, int timeout_ms)
+{
+	unsigned long before = engine->completed;
+	time_t now;
+	int n, i, deadline;
+
+	for (n = 0; n < engine->nnodes; n++)
+		node_dispatch(engine, &engine->nodes[n]);
+	if (engine->pending == 0)
+		return engine->completed > before ? (int)(engine->completed - before) : -1;
+
+	deadline = engine_deadline(engine, time(NULL));
+	if (deadline >= 0 && (timeout_ms < 0 || deadline < timeout_ms))
+		timeout_ms = deadline;
+
+#ifdef RPC_ENGINE_EPOLL
+	{
+		struct epoll_event evs[64];
+		int ready = epoll_wait(engine->epfd, evs, 64, timeout_ms);
+		for (i = 0; i < ready; i++)
+			conn_ready(engine, evs[i].data.ptr,
+			           (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0,
+			           (evs[i].events & EPOLLOUT) != 0);
+	}
+#else
+	{
+		int count = 0, ready, k;
+
+		for (n = 0; n < engine->nnodes; n++)
+			count += engine->nodes[n].nconns * (RPC_CONNECT_MAX_ADDRS + 1);
+		if (count > engine->pfd_cap) {
+			struct pollfd *pfds = realloc(engine->pfds, count * sizeof(*pfds));
+			RpcConn **conns = pfds ? realloc(engine->pfd_conns, count * sizeof(*conns)) : NULL;
+			if (pfds)
+				engine->pfds = pfds;
+			if (!conns)
+				return -1;
+			engine->pfd_conns = conns;
+			engine->pfd_cap = count;
+		}
+		k = 0;
+		for (n = 0; n < engine->nnodes; n++) {
+			RpcNode *node = &engine->nodes[n];
+			for (i = 0; i < node->nconns; i++) {
+				RpcConn *c = &node->conns[i];
+				int j;
+				/* A connect's attempts, each waited for */
+				if (c->connecting && c->local >= 0) {
+					engine->pfds[k].fd = c->local;
+					engine->pfds[k].events = POLLIN;
+					engine->pfds[k].revents = 0;
+					engine->pfd_conns[k++] = c;
+				}
+				for (j = 0; c->connecting && j < c->npending; j++) {
+					engine->pfds[k].fd = c->pending[j];
+					engine->pfds[k].events = POLLOUT;
+					engine->pfds[k].revents = 0;
+					engine->pfd_conns[k++] = c;
+				}
+				if (c->client.sock < 0 || c->count == 0)
+					continue;
+				engine->pfds[k].fd = c->client.sock;
+				engine->pfds[k].events = POLLIN | (c->unsent ? POLLOUT : 0);
+				engine->pfds[k].revents = 0;
+				engine->pfd_conns[k++] = c;
+			}
+		}
+		ready = poll(engine->pfds, k, timeout_ms);
+		for (i = 0; ready > 0 && i < k; i++)
+			/* Once one attempt connects, the others' events are stale */
+			if (engine->pfds[i].revents &&
+			    (engine->pfd_conns[i]->connecting ||
+			     engine->pfds[i].fd == engine->pfd_conns[i]->client.sock))
+				conn_ready(engine, engine->pfd_conns[i],
+				           (engine->pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0,
+				           (engine->pfds[i].revents & POLLOUT) != 0);
+	}
+#endif
+
+	/* Connections that have gone quiet for their timeout are retired,
+	 * as are connects past their deadline; the others start their next
+	 * attempt when it is due */
+	now = time(NULL);
+	for (n = 0; n < engine->nnodes; n++) {
+		RpcNode *node = &engine->nodes[n];
+		for (i = 0; i < node->nconns; i++) {
+			RpcConn *c = &node->conns[i];
+			if (c->connecting) {
+				long long ms = now_ms();
+				/* A daemon that does not answer is passed over,
+				 * as connect_local's receive timeout does */
+				if (c->local >= 0 && c->client.timeout > 0 &&
+				    now - c->last_io >= c->client.timeout) {
+					close(c->local);
+					c->local = -1;
+				}
+				if ((c->deadline && ms >= c->deadline) ||
+				    (c->local < 0 && conn_attempt(engine, c, ms) < 0))
+					conn_fail(engine, c, 1);
+				continue;
+			}
+			if (c->count > 0 && c->client.timeout > 0 &&
+			    now - c->last_io >= c->client.timeout)
+				conn_fail(engine, c, 1);
+		}
+		node_dispatch(engine, node);
+	}
+	return (int)(engine->completed - before);
+}
+
+int rpc_engine_run(RpcEngine *engine)
+{
+	while (engine->pending > 0)
+		if (rpc_engine_poll(engine, -1) < 0)
+			return -1;
+	return 0;
+}
+
+void rpc_engine_free(RpcEngine *engine)
+{
+	RpcJob *job;
+	int n, i;
+
+	if (!engine)
+		return;
+	for (n = 0; n < engine->nnodes; n++) {
+		RpcNode *node = &engine->nodes[n];
+		for (i = 0; i < node->nconns; i++) {
+			RpcConn *c = &node->conns[i];
+			while ((job = queue_pop(&c->inflight)) != NULL)
+				free(job);
+			conn_abort(c);
+			rpc_disconnect(&c->client);
+		}
+		while ((job = queue_pop(&node->queue)) != NULL)
+			free(job);
+		free(node->conns);
+	}
+	free(engine->nodes);
+#ifdef RPC_ENGINE_EPOLL
+	close(engine->epfd);
+#else
+	free(engine->pfds);
+	free(engine->pfd_conns);
+#endif
+	free(engine);
 }
@@ -4,6 +4,17 @@
 #define RPC_H
 
 #include <stddef.h>
+#include <sys/socket.h>
+#include "json.h"
+
+/* Receive buffer, kept across calls on a client */
+typedef struct {
+	char *data;
+	size_t size;       /* Allocated bytes */
+	size_t len;        /* Bytes received */
+	size_t next;       /* Start of the next (pipelined) response */
+	char held;         /* Byte at next, replaced by the last body's NUL */
+} RpcRecvBuf;
 
 typedef struct {
 	char host[256];
@@ -12,18 +23,120 @@ typedef struct {
 	char wallet[256];  /* Wallet name for -rpcwallet */
 	int sock;
 	int timeout;       /* Socket timeout in seconds (default: 900) */
+	int connect_timeout;  /* Connect deadline in ms, 0 = the OS's */
+	int fastopen;      /* Use TCP Fast Open */
 	int last_http_error;  /* Last HTTP error code (e.g. 401) */
+	unsigned int next_id; /* JSON-RPC id for the next request */
+	RpcRecvBuf recv;      /* Responses are read into this */
+	char head[1536];      /* Cached request line and fixed headers */
+	size_t head_len;      /* 0 = not built yet */
+	char head_path[512];  /* Path head was built for */
+	char local_path[108]; /* btc-cli -daemon socket to try before the node */
 } RpcClient;
 
+/* One request of a pipelined call (see rpc_call_pipelined) */
+typedef struct {
+	const char *method;
+	const char *params;   /* JSON params, NULL for [] */
+	const char *wallet;   /* Wallet endpoint, NULL for the client's -rpcwallet */
+	char *response;       /* Out: raw JSON-RPC response (caller frees), NULL on failure */
+	int http_status;      /* Out: HTTP status of this response */
+} RpcRequest;
+
+/* Requests written back-to-back before reading their responses */
+#define RPC_PIPELINE_WINDOW 64
+
 void rpc_init(RpcClient *client, const char *host, int port);
 int rpc_auth_cookie(RpcClient *client, const char *cookie_path);
 void rpc_auth_userpass(RpcClient *client, const char *user, const char *pass);
-int rpc_auth_auto(RpcClient *client, const char *datadir);
 void rpc_set_wallet(RpcClient *client, const char *wallet);
+/* Connect through the btc-cli -daemon listening on path when there is
+ * one, falling back to the node itself */
+void rpc_set_local(RpcClient *client, const char *path);
 int rpc_connect(RpcClient *client);
+/* Start a non-blocking connect to one address of the node, with the
+ * socket options rpc_connect uses. Returns the socket, with *done set if
+ * it is already connected, or -1 if the attempt failed. */
+int rpc_connect_start(const RpcClient *client, const struct sockaddr *addr,
+                      socklen_t addrlen, int *done);
 char *rpc_call(RpcClient *client, const char *method, const char *params);
+/* Like rpc_call, but return the body in place in the client's receive
+ * buffer rather than as a copy. The view is valid until the next call on
+ * the client; *len (if not NULL) is set to its length. */
+const char *rpc_call_view(RpcClient *client, const char *method,
+                          const char *params, size_t *len);
+/* Like rpc_call, but feed the response body to a streaming parser as it
+ * arrives instead of buffering it. The parser sees the whole JSON-RPC
+ * response object; bodies of HTTP errors other than 500 are not fed.
+ * Returns the HTTP status, or -1 if the call failed. */
+int rpc_call_stream(RpcClient *client, const char *method, const char *params,
+                    JsonStream *js);
+/* GET a REST endpoint (path such as /rest/block/<hash>.bin) on the same
+ * keep-alive connection. REST takes no credentials. Returns the body of a
+ * 200 response as a view like rpc_call_view's, NULL otherwise. */
+const char *rpc_rest_view(RpcClient *client, const char *path, size_t *len);
+/* Completion of a pipelined REST GET: the body of a 200 response (NULL
+ * otherwise), valid only during the callback */
+typedef void (*RpcRestCallback)(void *arg, int index, const char *body,
+                                size_t len, int http_status);
+/* GET count REST paths, written back-to-back in windows of
+ * RPC_PIPELINE_WINDOW as rpc_call_pipelined does, handing the responses to
+ * cb in order. Returns the number of responses received. */
+int rpc_rest_pipelined(RpcClient *client, const char *const *paths, int count,
+                       RpcRestCallback cb, void *arg);
 /* Batch RPC: send pre-built JSON batch array, returns response (caller frees) */
 char *rpc_call_batch(RpcClient *client, const char *batch_json);
+/* Split form of rpc_call_batch, for callers multiplexing several clients:
+ * send the batch, then (e.g. once poll() reports the socket readable)
+ * read its response (caller frees) */
+int rpc_batch_send(RpcClient *client, const char *batch_json);
+char *rpc_batch_recv(RpcClient *client);
+/* rpc_batch_recv as a view, valid until the next call on the client */
+const char *rpc_batch_recv_view(RpcClient *client, size_t *len);
+/* Pipelined RPC: write up to RPC_PIPELINE_WINDOW requests back-to-back on the
+ * keep-alive socket, each with a unique id, then read and match the responses
+ * in order. Fills reqs[i].response. Returns number of responses received. */
+int rpc_call_pipelined(RpcClient *client, RpcRequest *reqs, int count);
 void rpc_disconnect(RpcClient *client);
 
+/* Asynchronous engine: many connections, possibly to several nodes, each
+ * with up to depth pipelined requests in flight, multiplexed in one thread
+ * with epoll (poll() where there is no epoll). Calls are queued and
+ * complete through callbacks while rpc_engine_poll or rpc_engine_run
+ * drive the I/O. */
+typedef struct RpcEngine RpcEngine;
+
+/* Completion of a queued call. response is the body as rpc_call_view
+ * would return it (NULL on failure or for HTTP errors other than 500),
+ * valid only during the callback; http_status is 0 if the connection
+ * failed. The callback may queue further calls. */
+typedef void (*RpcCallback)(void *arg, const char *response, size_t len,
+                            int http_status);
+
+RpcEngine *rpc_engine_new(int depth);
+/* Add the node client is set up for (host, auth, wallet, timeouts) and
+ * start its connections; polling finishes them, racing the node's
+ * addresses as rpc_connect does. Returns the node's index, or -1 on
+ * allocation failure. */
+int rpc_engine_add_node(RpcEngine *engine, const RpcClient *client,
+                        int connections);
+/* Connections of a node still usable; once none are, its calls fail */
+int rpc_engine_live(const RpcEngine *engine, int node);
+/* Queue a call (params and wallet as in RpcRequest); 0 or -1 */
+int rpc_engine_call(RpcEngine *engine, int node, const char *method,
+                    const char *params, const char *wallet,
+                    RpcCallback cb, void *arg);
+/* Queue a pre-built JSON batch array */
+int rpc_engine_batch(RpcEngine *engine, int node, const char *batch_json,
+                     RpcCallback cb, void *arg);
+/* Calls queued or in flight */
+int rpc_engine_pending(const RpcEngine *engine);
+/* Send queued calls and handle I/O once, waiting up to timeout_ms (-1 =
+ * until something happens). Returns the number of calls completed, or -1
+ * if there was nothing to wait for. */
+int rpc_engine_poll(RpcEngine *engine, int timeout_ms);
+/* Poll until no calls are left. Returns 0, or -1 on error. */
+int rpc_engine_run(RpcEngine *engine);
+void rpc_engine_free(RpcEngine *engine);
+
 #endif
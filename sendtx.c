@@ -34,17 +34,16 @@ static char *sendtx_build_params(const char *hexstring, const char *maxfeerate)
 static int sendtx_verify_mempool(RpcClient *rpc, const char *txid)
 {
 	char params[128];
-	char *response;
+	const char *response;
 	int error_code;
 	char *result;
 
 	snprintf(params, sizeof(params), "[\"%s\"]", txid);
-	response = rpc_call(rpc, "getmempoolentry", params);
+	response = rpc_call_view(rpc, "getmempoolentry", params, NULL);
 	if (!response)
 		return 0;
 
 	result = method_extract_result(response, &error_code);
-	free(response);
 	free(result);
 
 	return (error_code == 0) ? 1 : 0;
@@ -56,7 +55,7 @@ static int sendtx_get_txid_from_hex(RpcClient *rpc, const char *hexstring,
 {
 	size_t plen = strlen(hexstring) + 16;
 	char *params = malloc(plen);
-	char *response;
+	const char *response;
 	int error_code;
 	char *result;
 
@@ -64,14 +63,13 @@ static int sendtx_get_txid_from_hex(RpcClient *rpc, const char *hexstring,
 		return -1;
 
 	snprintf(params, plen, "[\"%s\"]", hexstring);
-	response = rpc_call(rpc, "decoderawtransaction", params);
+	response = rpc_call_view(rpc, "decoderawtransaction", params, NULL);
 	free(params);
 
 	if (!response)
 		return -1;
 
 	result = method_extract_result(response, &error_code);
-	free(response);
 
 	if (error_code != 0 || !result) {
 		free(result);
@@ -99,7 +97,7 @@ int sendtx_submit(RpcClient *rpc, const char *hexstring,
                   const char *maxfeerate, SendTxResult *result)
 {
 	char *params;
-	char *response;
+	const char *response;
 	char *extracted;
 	int error_code;
 	int attempt;
@@ -126,7 +124,7 @@ int sendtx_submit(RpcClient *rpc, const char *hexstring,
 			}
 		}
 
-		response = rpc_call(rpc, "sendrawtransaction", params);
+		response = rpc_call_view(rpc, "sendrawtransaction", params, NULL);
 
 		if (!response) {
 			/* True network failure — retryable */
@@ -136,7 +134,6 @@ int sendtx_submit(RpcClient *rpc, const char *hexstring,
 		}
 
 		extracted = method_extract_result(response, &error_code);
-		free(response);
 
 		if (error_code == -27) {
 			/* Already in mempool — treat as success */
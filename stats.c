@@ -0,0 +1,562 @@
+/* Block statistics over a height range (-stats-range) */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "json.h"
+#include "methods.h"
+#include "hashidx.h"
+
+/* Heights handled per round: one getblockhash batch, then their
+ * getblockstats calls in batches of STATS_BATCH spread over the
+ * connections */
+#define STATS_CHUNK 1000
+#define STATS_BATCH 25
+/* getblockstats batches in flight per connection */
+#define STATS_DEPTH 4
+
+/* The values reduced, in output order. getblockstats reports amounts in
+ * satoshis and feerates in sat/vB. */
+enum {
+	M_TXS, M_WEIGHT, M_SUBSIDY, M_TOTALFEE, M_AVGFEERATE, M_MEDIANFEERATE,
+	STATS_METRICS
+};
+static const char *metric_names[STATS_METRICS] = {
+	"txs", "total_weight", "subsidy", "totalfee", "avgfeerate", "medianfeerate"
+};
+
+/* Percentiles given for each value */
+static const int percentiles[] = { 10, 25, 50, 75, 90 };
+
+/*
+ * Cache file: a header, then one fixed-size record per height at
+ * STATS_HEADER + height * sizeof(StatsRecord). A record whose hash is all
+ * zero (including the holes of a sparse file) is absent. Records carry
+ * the block's hash, so a reorg or a different chain on the same network
+ * (two regtest nodes) shows up as a mismatch and the height is fetched
+ * again.
+ */
+#define STATS_MAGIC "BTCSTAT1"
+#define STATS_HEADER 16
+
+typedef struct {
+	uint8_t hash[32];           /* As shown (big-endian hex order) */
+	int64_t v[STATS_METRICS];
+} StatsRecord;
+
+typedef struct {
+	int fd;                     /* -1 without a cache */
+} StatsCache;
+
+static void stats_cache_open(StatsCache *c, const char *path)
+{
+	char head[STATS_HEADER];
+	uint32_t size = sizeof(StatsRecord);
+
+	c->fd = -1;
+	if (!path)
+		return;
+	c->fd = open(path, O_RDWR | O_CREAT, 0600);
+	if (c->fd < 0) {
+		fprintf(stderr, "warning: stats cache %s: %s\n", path, strerror(errno));
+		return;
+	}
+	/* A file of another layout is started over */
+	if (pread(c->fd, head, sizeof(head), 0) == (ssize_t)sizeof(head) &&
+	    memcmp(head, STATS_MAGIC, 8) == 0 && memcmp(head + 8, &size, 4) == 0)
+		return;
+	memset(head, 0, sizeof(head));
+	memcpy(head, STATS_MAGIC, 8);
+	memcpy(head + 8, &size, 4);
+	if (ftruncate(c->fd, 0) < 0 ||
+	    pwrite(c->fd, head, sizeof(head), 0) != (ssize_t)sizeof(head)) {
+		fprintf(stderr, "warning: stats cache %s: %s\n", path, strerror(errno));
+		close(c->fd);
+		c->fd = -1;
+	}
+}
+
+static int stats_cache_get(StatsCache *c, int64_t height, const uint8_t *hash,
+                           StatsRecord *rec)
+{
+	if (c->fd < 0)
+		return -1;
+	if (pread(c->fd, rec, sizeof(*rec), STATS_HEADER + height * (off_t)sizeof(*rec)) !=
+	    (ssize_t)sizeof(*rec))
+		return -1;
+	return memcmp(rec->hash, hash, 32) == 0 ? 0 : -1;
+}
+
+static void stats_cache_put(StatsCache *c, int64_t height, const StatsRecord *rec)
+{
+	if (c->fd < 0)
+		return;
+	if (pwrite(c->fd, rec, sizeof(*rec), STATS_HEADER + height * (off_t)sizeof(*rec)) !=
+	    (ssize_t)sizeof(*rec)) {
+		/* Carry on without it rather than fail the summary */
+		fprintf(stderr, "warning: stats cache: %s\n", strerror(errno));
+		close(c->fd);
+		c->fd = -1;
+	}
+}
+
+/* A completed engine call, copied out of the callback */
+typedef struct {
+	char *response;
+	int done;
+} StatsSlot;
+
+static void slot_done(void *arg, const char *response, size_t len,
+                      int http_status)
+{
+	StatsSlot *slot = arg;
+
+	(void)http_status;
+	slot->response = NULL;
+	if (response) {
+		slot->response = malloc(len + 1);
+		if (slot->response)
+			memcpy(slot->response, response, len + 1);
+	}
+	slot->done = 1;
+}
+
+/* Report the error of a failed call (a batch element or a whole
+ * response); returns the exit code */
+static int report_error(const char *response, size_t len, const char *what)
+{
+	char *copy = response ? strndup(response, len) : NULL;
+	int code = 0;
+	char *msg = copy ? method_extract_result(copy, &code) : NULL;
+
+	if (code)
+		fprintf(stderr, "%s\n", msg);
+	else
+		fprintf(stderr, "error: %s failed\n", what);
+	free(msg);
+	free(copy);
+	return code ? abs(code) : 1;
+}
+
+/* Elements of a batch response by id (0..count-1); returns 0, or the
+ * exit code after reporting the failure */
+static int batch_elements(const char *response, JsonTape *tape, int *elems,
+                          int count, const char *what)
+{
+	int idx, i;
+
+	memset(tape, 0, sizeof(*tape));
+	if (!response || json_tape_parse(tape, response, strlen(response)) < 0 ||
+	    tape->count == 0 || tape->tok[0].type != JSON_ARRAY) {
+		json_tape_free(tape);
+		return report_error(response, response ? strlen(response) : 0, what);
+	}
+	for (i = 0; i < count; i++)
+		elems[i] = -1;
+	for (idx = json_tape_child(tape, 0); idx > 0; idx = json_tape_next(tape, idx)) {
+		int id = json_tape_get(tape, idx, "id");
+		int64_t n = id < 0 ? -1 : json_tape_int(tape, id);
+		int result = json_tape_get(tape, idx, "result");
+
+		if (n < 0 || n >= count)
+			continue;
+		if (result < 0 || tape->tok[result].type == JSON_NULL) {
+			int ret = report_error(json_tape_text(tape, idx), tape->tok[idx].len, what);
+			json_tape_free(tape);
+			return ret;
+		}
+		elems[n] = result;
+	}
+	for (i = 0; i < count; i++) {
+		if (elems[i] < 0) {
+			fprintf(stderr, "error: %s batch incomplete\n", what);
+			json_tape_free(tape);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int hex_bytes(const char *hex, uint8_t *out, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		unsigned int b;
+		if (sscanf(hex + 2 * i, "%2x", &b) != 1)
+			return -1;
+		out[i] = (uint8_t)b;
+	}
+	return 0;
+}
+
+/* Run the engine until every queued call has completed */
+static int engine_drain(RpcEngine *engine)
+{
+	if (rpc_engine_run(engine) < 0) {
+		fprintf(stderr, "error: Could not connect to the server\n");
+		return 1;
+	}
+	return 0;
+}
+
+/* Fill values for heights first..first+n-1 (index i at values[m][off + i])
+ * from the cache or the node. Returns 0 or the exit code. */
+static int stats_chunk(RpcEngine *engine, int node, StatsCache *cache,
+                       HashIdx *hashidx, int64_t first, int n, int64_t **values,
+                       int64_t off, long *fetched)
+{
+	StatsRecord *recs = calloc(n, sizeof(StatsRecord));
+	int *miss = malloc(sizeof(int) * n);
+	int *elems = malloc(sizeof(int) * n);
+	char (*hexes)[65] = malloc(sizeof(*hexes) * n);
+	StatsSlot hslot = {0}, *slots = NULL;
+	char *batch = NULL, *b;
+	int nmiss = 0, nbatch = 0, ret = 1, i, j, m;
+	int indexed, stale = 0;
+	JsonTape tape;
+
+	if (!recs || !miss || !elems || !hexes || !(batch = malloc((size_t)n * 256 + 2)))
+		goto done;
+
+resolve:
+	/* The hashes the node has for these heights now: from the index if
+	 * it has them all, else in a getblockhash batch */
+	for (i = 0; hashidx && !stale && i < n; i++)
+		if (hashidx_get(hashidx, first + i, hexes[i]) < 0)
+			break;
+	indexed = hashidx && !stale && i == n;
+	if (!indexed) {
+		b = batch;
+		*b++ = '[';
+		for (i = 0; i < n; i++)
+			b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,"
+			             "\"method\":\"getblockhash\",\"params\":[%lld]}",
+			             i ? "," : "", i, (long long)(first + i));
+		strcpy(b, "]");
+		if (rpc_engine_batch(engine, node, batch, slot_done, &hslot) < 0 ||
+		    engine_drain(engine) != 0)
+			goto done;
+		if ((ret = batch_elements(hslot.response, &tape, elems, n, "getblockhash")) != 0)
+			goto done;
+		for (i = 0; i < n; i++) {
+			if (json_tape_string(&tape, elems[i], hexes[i], sizeof(hexes[i])) != 64) {
+				fprintf(stderr, "error: Invalid getblockhash result\n");
+				json_tape_free(&tape);
+				ret = 1;
+				goto done;
+			}
+			if (hashidx)
+				hashidx_put(hashidx, first + i, hexes[i]);
+		}
+		json_tape_free(&tape);
+	}
+	nmiss = 0;
+	for (i = 0; i < n; i++) {
+		uint8_t hash[32];
+
+		if (hex_bytes(hexes[i], hash, 32) < 0) {
+			fprintf(stderr, "error: Invalid getblockhash result\n");
+			ret = 1;
+			goto done;
+		}
+		if (stats_cache_get(cache, first + i, hash, &recs[i]) != 0) {
+			memcpy(recs[i].hash, hash, 32);
+			miss[nmiss++] = i;
+		}
+	}
+
+	/* getblockstats for the rest, only the values reduced */
+	nbatch = (nmiss + STATS_BATCH - 1) / STATS_BATCH;
+	slots = calloc(nbatch ? nbatch : 1, sizeof(StatsSlot));
+	if (!slots) {
+		ret = 1;
+		goto done;
+	}
+	for (j = 0; j < nbatch; j++) {
+		int k, last = (j + 1) * STATS_BATCH < nmiss ? (j + 1) * STATS_BATCH : nmiss;
+
+		b = batch;
+		*b++ = '[';
+		for (k = j * STATS_BATCH; k < last; k++) {
+			uint8_t *h = recs[miss[k]].hash;
+			int x;
+
+			b += sprintf(b, "%s{\"jsonrpc\":\"2.0\",\"id\":%d,"
+			             "\"method\":\"getblockstats\",\"params\":[\"",
+			             k > j * STATS_BATCH ? "," : "", k - j * STATS_BATCH);
+			for (x = 0; x < 32; x++)
+				b += sprintf(b, "%02x", h[x]);
+			b += sprintf(b, "\",[\"height\",\"txs\",\"total_weight\",\"subsidy\","
+			             "\"totalfee\",\"avgfeerate\",\"feerate_percentiles\"]]}");
+		}
+		strcpy(b, "]");
+		if (rpc_engine_batch(engine, node, batch, slot_done, &slots[j]) < 0)
+			slots[j].done = 1;
+	}
+	if (nbatch && engine_drain(engine) != 0) {
+		ret = 1;
+		goto done;
+	}
+	for (j = 0; j < nbatch; j++) {
+		int k, count = (j + 1) * STATS_BATCH < nmiss ? STATS_BATCH : nmiss - j * STATS_BATCH;
+
+		if ((ret = batch_elements(slots[j].response, &tape, elems, count,
+		                          "getblockstats")) != 0)
+			goto done;
+		for (k = 0; k < count; k++) {
+			StatsRecord *rec = &recs[miss[j * STATS_BATCH + k]];
+			int r = elems[k], pct, height = json_tape_get(&tape, r, "height");
+			int idx[STATS_METRICS - 1] = {
+				json_tape_get(&tape, r, "txs"),
+				json_tape_get(&tape, r, "total_weight"),
+				json_tape_get(&tape, r, "subsidy"),
+				json_tape_get(&tape, r, "totalfee"),
+				json_tape_get(&tape, r, "avgfeerate"),
+			};
+
+			/* A stale index entry named another block: resolve the
+			 * chunk's heights with getblockhash instead */
+			if (height < 0 ||
+			    json_tape_int(&tape, height) != first + miss[j * STATS_BATCH + k]) {
+				json_tape_free(&tape);
+				if (!indexed) {
+					fprintf(stderr, "error: getblockstats returned another block\n");
+					ret = 1;
+					goto done;
+				}
+				for (j = 0; j < nbatch; j++)
+					free(slots[j].response);
+				free(slots);
+				slots = NULL;
+				nbatch = 0;
+				stale = 1;
+				goto resolve;
+			}
+
+			for (m = 0; m < STATS_METRICS - 1; m++)
+				rec->v[m] = idx[m] < 0 ? 0 : json_tape_int(&tape, idx[m]);
+			/* The median is the middle of feerate_percentiles */
+			pct = json_tape_get(&tape, r, "feerate_percentiles");
+			rec->v[M_MEDIANFEERATE] = 0;
+			if (pct >= 0 && tape.tok[pct].type == JSON_ARRAY && tape.tok[pct].count == 5) {
+				int e = json_tape_child(&tape, pct);
+				for (m = 0; m < 2; m++)
+					e = json_tape_next(&tape, e);
+				rec->v[M_MEDIANFEERATE] = json_tape_int(&tape, e);
+			}
+			stats_cache_put(cache, first + miss[j * STATS_BATCH + k], rec);
+		}
+		json_tape_free(&tape);
+	}
+	*fetched += nmiss;
+
+	for (i = 0; i < n; i++)
+		for (m = 0; m < STATS_METRICS; m++)
+			values[m][off + i] = recs[i].v[m];
+	ret = 0;
+
+done:
+	free(hslot.response);
+	for (j = 0; slots && j < nbatch; j++)
+		free(slots[j].response);
+	free(slots);
+	free(batch);
+	free(elems);
+	free(hexes);
+	free(miss);
+	free(recs);
+	return ret;
+}
+
+/* Growable output text */
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+	int failed;
+} Buf;
+
+static void buf_printf(Buf *b, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	if (b->failed)
+		return;
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+		va_end(ap);
+		if (n < 0) {
+			b->failed = 1;
+			return;
+		}
+		if ((size_t)n < b->cap - b->len) {
+			b->len += n;
+			return;
+		}
+		size_t cap = b->cap * 2 + n + 256;
+		char *data = realloc(b->data, cap);
+		if (!data) {
+			b->failed = 1;
+			return;
+		}
+		b->data = data;
+		b->cap = cap;
+	}
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* The members of a summary of heights [a, b) (offsets into values) */
+static void summarize(Buf *out, int64_t **values, int64_t a, int64_t b,
+                      int64_t *scratch)
+{
+	int64_t n = b - a, i;
+	int m, p;
+
+	for (m = 0; m < STATS_METRICS; m++) {
+		int64_t sum = 0;
+
+		memcpy(scratch, values[m] + a, n * sizeof(int64_t));
+		qsort(scratch, n, sizeof(int64_t), cmp_int64);
+		for (i = 0; i < n; i++)
+			sum += scratch[i];
+		buf_printf(out, ",\"%s\":{\"sum\":%lld,\"mean\":%.2f,\"min\":%lld,\"max\":%lld",
+		           metric_names[m], (long long)sum, (double)sum / n,
+		           (long long)scratch[0], (long long)scratch[n - 1]);
+		/* Nearest rank */
+		for (p = 0; p < (int)(sizeof(percentiles) / sizeof(percentiles[0])); p++) {
+			int64_t rank = (percentiles[p] * n + 99) / 100;
+			buf_printf(out, ",\"p%d\":%lld", percentiles[p],
+			           (long long)scratch[rank > 0 ? rank - 1 : 0]);
+		}
+		buf_printf(out, "}");
+	}
+}
+
+int stats_run(RpcClient *rpc, const char *spec, int bucket,
+              const char *cache_path, HashIdx *hashidx, int nconns, char **out)
+{
+	int64_t start, end, count, h, *values[STATS_METRICS] = {0}, *scratch = NULL;
+	StatsCache cache;
+	RpcEngine *engine = NULL;
+	Buf buf = {0};
+	long fetched = 0;
+	int node = -1, ret = 1, m;
+	char *p;
+
+	*out = NULL;
+	errno = 0;
+	start = strtoll(spec, &p, 10);
+	if (p == spec || *p != ':' || start < 0 || errno) {
+		fprintf(stderr, "error: -stats-range must be START:END\n");
+		return 1;
+	}
+	spec = p + 1;
+	if (*spec) {
+		end = strtoll(spec, &p, 10);
+		if (*p || end < start || errno) {
+			fprintf(stderr, "error: -stats-range must be START:END with START <= END\n");
+			return 1;
+		}
+	} else {
+		char *response = rpc_call(rpc, "getblockcount", "[]");
+		int code = 0;
+		char *result = response ? method_take_result(response, &code) : NULL;
+
+		if (!result || code != 0) {
+			fprintf(stderr, "%s\n", result ? result : "error: getblockcount failed");
+			free(result);
+			return code ? abs(code) : 1;
+		}
+		end = strtoll(result, NULL, 10);
+		free(result);
+		if (end < start) {
+			fprintf(stderr, "error: -stats-range starts past the tip (%lld)\n",
+			        (long long)end);
+			return 1;
+		}
+	}
+	count = end - start + 1;
+
+	for (m = 0; m < STATS_METRICS; m++)
+		if (!(values[m] = malloc(count * sizeof(int64_t))))
+			goto done;
+	if (!(scratch = malloc(count * sizeof(int64_t))))
+		goto done;
+
+	stats_cache_open(&cache, cache_path);
+	/* Heights the index has after checking it need no getblockhash */
+	if (hashidx && hashidx_sync(hashidx, rpc, 0, 0) < 0)
+		hashidx = NULL;
+	engine = rpc_engine_new(STATS_DEPTH);
+	/* The engine's connections share the main client's settings */
+	rpc_disconnect(rpc);
+	if (engine)
+		node = rpc_engine_add_node(engine, rpc, nconns);
+	if (node < 0)
+		goto close;
+
+	for (h = start; h <= end; h += STATS_CHUNK) {
+		int n = end - h + 1 > STATS_CHUNK ? STATS_CHUNK : (int)(end - h + 1);
+		if ((ret = stats_chunk(engine, node, &cache, hashidx, h, n, values,
+		                       h - start, &fetched)) != 0)
+			goto close;
+	}
+
+	buf_printf(&buf, "{\"start\":%lld,\"end\":%lld,\"blocks\":%lld,"
+	           "\"fetched\":%ld,\"cached\":%lld",
+	           (long long)start, (long long)end, (long long)count,
+	           fetched, (long long)(count - fetched));
+	summarize(&buf, values, 0, count, scratch);
+	if (bucket > 0) {
+		int64_t a;
+
+		buf_printf(&buf, ",\"buckets\":[");
+		for (a = start; a <= end; ) {
+			int64_t b = (a / bucket + 1) * bucket;
+
+			if (b > end + 1)
+				b = end + 1;
+			buf_printf(&buf, "%s{\"start\":%lld,\"end\":%lld,\"blocks\":%lld",
+			           a > start ? "," : "", (long long)a, (long long)(b - 1),
+			           (long long)(b - a));
+			summarize(&buf, values, a - start, b - start, scratch);
+			buf_printf(&buf, "}");
+			a = b;
+		}
+		buf_printf(&buf, "]");
+	}
+	buf_printf(&buf, "}");
+	if (buf.failed) {
+		free(buf.data);
+		ret = 1;
+	} else {
+		*out = buf.data;
+		ret = 0;
+	}
+
+close:
+	rpc_engine_free(engine);
+	if (cache.fd >= 0)
+		close(cache.fd);
+done:
+	for (m = 0; m < STATS_METRICS; m++)
+		free(values[m]);
+	free(scratch);
+	return ret;
+}
@@ -0,0 +1,24 @@
+/* Block statistics over a height range (-stats-range) */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include "config.h"
+#include "rpc.h"
+#include "hashidx.h"
+
+/* Fetch getblockstats for the heights in spec ("START:END", or "START:"
+ * for everything up to the tip) over nconns connections and reduce them
+ * to sum, mean, min/max and percentiles of tx count, block weight,
+ * subsidy, total fee and feerates. With bucket > 0 the same summary is
+ * also given per bucket of heights aligned to multiples of bucket (2016
+ * for difficulty epochs). Heights found in cache_path (NULL for none)
+ * under the hash the node has for them are not fetched again; fetched
+ * ones are added to it. The hashes come from hashidx (NULL for none)
+ * when it has them, and the ones fetched are recorded there. Returns the exit
+ * code; on success *out is the summary as JSON (caller frees). */
+int stats_run(RpcClient *rpc, const char *spec, int bucket,
+              const char *cache_path, HashIdx *hashidx, int nconns, char **out);
+
+#endif
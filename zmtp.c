@@ -0,0 +1,688 @@
+/* ZeroMQ notifications from bitcoind (-subscribe)
+ *
+ * A SUB socket speaking ZMTP 3.0 directly over TCP or a Unix socket,
+ * enough for bitcoind's zmqpub* publishers. After connecting each side
+ * sends
+ *
+ *   greeting   64 bytes: signature, version 3.0, the NULL mechanism
+ *   READY      a command frame with its Socket-Type
+ *
+ * and we send one subscription message (0x01 and the topic) per topic.
+ * Frames are a flags byte (MORE, LONG, COMMAND), a size of 1 byte, or 8
+ * big-endian bytes with LONG, and the body. Each notification is then a
+ * message of three frames: the topic, the body and a 4-byte little-endian
+ * sequence number the publisher counts per topic, from 0 when bitcoind
+ * starts.
+ */
+
+#define _GNU_SOURCE
+#include "zmtp.h"
+#include "block.h"
+#include "json.h"
+#include "methods.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define ZMTP_MAX_TOPICS 5
+#define ZMTP_MAX_BUF (64u << 20)  /* Unread data per connection; a block is at most 4 MB */
+#define ZMTP_READ 65536           /* Room made for each read */
+#define ZMTP_RETRY_MS 1000        /* Between attempts to reconnect */
+#define ZMTP_HANDSHAKE_MS 5000    /* For the peer's greeting and READY */
+
+#define FLAG_MORE    0x01
+#define FLAG_LONG    0x02
+#define FLAG_COMMAND 0x04
+
+/* What bitcoind publishes */
+static const char *const topic_names[] = {
+	"hashblock", "hashtx", "rawblock", "rawtx", "sequence"
+};
+
+typedef struct {
+	const char *name;
+	int conn;                 /* Its connection */
+	uint32_t next;            /* Sequence number expected next */
+	int seen;                 /* Any notification received yet */
+} ZmtpTopic;
+
+typedef struct {
+	char address[256];        /* tcp://host:port or ipc://path */
+	int fd;                   /* -1 while disconnected */
+	int greeted;              /* The peer's greeting was read */
+	int ready;                /* ...and its READY */
+	uint8_t *buf;             /* Received, not yet handled */
+	size_t len, cap;
+	long long retry_at;       /* Next attempt to reconnect (ms) */
+	long long opened_at;      /* When connected (ms) */
+} ZmtpConn;
+
+typedef struct {
+	ZmtpTopic topics[ZMTP_MAX_TOPICS];
+	int ntopics;
+	ZmtpConn conns[ZMTP_MAX_TOPICS];
+	int nconns;
+	const char *host;
+} Zmtp;
+
+static volatile sig_atomic_t zmtp_stop = 0;
+
+static void zmtp_signal(int sig)
+{
+	(void)sig;
+	zmtp_stop = 1;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Connect to a tcp:// or ipc:// endpoint. A wildcard host, as bitcoind
+ * may have been told to bind to, stands for host. Returns the socket, or
+ * -1 with errno set. */
+static int endpoint_connect(const char *address, const char *host)
+{
+	struct addrinfo hints, *res, *ai;
+	char name[256];
+	const char *p, *port;
+	size_t n;
+	int fd = -1, err;
+
+	if (strncmp(address, "ipc://", 6) == 0) {
+		struct sockaddr_un addr;
+
+		if (strlen(address + 6) >= sizeof(addr.sun_path)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strcpy(addr.sun_path, address + 6);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			err = errno;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		return fd;
+	}
+
+	if (strncmp(address, "tcp://", 6) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	p = address + 6;
+	if (*p == '[') {
+		const char *end = strchr(p, ']');
+
+		if (!end || end[1] != ':') {
+			errno = EINVAL;
+			return -1;
+		}
+		p++;
+		n = end - p;
+		port = end + 2;
+	} else {
+		const char *colon = strrchr(p, ':');
+
+		if (!colon) {
+			errno = EINVAL;
+			return -1;
+		}
+		n = colon - p;
+		port = colon + 1;
+	}
+	if (n == 0 || n >= sizeof(name) || !*port) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(name, p, n);
+	name[n] = '\0';
+	if (strcmp(name, "*") == 0 || strcmp(name, "0.0.0.0") == 0 ||
+	    strcmp(name, "::") == 0)
+		snprintf(name, sizeof(name), "%s", host);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(name, port, &hints, &res) != 0) {
+		errno = EHOSTUNREACH;
+		return -1;
+	}
+	err = ECONNREFUSED;
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		err = errno;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	if (fd < 0)
+		errno = err;
+	return fd;
+}
+
+static int send_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* Connect c and send our greeting, READY and subscriptions. Returns 0 or
+ * -1 with errno set. */
+static int conn_open(Zmtp *z, int ci)
+{
+	static const uint8_t ready[] = {
+		FLAG_COMMAND, 25,
+		5, 'R', 'E', 'A', 'D', 'Y',
+		11, 'S', 'o', 'c', 'k', 'e', 't', '-', 'T', 'y', 'p', 'e',
+		0, 0, 0, 3, 'S', 'U', 'B'
+	};
+	ZmtpConn *c = &z->conns[ci];
+	uint8_t out[64 + sizeof(ready) + ZMTP_MAX_TOPICS * 16];
+	size_t len = 64;
+	int i, err;
+
+	c->fd = endpoint_connect(c->address, z->host);
+	if (c->fd < 0)
+		return -1;
+	c->greeted = c->ready = 0;
+	c->len = 0;
+	c->opened_at = now_ms();
+
+	memset(out, 0, 64);
+	out[0] = 0xff;            /* Signature */
+	out[9] = 0x7f;
+	out[10] = 3;              /* Version 3.0 */
+	out[11] = 0;
+	memcpy(out + 12, "NULL", 4);
+	memcpy(out + len, ready, sizeof(ready));
+	len += sizeof(ready);
+	for (i = 0; i < z->ntopics; i++) {
+		size_t n = strlen(z->topics[i].name);
+
+		if (z->topics[i].conn != ci)
+			continue;
+		out[len++] = 0;
+		out[len++] = (uint8_t)(n + 1);
+		out[len++] = 1;
+		memcpy(out + len, z->topics[i].name, n);
+		len += n;
+	}
+	if (send_all(c->fd, out, len) < 0) {
+		err = errno;
+		close(c->fd);
+		c->fd = -1;
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+static void conn_close(ZmtpConn *c)
+{
+	if (c->fd >= 0)
+		close(c->fd);
+	c->fd = -1;
+	c->retry_at = now_ms() + ZMTP_RETRY_MS;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* A command from the peer. Returns 0, or -1 if it ends the session. */
+static int conn_command(ZmtpConn *c, const uint8_t *body, size_t len)
+{
+	size_t name_len = len > 0 ? body[0] : 0;
+	const uint8_t *p, *end = body + len;
+
+	if (len < 1 + name_len)
+		return -1;
+	if (name_len == 5 && memcmp(body + 1, "ERROR", 5) == 0) {
+		/* The reason: 1-byte length, text */
+		size_t n = len > 6 ? body[6] : 0;
+
+		if (n > 0 && n > len - 7)
+			n = len - 7;
+		fprintf(stderr, "error: %s refused the subscription: %.*s\n",
+		        c->address, (int)n, (const char *)body + 7);
+		return -1;
+	}
+	if (name_len != 5 || memcmp(body + 1, "READY", 5) != 0)
+		return 0;  /* Nothing else matters to a subscriber */
+
+	/* Properties: name (1-byte length), value (4-byte big-endian length) */
+	for (p = body + 6; p < end; ) {
+		size_t n = *p, v;
+
+		if ((size_t)(end - p) < 1 + n + 4)
+			return -1;
+		v = (size_t)p[1 + n] << 24 | (size_t)p[2 + n] << 16 |
+		    (size_t)p[3 + n] << 8 | p[4 + n];
+		if ((size_t)(end - p) - 5 - n < v)
+			return -1;
+		if (n == 11 && strncasecmp((const char *)p + 1, "Socket-Type", 11) == 0 &&
+		    !(v == 3 && memcmp(p + 5 + n, "PUB", 3) == 0) &&
+		    !(v == 4 && memcmp(p + 5 + n, "XPUB", 4) == 0)) {
+			fprintf(stderr, "error: %s is a %.*s socket, not a publisher\n",
+			        c->address, (int)v, (const char *)p + 5 + n);
+			return -1;
+		}
+		p += 5 + n + v;
+	}
+	c->ready = 1;
+	return 0;
+}
+
+/* Write a field of hex digits for data */
+static void print_hex(const char *key, const uint8_t *data, size_t len)
+{
+	char *hex = block_hex(data, len);
+
+	if (hex) {
+		printf(",\"%s\":\"%s\"", key, hex);
+		free(hex);
+	}
+}
+
+/* One notification: frames topic, body, sequence number. Returns 0, or
+ * -1 if stdout is gone. */
+static int zmtp_message(Zmtp *z, int ci, const uint8_t *buf,
+                        const size_t *off, const size_t *len, int nparts)
+{
+	const uint8_t *body;
+	size_t body_len;
+	ZmtpTopic *t = NULL;
+	uint32_t seq, missed = 0;
+	char hash[65];
+	int i;
+
+	if (nparts != 3 || len[2] != 4)
+		return 0;
+	body = buf + off[1];
+	body_len = len[1];
+	for (i = 0; i < z->ntopics; i++)
+		if (z->topics[i].conn == ci && strlen(z->topics[i].name) == len[0] &&
+		    memcmp(z->topics[i].name, buf + off[0], len[0]) == 0)
+			t = &z->topics[i];
+	if (!t)
+		return 0;
+
+	/* A number below the one expected means the node restarted and
+	 * counts from 0 again; what it sent meanwhile is unknown */
+	seq = le32(buf + off[2]);
+	if (t->seen && (int32_t)(seq - t->next) > 0)
+		missed = seq - t->next;
+	t->seen = 1;
+	t->next = seq + 1;
+
+	printf("{\"topic\":\"%s\",\"seq\":%u", t->name, seq);
+	if (missed)
+		printf(",\"missed\":%u", missed);
+	if (strcmp(t->name, "hashblock") == 0 || strcmp(t->name, "hashtx") == 0) {
+		/* Sent in the byte order hashes are shown in */
+		print_hex(strcmp(t->name, "hashtx") == 0 ? "txid" : "hash", body, body_len);
+	} else if (strcmp(t->name, "rawblock") == 0) {
+		if (block_hash(body, body_len, hash) == 0)
+			printf(",\"hash\":\"%s\"", hash);
+		print_hex("hex", body, body_len);
+	} else if (strcmp(t->name, "rawtx") == 0) {
+		if (block_txid(body, body_len, hash) == 0)
+			printf(",\"txid\":\"%s\"", hash);
+		print_hex("hex", body, body_len);
+	} else if (body_len >= 33) {
+		/* sequence: hash, label, and for mempool events the mempool
+		 * sequence number (8 bytes little-endian) */
+		const char *event;
+		int block = 0;
+
+		switch (body[32]) {
+		case 'C': event = "connected"; block = 1; break;
+		case 'D': event = "disconnected"; block = 1; break;
+		case 'A': event = "added"; break;
+		case 'R': event = "removed"; break;
+		default: event = NULL; break;
+		}
+		if (event)
+			printf(",\"event\":\"%s\"", event);
+		else
+			printf(",\"event\":\"%c\"", body[32] >= 0x20 && body[32] < 0x7f ? body[32] : '?');
+		print_hex(block ? "hash" : "txid", body, 32);
+		if (body_len == 41) {
+			uint64_t mseq = le32(body + 33) | (uint64_t)le32(body + 37) << 32;
+			printf(",\"mempool_sequence\":%llu", (unsigned long long)mseq);
+		}
+	}
+	fputs("}\n", stdout);
+	return fflush(stdout) == 0 ? 0 : -1;
+}
+
+/* Handle what has arrived on c: the greeting, then whole messages and
+ * commands. Returns 0, -1 if the peer broke the protocol or refused us,
+ * or -2 if stdout is gone. */
+static int conn_process(Zmtp *z, int ci)
+{
+	ZmtpConn *c = &z->conns[ci];
+	size_t done = 0;
+
+	if (!c->greeted) {
+		if (c->len < 64)
+			return 0;
+		if (c->buf[0] != 0xff || c->buf[9] != 0x7f || c->buf[10] < 3 ||
+		    memcmp(c->buf + 12, "NULL", 5) != 0) {
+			fprintf(stderr, "error: %s is not a ZMTP 3 endpoint with the NULL mechanism\n",
+			        c->address);
+			return -1;
+		}
+		c->greeted = 1;
+		done = 64;
+	}
+
+	for (;;) {
+		size_t pos = done, off[3], len[3];
+		int nparts = 0;
+
+		/* Frames up to the one without MORE */
+		for (;;) {
+			uint8_t flags;
+			size_t head, size;
+
+			if (c->len - pos < 2)
+				goto out;
+			flags = c->buf[pos];
+			head = (flags & FLAG_LONG) ? 9 : 2;
+			if (c->len - pos < head)
+				goto out;
+			if (flags & FLAG_LONG) {
+				int i;
+
+				for (size = 0, i = 1; i < 9; i++)
+					size = size << 8 | c->buf[pos + i];
+			} else {
+				size = c->buf[pos + 1];
+			}
+			if (size > ZMTP_MAX_BUF) {
+				fprintf(stderr, "error: %s sent an oversized frame\n", c->address);
+				return -1;
+			}
+			if (c->len - pos - head < size)
+				goto out;
+			if (flags & FLAG_COMMAND) {
+				if (nparts > 0 || conn_command(c, c->buf + pos + head, size) < 0)
+					return -1;
+				pos += head + size;
+				break;
+			}
+			if (!c->ready) {
+				fprintf(stderr, "error: %s sent a message before READY\n", c->address);
+				return -1;
+			}
+			if (nparts < 3) {
+				off[nparts] = pos + head;
+				len[nparts] = size;
+			}
+			nparts++;
+			pos += head + size;
+			if (!(flags & FLAG_MORE)) {
+				if (zmtp_message(z, ci, c->buf, off, len, nparts) < 0)
+					return -2;
+				break;
+			}
+		}
+		done = pos;
+	}
+out:
+	memmove(c->buf, c->buf + done, c->len - done);
+	c->len -= done;
+	return 0;
+}
+
+/* Read from c into its buffer. Returns bytes read, 0 at EOF, or -1. */
+static ssize_t conn_read(ZmtpConn *c)
+{
+	ssize_t n;
+
+	if (c->cap - c->len < ZMTP_READ) {
+		size_t cap = c->cap ? c->cap * 2 : 2 * ZMTP_READ;
+		uint8_t *buf;
+
+		while (cap - c->len < ZMTP_READ)
+			cap *= 2;
+		if (cap > ZMTP_MAX_BUF + 2 * ZMTP_READ || !(buf = realloc(c->buf, cap))) {
+			errno = ENOMEM;
+			return -1;
+		}
+		c->buf = buf;
+		c->cap = cap;
+	}
+	do
+		n = recv(c->fd, c->buf + c->len, c->cap - c->len, 0);
+	while (n < 0 && errno == EINTR && !zmtp_stop);
+	if (n > 0)
+		c->len += n;
+	return n;
+}
+
+/* The addresses the node publishes the topics on */
+static int zmtp_discover(Zmtp *z, RpcClient *rpc)
+{
+	char *response, *result, type[32], address[256];
+	JsonTape tape;
+	int code = 0, i, elem, ret = 0;
+
+	response = rpc_call(rpc, "getzmqnotifications", "[]");
+	result = response ? method_take_result(response, &code) : NULL;
+	if (!result || code != 0) {
+		fprintf(stderr, "error: Could not get the node's ZMQ endpoints%s%s\n",
+		        result ? ": " : "", result ? result : "");
+		free(result);
+		return -1;
+	}
+	memset(&tape, 0, sizeof(tape));
+	if (json_tape_parse(&tape, result, strlen(result)) < 0 ||
+	    tape.tok[0].type != JSON_ARRAY) {
+		fprintf(stderr, "error: Invalid getzmqnotifications response\n");
+		json_tape_free(&tape);
+		free(result);
+		return -1;
+	}
+	for (i = 0; i < z->ntopics; i++) {
+		ZmtpTopic *t = &z->topics[i];
+		int found = 0, j;
+
+		for (elem = json_tape_child(&tape, 0); elem > 0 && !found;
+		     elem = json_tape_next(&tape, elem)) {
+			int ti = json_tape_get(&tape, elem, "type");
+			int ai = json_tape_get(&tape, elem, "address");
+
+			found = ti > 0 && ai > 0 &&
+			        json_tape_string(&tape, ti, type, sizeof(type)) > 0 &&
+			        strncmp(type, "pub", 3) == 0 && strcmp(type + 3, t->name) == 0 &&
+			        json_tape_string(&tape, ai, address, sizeof(address)) > 0;
+		}
+		if (!found) {
+			fprintf(stderr, "error: The node does not publish %s (bitcoind -zmqpub%s=<address>)\n",
+			        t->name, t->name);
+			ret = -1;
+			break;
+		}
+		/* Topics published at one address share a connection */
+		for (j = 0; j < z->nconns; j++)
+			if (strcmp(z->conns[j].address, address) == 0)
+				break;
+		if (j == z->nconns)
+			snprintf(z->conns[z->nconns++].address, sizeof(z->conns[0].address),
+			         "%s", address);
+		t->conn = j;
+	}
+	json_tape_free(&tape);
+	free(result);
+	return ret;
+}
+
+int zmtp_run(RpcClient *rpc, const char *topics, const char *endpoint,
+             const char *host)
+{
+	static Zmtp z;
+	struct pollfd pfd[ZMTP_MAX_TOPICS];
+	struct sigaction sa;
+	const char *p = topics;
+	int i, ret = 0;
+
+	memset(&z, 0, sizeof(z));
+	z.host = host;
+
+	/* Topics, each once */
+	while (*p) {
+		size_t n = strcspn(p, ",");
+		int k, j;
+
+		if (n == 0) {
+			p++;
+			continue;
+		}
+		for (k = 0; k < ZMTP_MAX_TOPICS; k++)
+			if (strlen(topic_names[k]) == n && strncmp(topic_names[k], p, n) == 0)
+				break;
+		if (k == ZMTP_MAX_TOPICS) {
+			fprintf(stderr, "error: Unknown -subscribe topic: %.*s "
+			        "(hashblock, hashtx, rawblock, rawtx or sequence)\n", (int)n, p);
+			return 1;
+		}
+		for (j = 0; j < z.ntopics; j++)
+			if (z.topics[j].name == topic_names[k])
+				break;
+		if (j == z.ntopics)
+			z.topics[z.ntopics++].name = topic_names[k];
+		p += n;
+		if (*p == ',')
+			p++;
+	}
+	if (z.ntopics == 0) {
+		fprintf(stderr, "error: -subscribe needs a topic "
+		        "(hashblock, hashtx, rawblock, rawtx or sequence)\n");
+		return 1;
+	}
+
+	if (endpoint && endpoint[0]) {
+		snprintf(z.conns[0].address, sizeof(z.conns[0].address), "%s", endpoint);
+		z.nconns = 1;
+	} else if (zmtp_discover(&z, rpc) < 0) {
+		return 1;
+	}
+
+	for (i = 0; i < z.nconns; i++) {
+		if (conn_open(&z, i) < 0) {
+			if (errno == EINVAL)
+				fprintf(stderr, "error: Invalid ZMQ endpoint: %s "
+				        "(tcp://<host>:<port> or ipc://<path>)\n", z.conns[i].address);
+			else
+				fprintf(stderr, "error: Could not connect to %s: %s\n",
+				        z.conns[i].address, strerror(errno));
+			ret = 1;
+			goto done;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = zmtp_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	while (!zmtp_stop) {
+		long long now = now_ms(), wake = -1;
+		int n = 0;
+
+		/* Reconnect what was lost, quietly until it works */
+		for (i = 0; i < z.nconns; i++) {
+			ZmtpConn *c = &z.conns[i];
+
+			if (c->fd < 0 && now >= c->retry_at && conn_open(&z, i) < 0)
+				c->retry_at = now + ZMTP_RETRY_MS;
+			if (c->fd < 0 && (wake < 0 || c->retry_at - now < wake))
+				wake = c->retry_at - now;
+			/* Whatever listens there does not speak ZMTP */
+			if (c->fd >= 0 && !c->ready) {
+				long long left = c->opened_at + ZMTP_HANDSHAKE_MS - now;
+
+				if (left <= 0) {
+					fprintf(stderr, "error: No ZMTP handshake from %s\n", c->address);
+					ret = 1;
+					goto done;
+				}
+				if (wake < 0 || left < wake)
+					wake = left;
+			}
+		}
+		for (i = 0; i < z.nconns; i++) {
+			pfd[i].fd = z.conns[i].fd;   /* Negative ones are skipped */
+			pfd[i].events = POLLIN;
+			pfd[i].revents = 0;
+		}
+		if (poll(pfd, z.nconns, wake < 0 ? -1 : (int)wake) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "error: poll: %s\n", strerror(errno));
+			ret = 1;
+			break;
+		}
+		for (i = 0; i < z.nconns && !zmtp_stop; i++) {
+			ZmtpConn *c = &z.conns[i];
+			ssize_t got;
+
+			if (c->fd < 0 || !(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			got = conn_read(c);
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got <= 0) {
+				fprintf(stderr, "warning: Lost %s (%s), reconnecting\n", c->address,
+				        got == 0 ? "closed" : strerror(errno));
+				conn_close(c);
+				continue;
+			}
+			n = conn_process(&z, i);
+			if (n < 0) {
+				ret = 1;
+				goto done;
+			}
+		}
+	}
+
+done:
+	for (i = 0; i < z.nconns; i++) {
+		if (z.conns[i].fd >= 0)
+			close(z.conns[i].fd);
+		free(z.conns[i].buf);
+	}
+	return ret;
+}
@@ -0,0 +1,20 @@
+/* ZeroMQ notifications from bitcoind (-subscribe) */
+
+#ifndef ZMTP_H
+#define ZMTP_H
+
+#include "rpc.h"
+
+/* Subscribe to the comma-separated topics (hashblock, hashtx, rawblock,
+ * rawtx, sequence) at endpoint (tcp://host:port or ipc://path), or, if
+ * endpoint is NULL or empty, at the addresses the node gives for them in
+ * getzmqnotifications. A wildcard bind address (*, 0.0.0.0, ::) stands
+ * for host. Writes one JSON object per notification to stdout, with a
+ * "missed" count when the publisher's sequence numbers skip some; lost
+ * connections are reconnected. Runs until SIGINT or SIGTERM; returns
+ * the process exit code.
+ */
+int zmtp_run(RpcClient *rpc, const char *topics, const char *endpoint,
+             const char *host);
+
+#endif